@@ -39,7 +39,8 @@ static const char *    separator   = " ";              /* -s str        */
 
 static NTV2_BOOL       direction   = NTV2_CVT_FORWARD; /* -f | -i       */
 static NTV2_BOOL       reversed    = FALSE;            /* -r            */
-static NTV2_BOOL       read_on_fly = FALSE;            /* -d            */
+static int             data_mode   = NTV2_DATA_IN_MEMORY; /* -d|-m|-l|-z|-q */
+static int             alloc_mode  = NTV2_ALLOC_DEFAULT;  /* -H          */
 
 static NTV2_EXTENT     extent      = { 0 };            /* -e ...        */
 static NTV2_EXTENT   * extptr      = NTV2_NULL;        /* -e ...        */
@@ -58,6 +59,11 @@ static void display_usage(int level)
       printf("  -?, -help  Display help\n");
       printf("  -r         Reversed data (lon lat) instead of (lat lon)\n");
       printf("  -d         Read shift data on the fly (no load of data)\n");
+      printf("  -m         Map shift data into memory   (no load of data)\n");
+      printf("  -l         Load shift data for sub-files on first use\n");
+      printf("  -z         Keep shift data compressed in memory\n");
+      printf("  -q         Keep shift data quantized & compressed in memory\n");
+      printf("  -H         Put shift data in huge pages (if possible)\n");
       printf("  -i         Inverse transformation\n");
       printf("  -f         Forward transformation       "
                            "(default)\n");
@@ -77,10 +83,10 @@ static void display_usage(int level)
    else
    {
       fprintf(stderr,
-         "Usage: %s [-r] [-d] [-i|-f] [-c val] [-s str] [-p file]\n",
+         "Usage: %s [-r] [-d|-m|-l|-z|-q] [-H] [-i|-f] [-c val] [-s str]\n",
          pgm);
       fprintf(stderr,
-         "       %*s [-e wlon slat elon nlat]\n",
+         "       %*s [-p file] [-e wlon slat elon nlat]\n",
          (int)strlen(pgm), "");
       fprintf(stderr,
          "       %*s ntv2file [lat lon] ...\n",
@@ -125,7 +131,12 @@ static int process_options(int argc, const char **argv)
       else if ( strcmp(arg, "f") == 0 )  direction   = NTV2_CVT_FORWARD;
       else if ( strcmp(arg, "i") == 0 )  direction   = NTV2_CVT_INVERSE;
       else if ( strcmp(arg, "r") == 0 )  reversed    = TRUE;
-      else if ( strcmp(arg, "d") == 0 )  read_on_fly = TRUE;
+      else if ( strcmp(arg, "d") == 0 )  data_mode   = NTV2_DATA_HDRS_ONLY;
+      else if ( strcmp(arg, "m") == 0 )  data_mode   = NTV2_DATA_MAPPED;
+      else if ( strcmp(arg, "l") == 0 )  data_mode   = NTV2_DATA_ON_DEMAND;
+      else if ( strcmp(arg, "z") == 0 )  data_mode   = NTV2_DATA_COMPRESSED;
+      else if ( strcmp(arg, "q") == 0 )  data_mode   = NTV2_DATA_QUANTIZED;
+      else if ( strcmp(arg, "H") == 0 )  alloc_mode  = NTV2_ALLOC_HUGE;
 
       else if ( strcmp(arg, "s") == 0 )
       {
@@ -357,7 +368,8 @@ int main(int argc, const char **argv)
    hdr = ntv2_load_file(
       ntv2file,           /* in:  filename                 */
       FALSE,              /* in:  don't keep original hdrs */
-      !read_on_fly,       /* in:  read    shift data?      */
+      data_mode |         /* in:  how to read shift data   */
+      alloc_mode,         /* in:  how to allocate it       */
       extptr,             /* in:  extent pointer           */
       &rc);               /* out: result code              */
 
@@ -37,7 +37,7 @@ static const char *  outfile   = NTV2_NULL;            /* -o file      */
 static NTV2_BOOL     dump_hdr  = FALSE;                /* -h           */
 static NTV2_BOOL     list_hdr  = FALSE;                /* -l           */
 static NTV2_BOOL     dump_data = FALSE;                /* -d           */
-static NTV2_BOOL     read_data = FALSE;                /* -d | -o file */
+static NTV2_BOOL     read_data = FALSE;                /* -d           */
 static NTV2_BOOL     validate  = FALSE;                /* -v           */
 static NTV2_BOOL     ignore    = FALSE;                /* -i           */
 static NTV2_EXTENT   extent    = { 0 };                /* -e ...       */
@@ -169,7 +169,7 @@ static int process_options(int argc, const char **argv)
    }
 
    dump_data  = ( (dump_mode & NTV2_DUMP_DATA) != 0 );
-   read_data  = ( dump_data || (outfile != NTV2_NULL) );
+   read_data  = dump_data;
    dump_hdr  |= dump_data;
 
    if ( argc == optcnt )
@@ -217,6 +217,8 @@ static int process_file(const char *inpfile)
 
    /* -------- load the file */
 
+   /* When writing a new file, the data is read from the input file as
+      it is written (even if it is written over the input file). */
    hdr = ntv2_load_file(
       inpfile,            /* in:  input file          */
       TRUE,               /* in:  keep original data  */
@@ -49,6 +49,12 @@ extern "C" {
 #define NTV2_MAX_ERR_LEN   32            /*!< Max err msg  length  */
 
 typedef int            NTV2_BOOL;        /*!< Boolean variable     */
+
+#if defined(_MSC_VER)
+typedef __int64        NTV2_INT64;       /*!< 64-bit integer       */
+#else
+typedef long long      NTV2_INT64;       /*!< 64-bit integer       */
+#endif
 typedef double         NTV2_COORD [2];   /*!< Lon/lat coordinate   */
 
 #define NTV2_COORD_LON     0             /*!< NTV2_COORD longitude */
@@ -106,10 +112,12 @@ struct ntv2_extent
 
 #define NTV2_FILE_BIN_EXTENSION  "gsb"  /*!< "Grid Shift Binary"   */
 #define NTV2_FILE_ASC_EXTENSION  "gsa"  /*!< "Grid Shift Ascii"    */
+#define NTV2_FILE_TIL_EXTENSION  "gst"  /*!< "Grid Shift Tiled"    */
 
 #define NTV2_FILE_TYPE_UNK       0      /*!< File type is unknown  */
 #define NTV2_FILE_TYPE_BIN       1      /*!< File type is binary   */
 #define NTV2_FILE_TYPE_ASC       2      /*!< File type is ascii    */
+#define NTV2_FILE_TYPE_TIL       3      /*!< File type is tiled    */
 
 /*---------------------------------------------------------------------*/
 /**
@@ -260,6 +268,133 @@ struct ntv2_file_gs
    float  f_lon_accuracy;              /*!< Lon accuracy (in meters)  */
 };
 
+/*------------------------------------------------------------------------*/
+/* NTv2 tiled file layout                                                 */
+/*                                                                        */
+/* A tiled file is a companion to a binary file, laid out so that the     */
+/* shifts around any point can be read with one small aligned read.       */
+/* All values are in native byte order, and it is laid out as follows:    */
+/*                                                                        */
+/*    tiled file header                                                   */
+/*    overview record                                                     */
+/*    sub-file record 1, tile index 1                                     */
+/*    ...                                                                 */
+/*    sub-file record n, tile index n (if present)                        */
+/*    (padding to a page boundary)                                        */
+/*                                                                        */
+/*    shift tiles 1    (page-aligned)                                     */
+/*    accuracy tiles 1 (page-aligned)                                     */
+/*    ...                                                                 */
+/*    shift tiles n    (page-aligned)                                     */
+/*    accuracy tiles n (page-aligned)                                     */
+/*                                                                        */
+/* Each tile holds a square block of NTV2_TIL_DIM x NTV2_TIL_DIM          */
+/* NTV2_SHIFT pairs, row by row, in the same order as the grid-shift      */
+/* records in a binary file.  The tiles of a sub-file are stored row by   */
+/* row, and the tiles along the north and west edges are padded out to    */
+/* full size, so a tile can be found without any lookup and no tile       */
+/* spans two pages.                                                       */
+/*------------------------------------------------------------------------*/
+
+#define NTV2_TIL_MAGIC           "NTv2TILE" /*!< File identifier       */
+#define NTV2_TIL_BYTE_ORDER      0x01020304 /*!< Byte-order check      */
+#define NTV2_TIL_VERSION         1          /*!< Current version       */
+#define NTV2_TIL_PAGE_SIZE       4096       /*!< Page size             */
+#define NTV2_TIL_DIM             16         /*!< Tile width & height   */
+
+/*---------------------------------------------------------------------*/
+/**
+ * NTv2 tiled file header
+ *
+ * <p>A file is rejected if any of the magic, byte-order, version,
+ * page-size, or tile-dim fields are not what we expect.
+ */
+typedef struct ntv2_file_th NTV2_FILE_TH;
+struct ntv2_file_th
+{
+   char   magic      [NTV2_NAME_LEN];  /*!< NTV2_TIL_MAGIC            */
+   int    byte_order;                  /*!< NTV2_TIL_BYTE_ORDER       */
+   int    version;                     /*!< NTV2_TIL_VERSION          */
+   int    page_size;                   /*!< NTV2_TIL_PAGE_SIZE        */
+   int    tile_dim;                    /*!< NTV2_TIL_DIM              */
+   int    num_recs;                    /*!< Number of sub-files       */
+   int    hdr_pages;                   /*!< Pages used by the headers */
+};
+
+/*---------------------------------------------------------------------*/
+/**
+ * NTv2 tiled file tile index
+ *
+ * <p>One of these follows each sub-file record.
+ * The planes are located by page number.
+ */
+typedef struct ntv2_file_ti NTV2_FILE_TI;
+struct ntv2_file_ti
+{
+   int    nrows;                       /*!< Number of grid rows       */
+   int    ncols;                       /*!< Number of grid columns    */
+   int    ntrows;                      /*!< Number of tile rows       */
+   int    ntcols;                      /*!< Number of tile columns    */
+   int    shift_page;                  /*!< First page of shifts      */
+   int    accur_page;                  /*!< First page of accuracies  */
+   int    reserved   [2];              /*!< Zero                      */
+};
+
+/*------------------------------------------------------------------------*/
+/* NTv2 header index file layout                                          */
+/*                                                                        */
+/* A header index is a sidecar file that holds the parsed and validated   */
+/* headers of a NTv2 file of any type, so they can be loaded without      */
+/* reading through the file (see ntv2_load_indexed()).  It records the    */
+/* device, inode, size and modification time of the file it was made      */
+/* from, and is only used while they still match and the data offsets in  */
+/* it are all within the file.  All values are in native byte order, and  */
+/* it is laid out as follows:                                             */
+/*                                                                        */
+/*    index header                                                        */
+/*    overview record                                                     */
+/*    sub-file record 1, data offset 1                                    */
+/*    ...                                                                 */
+/*    sub-file record n, data offset n (if present)                       */
+/*                                                                        */
+/* Each data offset is a long giving the file offset of the shifts of     */
+/* the sub-file (or of the text of its first grid-shift record).          */
+/*------------------------------------------------------------------------*/
+
+#define NTV2_FILE_IDX_EXTENSION  "idx"      /*!< Appended to file name */
+
+#define NTV2_IDX_MAGIC           "NTv2INDX" /*!< File identifier       */
+#define NTV2_IDX_BYTE_ORDER      0x01020304 /*!< Byte-order check      */
+#define NTV2_IDX_VERSION         1          /*!< Current version       */
+
+/*---------------------------------------------------------------------*/
+/**
+ * NTv2 header index file header
+ *
+ * <p>An index is ignored (and rebuilt) if any of the magic, byte-order,
+ * version, header-size, or file-type fields are not what we expect,
+ * or if the file it was made from has changed.
+ */
+typedef struct ntv2_file_ix NTV2_FILE_IX;
+struct ntv2_file_ix
+{
+   char   magic      [NTV2_NAME_LEN];  /*!< NTV2_IDX_MAGIC            */
+   int    byte_order;                  /*!< NTV2_IDX_BYTE_ORDER       */
+   int    version;                     /*!< NTV2_IDX_VERSION          */
+   int    hdr_size;                    /*!< sizeof(NTV2_FILE_IX)      */
+   int    file_type;                   /*!< Type of the NTv2 file     */
+   int    num_recs;                    /*!< Number of sub-files       */
+   int    pads_present;                /*!< TRUE if pads are in file  */
+   int    swap_data;                   /*!< TRUE if must swap data    */
+   int    fixed;                       /*!< Mask of NTV2_FIX_* codes  */
+   int    pad;                         /*!< Zero                      */
+   NTV2_INT64 file_dev;                /*!< Device of the NTv2 file   */
+   NTV2_INT64 file_ino;                /*!< Inode of the NTv2 file    */
+   NTV2_INT64 file_size;               /*!< Size of the NTv2 file     */
+   NTV2_INT64 file_time;               /*!< Modification time of it   */
+   long   file_nsec;                   /*!< Nanoseconds past that     */
+};
+
 /*------------------------------------------------------------------------*/
 /* NTv2 internal structs                                                  */
 /*------------------------------------------------------------------------*/
@@ -315,13 +450,83 @@ struct ntv2_rec
    int            wskip;               /*!< Bytes to skip West        */
    int            eskip;               /*!< Bytes to skip East        */
 
-   /* This may be null if data is to be read on-the-fly. */
+   /* This may be null if data is to be read on-the-fly or on demand. */
 
    NTV2_SHIFT *   shifts;              /*!< Lat/lon grid-shift array  */
 
-   /* This may be null if not wanted. Always null if shifts is null. */
+   /* This may be null if not wanted, or if accuracies are read from   */
+   /* the file only when asked for (see ntv2_accuracy()).              */
 
    NTV2_SHIFT *   accurs;              /*!< Lat/lon accuracies array  */
+
+   /* This is only used if shifts are kept compressed in memory. */
+
+   void *         packed;              /*!< Ptr to compressed shifts  */
+
+   /* This is only used if data is read on demand. */
+
+   NTV2_BOOL      load_failed;         /*!< TRUE if read on demand
+                                            failed, so shifts are
+                                            read on-the-fly instead   */
+};
+
+/*---------------------------------------------------------------------*/
+/**
+ * NTv2 I/O routines
+ *
+ * <p>This struct defines a random-access source that a NTv2 file can be
+ * read from (see ntv2_load_io()).  Files opened by ntv2_load_file() are
+ * read through a built-in set of these routines.
+ *
+ * <p>The read_at routine has no notion of a current position, and
+ * it may be called by several threads at once when points are
+ * transformed with data read on-the-fly, so it must be thread-safe.
+ */
+typedef struct ntv2_io NTV2_IO;
+struct ntv2_io
+{
+   void *  ctx;                        /*!< Caller's context pointer  */
+
+   /*! Read len bytes at the given offset into buf.
+       Returns the number of bytes read (less than len at EOF or on
+       an error). */
+   size_t (*read_at)(void *ctx, void *buf, size_t len, long offset);
+
+   /*! Return the size of the source in bytes, or -1 if not known.
+       This routine may be NULL. */
+   long   (*size)   (void *ctx);
+
+   /*! Release the source.  This is called once when the source is
+       no longer needed, which may be before the object is deleted.
+       This routine may be NULL. */
+   void   (*close)  (void *ctx);
+};
+
+/*---------------------------------------------------------------------*/
+/**
+ * NTv2 grid array allocation statistics
+ *
+ * <p>This struct describes how the shift and accuracy arrays of an
+ * NTv2 object that are currently in memory were allocated
+ * (see ntv2_alloc_stats()).
+ */
+typedef struct ntv2_alloc_stats NTV2_ALLOC_STATS;
+struct ntv2_alloc_stats
+{
+   int     policy;                     /*!< Policy asked for
+                                            (NTV2_ALLOC_*)            */
+   int     num_arrays;                 /*!< Number of arrays          */
+   int     num_fallbacks;              /*!< Arrays that got less than
+                                            the policy asked for      */
+   size_t  heap_bytes;                 /*!< Bytes in plain heap blocks*/
+   size_t  aligned_bytes;              /*!< Bytes in cache-line
+                                            aligned heap blocks       */
+   size_t  thp_bytes;                  /*!< Bytes in blocks advised to
+                                            use transparent huge pages*/
+   size_t  hugetlb_bytes;              /*!< Bytes in explicit huge
+                                            pages                     */
+   size_t  arena_bytes;                /*!< Bytes in the arena (also
+                                            counted in its kind)      */
 };
 
 /*---------------------------------------------------------------------*/
@@ -361,9 +566,15 @@ struct ntv2_hdr
    NTV2_REC *     recs;                /*!< Array of ntv2 records     */
    NTV2_REC *     first_parent;        /*!< Pointer to first parent   */
 
-   /* This will be null if data is in memory. */
+   /* The read_at routine will be null if data is in memory.  */
+   /* The read-ahead buffer is only used while loading.       */
 
-   FILE *         fp;                  /*!< Data stream               */
+   NTV2_IO        io;                  /*!< I/O routines for file     */
+   size_t         io_pos;              /*!< Current read position     */
+   NTV2_BOOL      io_err;              /*!< TRUE if a read failed     */
+   unsigned char *io_buf;              /*!< Read-ahead buffer         */
+   size_t         io_buf_pos;          /*!< File position of buffer   */
+   size_t         io_buf_len;          /*!< Bytes in read-ahead buffer*/
 
    /* This should be used if mutex control is needed   */
    /* for multi-threaded access to the file when       */
@@ -372,6 +583,41 @@ struct ntv2_hdr
 
    void *         mutex;               /*!< Ptr to OS-specific mutex  */
 
+   /* This caches decoded shifts read from the file on-the-fly. */
+
+   void *         cache;               /*!< Ptr to tile cache or NULL */
+   int            fetch_mode;          /*!< How tiles are fetched for
+                                            batches (NTV2_FETCH_*)    */
+
+   /* This will be non-null if the file is memory-mapped      */
+   /* or is being read from a buffer given by the caller.     */
+
+   const unsigned char * map_data;     /*!< Mapped file contents      */
+   size_t                map_size;     /*!< Size of mapped file       */
+   NTV2_BOOL             map_owned;    /*!< TRUE if we mapped it      */
+
+   /* This will be non-null if the shifts are in a shared segment     */
+   /* (see ntv2_load_shared()) or a snapshot (see                     */
+   /* ntv2_open_snapshot()), and the grid arrays point into it.       */
+
+   const unsigned char * shm_data;     /*!< Mapped shared segment     */
+   size_t                shm_size;     /*!< Size of shared segment    */
+
+   int            data_mode;           /*!< How data is accessed
+                                            (NTV2_DATA_*)             */
+   NTV2_BOOL      quantized;           /*!< TRUE if compressed shifts
+                                            were quantized            */
+
+   /* This describes how the grid arrays were allocated. */
+
+   NTV2_ALLOC_STATS alloc;             /*!< Grid array allocation     */
+
+   /* This will be non-null if the object was loaded into an arena    */
+   /* (see NTV2_ALLOC_ARENA).  The arena holds this struct, the       */
+   /* records, and the grid arrays, and is freed all at once.         */
+
+   void *         arena;               /*!< Ptr to arena or NULL      */
+
    /* These may be null if not wanted. */
 
    NTV2_FILE_OV * overview;            /*!< Overview record           */
@@ -388,6 +634,8 @@ struct ntv2_hdr
 #define NTV2_ERR_NO_MEMORY                  1
 #define NTV2_ERR_IOERR                      2
 #define NTV2_ERR_NULL_HDR                   3
+#define NTV2_ERR_INVALID_ARG                4
+#define NTV2_ERR_NOT_SUPPORTED              5
 
 /* warnings */
 #define NTV2_ERR_FILE_NEEDS_FIXING        101
@@ -430,6 +678,10 @@ struct ntv2_hdr
 #define NTV2_ERR_CANNOT_OPEN_FILE         321
 #define NTV2_ERR_UNEXPECTED_EOF           322
 #define NTV2_ERR_INVALID_LINE             323
+#define NTV2_ERR_FILE_NOT_TILED           324
+#define NTV2_ERR_SAME_FILE                325
+#define NTV2_ERR_INVALID_ALLOCATOR        326
+#define NTV2_ERR_INVALID_SNAPSHOT         327
 
 /* fix header reasons (bit-mask) */
 
@@ -463,7 +715,7 @@ extern const char * ntv2_errmsg(
 
 /*---------------------------------------------------------------------*/
 /**
- * Determine whether a filename is for a binary or a text file.
+ * Determine whether a filename is for a binary, text, or tiled file.
  *
  * <p>This is done solely by checking the filename extension.
  * No examination of the file contents (if any) is done.
@@ -475,24 +727,118 @@ extern const char * ntv2_errmsg(
  *           <li>NTV2_FILE_TYPE_UNK  file type is unknown
  *           <li>NTV2_FILE_TYPE_BIN  file type is binary
  *           <li>NTV2_FILE_TYPE_ASC  file type is ascii
+ *           <li>NTV2_FILE_TYPE_TIL  file type is tiled
  *         </ul>
  */
 extern int ntv2_filetype(
    const char *ntv2file);
 
 /*---------------------------------------------------------------------*/
+
+#define NTV2_DATA_HDRS_ONLY  0    /*!< Read headers, shifts on-the-fly */
+#define NTV2_DATA_IN_MEMORY  1    /*!< Read shifts into memory         */
+#define NTV2_DATA_MAPPED     2    /*!< Map the file into memory        */
+#define NTV2_DATA_ON_DEMAND  3    /*!< Read shifts of a sub-file when
+                                       it is first used                */
+#define NTV2_DATA_COMPRESSED 4    /*!< Read shifts into memory, and
+                                       keep them compressed            */
+#define NTV2_DATA_QUANTIZED  5    /*!< Read shifts into memory, and
+                                       keep them rounded & compressed  */
+
+#ifndef   NTV2_QUANT_ERROR
+#  define NTV2_QUANT_ERROR   0.0001 /*!< Max error of a quantized shift
+                                         (seconds)                     */
+#endif
+
+/* These may be or-ed into read_data to say how grid arrays are allocated */
+
+#define NTV2_ALLOC_DEFAULT   0x000 /*!< Plain heap allocation           */
+#define NTV2_ALLOC_ALIGNED   0x100 /*!< Align arrays to cache lines     */
+#define NTV2_ALLOC_HUGE      0x200 /*!< Align, and use transparent
+                                        huge pages for large arrays     */
+#define NTV2_ALLOC_HUGETLB   0x300 /*!< Align, and use explicit huge
+                                        pages for large arrays          */
+#define NTV2_ALLOC_MASK      0x300 /*!< Mask of the allocation policy   */
+#define NTV2_ALLOC_ARENA     0x400 /*!< Put everything in one arena     */
+
 /**
  * Load an NTv2 file into memory.
  *
  * @param ntv2file     The name of the NTv2 file to load.
  *
  * @param keep_orig    TRUE to keep copies of all external records.
- *                     A TRUE value will also cause accuracy values to be
- *                     read in when reading shift values.
- *
- * @param read_data    TRUE to read in shift (and optionally accuracy) data.
- *                     A TRUE value will also result in closing the file
- *                     after reading, since there is no need to keep it open.
+ *                     A TRUE value will also make accuracy values
+ *                     available.  They are read from the file only
+ *                     when asked for, so the file is kept open even
+ *                     if all shifts are read in.  Accuracies are read
+ *                     in with the shifts only if the file is read from
+ *                     a caller-supplied buffer.
+ *
+ * @param read_data    How to access the shift (and optionally accuracy) data.
+ *                     <ul>
+ *                       <li>NTV2_DATA_HDRS_ONLY (FALSE) to read only the
+ *                           headers and read shifts from the file on-the-fly.
+ *                       <li>NTV2_DATA_IN_MEMORY (TRUE) to read in all data.
+ *                           This will also result in closing the file
+ *                           after reading, since there is no need to keep
+ *                           it open.
+ *                       <li>NTV2_DATA_MAPPED to map a binary file into
+ *                           memory and interpolate directly from the
+ *                           mapped grid records.  The mapped pages are
+ *                           shared by all processes mapping the same file.
+ *                           Text files (and platforms that cannot map files)
+ *                           are read into memory instead.
+ *                           A tiled file is mapped the same way.
+ *                       <li>NTV2_DATA_ON_DEMAND to read only the headers,
+ *                           and read in the data for each sub-file the
+ *                           first time a point falls in it.  Memory use
+ *                           thus follows the sub-files actually used.
+ *                           Text files are read into memory instead.
+ *                       <li>NTV2_DATA_COMPRESSED to read in all shifts and
+ *                           keep them compressed (losslessly) in tiles,
+ *                           which are decoded as needed into a few tiles
+ *                           kept by each thread (or, if the compiler has
+ *                           no thread-local storage, into the tile cache,
+ *                           see ntv2_set_cache_size()).  Smooth shift
+ *                           grids typically need about half the memory.
+ *                           Accuracies are not kept.
+ *                       <li>NTV2_DATA_QUANTIZED to do the same, but first
+ *                           round each shift to a multiple of
+ *                           NTV2_QUANT_ERROR seconds, so that no shift
+ *                           is off by more than NTV2_QUANT_ERROR seconds
+ *                           (0.0001 seconds is about 3 mm on the ground).
+ *                           Smooth shift grids then typically need a
+ *                           third to a fifth of the memory.  The object's
+ *                           data_mode is NTV2_DATA_COMPRESSED, and its
+ *                           quantized flag is set.  A file written from
+ *                           it has the rounded shifts.
+ *                     </ul>
+ *                     <p>One of the following may be or-ed in to say
+ *                     how the arrays of grid data read into memory are
+ *                     allocated (see ntv2_alloc_stats()):
+ *                     <ul>
+ *                       <li>NTV2_ALLOC_DEFAULT to allocate them from the
+ *                           heap as usual.
+ *                       <li>NTV2_ALLOC_ALIGNED to start each array on a
+ *                           (64-byte) cache line.
+ *                       <li>NTV2_ALLOC_HUGE to also ask the OS to back
+ *                           arrays of a huge page (2 MB) or more with
+ *                           transparent huge pages, so that lookups in
+ *                           random order take fewer TLB misses.
+ *                       <li>NTV2_ALLOC_HUGETLB to put such arrays in
+ *                           explicit huge pages, which must have been
+ *                           reserved on the system.
+ *                     </ul>
+ *                     Whatever can't be done falls back to the next
+ *                     policy down.
+ *                     <p>NTV2_ALLOC_ARENA may also be or-ed in to load
+ *                     the object into a single block (an arena) sized
+ *                     from the headers, which is allocated as above.
+ *                     The object, its records, and its grid arrays
+ *                     are laid out in it in the order they are looked
+ *                     at when transforming points, and ntv2_delete()
+ *                     frees it all at once.  This is only done if all
+ *                     data is read into memory (NTV2_DATA_IN_MEMORY).
  *
  * @param extent       A pointer to an NTV2_EXTENT struct.
  *                     This pointer may be NULL.
@@ -514,6 +860,214 @@ extern NTV2_HDR * ntv2_load_file(
    NTV2_EXTENT * extent,
    int *         prc);
 
+/*---------------------------------------------------------------------*/
+/**
+ * Load an NTv2 file into memory, using a header index.
+ *
+ * <p>This is the same as ntv2_load_file(), except that the headers are
+ * loaded from a header index file if it is up to date, so the file does
+ * not have to be read through to find them.  This mostly helps with
+ * text files, whose data has to be parsed to get from one sub-file
+ * to the next, and with files that have many sub-files.
+ *
+ * <p>If the index is missing or out of date (or is not valid), the
+ * headers are read from the file and the index is (re)written.
+ * Failing to write the index is not an error.
+ *
+ * @param ntv2file     The name of the NTv2 file to load.
+ *
+ * @param idxfile      The name of the header index file.
+ *                     If NULL, the name of the NTv2 file with
+ *                     "." NTV2_FILE_IDX_EXTENSION appended is used.
+ *
+ * @param keep_orig    TRUE to keep copies of all external records.
+ *
+ * @param read_data    How to access the shift data (NTV2_DATA_*).
+ *
+ * @param extent       A pointer to an NTV2_EXTENT struct.
+ *                     This pointer may be NULL.
+ *
+ * @param prc          A pointer to a result code.
+ *                     This pointer may be NULL.
+ *
+ * @return A pointer to an NTV2_HDR object or NULL if unsuccessful.
+ */
+extern NTV2_HDR * ntv2_load_indexed(
+   const char *  ntv2file,
+   const char *  idxfile,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Load an NTv2 file into memory shared by all processes on a host.
+ *
+ * <p>This is the same as ntv2_load_file() with NTV2_DATA_IN_MEMORY,
+ * except that the shifts are kept in a shared segment, which is a file
+ * in a memory file system.  The first process to load a file creates
+ * the segment, and later processes loading the same file (by any
+ * pathname, and with the same extent) just map it in read-only, so the
+ * shifts are read in only once and their memory is shared.
+ *
+ * <p>A segment records the full pathname, identity, size and
+ * modification time of the file, the extent, and the layout of the data
+ * in it.  A segment that doesn't match is replaced by a new one
+ * (processes already using the old one are not affected).
+ *
+ * <p>Segments are not removed when no longer used.  The segment for a
+ * file can be removed with ntv2_shared_unlink() (say, before the file is
+ * replaced).  Segments are named "ntv2-*.shm", so any left over from
+ * files since replaced can be removed from the directory when nothing is
+ * running (a tmpfs mount such as /dev/shm is also emptied at boot).
+ *
+ * <p>Since the segment directory is usually writable by anyone, a
+ * segment is only used if it is a regular file (not a symbolic link)
+ * owned by the effective user or by root, and not writable by anyone
+ * else.  Segments are thus only shared by processes of the same user.
+ *
+ * <p>The headers are still read from the file by each process.
+ * If a segment can't be created, the shifts are just read into
+ * private memory.
+ *
+ * @param ntv2file     The name of the NTv2 file to load.
+ *
+ * @param shm_dir      The directory to keep segments in.
+ *                     If NULL, NTV2_SHM_DIR is used.
+ *                     A hugetlbfs mount may be used to get huge pages.
+ *
+ * @param keep_orig    TRUE to keep copies of all external records.
+ *
+ * @param extent       A pointer to an NTV2_EXTENT struct.
+ *                     This pointer may be NULL.
+ *
+ * @param prc          A pointer to a result code.
+ *                     This pointer may be NULL.
+ *
+ * @return A pointer to an NTV2_HDR object or NULL if unsuccessful.
+ */
+#ifndef   NTV2_SHM_DIR
+#  define NTV2_SHM_DIR      "/dev/shm"   /*!< Default segment directory */
+#endif
+
+extern NTV2_HDR * ntv2_load_shared(
+   const char *  ntv2file,
+   const char *  shm_dir,
+   NTV2_BOOL     keep_orig,
+   NTV2_EXTENT * extent,
+   int *         prc);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Remove the shared segment for a file (see ntv2_load_shared()).
+ *
+ * <p>Processes already using the segment are not affected, but the
+ * next process to load the file makes a new one.
+ *
+ * @param ntv2file     The name of the NTv2 file.
+ *
+ * @param shm_dir      The directory segments are kept in.
+ *                     If NULL, NTV2_SHM_DIR is used.
+ *
+ * @param extent       The extent the file was loaded with.
+ *                     This pointer may be NULL.
+ *
+ * @return If successful,   NTV2_ERR_OK (0).
+ *         If unsuccessful, NTV2_ERR_*.
+ *         NTV2_ERR_CANNOT_OPEN_FILE is returned if the file or its
+ *         segment can't be found, or the segment can't be removed.
+ */
+extern int ntv2_shared_unlink(
+   const char *  ntv2file,
+   const char *  shm_dir,
+   NTV2_EXTENT * extent);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Load an NTv2 file from a memory buffer.
+ *
+ * <p>This is the same as ntv2_load_file(), except that the contents
+ * of the file are given in a buffer, so no file is needed.
+ *
+ * <p>For a binary or tiled file, unless read_data is NTV2_DATA_IN_MEMORY,
+ * the shifts are read directly from the buffer when transforming points
+ * (just as for NTV2_DATA_MAPPED), so no copy of the data is made.
+ * In this case the buffer must remain valid and unchanged until the
+ * object is deleted.  Data in non-native byte order is swapped as each
+ * value is read.  Otherwise, the buffer is no longer needed once this
+ * call returns.  The data of a text file is always read in.
+ *
+ * @param buf          A pointer to the file contents.
+ *
+ * @param len          The length of the file contents in bytes.
+ *
+ * @param type         The type of file contents
+ *                     (NTV2_FILE_TYPE_BIN, NTV2_FILE_TYPE_ASC,
+ *                     or NTV2_FILE_TYPE_TIL).
+ *
+ * @param keep_orig    TRUE to keep copies of all external records.
+ *
+ * @param read_data    How to access the shift data (NTV2_DATA_*).
+ *
+ * @param extent       A pointer to an NTV2_EXTENT struct.
+ *                     This pointer may be NULL.
+ *                     This is ignored for text files.
+ *
+ * @param prc          A pointer to a result code.
+ *                     This pointer may be NULL.
+ *
+ * @return A pointer to an NTV2_HDR object or NULL if unsuccessful.
+ */
+extern NTV2_HDR * ntv2_load_buffer(
+   const void *  buf,
+   size_t        len,
+   int           type,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Load an NTv2 file using caller-supplied I/O routines.
+ *
+ * <p>This is the same as ntv2_load_file(), except that the file is
+ * read using the given I/O routines, so it may come from any
+ * random-access source (e.g. a member of an archive).  All modes of
+ * data access are supported except NTV2_DATA_MAPPED, which is treated
+ * as NTV2_DATA_IN_MEMORY.
+ *
+ * <p>The struct is copied, but the context must remain valid until
+ * the close routine is called.  The close routine is always called
+ * (even if the load fails) unless the I/O struct is invalid.
+ *
+ * @param io           A pointer to the I/O routines to use.
+ *
+ * @param type         The type of file (NTV2_FILE_TYPE_BIN,
+ *                     NTV2_FILE_TYPE_ASC, or NTV2_FILE_TYPE_TIL).
+ *
+ * @param keep_orig    TRUE to keep copies of all external records.
+ *
+ * @param read_data    How to access the shift data (NTV2_DATA_*).
+ *
+ * @param extent       A pointer to an NTV2_EXTENT struct.
+ *                     This pointer may be NULL.
+ *                     This is ignored for text files.
+ *
+ * @param prc          A pointer to a result code.
+ *                     This pointer may be NULL.
+ *
+ * @return A pointer to an NTV2_HDR object or NULL if unsuccessful.
+ */
+extern NTV2_HDR * ntv2_load_io(
+   const NTV2_IO * io,
+   int             type,
+   NTV2_BOOL       keep_orig,
+   NTV2_BOOL       read_data,
+   NTV2_EXTENT *   extent,
+   int *           prc);
+
 /*---------------------------------------------------------------------*/
 /**
  * Delete an NTv2 object
@@ -525,6 +1079,312 @@ extern NTV2_HDR * ntv2_load_file(
 extern void ntv2_delete(
    NTV2_HDR *hdr);
 
+/*---------------------------------------------------------------------*/
+/**
+ * Create a replica of an NTv2 object.
+ *
+ * <p>On a NUMA machine, lookups against a single copy of a large grid
+ * from threads running on other nodes pay for remote-memory access.
+ * This call makes a complete copy of the object (headers and shift data)
+ * that can be given to threads running on one node.
+ *
+ * <p>The data is copied by the calling thread, so with the usual OS
+ * first-touch policy the pages are placed on the caller's node.
+ * If the library was built with NTV2_USE_NUMA, the pages are instead
+ * explicitly bound to the requested node while they are being filled,
+ * after which the calling thread's own memory policy is put back.
+ *
+ * <p>The replica is a stand-alone object, and must be deleted
+ * with ntv2_delete() independently of the original.  It holds all its
+ * data in memory, since it has no file to read it from:
+ * compressed shifts (NTV2_DATA_COMPRESSED) are copied as they are,
+ * and any shifts not in memory (NTV2_DATA_MAPPED, NTV2_DATA_ON_DEMAND
+ * or NTV2_DATA_HDRS_ONLY) are read from the original's file.  Likewise
+ * any accuracies of an object loaded with keep_orig set that were left
+ * in its file are read into the replica.
+ *
+ * <p>A usual way to use replicas is to make one per node, with
+ * each worker thread pinned to the CPUs of a node:
+ * <pre>
+ *    reps[node] = ntv2_replicate(hdr, node, &rc);     (at startup)
+ *    ...
+ *    rep = reps[ntv2_numa_node()];                    (in each thread)
+ * </pre>
+ * A thread that isn't pinned may be moved to another node at any time,
+ * so it will still get the right answers but may pay for remote access.
+ *
+ * @param hdr   A pointer to a NTV2_HDR object.
+ *              Its data must be in memory or in its file.
+ *
+ * @param node  The NUMA node to place the data on, or -1 to use
+ *              the node of the calling thread.
+ *              NTV2_ERR_INVALID_ARG is returned if the node is out
+ *              of range, or (with NTV2_USE_NUMA) doesn't exist.
+ *
+ * @param prc   A pointer to a result code.
+ *              This pointer may be NULL.
+ *
+ * @return A pointer to a new NTV2_HDR object or NULL if unsuccessful.
+ */
+extern NTV2_HDR * ntv2_replicate(
+   const NTV2_HDR *hdr,
+   int             node,
+   int *           prc);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Get the NUMA node the calling thread is running on.
+ *
+ * <p>This can be used to pick the replica made by ntv2_replicate()
+ * for the node a thread is on.  It is found from the CPU the thread is
+ * running on at the moment, so it is only stable for a pinned thread.
+ *
+ * @return The node number, or 0 if it can't be found (or the OS
+ *         has no NUMA support).
+ */
+extern int ntv2_numa_node(void);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Save a snapshot of an NTv2 object to a file.
+ *
+ * <p>A snapshot is an image of the object as it is in memory: its
+ * headers and records as processed (with any extent applied and any
+ * fixes made), and its shifts (and accuracies, if the original data is
+ * kept) already decoded, each array on a cache-line boundary.
+ * Opening it with ntv2_open_snapshot() takes no parsing or decoding,
+ * so a process can restart with a large grid almost at once.
+ *
+ * <p>The image is in native layout and byte-order, so it can only be
+ * opened by a library built the same way on the same kind of machine.
+ * It does not track the NTv2 file it was made from, and so must be
+ * saved again if that file changes.
+ *
+ * <p>The data need not be in memory.  Any data that is not is read
+ * from the input file (or decompressed) as it is written.  The file is
+ * written under a temporary name and then renamed, so a partly written
+ * snapshot is never seen under its real name.
+ *
+ * @param hdr   A pointer to a NTV2_HDR object.
+ *
+ * @param path  The pathname of the snapshot file to write.
+ *
+ * @return If successful,   NTV2_ERR_OK (0).
+ *         If unsuccessful, NTV2_ERR_*.
+ */
+extern int ntv2_save_snapshot(
+   NTV2_HDR   *hdr,
+   const char *path);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Open a snapshot saved by ntv2_save_snapshot().
+ *
+ * <p>The snapshot is mapped read-only into memory, and only the header
+ * and records are copied out of it, to fix up the links between them.
+ * The shifts and accuracies are used where they are in the mapping,
+ * so the pages are read in as they are first used and are shared by
+ * all processes opening the same snapshot.  If the file can't be
+ * mapped, it is read into memory instead.
+ *
+ * <p>The object has its data in memory (NTV2_DATA_IN_MEMORY) and may
+ * be used like any other, but has no input file.  Only plain data is
+ * taken from the file, so a damaged or hostile snapshot can't make the
+ * library follow a pointer from it.
+ *
+ * @param path  The pathname of the snapshot file.
+ *
+ * @param prc   A pointer to a result code.
+ *              This pointer may be NULL.
+ *              NTV2_ERR_INVALID_SNAPSHOT is returned if the file is not
+ *              a snapshot or was saved by a different build.
+ *
+ * @return A pointer to an NTV2_HDR object or NULL if unsuccessful.
+ */
+extern NTV2_HDR * ntv2_open_snapshot(
+   const char *path,
+   int *       prc);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Get the number of bytes of grid data held in memory by an NTv2 object.
+ *
+ * <p>This is the memory cost of each replica made by ntv2_replicate().
+ *
+ * @param hdr  A pointer to a NTV2_HDR object.
+ *
+ * @return The number of bytes of shift and accuracy data in memory.
+ */
+extern size_t ntv2_data_size(
+   const NTV2_HDR *hdr);
+
+/*---------------------------------------------------------------------*/
+/**
+ * Get how the grid arrays of an NTv2 object are allocated.
+ *
+ * <p>The policy is given when the object is loaded (see NTV2_ALLOC_*).
+ * Arrays smaller than a huge page, and arrays for which huge pages
+ * could not be had, are counted in the lesser kind they got, and
+ * the latter are also counted as fallbacks.  Transparent huge pages
+ * are only asked for, so the OS may still back some of them with
+ * normal pages.
+ *
+ * @param hdr    A pointer to a NTV2_HDR object.
+ *
+ * @param stats  A pointer to a struct to fill in.
+ *
+ * @return NTV2_ERR_OK if successful or an NTV2_ERR_* code.
+ */
+extern int ntv2_alloc_stats(
+   const NTV2_HDR *   hdr,
+   NTV2_ALLOC_STATS * stats);
+
+/*---------------------------------------------------------------------*/
+/**
+ * NTv2 memory allocator
+ *
+ * <p>This struct defines the routines the library gets all its memory
+ * from (see ntv2_set_allocator()).  By default, malloc() and free()
+ * are used.
+ */
+typedef struct ntv2_allocator NTV2_ALLOCATOR;
+struct ntv2_allocator
+{
+   void *  ctx;                        /*!< Caller's context pointer  */
+
+   /*! Allocate n bytes, or return NULL if there isn't enough memory. */
+   void * (*alloc)        (void *ctx, size_t n);
+
+   /*! Free a block from either allocation routine.
+       The pointer is never NULL. */
+   void   (*free)         (void *ctx, void *p);
+
+   /*! Allocate n bytes starting on a multiple of align (a power of
+       two), or return NULL.  This routine may be NULL, in which case
+       aligned blocks are carved out of bigger blocks from alloc. */
+   void * (*aligned_alloc)(void *ctx, size_t n, size_t align);
+};
+
+/**
+ * Set the memory allocator used by the library.
+ *
+ * <p>All memory the library allocates comes from this allocator,
+ * except for files mapped into memory and huge pages it maps itself.
+ * While an allocator is set, grid arrays that are to be in huge
+ * pages (see NTV2_ALLOC_HUGE) are instead asked for from it, aligned
+ * to a huge page (2 MB), so that it may provide huge pages from a
+ * pool of its own.  They are counted in ntv2_alloc_stats() as
+ * aligned blocks (and as fallbacks).
+ *
+ * <p>Since memory must be freed by the allocator that allocated it,
+ * this should be called before any objects are created, or at least
+ * while none exist.  It is not thread-safe.
+ *
+ * @param allocator  A pointer to the allocator routines, which are
+ *                   copied.  If NULL, malloc() and free() are used.
+ *
+ * @return NTV2_ERR_OK if successful or an NTV2_ERR_* code.
+ */
+extern int ntv2_set_allocator(
+   const NTV2_ALLOCATOR *allocator);
+
+/**
+ * Get the memory allocator used by the library.
+ *
+ * <p>If no allocator has been set, all routines are returned as NULL.
+ *
+ * @param allocator  A pointer to a struct to fill in.
+ */
+extern void ntv2_get_allocator(
+   NTV2_ALLOCATOR *allocator);
+
+/*---------------------------------------------------------------------*/
+
+#define NTV2_CACHE_SIZE_DEFAULT  (4 * 1024 * 1024) /*!< Default cache size */
+
+/**
+ * Set the size of the tile cache used when reading shifts on-the-fly.
+ *
+ * <p>When an object is loaded with NTV2_DATA_HDRS_ONLY, shift values are
+ * read from the file as they are needed.  To avoid re-reading the same
+ * values, they are read in square tiles of grid points which are kept,
+ * decoded and swapped, in a cache.  The cache is split into shards, each
+ * with its own lock, so that threads looking up points in different areas
+ * don't contend with each other.  Tiles are evicted using the CLOCK
+ * algorithm.
+ *
+ * <p>The same cache holds decoded tiles when an object is loaded with
+ * NTV2_DATA_COMPRESSED or NTV2_DATA_QUANTIZED, but only if the compiler
+ * has no thread-local storage.  Otherwise, each thread keeps the last
+ * few tiles it decoded itself, without taking any lock, and no cache
+ * is used.
+ *
+ * <p>A cache of NTV2_CACHE_SIZE_DEFAULT bytes is created when the file
+ * is loaded.  This call discards the current cache (if any) and creates
+ * a new one.  A size of zero turns off caching.  This call does nothing
+ * if the data is not being read on-the-fly or kept compressed in the
+ * cache.
+ *
+ * <p>This call is not thread-safe, so it should be made before the
+ * object is shared by multiple threads.
+ *
+ * @param hdr     A pointer to a NTV2_HDR object.
+ *
+ * @param nbytes  The maximum number of bytes to use for the cache.
+ *
+ * @return NTV2_ERR_OK if successful or an NTV2_ERR_* code.
+ */
+extern int ntv2_set_cache_size(
+   NTV2_HDR *hdr,
+   size_t    nbytes);
+
+/*---------------------------------------------------------------------*/
+
+#define NTV2_FETCH_NONE      0    /*!< Read tiles only as needed       */
+#define NTV2_FETCH_READ      1    /*!< Read a batch's tiles up front   */
+#define NTV2_FETCH_ASYNC     2    /*!< Read them asynchronously        */
+
+/**
+ * Set how shifts are fetched ahead of time for batches of points.
+ *
+ * <p>When an object is loaded from a binary file with
+ * NTV2_DATA_HDRS_ONLY, the transform routines process points in batches,
+ * and first find all the tiles a batch will touch that aren't in the
+ * cache.  The file ranges for them are sorted and merged, and then:
+ *    <ul>
+ *      <li>NTV2_FETCH_NONE does nothing, so each tile is read when
+ *          it is first needed.
+ *      <li>NTV2_FETCH_READ reads each merged range with one call of the
+ *          read_at routine (see NTV2_IO), so it works with any source.
+ *      <li>NTV2_FETCH_ASYNC reads all the ranges of a batch with one
+ *          submission, while the previous batch is being transformed.
+ *          This uses Linux io_uring, and is only built in if the library
+ *          is compiled with NTV2_USE_IO_URING.  It also needs the file to
+ *          have been opened by ntv2_load_file(), and a kernel that
+ *          supports io_uring.
+ *    </ul>
+ * The tiles read are put into the tile cache, so nothing is read ahead
+ * if there is no cache (see ntv2_set_cache_size()).  For a file opened
+ * by ntv2_load_file(), the OS is also asked to start reading any ranges
+ * that don't fit in the batch's buffer.
+ *
+ * <p>When a file is loaded, the mode is set to NTV2_FETCH_ASYNC
+ * if it is supported, or else to NTV2_FETCH_READ if that is.
+ *
+ * <p>This call is not thread-safe, so it should be made before the
+ * object is shared by multiple threads.
+ *
+ * @param hdr     A pointer to a NTV2_HDR object.
+ *
+ * @param mode    How to fetch shifts (NTV2_FETCH_*).
+ *
+ * @return NTV2_ERR_OK if successful, NTV2_ERR_NOT_SUPPORTED if the
+ *         object can't fetch shifts that way, or another NTV2_ERR_* code.
+ */
+extern int ntv2_set_fetch_mode(
+   NTV2_HDR *hdr,
+   int       mode);
+
 /*---------------------------------------------------------------------*/
 
 #define NTV2_ENDIAN_INP_FILE 0    /*!< Input-file    byte-order */
@@ -554,10 +1414,20 @@ extern void ntv2_delete(
  * <p>This call can also be used to write out a binary file for an object
  * that was read from a text file, and vice-versa.
  *
+ * <p>The object must have been loaded with keep_orig set, but its data
+ * need not have been read in.  Any data that is not in memory is read
+ * from the input file a block of rows at a time as it is written, so
+ * if the output file is the input file (however its name is spelled),
+ * a temporary file is written and then renamed over the input file.
+ * On Windows, which won't replace an open file, the input file is
+ * closed first, so the object can't read any data not in memory after
+ * that (it should be loaded again).
+ * Accuracies are written as zeros if they were not kept.
+ *
  * @param hdr         A pointer to a NTV2_HDR object.
  *
  * @param path        The pathname of the file to write.
- *                    This can name either a binary or a text NTv2 file.
+ *                    This can name a binary, text, or tiled NTv2 file.
  *
  * @param byte_order  Byte order of the output file (NTV2_ENDIAN_*) if
  *                    binary.  A value of NTV2_ENDIAN_INP_FILE means to
@@ -565,6 +1435,9 @@ extern void ntv2_delete(
  *                    input file if binary or native byte-order if the
  *                    input file was a text file.
  *                    This parameter is ignored when writing text files.
+ *                    Tiled files are always written in native byte-order,
+ *                    and NTV2_ERR_INVALID_ARG is returned if the other
+ *                    byte-order is asked for.
  *
  * @return If successful,   NTV2_ERR_OK (0).
  *         If unsuccessful, NTV2_ERR_*.
@@ -574,6 +1447,37 @@ extern int ntv2_write_file(
    const char *path,
    int         byte_order);
 
+/*---------------------------------------------------------------------*/
+/**
+ * Convert a NTv2 file to another file.
+ *
+ * <p>This is the same as loading the input file with keep_orig set and
+ * NTV2_DATA_HDRS_ONLY, and writing it out with ntv2_write_file().
+ * The data is streamed from one file to the other, so the memory used
+ * does not depend on the size of the grid.
+ *
+ * @param inpfile     The pathname of the file to read.
+ *
+ * @param outfile     The pathname of the file to write.
+ *                    This can name a binary, text, or tiled NTv2 file,
+ *                    but can't be the same as the input file.
+ *
+ * @param byte_order  Byte order of the output file (NTV2_ENDIAN_*) if
+ *                    binary (see ntv2_write_file()).
+ *
+ * @param extent      A pointer to an extent to cut the grid down to,
+ *                    or NULL to convert the whole grid.
+ *                    Extents are ignored for text files.
+ *
+ * @return If successful,   NTV2_ERR_OK (0).
+ *         If unsuccessful, NTV2_ERR_*.
+ */
+extern int ntv2_convert_file(
+   const char *  inpfile,
+   const char *  outfile,
+   int           byte_order,
+   NTV2_EXTENT * extent);
+
 /*---------------------------------------------------------------------*/
 /**
  * Validate all headers in an NTv2 file.
@@ -791,6 +1695,274 @@ extern int ntv2_transform(
    NTV2_COORD      coord[],
    int             direction);
 
+/**
+ * Perform a transformation on separate arrays of lons and lats.
+ *
+ * <p>This is the same as ntv2_transform(), except that the lons and
+ * lats are in separate arrays, each read (or written) every so many
+ * values.  So points may be transformed where they are, whether they
+ * are in separate lon and lat columns (a stride of 1), or interleaved
+ * with other values (e.g. a stride of 4 for x/y/z/m values), with no
+ * need to copy them to and from an array of NTV2_COORDs.
+ *
+ * @param hdr         A pointer to a NTV2_HDR object.
+ *
+ * @param deg_factor  The conversion factor to convert the given coordinates
+ *                    to decimal degrees.
+ *                    The value is degrees-per-unit.
+ *
+ * @param n           Number of points to be transformed.
+ *
+ * @param lon_in      A pointer to the first lon to be transformed.
+ *
+ * @param lat_in      A pointer to the first lat to be transformed.
+ *
+ * @param in_stride   The number of doubles from one input lon (or lat)
+ *                    to the next.  A value less than 1 is taken as 1.
+ *
+ * @param lon_out     A pointer to where the first lon is stored.
+ *
+ * @param lat_out     A pointer to where the first lat is stored.
+ *
+ * @param out_stride  The number of doubles from one output lon (or lat)
+ *                    to the next.  A value less than 1 is taken as 1.
+ *
+ * @param direction   The direction of the transformation
+ *                    (NTV2_CVT_FORWARD or NTV2_CVT_INVERSE).
+ *
+ * @return The number of points successfully transformed.
+ *
+ * <p>To transform in place, pass the same pointers and strides for the
+ * output as for the input.  Otherwise, the output must not overlap the
+ * input.  Points that can't be transformed are copied to the output
+ * unchanged.
+ */
+extern int ntv2_transform_strided(
+   const NTV2_HDR *hdr,
+   double          deg_factor,
+   int             n,
+   const double *  lon_in,
+   const double *  lat_in,
+   int             in_stride,
+   double *        lon_out,
+   double *        lat_out,
+   int             out_stride,
+   int             direction);
+
+/**
+ * Perform a transformation on separate arrays of float lons and lats.
+ *
+ * <p>This is the same as ntv2_transform_strided(), except that the
+ * coordinates are floats and the shifts are interpolated in single
+ * precision (the grid shifts are stored as floats).  The cell a point
+ * is in is still found in double precision, so the same cell is used
+ * as for double coordinates.
+ *
+ * <p>The interpolated shifts differ from those of the double path by
+ * at most 2^-18 of the largest shift at the corners of the cell.  For
+ * shifts of up to 10 seconds, this is less than 0.00004 seconds (about
+ * a millimeter), which is under a tenth of the float resolution of any
+ * coordinate of 1 degree or more.  Each result is rounded to a float
+ * only once, after its shift is added, so it is within 0.6 units in
+ * the last place of the double result rounded to a float.  An inverse
+ * is refined until it changes by less than 2^-28 degrees.
+ *
+ * @param hdr         A pointer to a NTV2_HDR object.
+ *
+ * @param deg_factor  The conversion factor to convert the given coordinates
+ *                    to decimal degrees.
+ *                    The value is degrees-per-unit.
+ *
+ * @param n           Number of points to be transformed.
+ *
+ * @param lon_in      A pointer to the first lon to be transformed.
+ *
+ * @param lat_in      A pointer to the first lat to be transformed.
+ *
+ * @param in_stride   The number of floats from one input lon (or lat)
+ *                    to the next.  A value less than 1 is taken as 1.
+ *
+ * @param lon_out     A pointer to where the first lon is stored.
+ *
+ * @param lat_out     A pointer to where the first lat is stored.
+ *
+ * @param out_stride  The number of floats from one output lon (or lat)
+ *                    to the next.  A value less than 1 is taken as 1.
+ *
+ * @param direction   The direction of the transformation
+ *                    (NTV2_CVT_FORWARD or NTV2_CVT_INVERSE).
+ *
+ * @return The number of points successfully transformed.
+ *
+ * <p>To transform in place, pass the same pointers and strides for the
+ * output as for the input.  Otherwise, the output must not overlap the
+ * input.  Points that can't be transformed are copied to the output
+ * unchanged.
+ */
+extern int ntv2_transform_float(
+   const NTV2_HDR *hdr,
+   double          deg_factor,
+   int             n,
+   const float *   lon_in,
+   const float *   lat_in,
+   int             in_stride,
+   float *         lon_out,
+   float *         lat_out,
+   int             out_stride,
+   int             direction);
+
+/**
+ * Get the accuracies for an array of points.
+ *
+ * @param hdr         A pointer to a NTV2_HDR object.
+ *
+ * @param deg_factor  The conversion factor to convert the given coordinates
+ *                    to decimal degrees.
+ *                    The value is degrees-per-unit.
+ *
+ * @param n           Number of points in the array.
+ *
+ * @param coord       An array of NTV2_COORD values to get accuracies for.
+ *
+ * @param accur       An array of NTV2_COORD values to hold the lon/lat
+ *                    accuracies (in meters) of each point.
+ *
+ * @return The number of points for which accuracies were found.
+ *
+ * <p>The object must have been loaded with keep_orig set.
+ * Accuracies are interpolated from the grid in the same way as shifts
+ * and are read from the file as needed, so a grid loaded in memory for
+ * transformations does not have to hold them.
+ * Entries for points outside of the grid are left unchanged.
+ */
+extern int ntv2_accuracy(
+   const NTV2_HDR  *hdr,
+   double           deg_factor,
+   int              n,
+   const NTV2_COORD coord[],
+   NTV2_COORD       accur[]);
+
+/*------------------------------------------------------------------------*/
+/* NTv2 catalog                                                           */
+/*------------------------------------------------------------------------*/
+
+/**
+ * NTv2 catalog
+ *
+ * <p>A catalog holds any number of NTv2 files that together cover an
+ * area, such as a national file and several provincial ones, and picks
+ * the file to use for each point.
+ *
+ * <p>Only the headers of a file are read when it is added, and the file
+ * is loaded when a point is first routed to it.  Loaded files are
+ * unloaded, least recently used first, to keep the data size of all of
+ * them (as given by ntv2_data_size()) within a memory budget.
+ *
+ * <p>The contents of this struct are private.
+ */
+typedef struct ntv2_catalog NTV2_CATALOG;
+
+/**
+ * Create an empty NTv2 catalog.
+ *
+ * @param mem_budget   The most data (in bytes) to keep loaded at once,
+ *                     or 0 for no limit.
+ *                     A file that is in use is never unloaded, so the
+ *                     budget can be exceeded for a while if needed.
+ *
+ * @param read_data    How to access the shift data of each file when
+ *                     it is loaded (NTV2_DATA_*).
+ *
+ * @param prc          A pointer to a result code.
+ *                     This pointer may be NULL.
+ *
+ * @return A pointer to an NTV2_CATALOG object or NULL if unsuccessful.
+ */
+extern NTV2_CATALOG * ntv2_catalog_create(
+   size_t        mem_budget,
+   int           read_data,
+   int *         prc);
+
+/**
+ * Delete an NTv2 catalog and all files loaded by it.
+ *
+ * @param cat   A pointer to an NTV2_CATALOG object.
+ */
+extern void ntv2_catalog_delete(
+   NTV2_CATALOG *cat);
+
+/**
+ * Add an NTv2 file to a catalog.
+ *
+ * <p>The headers of the file are read to get the extents of its
+ * top-level grids.  They are read using a header index (see
+ * ntv2_load_indexed()), which is created if needed.
+ *
+ * <p>Files should not be added while points are being transformed
+ * by other threads.
+ *
+ * @param cat       A pointer to an NTV2_CATALOG object.
+ *
+ * @param ntv2file  The name of the NTv2 file to add.
+ *
+ * @return A result code (NTV2_ERR_*).
+ */
+extern int ntv2_catalog_add(
+   NTV2_CATALOG *cat,
+   const char *  ntv2file);
+
+/**
+ * Get the size of the data of all files loaded by a catalog.
+ *
+ * @param cat   A pointer to an NTV2_CATALOG object.
+ *
+ * @return The number of bytes of shift and accuracy data in memory.
+ */
+extern size_t ntv2_catalog_data_size(
+   NTV2_CATALOG *cat);
+
+/**
+ * Perform a transformation on an array of points using a catalog.
+ *
+ * <p>Each point is routed to the top-level grid that contains it.
+ * If more than one does (from different files), the one with the
+ * smallest cells is used, and if they are the same, the one in the
+ * file added first.  A point not contained in any grid is routed to
+ * one it is just outside of (see ntv2_find_rec()), if any.
+ *
+ * <p>Consecutive points routed to the same file are transformed
+ * together, so points should be sorted by location if possible.
+ * This routine may be called by several threads at once.
+ *
+ * @param cat         A pointer to an NTV2_CATALOG object.
+ *
+ * @param deg_factor  The conversion factor to convert the given coordinates
+ *                    to decimal degrees.
+ *                    The value is degrees-per-unit.
+ *
+ * @param n           Number of points in the array to be transformed.
+ *
+ * @param coord       An array of NTV2_COORD values to be transformed.
+ *
+ * @param direction   The direction of the transformation
+ *                    (NTV2_CVT_FORWARD or NTV2_CVT_INVERSE).
+ *
+ * @return The number of points successfully transformed.
+ *
+ * <p>As with ntv2_transform(), points that can't be transformed are
+ * left unchanged.  This includes points routed to a file that can't
+ * be loaded.  Such a file is skipped (so its points go to the next
+ * grid that would do, if any) until it is tried again, after a delay
+ * that starts at a second and doubles with each failure up to five
+ * minutes, or as soon as the file is seen to have changed.
+ */
+extern int ntv2_catalog_transform(
+   NTV2_CATALOG *cat,
+   double        deg_factor,
+   int           n,
+   NTV2_COORD    coord[],
+   int           direction);
+
 /*---------------------------------------------------------------------*/
 
 #ifdef __cplusplus
@@ -26,8 +26,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <float.h>
+#include <limits.h>
 #include <ctype.h>
 #include <locale.h>
+#include <time.h>
 
 #include "libntv2.h"
 #include "libntv2_utils.i"
@@ -113,6 +116,8 @@ static const NTV2_ERRS ntv2_errlist[] =
    { NTV2_ERR_NO_MEMORY,               "No memory"              },
    { NTV2_ERR_IOERR,                   "I/O error"              },
    { NTV2_ERR_NULL_HDR,                "NULL header"            },
+   { NTV2_ERR_INVALID_ARG,             "Invalid argument"       },
+   { NTV2_ERR_NOT_SUPPORTED,           "Not supported"          },
 
    /* warnings */
 
@@ -154,6 +159,10 @@ static const NTV2_ERRS ntv2_errlist[] =
    { NTV2_ERR_CANNOT_OPEN_FILE,        "Cannot open file"       },
    { NTV2_ERR_UNEXPECTED_EOF,          "Unexpected EOF"         },
    { NTV2_ERR_INVALID_LINE,            "Invalid line"           },
+   { NTV2_ERR_FILE_NOT_TILED,          "File not tiled"         },
+   { NTV2_ERR_SAME_FILE,               "Output is input file"   },
+   { NTV2_ERR_INVALID_ALLOCATOR,       "Invalid allocator"      },
+   { NTV2_ERR_INVALID_SNAPSHOT,        "Invalid snapshot"       },
 
    { -1, NULL }
 };
@@ -466,161 +475,425 @@ static void ntv2_strcpy_pad(char *tgt, const char *src)
 }
 
 /*------------------------------------------------------------------------
- * convert a string to a double
+ * scan a number in a string
+ *
+ * This is a locale-independent (and much faster) replacement for strtod()
+ * for the numbers found in NTv2 files: an optional sign, digits with
+ * an optional '.', and an optional exponent, which must be followed by
+ * whitespace or the end of the string.
+ *
+ * If the digits (as an integer) are less than 2^53 and the power of ten
+ * is no more than 22, both the digits and the power of ten are exact
+ * doubles, so one multiply or divide gives the correctly-rounded result
+ * (i.e. the same value strtod() would give).  This covers all numbers
+ * with up to 15 significant digits, and most with 16.  Anything else
+ * returns NULL, and the caller should use ntv2_atod_locale() instead.
+ *
+ * That only holds if the multiply or divide is done in double precision.
+ * If it is done in extended precision (FLT_EVAL_METHOD 2, as with x87),
+ * the result is rounded twice and may be off by one bit, so then only
+ * numbers with no power of ten to apply are scanned here.
+ *
+ * Returns a pointer past the number, or NULL.
+ */
+static const double ntv2_pow10[] =
+{
+   1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#if defined(FLT_EVAL_METHOD) && (FLT_EVAL_METHOD == 0 || FLT_EVAL_METHOD == 1)
+#  define NTV2_SCAN_ROUNDED   TRUE     /* doubles rounded only once */
+#else
+#  define NTV2_SCAN_ROUNDED   FALSE
+#endif
+
+static const char * ntv2_scan_dbl(
+   const char * s,
+   const char * end,
+   double *     pd)
+{
+   double mant    = 0.0;
+   int    ndigits = 0;
+   int    exp10   = 0;
+   NTV2_BOOL neg  = FALSE;
+
+   if ( s < end && (*s == '-' || *s == '+') )
+      neg = (*s++ == '-');
+
+   for (; s < end && *s >= '0' && *s <= '9'; s++, ndigits++)
+   {
+      mant = (mant * 10.0) + (*s - '0');
+   }
+
+   if ( s < end && *s == '.' )
+   {
+      for (s++; s < end && *s >= '0' && *s <= '9'; s++, ndigits++)
+      {
+         mant = (mant * 10.0) + (*s - '0');
+         exp10--;
+      }
+   }
+
+   /* (once the digits reach 2^53, they may no longer be exact) */
+   if ( ndigits == 0 || mant >= 9007199254740992.0 )
+      return NTV2_NULL;
+
+   if ( s < end && (*s == 'e' || *s == 'E') )
+   {
+      NTV2_BOOL eneg = FALSE;
+      int       e    = 0;
+
+      s++;
+      if ( s < end && (*s == '-' || *s == '+') )
+         eneg = (*s++ == '-');
+
+      if ( s == end || *s < '0' || *s > '9' )
+         return NTV2_NULL;
+
+      for (; s < end && *s >= '0' && *s <= '9'; s++)
+      {
+         if ( e < 1000 )
+            e = (e * 10) + (*s - '0');
+      }
+
+      exp10 += eneg ? -e : e;
+   }
+
+   if ( s < end && !isspace((unsigned char)*s) )
+      return NTV2_NULL;
+
+   if ( mant != 0.0 && exp10 != 0 )
+   {
+      if ( exp10 < -22 || exp10 > 22 || !NTV2_SCAN_ROUNDED )
+         return NTV2_NULL;
+
+      if ( exp10 < 0 )
+         mant /= ntv2_pow10[-exp10];
+      else
+         mant *= ntv2_pow10[ exp10];
+   }
+
+   *pd = neg ? -mant : mant;
+   return s;
+}
+
+/*------------------------------------------------------------------------
+ * convert a string to a double using the C library
  *
  * Note: Any '.' in the string is first converted to the localized value.
- *       This means the string cannot be const, as it may be modified.
+ *       This is done on a copy, so the string is not modified.
  */
-static double ntv2_atod(char *s)
+static double ntv2_atod_locale(const char *s)
 {
    char   dec_pnt = localeconv()->decimal_point[0];
+   char   buf[NTV2_TOKENS_BUFLEN];
+   char * p;
+
+   ntv2_strncpy(buf, s, sizeof(buf));
+
+   p = strchr(buf, '.');
+   if ( p != NULL )
+      *p = dec_pnt;
+
+   return atof(buf);
+}
+
+/*------------------------------------------------------------------------
+ * convert a string to a double
+ *
+ * The string must use '.' as the decimal point, whatever the locale.
+ */
+static double ntv2_atod(const char *s)
+{
    double d = 0.0;
 
    if ( s != NULL && *s != 0 )
    {
-      char *p = strchr(s, '.');
-      if ( p != NULL )
-         *p = dec_pnt;
-      d = atof(s);
+      if ( ntv2_scan_dbl(s, s + strlen(s), &d) == NTV2_NULL )
+         d = ntv2_atod_locale(s);
    }
 
    return d;
 }
 
 /*------------------------------------------------------------------------
- * convert a double to a string
+ * Number formatting.
  *
- * The string will always have a '.' as the decimal point character.
+ * Numbers are written with the fewest significant digits that read back
+ * (with ntv2_atod()) as the same value, as a float for shifts and
+ * accuracies or as a double for everything else.  The decimal point is
+ * always a '.', whatever the locale.  Numbers from 1e-9 up to 1e16 are
+ * written in fixed notation with at least one digit after the '.', and
+ * all others as "d.ddde+XX" with at least two exponent digits.
  */
-static char * ntv2_dtoa(char *buf, double dnum)
-{
-   char decimal_point_char = localeconv()->decimal_point[0];
-   char tmp[64];
-   char *pc;
-   int  i, is16, iexp, ilen, idec;
-   int  nsigdigits = 16;
-
-   if ( buf == NULL )
-      return NULL;
 
-   if ( nsigdigits <= 0 )
-      nsigdigits = 1;
-   else if ( nsigdigits > 16 )
-      nsigdigits = 16;
+/* Lay out the significant digits of a value of d.ddd x 10^k. */
+static char * ntv2_fmt_digits(
+   char *       buf,
+   NTV2_BOOL    neg,
+   const char * digits,
+   int          ndigits,
+   int          k)
+{
+   char * p = buf;
+   int    i;
 
-   is16 = nsigdigits == 16 ? 1 : 0;
-   ilen = nsigdigits + 8 - is16;
-   idec = nsigdigits - is16;
-   sprintf(tmp, "%*.*e", ilen, idec, dnum);
+   if ( neg )
+      *p++ = '-';
 
-   pc = &tmp[ilen - 3];
-   while ( *pc != '+' && *pc != '-' )
+   if ( k >= -9 && k < 16 )
+   {
+      if ( k < 0 )
+      {
+         *p++ = '0';
+         *p++ = '.';
+         for (i = -1; i > k; i--)
+            *p++ = '0';
+         for (i = 0; i < ndigits; i++)
+            *p++ = digits[i];
+      }
+      else
+      {
+         for (i = 0; i <= k; i++)
+            *p++ = (i < ndigits) ? digits[i] : '0';
+         *p++ = '.';
+         if ( ndigits <= k + 1 )
+            *p++ = '0';
+         for (; i < ndigits; i++)
+            *p++ = digits[i];
+      }
+      *p = 0;
+   }
+   else
    {
-     pc--;
+      *p++ = digits[0];
+      *p++ = '.';
+      if ( ndigits == 1 )
+         *p++ = '0';
+      for (i = 1; i < ndigits; i++)
+         *p++ = digits[i];
+      sprintf(p, "e%c%02d", (k < 0) ? '-' : '+', (k < 0) ? -k : k);
    }
-   iexp = atoi(pc);
 
-   if ( is16 )
+   return buf;
+}
+
+/* Get the shortest digits of a (positive) value using the C library.
+   This tries each precision in turn, so it is only used for values
+   the fast routine below can't do. */
+static int ntv2_digits_lib(
+   double    dnum,
+   NTV2_BOOL is_flt,
+   char      digits[],
+   int *     pk)
+{
+   char tmp[64];
+   char chk[64];
+   int  ndigits = 0;
+   int  p;
+
+   for (p = 1; p <= 17; p++)
    {
-      pc = pc - 4;
+      double d;
+      char * s;
 
-      if ( iexp < 12 )
-      {
-         /* Check the last couple of sig digits */
+      sprintf(tmp, "%.*e", p - 1, dnum);
 
-         if ( !strncmp(pc, "00", 2) )
-         {
-            /* Truncate */
-            /* Drop the number of significant digits */
-            nsigdigits--;
-         }
-         else if ( !strncmp(pc, "99", 2) )
-         {
-            /* Round up */
-            /* Drop the number of significant digits */
-            nsigdigits--;
-         }
+      /* collect the digits, skipping the (localized) decimal point */
+      ndigits = 0;
+      for (s = tmp; *s != 'e' && *s != 0; s++)
+      {
+         if ( isdigit((unsigned char)*s) )
+            digits[ndigits++] = *s;
       }
+      *pk = atoi(s + 1);
+
+      d = ntv2_atod(ntv2_fmt_digits(chk, FALSE, digits, ndigits, *pk));
+      if ( is_flt ? ((float)d == (float)dnum) : (d == dnum) )
+         break;
    }
 
-   if ( iexp < 0 )
+   while ( ndigits > 1 && digits[ndigits-1] == '0' )
+      ndigits--;
+
+   return ndigits;
+}
+
+/* Round a (positive) float to p significant digits.
+
+   Rounding a float to p digits means scaling it by 10^j (j = p-1-k for
+   a value of d.ddd x 10^k).  With no more than 24 bits in the float and
+   53 bits in a double, the scaling is exact for 0 <= j <= 12, and for
+   j < 0 the remainder (from fmod()) is exact, so the rounding is done
+   exactly without any big-number arithmetic.  Reading back the digits
+   is the same divide or multiply ntv2_scan_dbl() does.
+
+   The exponent k is passed in as a guess and is corrected if needed.
+   Returns the number of digits (less any trailing zeros), -1 if the
+   digits don't read back as the same float, or 0 if the value is out
+   of range. */
+static int ntv2_round_flt(
+   float     fnum,
+   int       p,
+   char      digits[],
+   int *     pk)
+{
+   double d = fnum;
+   double n;
+   double v;
+   int    j;
+   int    i;
+
+   for (;;)
    {
-      idec = nsigdigits - 1 + (iexp * -1);
-      ilen = idec + 3;
+      j = p - 1 - *pk;
+      if ( j > 12 || j < -22 || d >= 9007199254740992.0 )
+         return 0;
 
-      if ( ilen > 63 )
+      if ( j >= 0 )
       {
-         idec = nsigdigits;
-         ilen = idec + 8;
-         sprintf(tmp, "%*.*g", ilen, idec, dnum);
+         double f;
+
+         n = d * ntv2_pow10[j];
+         f = n - floor(n);
+         n = floor(n);
+         if ( f > 0.5 || (f == 0.5 && fmod(n, 2.0) != 0.0) )
+            n += 1.0;
       }
       else
       {
-         sprintf(tmp, "%*.*f", ilen, idec, dnum);
-         for (i = (int)strlen(tmp) - 1; i >= 0; i--)
-         {
-            if ( tmp[i] != '0' )
-            {
-               break;
-            }
-            tmp[i] = 0;
-         }
-         if ( tmp[i] == decimal_point_char )
-         {
-            tmp[i+1] = '0';
-            tmp[i+2] = 0;
-         }
+         double s = ntv2_pow10[-j];
+         double r = fmod(d, s);
 
-         if ( strlen(tmp) > 24 || iexp < -9 )
-         {
-            idec = nsigdigits;
-            ilen = idec + 8;
-            sprintf(tmp, "%*.*g", ilen, idec, dnum);
-         }
+         n = (d - r) / s;
+         if ( r > s / 2 || (r == s / 2 && fmod(n, 2.0) != 0.0) )
+            n += 1.0;
       }
-      for (pc = tmp; isspace(*pc); pc++) ;
-      strcpy(buf, pc);
+
+      if ( n >= ntv2_pow10[p] )
+         (*pk)++;
+      else if ( n < ntv2_pow10[p-1] )
+         (*pk)--;
+      else
+         break;
    }
-   else
-   {
-      idec = nsigdigits - 1 - iexp;
-      if ( idec > -1 )
-      {
-         ilen = nsigdigits + 2;
-         sprintf(buf, "%*.*f", ilen, idec, dnum);
 
-         if ( !strchr(buf, decimal_point_char) )
-         {
-            char buf2[8];
-            sprintf(buf2, "%c0", decimal_point_char);
-            strcat(buf, buf2);
-         }
+   v = (j >= 0) ? (n / ntv2_pow10[j]) : (n * ntv2_pow10[-j]);
+   if ( (float)v != fnum )
+      return -1;
 
-         for (i = (int)strlen(buf) - 1; i >= 0; i--)
-         {
-            if ( buf[i] != '0' )
-            {
-               break;
-            }
-            buf[i] = 0;
-         }
-         if ( buf[i] == decimal_point_char )
-         {
-            buf[i+1] = '0';
-            buf[i+2] = 0;
-         }
-      }
-      else
+   {
+      unsigned long u = (unsigned long)n;
+
+      for (i = p - 1; i >= 0; i--)
       {
-         idec = nsigdigits;
-         ilen = idec + 8;
-         sprintf(buf, "%*.*g", ilen, idec, dnum);
+         digits[i] = (char)('0' + (u % 10));
+         u /= 10;
       }
    }
 
-   ntv2_strip_buf(buf);
+   while ( p > 1 && digits[p-1] == '0' )
+      p--;
 
-   return buf;
+   return p;
+}
+
+/* Get the shortest digits of a (positive) float.
+   Returns 0 if the value is out of range. */
+static int ntv2_digits_flt(
+   float     fnum,
+   char      digits[],
+   int *     pk)
+{
+   int k = (int)floor(log10((double)fnum));
+   int n;
+   int p;
+
+   /* Most floats need 7 to 9 digits, so start in the middle ... */
+
+   n = ntv2_round_flt(fnum, 6, digits, &k);
+
+   for (p = 7; n < 0 && p <= 9; p++)
+      n = ntv2_round_flt(fnum, p, digits, &k);
+
+   /* ... and if that will do, see if fewer will too. */
+
+   for (p = n - 1; n > 0 && p >= 1; p = n - 1)
+   {
+      char tmp[16];
+      int  kk = k;
+      int  nn = ntv2_round_flt(fnum, p, tmp, &kk);
+
+      if ( nn <= 0 )
+         break;
+
+      memcpy(digits, tmp, (size_t)nn);
+      n = nn;
+      k = kk;
+   }
+
+   *pk = k;
+   return (n > 0) ? n : 0;
+}
+
+/* Format a value, either as a float or as a double. */
+static char * ntv2_fmt_num(
+   char *    buf,
+   double    dnum,
+   NTV2_BOOL is_flt)
+{
+   char digits[32];
+   int  ndigits = 0;
+   int  k       = 0;
+   NTV2_BOOL neg = (dnum < 0.0 || (dnum == 0.0 && 1.0 / dnum < 0.0));
+
+   if ( buf == NULL )
+      return NULL;
+
+   if ( dnum != dnum || dnum - dnum != 0.0 )
+   {
+      /* NaN or infinity */
+      sprintf(buf, "%g", dnum);
+      return buf;
+   }
+
+   if ( dnum == 0.0 )
+   {
+      strcpy(buf, neg ? "-0.0" : "0.0");
+      return buf;
+   }
+
+   if ( neg )
+      dnum = -dnum;
+
+   if ( is_flt )
+      ndigits = ntv2_digits_flt((float)dnum, digits, &k);
+
+   if ( ndigits == 0 )
+      ndigits = ntv2_digits_lib(dnum, is_flt, digits, &k);
+
+   return ntv2_fmt_digits(buf, neg, digits, ndigits, k);
+}
+
+/*------------------------------------------------------------------------
+ * convert a double to a string
+ *
+ * The string will always have a '.' as the decimal point character.
+ */
+static char * ntv2_dtoa(char *buf, double dnum)
+{
+   return ntv2_fmt_num(buf, dnum, FALSE);
+}
+
+/*------------------------------------------------------------------------
+ * convert a float to a string
+ *
+ * The string will always have a '.' as the decimal point character.
+ */
+static char * ntv2_ftoa(char *buf, float fnum)
+{
+   return ntv2_fmt_num(buf, fnum, TRUE);
 }
 
 /*------------------------------------------------------------------------
@@ -638,97 +911,388 @@ static int ntv2_dtoi(double dbl)
 }
 
 /*------------------------------------------------------------------------
- * Read in a line from an ascii stream.
- *
- * This will read in a line, strip all leading and trailing whitespace,
- * and discard any blank lines and comments (anything following a #).
- *
- * Returns NULL at EOF.
+ * Built-in I/O routines for a file.
  */
-static char * ntv2_read_line(FILE *fp, char *buf, size_t buflen)
+static size_t ntv2_io_file_read_at(
+   void * ctx,
+   void * buf,
+   size_t len,
+   long   offset)
 {
-   char * bufp;
-
-   for (;;)
-   {
-      char *p;
-
-      bufp = fgets(buf, (int)buflen, fp);
-      if ( bufp == NULL )
-         break;
+   return ntv2_file_read_at((FILE *)ctx, buf, len, offset);
+}
 
-      p = strchr(bufp, '#');
-      if ( p != NULL )
-         *p = 0;
+static long ntv2_io_file_size(
+   void * ctx)
+{
+   FILE * fp = (FILE *)ctx;
 
-      bufp = ntv2_strip(bufp);
-      if ( *bufp != 0 )
-         break;
-   }
+   if ( fseek(fp, 0, SEEK_END) != 0 )
+      return -1;
+   return ftell(fp);
+}
 
-   return bufp;
+static void ntv2_io_file_close(
+   void * ctx)
+{
+   fclose((FILE *)ctx);
 }
 
 /*------------------------------------------------------------------------
- * Read in a tokenized line
+ * Return the stdio stream if the file is read by the built-in routines.
  *
- * Returns number of tokens or -1 at EOF
+ * This is used for OS-level read-ahead and asynchronous reads.
  */
-static int ntv2_read_toks(FILE *fp, NTV2_TOKEN *ptok, int maxtoks)
+static FILE * ntv2_io_fp(
+   const NTV2_HDR * hdr)
 {
-   char  buf[NTV2_TOKENS_BUFLEN];
-   char *bufp;
+   if ( hdr->io.read_at == ntv2_io_file_read_at )
+      return (FILE *)hdr->io.ctx;
 
-   bufp = ntv2_read_line(fp, buf, sizeof(buf));
-   if ( bufp == NULL )
-      return -1;
+   return NTV2_NULL;
+}
 
-   return ntv2_str_tokenize(ptok, bufp, NULL, maxtoks);
+/*------------------------------------------------------------------------
+ * Release the I/O source and any read-ahead buffer.
+ */
+static void ntv2_io_close(
+   NTV2_HDR * hdr)
+{
+   if ( hdr->io.read_at != NTV2_NULL && hdr->io.close != NTV2_NULL )
+      hdr->io.close(hdr->io.ctx);
+   memset(&hdr->io, 0, sizeof(hdr->io));
+
+   ntv2_memdealloc(hdr->io_buf);
+   hdr->io_buf     = NTV2_NULL;
+   hdr->io_buf_pos = 0;
+   hdr->io_buf_len = 0;
 }
 
 /*------------------------------------------------------------------------
- * Check if an extent is empty.
+ * Stream routines.
+ *
+ * A file is read either with its I/O routines or, if it was loaded with
+ * ntv2_load_buffer(), from the caller's buffer.  These routines keep the
+ * current position and hide the difference, and behave like their stdio
+ * counterparts.  Small reads from the I/O routines are done through a
+ * read-ahead buffer, since headers are read a field at a time.
  */
-static NTV2_BOOL ntv2_extent_is_empty(const NTV2_EXTENT *extent)
+#define NTV2_STREAM_BUFSIZE   8192
+
+/* Return a pointer to the data at the current position, and how much
+   is available there (0 at EOF). */
+static size_t ntv2_stream_avail(
+   NTV2_HDR *             hdr,
+   const unsigned char ** pp)
 {
-   if ( extent == NTV2_NULL )
-      return TRUE;
+   if ( hdr->io.read_at == NTV2_NULL )
+   {
+      if ( hdr->map_data == NTV2_NULL || hdr->io_pos >= hdr->map_size )
+         return 0;
 
-   if ( NTV2_EQ(extent->wlon, extent->elon) ||
-        NTV2_EQ(extent->slat, extent->nlat) )
+      *pp = hdr->map_data + hdr->io_pos;
+      return hdr->map_size - hdr->io_pos;
+   }
+
+   if ( hdr->io_pos <  hdr->io_buf_pos ||
+        hdr->io_pos >= hdr->io_buf_pos + hdr->io_buf_len )
    {
-      return TRUE;
+      if ( hdr->io_buf == NTV2_NULL )
+      {
+         hdr->io_buf = (unsigned char *)ntv2_memalloc(NTV2_STREAM_BUFSIZE);
+         if ( hdr->io_buf == NTV2_NULL )
+            return 0;
+      }
+
+      hdr->io_buf_pos = hdr->io_pos;
+      hdr->io_buf_len = hdr->io.read_at(hdr->io.ctx, hdr->io_buf,
+                                        NTV2_STREAM_BUFSIZE,
+                                        (long)hdr->io_pos);
+      if ( hdr->io_buf_len == 0 )
+         return 0;
    }
 
-   return FALSE;
+   *pp = hdr->io_buf + (hdr->io_pos - hdr->io_buf_pos);
+   return hdr->io_buf_pos + hdr->io_buf_len - hdr->io_pos;
 }
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 validation routines                                                  */
-/* ------------------------------------------------------------------------- */
+static size_t ntv2_fread(NTV2_HDR *hdr, void *buf, size_t size, size_t n)
+{
+   unsigned char * dst  = (unsigned char *)buf;
+   size_t          len  = size * n;
+   size_t          done = 0;
 
-/*------------------------------------------------------------------------
- * Cleanup a name string.
- *
- * All strings in NTv2 headers are supposed to be
- * 8-byte fields that are blank-padded to 8 bytes,
- * with no null at the end.
- *
- * However, we have encountered many files in which this is
- * not the case.  We have seen trailing nulls, null/garbage,
- * and even new-line/null/garbage.  This occurs in both
- * the field names and in the value strings.
- * This can cause problems, especially in identifying which
- * records are parents and which are children.
- *
- * We have also seen lower-case (and mixed-case) chars in the field
- * names, although the spec clearly shows all field names should
- * be upper-case.
- *
- * So, our solution is to "cleanup" these fields.  This also
- * gives us the added benefit that any file that we write will
- * always be in "standard" format.
- *
+   if ( len == 0 )
+      return 0;
+
+   while ( done < len )
+   {
+      const unsigned char * p;
+      size_t                nr;
+
+      if ( hdr->io.read_at != NTV2_NULL &&
+           len - done >= NTV2_STREAM_BUFSIZE )
+      {
+         /* big reads go directly into the caller's buffer */
+         nr = hdr->io.read_at(hdr->io.ctx, dst + done, len - done,
+                              (long)hdr->io_pos);
+         hdr->io_pos += nr;
+         done        += nr;
+         break;
+      }
+
+      nr = ntv2_stream_avail(hdr, &p);
+      if ( nr == 0 )
+         break;
+
+      if ( nr > len - done )
+         nr = len - done;
+      memcpy(dst + done, p, nr);
+      hdr->io_pos += nr;
+      done        += nr;
+   }
+
+   if ( done < len )
+      hdr->io_err = TRUE;
+
+   return done / size;
+}
+
+/* Read a block at an offset, bypassing the read-ahead buffer and leaving
+   the current position alone.  This is for scattered reads, where the
+   read-ahead would only read data that isn't wanted. */
+static size_t ntv2_fread_at(NTV2_HDR *hdr, void *buf, size_t len, long offset)
+{
+   if ( hdr->io.read_at != NTV2_NULL )
+      return hdr->io.read_at(hdr->io.ctx, buf, len, offset);
+
+   if ( hdr->map_data == NTV2_NULL || offset < 0 ||
+        (size_t)offset >= hdr->map_size )
+   {
+      return 0;
+   }
+
+   if ( len > hdr->map_size - (size_t)offset )
+      len = hdr->map_size - (size_t)offset;
+   memcpy(buf, hdr->map_data + offset, len);
+
+   return len;
+}
+
+static void ntv2_fseek(NTV2_HDR *hdr, long offset, int whence)
+{
+   long pos = offset;
+
+   if ( whence == SEEK_CUR )
+   {
+      pos += (long)hdr->io_pos;
+   }
+   else if ( whence == SEEK_END )
+   {
+      if ( hdr->io.read_at == NTV2_NULL )
+         pos += (long)hdr->map_size;
+      else if ( hdr->io.size != NTV2_NULL )
+         pos += hdr->io.size(hdr->io.ctx);
+   }
+
+   hdr->io_pos = (pos < 0) ? 0 : (size_t)pos;
+   hdr->io_err = FALSE;
+}
+
+static long ntv2_ftell(NTV2_HDR *hdr)
+{
+   return (long)hdr->io_pos;
+}
+
+static NTV2_BOOL ntv2_ferror(NTV2_HDR *hdr)
+{
+   return hdr->io_err;
+}
+
+static char * ntv2_fgets(NTV2_HDR *hdr, char *buf, int buflen)
+{
+   NTV2_BOOL eol = FALSE;
+   int       n   = 0;
+
+   while ( !eol && n < buflen - 1 )
+   {
+      const unsigned char * p;
+      size_t                nr = ntv2_stream_avail(hdr, &p);
+      size_t                i  = 0;
+
+      if ( nr == 0 )
+         break;
+
+      while ( !eol && i < nr && n < buflen - 1 )
+      {
+         buf[n] = (char)p[i++];
+         eol    = (buf[n++] == '\n');
+      }
+
+      hdr->io_pos += i;
+   }
+   buf[n] = 0;
+
+   return (n == 0) ? NTV2_NULL : buf;
+}
+
+/*------------------------------------------------------------------------
+ * Read in a line from an ascii stream.
+ *
+ * This will read in a line, strip all leading and trailing whitespace,
+ * and discard any blank lines and comments (anything following a #).
+ *
+ * Returns NULL at EOF.
+ */
+static char * ntv2_read_line(NTV2_HDR *hdr, char *buf, size_t buflen)
+{
+   char * bufp;
+
+   for (;;)
+   {
+      char *p;
+
+      bufp = ntv2_fgets(hdr, buf, (int)buflen);
+      if ( bufp == NULL )
+         break;
+
+      p = strchr(bufp, '#');
+      if ( p != NULL )
+         *p = 0;
+
+      bufp = ntv2_strip(bufp);
+      if ( *bufp != 0 )
+         break;
+   }
+
+   return bufp;
+}
+
+/*------------------------------------------------------------------------
+ * Read in a tokenized line
+ *
+ * Returns number of tokens or -1 at EOF
+ */
+static int ntv2_read_toks(NTV2_HDR *hdr, NTV2_TOKEN *ptok, int maxtoks)
+{
+   char  buf[NTV2_TOKENS_BUFLEN];
+   char *bufp;
+
+   bufp = ntv2_read_line(hdr, buf, sizeof(buf));
+   if ( bufp == NULL )
+      return -1;
+
+   return ntv2_str_tokenize(ptok, bufp, NULL, maxtoks);
+}
+
+/*------------------------------------------------------------------------
+ * Read in a line of numbers from an ascii stream.
+ *
+ * This gives the same result as ntv2_read_toks() followed by ntv2_atod()
+ * on each token, but parses the line right where it sits in the stream
+ * buffer, so nothing is copied.  A line that can't be parsed in place
+ * (because it runs past the end of the buffer or holds something other
+ * than plain numbers) is just read in and tokenized.
+ *
+ * Returns number of values (at most maxvals) or -1 at EOF
+ */
+static int ntv2_read_nums(NTV2_HDR *hdr, double vals[], int maxvals)
+{
+   NTV2_TOKEN tok;
+   int n, i;
+
+   for (;;)
+   {
+      const unsigned char * p;
+      const char *          s;
+      const char *          eol;
+      const char *          end;
+      size_t                nr = ntv2_stream_avail(hdr, &p);
+
+      if ( nr == 0 )
+         return -1;
+
+      s   = (const char *)p;
+      eol = (const char *)memchr(s, '\n', nr);
+      if ( eol == NTV2_NULL )
+         break;
+
+      end = (const char *)memchr(s, '#', (size_t)(eol - s));
+      if ( end == NTV2_NULL )
+         end = eol;
+
+      for (n = 0; n < maxvals; n++)
+      {
+         while ( s < end && isspace((unsigned char)*s) )
+            s++;
+         if ( s == end )
+            break;
+
+         s = ntv2_scan_dbl(s, end, &vals[n]);
+         if ( s == NTV2_NULL )
+            break;
+      }
+
+      if ( s == NTV2_NULL )
+         break;
+
+      hdr->io_pos += (size_t)(eol - (const char *)p) + 1;
+
+      /* skip blank lines and comments */
+      if ( n > 0 )
+         return n;
+   }
+
+   n = ntv2_read_toks(hdr, &tok, maxvals);
+   for (i = 0; i < n; i++)
+      vals[i] = ntv2_atod(tok.toks[i]);
+
+   return n;
+}
+
+/*------------------------------------------------------------------------
+ * Check if an extent is empty.
+ */
+static NTV2_BOOL ntv2_extent_is_empty(const NTV2_EXTENT *extent)
+{
+   if ( extent == NTV2_NULL )
+      return TRUE;
+
+   if ( NTV2_EQ(extent->wlon, extent->elon) ||
+        NTV2_EQ(extent->slat, extent->nlat) )
+   {
+      return TRUE;
+   }
+
+   return FALSE;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 validation routines                                                  */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Cleanup a name string.
+ *
+ * All strings in NTv2 headers are supposed to be
+ * 8-byte fields that are blank-padded to 8 bytes,
+ * with no null at the end.
+ *
+ * However, we have encountered many files in which this is
+ * not the case.  We have seen trailing nulls, null/garbage,
+ * and even new-line/null/garbage.  This occurs in both
+ * the field names and in the value strings.
+ * This can cause problems, especially in identifying which
+ * records are parents and which are children.
+ *
+ * We have also seen lower-case (and mixed-case) chars in the field
+ * names, although the spec clearly shows all field names should
+ * be upper-case.
+ *
+ * So, our solution is to "cleanup" these fields.  This also
+ * gives us the added benefit that any file that we write will
+ * always be in "standard" format.
+ *
  * Note we always cleanup the record-name and the parent-name in the
  * ntv2-rec struct, but we only cleanup the strings in the overview
  * and subfile records when we write out a new file.
@@ -1689,1331 +2253,1805 @@ static int ntv2_fix_ptrs(
 }
 
 /* ------------------------------------------------------------------------- */
-/* NTv2 common routines                                                      */
+/* NTv2 grid array routines                                                  */
 /* ------------------------------------------------------------------------- */
 
 /*------------------------------------------------------------------------
- * Determine the file type of a name
+ * Grid arrays (shifts and accuracies read into memory) are allocated
+ * according to the policy the object was loaded with.  Each array is
+ * preceded by a block header that says how it was allocated, so it can
+ * be freed (and taken out of the stats) without knowing the policy.
  *
- * This is done solely by checking the filename extension.
- * No examination of the file contents (if any) is done.
+ * The header takes up a whole cache line, so an array in an aligned
+ * block (or in huge pages) starts on a cache line.
  */
-int ntv2_filetype(const char *ntv2file)
-{
-   const char *ext;
+#define NTV2_CACHE_LINE    64
 
-   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
-      return NTV2_FILE_TYPE_UNK;
+#define NTV2_GRID_HEAP     0     /* from the heap                */
+#define NTV2_GRID_ALIGNED  1     /* from the heap, aligned       */
+#define NTV2_GRID_THP      2     /* in transparent huge pages    */
+#define NTV2_GRID_HUGETLB  3     /* in explicit huge pages       */
 
-   ext = strrchr(ntv2file, '.');
-   if ( ext != NTV2_NULL )
-   {
-      ext++;
+#define NTV2_GRID_KIND(policy)  (((policy) & NTV2_ALLOC_MASK) >> 8)
 
-      if ( ntv2_strcmp_i(ext, NTV2_FILE_BIN_EXTENSION) == 0 )
-         return NTV2_FILE_TYPE_BIN;
+#define NTV2_ALLOC_FLAGS   (NTV2_ALLOC_MASK | NTV2_ALLOC_ARENA)
 
-      if ( ntv2_strcmp_i(ext, NTV2_FILE_ASC_EXTENSION) == 0 )
-         return NTV2_FILE_TYPE_ASC;
-   }
+#define NTV2_LINE_ROUND(n) \
+   (((n) + NTV2_CACHE_LINE - 1) / NTV2_CACHE_LINE * NTV2_CACHE_LINE)
 
-   return NTV2_FILE_TYPE_UNK;
-}
+typedef struct ntv2_grid_blk NTV2_GRID_BLK;
+struct ntv2_grid_blk
+{
+   void * base;                        /* start of what was allocated */
+   size_t size;                        /* bytes allocated             */
+   size_t nbytes;                      /* bytes in the array          */
+   int    kind;                        /* NTV2_GRID_* we got          */
+   int    want;                        /* NTV2_GRID_* asked for       */
+};
 
 /*------------------------------------------------------------------------
- * Create an empty NTv2 struct, query the file type, and open the file.
+ * An arena is a single grid block that holds a whole object (see
+ * ntv2_arena_make()).  This struct is at its start, and is followed by
+ * the object and its records, and then by room for the grid arrays,
+ * which are handed out in turn as they are allocated.  Arrays in the
+ * arena are never freed by themselves, and anything that doesn't fit
+ * is allocated as usual.
  */
-static NTV2_HDR * ntv2_create(const char *ntv2file, int type, int *prc)
+typedef struct ntv2_arena NTV2_ARENA;
+struct ntv2_arena
 {
-   NTV2_HDR * hdr;
+   unsigned char * data;               /* start of grid arrays        */
+   size_t          size;               /* bytes for grid arrays       */
+   size_t          used;               /* bytes handed out so far     */
+};
 
-   hdr = (NTV2_HDR *)ntv2_memalloc(sizeof(*hdr));
-   if ( hdr == NTV2_NULL )
-   {
-      *prc = NTV2_ERR_NO_MEMORY;
-      return NTV2_NULL;
-   }
+#define NTV2_IN_ARENA(a, p) \
+   ( (a) != NTV2_NULL && \
+     (const unsigned char *)(p) >= (const unsigned char *)(a) && \
+     (const unsigned char *)(p) <  ((const NTV2_ARENA *)(a))->data + \
+                                   ((const NTV2_ARENA *)(a))->size )
 
-   memset(hdr, 0, sizeof(*hdr));
+/* Arrays in a mapped shared segment or snapshot are freed with it. */
 
-   strcpy(hdr->path, ntv2file);
-   hdr->file_type = type;
-   hdr->lon_min   =  360.0;
-   hdr->lat_min   =   90.0;
-   hdr->lon_max   = -360.0;
-   hdr->lat_max   =  -90.0;
+#define NTV2_IN_SHM(h, p) \
+   ( (h)->shm_data != NTV2_NULL && \
+     (const unsigned char *)(p) >= (h)->shm_data && \
+     (const unsigned char *)(p) <  (h)->shm_data + (h)->shm_size )
+
+/*------------------------------------------------------------------------
+ * Add (or take away) a block in the allocation stats.
+ */
+static void ntv2_grid_count(
+   NTV2_HDR *            hdr,
+   const NTV2_GRID_BLK * blk,
+   int                   sign)
+{
+   NTV2_ALLOC_STATS * stats = &hdr->alloc;
+   size_t *           pbytes;
 
-   hdr->fp = fopen(hdr->path, "rb");
-   if ( hdr->fp == NTV2_NULL )
+   switch (blk->kind)
    {
-      ntv2_memdealloc(hdr);
-      *prc = NTV2_ERR_CANNOT_OPEN_FILE;
-      return NTV2_NULL;
+      case NTV2_GRID_ALIGNED: pbytes = &stats->aligned_bytes; break;
+      case NTV2_GRID_THP:     pbytes = &stats->thp_bytes;     break;
+      case NTV2_GRID_HUGETLB: pbytes = &stats->hugetlb_bytes; break;
+      default:                pbytes = &stats->heap_bytes;    break;
    }
 
-   if ( type == NTV2_FILE_TYPE_BIN )
+   if ( sign > 0 )
    {
-      hdr->mutex = ntv2_mutex_create();
+      stats->num_arrays++;
+      *pbytes += blk->nbytes;
+   }
+   else
+   {
+      stats->num_arrays--;
+      *pbytes -= blk->nbytes;
    }
 
-   *prc = NTV2_ERR_OK;
-   return hdr;
+   if ( blk->kind != blk->want )
+      stats->num_fallbacks += sign;
 }
 
 /*------------------------------------------------------------------------
- * Delete a NTv2 object
+ * Allocate a grid array.
+ *
+ * Huge pages are only asked for if the array fills at least one, and
+ * explicit huge pages fall back to transparent ones, which fall back
+ * to an aligned heap block.  If an allocator has been set, huge pages
+ * are asked for from it instead.  If the object has an arena with room
+ * left, the array is just taken from it.
  */
-void ntv2_delete(NTV2_HDR *hdr)
+static void * ntv2_grid_alloc(
+   NTV2_HDR * hdr,
+   size_t     nbytes)
 {
-   if ( hdr != NTV2_NULL )
+   int             want = NTV2_GRID_KIND(hdr->alloc.policy);
+   int             kind = want;
+   unsigned char * base = NTV2_NULL;
+   unsigned char * p    = NTV2_NULL;
+   size_t          size = 0;
+   NTV2_GRID_BLK * blk;
+
+   if ( hdr->arena != NTV2_NULL )
    {
-      int i;
+      NTV2_ARENA * arena = (NTV2_ARENA *)hdr->arena;
+
+      if ( arena->size - arena->used >= NTV2_LINE_ROUND(nbytes) )
+      {
+         p = arena->data + arena->used;
+         arena->used += NTV2_LINE_ROUND(nbytes);
+         return p;
+      }
+   }
+
+   if ( kind >= NTV2_GRID_THP && nbytes < NTV2_HUGE_PAGE_SIZE )
+   {
+      kind = want = NTV2_GRID_ALIGNED;
+   }
+
+   if ( kind == NTV2_GRID_HUGETLB || kind == NTV2_GRID_THP )
+   {
+      size = (nbytes + NTV2_CACHE_LINE + NTV2_HUGE_PAGE_SIZE - 1) /
+             NTV2_HUGE_PAGE_SIZE * NTV2_HUGE_PAGE_SIZE;
 
-      if ( hdr->fp != NTV2_NULL )
+      if ( ntv2_allocator.alloc != NTV2_NULL )
       {
-         fclose(hdr->fp);
+         /* Huge pages are left to the caller's allocator. */
+         base = (unsigned char *)ntv2_memalloc_aligned(size,
+                                                       NTV2_HUGE_PAGE_SIZE);
+         kind = NTV2_GRID_ALIGNED;
+      }
+      else if ( kind == NTV2_GRID_HUGETLB )
+      {
+         base = (unsigned char *)ntv2_huge_alloc(size, NTV2_PAGES_HUGETLB);
+         if ( base == NTV2_NULL )
+            kind = NTV2_GRID_THP;
       }
 
-      if ( hdr->mutex != NTV2_NULL )
+      if ( base == NTV2_NULL && kind == NTV2_GRID_THP )
       {
-         ntv2_mutex_delete(hdr->mutex);
+         base = (unsigned char *)ntv2_huge_alloc(size, NTV2_PAGES_THP);
+         if ( base == NTV2_NULL )
+            kind = NTV2_GRID_ALIGNED;
       }
 
-      for (i = 0; i < hdr->num_recs; i++)
+      if ( base != NTV2_NULL )
+         p = base + NTV2_CACHE_LINE;
+   }
+
+   if ( kind == NTV2_GRID_ALIGNED && base == NTV2_NULL )
+   {
+      size = nbytes + NTV2_CACHE_LINE;
+      base = (unsigned char *)ntv2_memalloc_aligned(size, NTV2_CACHE_LINE);
+
+      if ( base == NTV2_NULL )
       {
-         ntv2_memdealloc(hdr->recs[i].shifts);
-         ntv2_memdealloc(hdr->recs[i].accurs);
+         size = nbytes + 2 * NTV2_CACHE_LINE;
+         base = (unsigned char *)ntv2_memalloc(size);
+         if ( base == NTV2_NULL )
+            return NTV2_NULL;
       }
 
-      ntv2_memdealloc(hdr->overview);
-      ntv2_memdealloc(hdr->subfiles);
+      p = base + NTV2_CACHE_LINE;
+      p = p + (NTV2_CACHE_LINE - ((size_t)p % NTV2_CACHE_LINE)) %
+              NTV2_CACHE_LINE;
+   }
+
+   if ( kind == NTV2_GRID_HEAP )
+   {
+      size = nbytes + NTV2_CACHE_LINE;
+      base = (unsigned char *)ntv2_memalloc(size);
+      if ( base == NTV2_NULL )
+         return NTV2_NULL;
 
-      ntv2_memdealloc(hdr->recs);
-      ntv2_memdealloc(hdr);
+      p = base + NTV2_CACHE_LINE;
    }
-}
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 binary read routines                                                 */
-/* ------------------------------------------------------------------------- */
+   blk = (NTV2_GRID_BLK *)(p - sizeof(*blk));
+   blk->base   = base;
+   blk->size   = size;
+   blk->nbytes = nbytes;
+   blk->kind   = kind;
+   blk->want   = want;
+
+   ntv2_grid_count(hdr, blk, 1);
+
+   return p;
+}
 
 /*------------------------------------------------------------------------
- * Read a binary overview record.
- *
- * The original Canadian specification for NTv2 files included
- * a 4-byte pad of zeros after each int in the headers, which
- * kept the length of each record (overview field, sub-file field,
- * or grid-shift entry) to be 16 bytes.  This was probably done
- * so they could read the files in FORTRAN or on a main-frame using
- * "DCB=(RECFM=FB,LRECL=16,...)".
- *
- * However, when Australia started using this file format, they
- * misunderstood the reason for the padding and thought it was a compiler
- * issue.  The Canadians had implemented NTv2 using FORTRAN,
- * and information at the time suggested that the use of records in
- * a FORTRAN binary file would create a file that other languages
- * would have a difficult time reading and writing.  Thus, the
- * Australians decided to format the file as specified, but to
- * ignore any "auxiliary record identifiers" that FORTRAN used (i.e.
- * the padding bytes).
- *
- * To make matters worse, New Zealand copied the Australian
- * format.  Blimey!  However, it became apparent that the NTv2 binary
- * format is not compiler dependent, and since 2000 both Australia
- * and New Zealand have been writing new files correctly.
- *
- * But this means that when reading a NTv2 header record we have to
- * determine whether these pad bytes are there, since we may be reading
- * an older Australian or New Zealand NTv2 file.
- *
- * Also, there is nothing in the NTv2 specification that states
- * whether the file should be written big-endian or little-endian,
- * so we also have to determine how it was written, so we can know if
- * we have to byte-swap the numbers.  However, all files we've seen
- * so far are all little-endian.
- *
- * Also, when we cache the overview and subfile records, they are always
- * stored in native-endian format.  They get byte-swapped back, if needed,
- * when written out.  This allows us to choose how they are written out,
- * and makes it easier to dump the data.
- *
- *------------------------------------------------------------------------
- * Implementation note:
- *   In GCC, a function can be declared with the attribute "warn_unused_result",
- *   which results in a warning being issued if the return value from that
- *   function is not used.  This, of course, will cause a compilation to
- *   fail if "-Werror" (treat warnings as errors) is specified on the
- *   command line (which we like to do).  For details, see
- *   "http://gcc.gnu.org/onlinedocs/gcc-3.4.6/gcc/Function-Attributes.html".
- *
- *   Despite flames from the user community, Ubuntu Linux sets this attribute
- *   for the fread() function.  Unfortunately, we don't bother to check the
- *   result from each call to fread(), since that makes the code real ugly
- *   and it is easier just to check ferror() at the end.  But, because of
- *   Ubuntu's insistence on requiring that the return value be used, we store
- *   the result but we don't bother checking it.
- *------------------------------------------------------------------------
+ * Free a grid array.
  */
-static int ntv2_read_ov_bin(
-   NTV2_HDR     *hdr,
-   NTV2_FILE_OV *ov)
+static void ntv2_grid_free(
+   NTV2_HDR * hdr,
+   void *     p)
 {
-   size_t nr;
-
-   /* -------- NUM_OREC */
-
-   nr = fread( ov->n_num_orec, NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&ov->i_num_orec, NTV2_SIZE_INT, 1, hdr->fp);
-
-   /* determine if byte-swapping is needed */
+   NTV2_GRID_BLK * blk;
 
-   if ( ov->i_num_orec != 11 )
+   if ( p == NTV2_NULL || NTV2_IN_ARENA(hdr->arena, p) ||
+        NTV2_IN_SHM(hdr, p) )
    {
-      hdr->swap_data = TRUE;
-      NTV2_SWAPI(&ov->i_num_orec, 1);
-      if ( ov->i_num_orec != 11 )
-         return NTV2_ERR_INVALID_NUM_OREC;
+      return;
    }
 
-   /* determine if pad-bytes are present */
+   blk = (NTV2_GRID_BLK *)((unsigned char *)p - sizeof(*blk));
+   ntv2_grid_count(hdr, blk, -1);
 
-   nr = fread(&ov->p_num_orec, NTV2_SIZE_INT, 1, hdr->fp);
-   if ( ov->p_num_orec == 0 )
-   {
-      hdr->pads_present = TRUE;
-   }
+   if ( blk->kind == NTV2_GRID_THP || blk->kind == NTV2_GRID_HUGETLB )
+      ntv2_huge_free(blk->base, blk->size);
    else
-   {
-      ov->p_num_orec = 0;
-      fseek(hdr->fp, -NTV2_SIZE_INT, SEEK_CUR);
-   }
-
-   /* -------- NUM_SREC */
+      ntv2_memdealloc(blk->base);
+}
 
-   nr = fread( ov->n_num_srec, NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread(&ov->i_num_srec, NTV2_SIZE_INT,  1, hdr->fp);
-   ov->p_num_srec = 0;
+/* ------------------------------------------------------------------------- */
+/* NTv2 tile cache routines                                                  */
+/* ------------------------------------------------------------------------- */
 
-   NTV2_SWAPI(&ov->i_num_srec, 1);
-   if ( ov->i_num_srec != 11 )
-      return NTV2_ERR_INVALID_NUM_SREC;
+/*------------------------------------------------------------------------
+ * Get the file offset of a grid-shift record in a binary file.
+ *
+ * The row & column are relative to the (possibly extent-clipped) record,
+ * so the skips have to be added back in to get to the original layout.
+ */
+static long ntv2_data_offset(
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow)
+{
+   long row_len = rec->eskip +
+                  rec->ncols * (long)sizeof(NTV2_FILE_GS) +
+                  rec->wskip;
 
-   if ( hdr->pads_present )
-      fseek(hdr->fp, NTV2_SIZE_INT, SEEK_CUR);
+   return rec->offset + rec->sskip +
+          (irow * row_len) +
+          rec->eskip + (icol * (long)sizeof(NTV2_FILE_GS));
+}
 
-   /* -------- NUM_FILE */
+/*------------------------------------------------------------------------
+ * Get the layout of a record in a tiled file.
+ *
+ * The skips are kept in binary-file units (see ntv2_process_extent()),
+ * which give the original size of the grid and the row & column of the
+ * (possibly extent-clipped) record in it.
+ */
+#define NTV2_TIL_TILE_SIZE   \
+   ((long)sizeof(NTV2_SHIFT) * NTV2_TIL_DIM * NTV2_TIL_DIM)
 
-   nr = fread( ov->n_num_file,  NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&ov->i_num_file,  NTV2_SIZE_INT, 1, hdr->fp);
-   ov->p_num_file = 0;
+static void ntv2_til_layout(
+   const NTV2_REC * rec,
+   int *            row0,
+   int *            col0,
+   int *            ntrows,
+   int *            ntcols)
+{
+   int ocols = rec->ncols +
+               (rec->wskip + rec->eskip) / (int)sizeof(NTV2_FILE_GS);
+   int orows = rec->nrows +
+               (rec->sskip + rec->nskip) / ((int)sizeof(NTV2_FILE_GS) * ocols);
+
+   *row0   = rec->sskip / ((int)sizeof(NTV2_FILE_GS) * ocols);
+   *col0   = rec->eskip / (int)sizeof(NTV2_FILE_GS);
+   *ntrows = (orows + NTV2_TIL_DIM - 1) / NTV2_TIL_DIM;
+   *ntcols = (ocols + NTV2_TIL_DIM - 1) / NTV2_TIL_DIM;
+}
 
-   NTV2_SWAPI(&ov->i_num_file, 1);
-   if ( ov->i_num_file <= 0 )
-      return NTV2_ERR_INVALID_NUM_FILE;
-   hdr->num_recs = ov->i_num_file;
+/*------------------------------------------------------------------------
+ * Get the size of a plane of tiles in a tiled file (in whole pages).
+ */
+static long ntv2_til_plane_size(
+   int ntrows,
+   int ntcols)
+{
+   long size = (long)ntrows * ntcols * NTV2_TIL_TILE_SIZE;
 
-   if ( hdr->pads_present )
-      fseek(hdr->fp, NTV2_SIZE_INT, SEEK_CUR);
+   return ((size + NTV2_TIL_PAGE_SIZE - 1) / NTV2_TIL_PAGE_SIZE) *
+          NTV2_TIL_PAGE_SIZE;
+}
 
-   /* -------- GS_TYPE */
+/*------------------------------------------------------------------------
+ * Get the file offset of a grid-shift pair in a tiled file.
+ */
+static long ntv2_til_offset(
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow)
+{
+   int row0, col0, ntrows, ntcols;
 
-   nr = fread( ov->n_gs_type,  NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread( ov->s_gs_type,  NTV2_NAME_LEN,  1, hdr->fp);
+   ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+   irow += row0;
+   icol += col0;
 
-   /* -------- VERSION */
+   return rec->offset +
+          ((long)(irow / NTV2_TIL_DIM) * ntcols + (icol / NTV2_TIL_DIM)) *
+             NTV2_TIL_TILE_SIZE +
+          ((irow % NTV2_TIL_DIM) * NTV2_TIL_DIM + (icol % NTV2_TIL_DIM)) *
+             (long)sizeof(NTV2_SHIFT);
+}
 
-   nr = fread( ov->n_version,  NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread( ov->s_version,  NTV2_NAME_LEN,  1, hdr->fp);
+/*------------------------------------------------------------------------
+ * Get the file offset of a lat or lon shift value.
+ */
+static long ntv2_shift_offset(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+   if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+   {
+      return ntv2_til_offset(rec, icol, irow) + (coord_type * NTV2_SIZE_FLT);
+   }
 
-   /* -------- SYSTEM_F */
+   return ntv2_data_offset(rec, icol, irow) +
+          ((coord_type == NTV2_COORD_LAT) ?
+             NTV2_OFFSET_OF(NTV2_FILE_GS, f_lat_shift) :
+             NTV2_OFFSET_OF(NTV2_FILE_GS, f_lon_shift) );
+}
 
-   nr = fread( ov->n_system_f, NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread( ov->s_system_f, NTV2_NAME_LEN,  1, hdr->fp);
+/*------------------------------------------------------------------------
+ * Get the file offset of a lat or lon accuracy value.
+ */
+static long ntv2_accur_offset(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+   if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+   {
+      int row0, col0, ntrows, ntcols;
 
-   /* -------- SYSTEM_T */
+      ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+      return ntv2_til_offset(rec, icol, irow) +
+             ntv2_til_plane_size(ntrows, ntcols) +
+             (coord_type * NTV2_SIZE_FLT);
+   }
 
-   nr = fread( ov->n_system_t, NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread( ov->s_system_t, NTV2_NAME_LEN,  1, hdr->fp);
+   return ntv2_data_offset(rec, icol, irow) +
+          ((coord_type == NTV2_COORD_LAT) ?
+             NTV2_OFFSET_OF(NTV2_FILE_GS, f_lat_accuracy) :
+             NTV2_OFFSET_OF(NTV2_FILE_GS, f_lon_accuracy) );
+}
 
-   /* -------- MAJOR_F */
+/*------------------------------------------------------------------------
+ * The tile cache is used when shifts are read from the file on-the-fly.
+ *
+ * Each tile holds the decoded (and swapped) shift pairs for a block of
+ * NTV2_TILE_DIM x NTV2_TILE_DIM grid points of one record.  Tiles are
+ * spread over a number of shards by a hash of their key, and each shard
+ * has its own mutex, hash chains, and CLOCK hand for eviction.  Thus
+ * threads looking up points in different areas seldom wait on each other.
+ */
+#define NTV2_TILE_DIM        16
+#define NTV2_TILE_NUM        (NTV2_TILE_DIM * NTV2_TILE_DIM)
+#define NTV2_CACHE_SHARDS    16
 
-   nr = fread( ov->n_major_f,  NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread(&ov->d_major_f,  NTV2_SIZE_DBL,  1, hdr->fp);
-   NTV2_SWAPD(&ov->d_major_f, 1);
+typedef struct ntv2_tile NTV2_TILE;
+struct ntv2_tile
+{
+   int            rec_num;             /* Record number or -1 if unused */
+   int            trow;                /* Tile row    in the record     */
+   int            tcol;                /* Tile column in the record     */
+   int            next;                /* Next tile in hash chain or -1 */
+   int            used;                /* CLOCK reference bit           */
+   NTV2_SHIFT     shifts[NTV2_TILE_NUM];
+};
 
-   /* -------- MINOR_F */
+typedef struct ntv2_shard NTV2_SHARD;
+struct ntv2_shard
+{
+   void *         mutex;               /* Shard mutex                   */
+   int            num_tiles;           /* Number of tiles in shard      */
+   int            hand;                /* CLOCK hand                    */
+   int *          chains;              /* Hash chain heads [num_tiles]  */
+   NTV2_TILE *    tiles;               /* Tile array       [num_tiles]  */
+};
 
-   nr = fread( ov->n_minor_f,  NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread(&ov->d_minor_f,  NTV2_SIZE_DBL,  1, hdr->fp);
-   NTV2_SWAPD(&ov->d_minor_f, 1);
+typedef struct ntv2_cache NTV2_CACHE;
+struct ntv2_cache
+{
+   int            num_shards;
+   NTV2_SHARD     shards[NTV2_CACHE_SHARDS];
+};
 
-   /* -------- MAJOR_T */
+static unsigned int ntv2_tile_hash(
+   int rec_num,
+   int trow,
+   int tcol)
+{
+   unsigned int h;
 
-   nr = fread( ov->n_major_t,  NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread(&ov->d_major_t,  NTV2_SIZE_DBL,  1, hdr->fp);
-   NTV2_SWAPD(&ov->d_major_t, 1);
+   h  = (unsigned int)rec_num * 0x9E3779B1U;
+   h ^= (unsigned int)trow    * 0x85EBCA77U;
+   h ^= (unsigned int)tcol    * 0xC2B2AE3DU;
+   h ^= (h >> 15);
 
-   /* -------- MINOR_T */
+   return h;
+}
 
-   nr = fread( ov->n_minor_t,  NTV2_NAME_LEN,  1, hdr->fp);
-   nr = fread(&ov->d_minor_t,  NTV2_SIZE_DBL,  1, hdr->fp);
-   NTV2_SWAPD(&ov->d_minor_t, 1);
+/*------------------------------------------------------------------------
+ * Get the number of rows & columns in a tile (edge tiles are partial).
+ */
+static void ntv2_tile_size(
+   const NTV2_REC * rec,
+   int              trow,
+   int              tcol,
+   int            * pnrows,
+   int            * pncols)
+{
+   *pnrows = rec->nrows - (trow * NTV2_TILE_DIM);
+   *pncols = rec->ncols - (tcol * NTV2_TILE_DIM);
 
-   /* -------- check for I/O error */
+   if ( *pnrows > NTV2_TILE_DIM )  *pnrows = NTV2_TILE_DIM;
+   if ( *pncols > NTV2_TILE_DIM )  *pncols = NTV2_TILE_DIM;
+}
 
-   if ( ferror(hdr->fp) || feof(hdr->fp) || nr != 1 )
+/*------------------------------------------------------------------------
+ * Delete a tile cache.
+ */
+static void ntv2_cache_delete(
+   NTV2_CACHE *cache)
+{
+   if ( cache != NTV2_NULL )
    {
-      return NTV2_ERR_IOERR;
+      int i;
+
+      for (i = 0; i < cache->num_shards; i++)
+      {
+         NTV2_SHARD * shard = &cache->shards[i];
+
+         ntv2_mutex_delete(shard->mutex);
+         ntv2_memdealloc(shard->chains);
+         ntv2_memdealloc(shard->tiles);
+      }
+
+      ntv2_memdealloc(cache);
    }
+}
 
-   /* -------- get the conversion
+/*------------------------------------------------------------------------
+ * Create a tile cache using (at most) a given number of bytes.
+ */
+static NTV2_CACHE * ntv2_cache_create(
+   size_t nbytes)
+{
+   NTV2_CACHE * cache;
+   int          num_tiles;
+   int          i, j;
 
-      Note that this conversion factor applies to both the header values
-      and the shift values, but in different ways.
+   num_tiles = (int)(nbytes / (sizeof(NTV2_TILE) + sizeof(int)));
+   if ( num_tiles <= 0 )
+      return NTV2_NULL;
 
-      So far, the only data type we've encountered in any published
-      NTv2 file is "SECONDS".
-   */
+   cache = (NTV2_CACHE *)ntv2_memalloc(sizeof(*cache));
+   if ( cache == NTV2_NULL )
+      return NTV2_NULL;
 
-   ntv2_cleanup_str(hdr, hdr->gs_type, ov->s_gs_type, FALSE);
+   memset(cache, 0, sizeof(*cache));
 
-   if      ( strncmp(hdr->gs_type, "SECONDS ", NTV2_NAME_LEN) == 0 )
-   {
-      hdr->hdr_conv = ( 1.0 / 3600.0 );
-      hdr->dat_conv = ( 1.0          );
-   }
-   else if ( strncmp(hdr->gs_type, "MINUTES ", NTV2_NAME_LEN) == 0 )
-   {
-      hdr->hdr_conv = ( 1.0 / 60.0   );
-      hdr->dat_conv = ( 60.0         );
-   }
-   else if ( strncmp(hdr->gs_type, "DEGREES ", NTV2_NAME_LEN) == 0 )
-   {
-      hdr->hdr_conv = ( 1.0          );
-      hdr->dat_conv = ( 3600.0       );
-   }
-   else
+   cache->num_shards = (num_tiles < NTV2_CACHE_SHARDS) ?
+                        num_tiles : NTV2_CACHE_SHARDS;
+
+   for (i = 0; i < cache->num_shards; i++)
    {
-      return NTV2_ERR_INVALID_GS_TYPE;
+      NTV2_SHARD * shard = &cache->shards[i];
+
+      shard->num_tiles = num_tiles / cache->num_shards;
+      shard->mutex     = ntv2_mutex_create();
+      shard->chains    = (int *)
+                         ntv2_memalloc(sizeof(*shard->chains) *
+                                       shard->num_tiles);
+      shard->tiles     = (NTV2_TILE *)
+                         ntv2_memalloc(sizeof(*shard->tiles) *
+                                       shard->num_tiles);
+
+      if ( shard->chains == NTV2_NULL || shard->tiles == NTV2_NULL )
+      {
+         cache->num_shards = i + 1;
+         ntv2_cache_delete(cache);
+         return NTV2_NULL;
+      }
+
+      for (j = 0; j < shard->num_tiles; j++)
+      {
+         shard->chains[j]        = -1;
+         shard->tiles[j].rec_num = -1;
+         shard->tiles[j].next    = -1;
+         shard->tiles[j].used    = FALSE;
+      }
    }
 
-   return NTV2_ERR_OK;
+   return cache;
 }
 
 /*------------------------------------------------------------------------
- * Read a binary subfile record.
+ * Compressed shift storage.
  *
- * See above implementation comment.
+ * With NTV2_DATA_COMPRESSED, the shifts of each record are kept in the
+ * same tiles that the tile cache holds, and each tile is compressed
+ * separately, so it can be decoded on its own into the cache.
+ *
+ * Each float is first mapped to an unsigned int that sorts in the same
+ * order, and is then predicted from its neighbors to the left, above,
+ * and above-left.  Since shift grids are smooth, the residuals are small,
+ * and they are stored zig-zag encoded with a fixed number of bits for
+ * each row of the tile.  All arithmetic is modulo 2^32, so the values
+ * are restored exactly.
+ *
+ * With NTV2_DATA_QUANTIZED, each float is instead rounded to a multiple
+ * of a step (NTV2_QUANT_ERROR seconds), and the number of steps is
+ * what is predicted and stored.  The residuals are then mostly a few
+ * bits wide.  A shift is at most half a step from its multiple, which
+ * is at most another half step from the float it is restored to, so no
+ * shift is off by more than one step.  A record whose shifts are too
+ * big for this is kept losslessly.
+ *
+ * Decoded tiles are kept by each thread if the compiler has thread-local
+ * storage (see ntv2_packed_tile()), and in the tile cache otherwise.
+ *
+ * The lat and then the lon values of a tile are stored as follows:
+ *
+ *    4 bytes     the first value (mapped, little-endian)
+ *    per row:
+ *      1 byte    the number of bits per residual (0 - 32)
+ *      n bytes   the residuals, packed low bit first
  */
-static int ntv2_read_sf_bin(
-   NTV2_HDR     *hdr,
-   NTV2_FILE_SF *sf)
+#define NTV2_PACK_TILE_MAX   (2 * (4 + NTV2_TILE_DIM * (1 + 4 * NTV2_TILE_DIM)))
+
+typedef struct ntv2_packed NTV2_PACKED;
+struct ntv2_packed
 {
-   size_t nr;
+   long           id;                  /* Unique id of this block       */
+   double         step;                /* Quantizing step or 0          */
+   int            ntcols;              /* Number of tile columns        */
+   size_t         size;                /* Total size in bytes           */
+   unsigned int * index;               /* Offset of each tile in data   */
+   unsigned char* data;                /* Compressed tiles              */
+};
 
-   /* -------- SUB_NAME */
+static unsigned int ntv2_pack_map(
+   float f)
+{
+   unsigned int u;
 
-   nr = fread( sf->n_sub_name, NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread( sf->s_sub_name, NTV2_NAME_LEN, 1, hdr->fp);
+   memcpy(&u, &f, sizeof(u));
+   return (u & 0x80000000U) ? ~u : (u | 0x80000000U);
+}
 
-   /* -------- PARENT */
+static float ntv2_pack_unmap(
+   unsigned int m)
+{
+   unsigned int u = (m & 0x80000000U) ? (m & 0x7FFFFFFFU) : ~m;
+   float f;
 
-   nr = fread( sf->n_parent,   NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread( sf->s_parent,   NTV2_NAME_LEN, 1, hdr->fp);
+   memcpy(&f, &u, sizeof(f));
+   return f;
+}
 
-   /* -------- CREATED */
+/* Map a float to a number of steps, or to an int if the step is 0. */
+static unsigned int ntv2_pack_value(
+   float  f,
+   double step)
+{
+   double q;
 
-   nr = fread( sf->n_created,  NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread( sf->s_created,  NTV2_NAME_LEN, 1, hdr->fp);
+   if ( step <= 0.0 )
+      return ntv2_pack_map(f);
 
-   /* -------- UPDATED */
+   q = floor(f / step + 0.5);
+   return (q < 0.0) ? ~(unsigned int)(-q - 1.0) : (unsigned int)q;
+}
 
-   nr = fread( sf->n_updated,  NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread( sf->s_updated,  NTV2_NAME_LEN, 1, hdr->fp);
+static float ntv2_unpack_value(
+   unsigned int v,
+   double       step)
+{
+   double q;
 
-   /* -------- S_LAT */
+   if ( step <= 0.0 )
+      return ntv2_pack_unmap(v);
 
-   nr = fread( sf->n_s_lat,    NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->d_s_lat,    NTV2_SIZE_DBL, 1, hdr->fp);
-   NTV2_SWAPD(&sf->d_s_lat, 1);
+   q = (v & 0x80000000U) ? -(double)(~v) - 1.0 : (double)v;
+   return (float)(q * step);
+}
 
-   /* -------- N_LAT */
+static unsigned int ntv2_pack_pred(
+   const unsigned int *v,
+   int                 row,
+   int                 col)
+{
+   const unsigned int * p = v + (row * NTV2_TILE_DIM) + col;
 
-   nr = fread( sf->n_n_lat,    NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->d_n_lat,    NTV2_SIZE_DBL, 1, hdr->fp);
-   NTV2_SWAPD(&sf->d_n_lat, 1);
+   if ( row == 0 )
+      return (col == 0) ? 0 : p[-1];
 
-   /* -------- E_LONG */
+   if ( col == 0 )
+      return p[-NTV2_TILE_DIM];
 
-   nr = fread( sf->n_e_lon,    NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->d_e_lon,    NTV2_SIZE_DBL, 1, hdr->fp);
-   NTV2_SWAPD(&sf->d_e_lon, 1);
+   return p[-1] + p[-NTV2_TILE_DIM] - p[-NTV2_TILE_DIM-1];
+}
 
-   /* -------- W_LONG */
+static void ntv2_pack_bits(
+   unsigned char *p,
+   size_t         bitpos,
+   unsigned int   z,
+   int            w)
+{
+   while ( w > 0 )
+   {
+      int sh = (int)(bitpos & 7);
+      int n  = 8 - sh;
 
-   nr = fread( sf->n_w_lon,    NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->d_w_lon,    NTV2_SIZE_DBL, 1, hdr->fp);
-   NTV2_SWAPD(&sf->d_w_lon, 1);
+      if ( n > w )
+         n = w;
 
-   /* -------- LAT_INC */
+      p[bitpos >> 3] |= (unsigned char)((z & ((1U << n) - 1)) << sh);
+      z      >>= n;
+      bitpos  += n;
+      w       -= n;
+   }
+}
 
-   nr = fread( sf->n_lat_inc,  NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->d_lat_inc,  NTV2_SIZE_DBL, 1, hdr->fp);
-   NTV2_SWAPD(&sf->d_lat_inc, 1);
+static unsigned int ntv2_unpack_bits(
+   const unsigned char *p,
+   size_t               bitpos,
+   int                  w)
+{
+   unsigned int z   = 0;
+   int          got = 0;
 
-   /* -------- LONG_INC */
+   while ( got < w )
+   {
+      int sh = (int)(bitpos & 7);
+      int n  = 8 - sh;
 
-   nr = fread( sf->n_lon_inc,  NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->d_lon_inc,  NTV2_SIZE_DBL, 1, hdr->fp);
-   NTV2_SWAPD(&sf->d_lon_inc, 1);
+      if ( n > w - got )
+         n = w - got;
 
-   /* -------- GS_COUNT */
-
-   nr = fread( sf->n_gs_count, NTV2_NAME_LEN, 1, hdr->fp);
-   nr = fread(&sf->i_gs_count, NTV2_SIZE_INT, 1, hdr->fp);
-   sf->p_gs_count = 0;
-
-   NTV2_SWAPI(&sf->i_gs_count, 1);
-   if ( sf->i_gs_count <= 0 )
-      return NTV2_ERR_INVALID_GS_COUNT;
-
-   if ( hdr->pads_present )
-      fseek(hdr->fp, NTV2_SIZE_INT, SEEK_CUR);
-
-   /* -------- check for I/O error */
-
-   if ( ferror(hdr->fp) || feof(hdr->fp) || nr != 1 )
-   {
-      return NTV2_ERR_IOERR;
+      z      |= ((unsigned int)(p[bitpos >> 3] >> sh) & ((1U << n) - 1)) << got;
+      got    += n;
+      bitpos += n;
    }
 
-   return NTV2_ERR_OK;
-}
-
-/*------------------------------------------------------------------------
- * Read a binary end record.
- *
- * The only NTv2 file I've seen that would generate an error here
- * is the file "italy/rer.gsb", which omits the end record completely.
- * Maybe we should make them an offer they can't refuse...
- */
-static int ntv2_read_er_bin(
-   NTV2_HDR      *hdr,
-   NTV2_FILE_END *er)
-{
-   size_t nr = fread(er, sizeof(*er), 1, hdr->fp);
-   return (nr == 1) ? NTV2_ERR_OK : NTV2_ERR_IOERR;
+   return z;
 }
 
 /*------------------------------------------------------------------------
- * Convert a subfile record to a ntv2-rec.
- *
- * The NTv2 specification uses the convention of positive-west /
- * negative-east (probably since Canada is all in the west).
- * However, this is backwards from the standard negative-west /
- * positive-east notation.
- *
- * Thus, when converting the sub-file records, we flip the sign of
- * the longitude-max (the east value) and the longitude-min
- * (the west value).  This way, the longitude-min (west) is less than
- * the longitude-max (east).  This may have to be rethought if an NTv2
- * file ever spans the dateline (+/-180 degrees).
+ * Compress one tile of shifts.
  *
- * However, we still have to remember that the grid-shift records
- * are written (backwards) east-to-west, and the longitude shift values
- * are positive-west/negative-east.
+ * The shifts pointer points to the first point of the tile, and the
+ * stride is the number of points in a row of the record.
+ * Returns the number of bytes used (at most NTV2_PACK_TILE_MAX).
  */
-static int ntv2_sf_to_rec(
-   NTV2_HDR     *hdr,
-   NTV2_FILE_SF *sf,
-   int           n)
+static size_t ntv2_pack_tile(
+   unsigned char    * out,
+   const NTV2_SHIFT * shifts,
+   int                stride,
+   int                nrows,
+   int                ncols,
+   double             step)
 {
-   NTV2_REC * rec = hdr->recs + n;
+   unsigned int v[NTV2_TILE_NUM];
+   size_t len = 0;
+   int coord, row, col;
 
-   ntv2_cleanup_str(hdr, rec->record_name, sf->s_sub_name, TRUE);
-   ntv2_cleanup_str(hdr, rec->parent_name, sf->s_parent,   TRUE);
-   rec->record_name[NTV2_NAME_LEN] = 0;
-   rec->parent_name[NTV2_NAME_LEN] = 0;
+   for (coord = 0; coord < 2; coord++)
+   {
+      for (row = 0; row < nrows; row++)
+      {
+         for (col = 0; col < ncols; col++)
+         {
+            v[row * NTV2_TILE_DIM + col] =
+               ntv2_pack_value(shifts[row * stride + col][coord], step);
+         }
+      }
 
-   rec->active     =  TRUE;
-   rec->parent     =  NTV2_NULL;
-   rec->sub        =  NTV2_NULL;
-   rec->next       =  NTV2_NULL;
-   rec->num_subs   =  0;
-   rec->rec_num    =  n;
+      out[len++] = (unsigned char)( v[0]        & 0xFF);
+      out[len++] = (unsigned char)((v[0] >>  8) & 0xFF);
+      out[len++] = (unsigned char)((v[0] >> 16) & 0xFF);
+      out[len++] = (unsigned char)((v[0] >> 24) & 0xFF);
 
-   rec->offset     =  ftell(hdr->fp);
-   rec->sskip      =  0;
-   rec->nskip      =  0;
-   rec->wskip      =  0;
-   rec->eskip      =  0;
+      for (row = 0; row < nrows; row++)
+      {
+         unsigned int z[NTV2_TILE_DIM];
+         unsigned int zmax = 0;
+         int n = 0;
+         int w = 0;
+         int i;
 
-   rec->shifts     =  NTV2_NULL;
-   rec->accurs     =  NTV2_NULL;
+         for (col = (row == 0) ? 1 : 0; col < ncols; col++)
+         {
+            unsigned int r = v[row * NTV2_TILE_DIM + col] -
+                             ntv2_pack_pred(v, row, col);
 
-   rec->lat_min    =  sf->d_s_lat;
-   rec->lat_min   *=  hdr->hdr_conv;
+            z[n]  = (r & 0x80000000U) ? ~(r << 1) : (r << 1);
+            zmax |= z[n++];
+         }
 
-   rec->lat_max    =  sf->d_n_lat;
-   rec->lat_max   *=  hdr->hdr_conv;
+         while ( w < 32 && (zmax >> w) != 0 )
+            w++;
 
-   rec->lat_inc    =  sf->d_lat_inc;
-   rec->lat_inc   *=  hdr->hdr_conv;
+         out[len++] = (unsigned char)w;
+         memset(out + len, 0, ((size_t)n * w + 7) / 8);
+         for (i = 0; i < n; i++)
+            ntv2_pack_bits(out + len, (size_t)i * w, z[i], w);
+         len += ((size_t)n * w + 7) / 8;
+      }
+   }
 
-   rec->lon_max    =  sf->d_e_lon;
-   rec->lon_max   *= -hdr->hdr_conv;      /* NOTE: reversing sign! */
+   return len;
+}
 
-   rec->lon_min    =  sf->d_w_lon;
-   rec->lon_min   *= -hdr->hdr_conv;      /* NOTE: reversing sign! */
+/*------------------------------------------------------------------------
+ * Decode one compressed tile into a tile-sized array of shifts.
+ */
+static void ntv2_unpack_tile(
+   NTV2_SHIFT          * shifts,
+   const unsigned char * in,
+   int                   nrows,
+   int                   ncols,
+   double                step)
+{
+   unsigned int v[NTV2_TILE_NUM];
+   int coord, row, col;
 
-   rec->lon_inc    =  sf->d_lon_inc;
-   rec->lon_inc   *=  hdr->hdr_conv;
+   for (coord = 0; coord < 2; coord++)
+   {
+      v[0] = (unsigned int)in[0]         |
+             ((unsigned int)in[1] <<  8) |
+             ((unsigned int)in[2] << 16) |
+             ((unsigned int)in[3] << 24);
+      in += 4;
 
-   rec->num        =  sf->i_gs_count;
+      for (row = 0; row < nrows; row++)
+      {
+         int    w = *in++;
+         size_t n = 0;
 
-   rec->nrows      =  ntv2_dtoi((rec->lat_max - rec->lat_min) / rec->lat_inc) + 1;
-   rec->ncols      =  ntv2_dtoi((rec->lon_max - rec->lon_min) / rec->lon_inc) + 1;
+         for (col = (row == 0) ? 1 : 0; col < ncols; col++)
+         {
+            unsigned int z = ntv2_unpack_bits(in, n++ * w, w);
+            unsigned int r = (z & 1) ? ~(z >> 1) : (z >> 1);
 
-   /* collect the min/max of all the sub-files */
+            v[row * NTV2_TILE_DIM + col] = ntv2_pack_pred(v, row, col) + r;
+         }
 
-   if ( hdr->lon_min > rec->lon_min )  hdr->lon_min = rec->lon_min;
-   if ( hdr->lat_min > rec->lat_min )  hdr->lat_min = rec->lat_min;
-   if ( hdr->lon_max < rec->lon_max )  hdr->lon_max = rec->lon_max;
-   if ( hdr->lat_max < rec->lat_max )  hdr->lat_max = rec->lat_max;
+         in += (n * w + 7) / 8;
+      }
 
-   return NTV2_ERR_OK;
+      for (row = 0; row < nrows; row++)
+      {
+         for (col = 0; col < ncols; col++)
+         {
+            shifts[row * NTV2_TILE_DIM + col][coord] =
+               ntv2_unpack_value(v[row * NTV2_TILE_DIM + col], step);
+         }
+      }
+   }
 }
 
 /*------------------------------------------------------------------------
- * Read binary header data from the file.
+ * Get the step to quantize the shifts of a record to.
+ *
+ * This is 0 (lossless) unless the object is to be quantized, and
+ * every shift is a number of steps that fits in an int.
  */
-static int ntv2_read_hdrs_bin(
-   NTV2_HDR *hdr)
+static double ntv2_pack_step(
+   const NTV2_HDR *hdr,
+   const NTV2_REC *rec)
 {
-   NTV2_FILE_OV  ov_rec;
-   NTV2_FILE_SF  sf_rec;
-   NTV2_FILE_END en_rec;
+   double step;
+   double max = 0.0;
    int i;
-   int rc;
 
-   /* -------- read in the overview record */
+   if ( !hdr->quantized || hdr->dat_conv <= 0.0 )
+      return 0.0;
 
-   rc = ntv2_read_ov_bin(hdr, &ov_rec);
-   if ( rc != NTV2_ERR_OK )
-   {
-      return rc;
-   }
+   step = NTV2_QUANT_ERROR / hdr->dat_conv;
 
-   hdr->num_parents = 0;
-   hdr->recs        = (NTV2_REC *)
-                      ntv2_memalloc(sizeof(*hdr->recs) * hdr->num_recs);
-   if ( hdr->recs == NTV2_NULL )
+   for (i = 0; i < rec->num; i++)
    {
-      return NTV2_ERR_NO_MEMORY;
+      double lat = fabs(rec->shifts[i][NTV2_COORD_LAT]);
+      double lon = fabs(rec->shifts[i][NTV2_COORD_LON]);
+
+      /* this is also false for NaNs */
+      if ( !(lat <= max) )  max = lat;
+      if ( !(lon <= max) )  max = lon;
    }
 
-   memset(hdr->recs, 0, sizeof(*hdr->recs) * hdr->num_recs);
+   if ( !(max / step < 2147483647.0) )
+      return 0.0;
 
-   /* -------- create the file record cache if wanted */
+   return step;
+}
 
-   if ( hdr->keep_orig )
-   {
-      hdr->overview = (NTV2_FILE_OV *)
-                      ntv2_memalloc(sizeof(*hdr->overview));
-      if ( hdr->overview == NTV2_NULL )
-      {
-         return NTV2_ERR_NO_MEMORY;
-      }
+/*------------------------------------------------------------------------
+ * Compress the shifts of a record that have been read into memory.
+ *
+ * The tiles are compressed twice: once to get the total size, and then
+ * into the allocated block.  The accuracies are discarded.  If there
+ * isn't enough memory, the shifts are just left uncompressed.
+ */
+static void ntv2_pack_rec(
+   NTV2_HDR *hdr,
+   NTV2_REC *rec)
+{
+   static volatile long last_id = 0;
 
-      memcpy(hdr->overview, &ov_rec, sizeof(*hdr->overview));
+   unsigned char tmp[NTV2_PACK_TILE_MAX];
+   NTV2_PACKED * packed;
+   size_t size = 0;
+   double step;
+   int ntrows = (rec->nrows + NTV2_TILE_DIM - 1) / NTV2_TILE_DIM;
+   int ntcols = (rec->ncols + NTV2_TILE_DIM - 1) / NTV2_TILE_DIM;
+   int pass, trow, tcol;
 
-      hdr->subfiles = (NTV2_FILE_SF *)
-                      ntv2_memalloc(sizeof(*hdr->subfiles) * hdr->num_recs);
-      if ( hdr->subfiles == NTV2_NULL )
-      {
-         return NTV2_ERR_NO_MEMORY;
-      }
-   }
+   ntv2_grid_free(hdr, rec->accurs);
+   rec->accurs = NTV2_NULL;
 
-   /* -------- read in all subfile records (but not the actual data)
+   if ( rec->shifts == NTV2_NULL )
+      return;
 
-      We don't read in the data now, since we may be doing
-      extent processing later, which would affect the reading
-      of the data.
-   */
+   step = ntv2_pack_step(hdr, rec);
 
-   for (i = 0; i < hdr->num_recs; i++)
+   packed = NTV2_NULL;
+   for (pass = 0; pass < 2; pass++)
    {
-      long offset;
+      size_t off = 0;
 
-      rc = ntv2_read_sf_bin(hdr, &sf_rec);
-      if ( rc != NTV2_ERR_OK )
+      for (trow = 0; trow < ntrows; trow++)
       {
-         return rc;
-      }
+         for (tcol = 0; tcol < ntcols; tcol++)
+         {
+            const NTV2_SHIFT * shifts = rec->shifts +
+                                        (trow * NTV2_TILE_DIM * rec->ncols) +
+                                        (tcol * NTV2_TILE_DIM);
+            int nrows, ncols;
 
-      if ( hdr->subfiles != NTV2_NULL )
-      {
-         memcpy(&hdr->subfiles[i], &sf_rec, sizeof(*hdr->subfiles));
+            ntv2_tile_size(rec, trow, tcol, &nrows, &ncols);
+
+            if ( packed == NTV2_NULL )
+            {
+               off += ntv2_pack_tile(tmp, shifts, rec->ncols, nrows, ncols,
+                                     step);
+            }
+            else
+            {
+               packed->index[trow * ntcols + tcol] = (unsigned int)off;
+               off += ntv2_pack_tile(packed->data + off, shifts, rec->ncols,
+                                     nrows, ncols, step);
+            }
+         }
       }
 
-      rc = ntv2_sf_to_rec(hdr, &sf_rec, i);
-      if ( rc != NTV2_ERR_OK )
+      if ( packed == NTV2_NULL )
       {
-         return rc;
+         size   = sizeof(*packed) +
+                  sizeof(*packed->index) * ntrows * ntcols +
+                  off;
+         packed = (NTV2_PACKED *)ntv2_memalloc(size);
+         if ( packed == NTV2_NULL )
+            return;
+
+#if defined(NTV2_THREAD_LOCAL)
+         packed->id     = ntv2_atomic_inc(&last_id);
+#else
+         packed->id     = ++last_id;
+#endif
+         packed->step   = step;
+         packed->ntcols = ntcols;
+         packed->size   = size;
+         packed->index  = (unsigned int *)(packed + 1);
+         packed->data   = (unsigned char *)(packed->index + ntrows * ntcols);
       }
-
-      /* skip over grid-shift records */
-      offset = hdr->recs[i].num * sizeof(NTV2_FILE_GS);
-      fseek(hdr->fp, offset, SEEK_CUR);
    }
 
-   /* -------- read in the end record
+   ntv2_grid_free(hdr, rec->shifts);
+   rec->shifts = NTV2_NULL;
+   rec->packed = packed;
+}
 
-      Note that we don't bail if we can't read the end record,
-      since it is certainly possible to use the file without it because
-      we know the number of records and thus where the end should be.
-      But we do note that the file "needs fixing" if it isn't there,
-      or if it isn't in "standard" format.
+/*------------------------------------------------------------------------
+ * Decode a compressed tile of a record.
+ */
+static void ntv2_unpack_rec_tile(
+   const NTV2_REC * rec,
+   int              trow,
+   int              tcol,
+   NTV2_SHIFT     * shifts)
+{
+   const NTV2_PACKED * packed = (const NTV2_PACKED *)rec->packed;
+   int nrows, ncols;
 
-      Interestingly enough, all the Canadian NTv2 files properly
-      zero out the filler bytes in the end record, but the name
-      field is "END xxxx" (ie "END " and four trailing garbage bytes).
-      And it's their specification!
-   */
+   ntv2_tile_size(rec, trow, tcol, &nrows, &ncols);
+   ntv2_unpack_tile(shifts,
+                    packed->data + packed->index[trow * packed->ntcols + tcol],
+                    nrows, ncols, packed->step);
+}
 
-   rc = ntv2_read_er_bin(hdr, &en_rec);
-   if ( rc == NTV2_ERR_OK )
-   {
-      if ( strncmp(en_rec.n_end, NTV2_END_NAME,  NTV2_NAME_LEN) != 0 )
-         hdr->fixed |= NTV2_FIX_END_REC_NAME_NOT_ALPHA;
+/*------------------------------------------------------------------------
+ * Read a block of data from a binary file at a given offset.
+ *
+ * The mutex is only needed if the file is read by the built-in routines
+ * and the OS doesn't have a positional read.
+ */
+static int ntv2_read_at(
+   const NTV2_HDR * hdr,
+   void           * buf,
+   size_t           len,
+   long             offset)
+{
+   size_t    nr = 0;
+   NTV2_BOOL lock;
 
-      if ( memcmp(en_rec.filler, NTV2_ALL_ZEROS, NTV2_NAME_LEN) != 0 )
-         hdr->fixed |= NTV2_FIX_END_REC_PAD_NOT_ZERO;
-   }
-   else
-   {
-      hdr->fixed |= NTV2_FIX_END_REC_NOT_FOUND;
-   }
+   if ( hdr->io.read_at == NTV2_NULL )
+      return NTV2_ERR_DATA_NOT_READ;
 
-   /* -------- adjust all pointers */
+   lock = ( !NTV2_READ_AT_IS_ATOMIC && ntv2_io_fp(hdr) != NTV2_NULL );
 
-   rc = ntv2_fix_ptrs(hdr);
-   return rc;
+   if ( lock )
+      ntv2_mutex_enter(hdr->mutex);
+
+   /* The file may have been closed meanwhile (see ntv2_write_file()). */
+   if ( hdr->io.read_at != NTV2_NULL )
+      nr = hdr->io.read_at(hdr->io.ctx, buf, len, offset);
+
+   if ( lock )
+      ntv2_mutex_leave(hdr->mutex);
+
+   return (nr == len) ? NTV2_ERR_OK : NTV2_ERR_IOERR;
 }
 
 /*------------------------------------------------------------------------
- * Mark a sub-file and all its children as inactive.
+ * Decode one row of a tile from raw grid-shift records.
  *
- * This is called if a sub-file is to be skipped due to extent processing.
+ * The raw data may not be aligned, so each record is copied out.
  */
-static int ntv2_inactivate(
-   NTV2_HDR *hdr,
-   NTV2_REC *rec,
-   int       nrecs)
+static void ntv2_tile_decode_row(
+   const NTV2_HDR * hdr,
+   NTV2_SHIFT     * shifts,
+   const void     * data,
+   int              ncols)
 {
-   if ( rec->active )
+   int col;
+
+   for (col = 0; col < ncols; col++)
    {
-      NTV2_REC *sub;
+      NTV2_FILE_GS gs;
 
-      nrecs--;
-      rec->active = FALSE;
+      memcpy(&gs, (const NTV2_FILE_GS *)data + col, sizeof(gs));
 
-      for (sub = rec->sub; sub != NTV2_NULL; sub = sub->next)
-      {
-         nrecs = ntv2_inactivate(hdr, sub, nrecs);
-      }
-   }
+      NTV2_SWAPF(&gs.f_lat_shift, 1);
+      NTV2_SWAPF(&gs.f_lon_shift, 1);
 
-   return nrecs;
+      shifts[col][NTV2_COORD_LAT] = gs.f_lat_shift;
+      shifts[col][NTV2_COORD_LON] = gs.f_lon_shift;
+   }
 }
 
 /*------------------------------------------------------------------------
- * Apply an extent to an NTv2 object.
+ * Read the shifts for one tile from a tiled file.
+ *
+ * Unless an extent has shifted the grid, a cache tile is exactly one
+ * tile in the file, so it is read with a single read.  Otherwise, each
+ * row is read in runs that stop at the edges of the file tiles.
+ * No decoding is needed, since the file is in native byte order.
  */
-static int ntv2_process_extent(
-   NTV2_HDR    *hdr,
-   NTV2_EXTENT *extent)
+static int ntv2_tile_read_til(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   NTV2_TILE      * tile)
 {
-   double wlon;
-   double slat;
-   double elon;
-   double nlat;
-   int    nrecs;
-   int    i;
-   int    rc = NTV2_ERR_OK;
-
-   if ( ntv2_extent_is_empty(extent) )
-   {
-      return NTV2_ERR_OK;
-   }
-
-   nrecs = hdr->num_recs;
-
-   /* get extent values */
+   int row0, col0, ntrows, ntcols;
+   int nrows, ncols;
+   int row;
 
-   wlon = extent->wlon;
-   slat = extent->slat;
-   elon = extent->elon;
-   nlat = extent->nlat;
+   ntv2_tile_size(rec, tile->trow, tile->tcol, &nrows, &ncols);
+   ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
 
-   /* apply the extent to all records */
+   row0 += tile->trow * NTV2_TILE_DIM;
+   col0 += tile->tcol * NTV2_TILE_DIM;
 
-   for (i = 0; i < hdr->num_recs; i++)
+   if ( NTV2_TILE_DIM == NTV2_TIL_DIM &&
+        (row0 % NTV2_TIL_DIM) == 0 && (col0 % NTV2_TIL_DIM) == 0 )
    {
-      NTV2_REC * rec = &hdr->recs[i];
-      double d;
-      int    nskip = 0;
-      int    sskip = 0;
-      int    wskip = 0;
-      int    eskip = 0;
-      int    ocols = rec->ncols;
-      int    k;
-
-      /* check if this record has already been marked as out-of-range */
-
-      if ( !rec->active )
-         continue;
-
-      /* check if this record is out-of-range */
-
-      if ( NTV2_GE(wlon, rec->lon_max) ||
-           NTV2_GE(slat, rec->lat_max) ||
-           NTV2_LE(elon, rec->lon_min) ||
-           NTV2_LE(nlat, rec->lat_min) )
-      {
-         nrecs = ntv2_inactivate(hdr, rec, nrecs);
-         continue;
-      }
+      return ntv2_read_at(hdr, tile->shifts,
+                          sizeof(NTV2_SHIFT) * NTV2_TILE_DIM * nrows,
+                          ntv2_til_offset(rec, tile->tcol * NTV2_TILE_DIM,
+                                               tile->trow * NTV2_TILE_DIM));
+   }
 
-      /* check if this extent is a subset of the record */
+   for (row = 0; row < nrows; row++)
+   {
+      int col = 0;
 
-      if ( NTV2_GT(wlon, rec->lon_min) ||
-           NTV2_GT(slat, rec->lat_min) ||
-           NTV2_LT(elon, rec->lon_max) ||
-           NTV2_LT(nlat, rec->lat_max) )
+      while ( col < ncols )
       {
-         /* Force our extent to be a proper multiple of the deltas.
-            We move the extent edges out to the next delta
-            multiple to do this.
-
-            Note that the deltas we use are the parent's deltas if
-            we have a parent.  This is to make sure we stay lined
-            up on a parent grid line.
-         */
-         double lat_inc = rec->lat_inc;
-         double lon_inc = rec->lon_inc;
-         int    lat_mul = 1;
-         int    lon_mul = 1;
+         int n  = NTV2_TIL_DIM - ((col0 + col) % NTV2_TIL_DIM);
+         int rc;
 
-         if ( rec->parent != NTV2_NULL )
-         {
-            lat_inc = rec->parent->lat_inc;
-            lon_inc = rec->parent->lon_inc;
-            lat_mul = ntv2_dtoi(lat_inc / rec->lat_inc);
-            lon_mul = ntv2_dtoi(lon_inc / rec->lon_inc);
-         }
+         if ( n > ncols - col )
+            n = ncols - col;
 
-         if ( NTV2_GT(wlon, rec->lon_min) )
-         {
-            d = (wlon - rec->lon_min) / lon_inc;
-            k = (int)floor(d) * lon_mul;
+         rc = ntv2_read_at(hdr, tile->shifts + (row * NTV2_TILE_DIM) + col,
+                           sizeof(NTV2_SHIFT) * n,
+                           ntv2_til_offset(rec,
+                                           tile->tcol * NTV2_TILE_DIM + col,
+                                           tile->trow * NTV2_TILE_DIM + row));
+         if ( rc != NTV2_ERR_OK )
+            return rc;
 
-            if ( k > 0 )
-            {
-               wskip = k;
-               rec->lon_min += (k * rec->lon_inc);
-               rec->ncols   -= k;
-            }
-         }
+         col += n;
+      }
+   }
 
-         if ( NTV2_LT(elon, rec->lon_max) )
-         {
-            d = (rec->lon_max - elon) / lon_inc;
-            k = (int)floor(d) * lon_mul;
+   return NTV2_ERR_OK;
+}
 
-            if ( k > 0 )
-            {
-               eskip = k;
-               rec->lon_max -= (k * rec->lon_inc);
-               rec->ncols   -= k;
-            }
-         }
+/*------------------------------------------------------------------------
+ * Read the shifts for one tile from the file (or decode them).
+ *
+ * Each row of the tile is a contiguous run of grid-shift records,
+ * so it is read with a single read.
+ */
+static int ntv2_tile_read(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   NTV2_TILE      * tile)
+{
+   NTV2_FILE_GS gs[NTV2_TILE_DIM];
+   int nrows, ncols;
+   int row;
 
-         if ( NTV2_GT(slat, rec->lat_min) )
-         {
-            d = (slat - rec->lat_min) / lat_inc;
-            k = (int)floor(d) * lat_mul;
+   if ( rec->packed != NTV2_NULL )
+   {
+      ntv2_unpack_rec_tile(rec, tile->trow, tile->tcol, tile->shifts);
+      return NTV2_ERR_OK;
+   }
 
-            if ( k > 0 )
-            {
-               sskip = k;
-               rec->lat_min += (k * rec->lat_inc);
-               rec->nrows   -= k;
-            }
-         }
+   if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+   {
+      return ntv2_tile_read_til(hdr, rec, tile);
+   }
 
-         if ( NTV2_LT(nlat, rec->lat_max) )
-         {
-            d = (rec->lat_max - nlat) / lat_inc;
-            k = (int)floor(d) * lat_mul;
+   ntv2_tile_size(rec, tile->trow, tile->tcol, &nrows, &ncols);
 
-            if ( k > 0 )
-            {
-               nskip = k;
-               rec->lat_max -= (k * rec->lat_inc);
-               rec->nrows   -= k;
-            }
-         }
+   for (row = 0; row < nrows; row++)
+   {
+      int rc = ntv2_read_at(hdr, gs, sizeof(*gs) * ncols,
+                            ntv2_data_offset(rec,
+                                             tile->tcol * NTV2_TILE_DIM,
+                                             tile->trow * NTV2_TILE_DIM + row));
+      if ( rc != NTV2_ERR_OK )
+         return rc;
 
-         /* Check if there is any data left.
-            I think that this will always be the case, but it is
-            easier to do the check than to think out all
-            possible scenarios.  Also, better safe than sorry.
-         */
+      ntv2_tile_decode_row(hdr, tile->shifts + (row * NTV2_TILE_DIM),
+                           gs, ncols);
+   }
 
-         if ( rec->ncols <= 0 || rec->nrows <= 0 )
-         {
-            nrecs = ntv2_inactivate(hdr, rec, nrecs);
-            continue;
-         }
+   return NTV2_ERR_OK;
+}
 
-         /* check if this record has changed */
+/*------------------------------------------------------------------------
+ * Find a tile in a shard (the shard must be locked).
+ */
+static int ntv2_cache_find(
+   const NTV2_SHARD * shard,
+   unsigned int       h,
+   int                rec_num,
+   int                trow,
+   int                tcol)
+{
+   int n;
 
-         if ( nskip > 0 || sskip > 0 || wskip > 0 || eskip > 0 )
-         {
-            rec->num   = (rec->ncols * rec->nrows);
-            rec->sskip = (sskip * sizeof(NTV2_FILE_GS)) * ocols;
-            rec->nskip = (nskip * sizeof(NTV2_FILE_GS)) * ocols;
-            rec->wskip = (wskip * sizeof(NTV2_FILE_GS));
-            rec->eskip = (eskip * sizeof(NTV2_FILE_GS));
+   for (n = shard->chains[h % (unsigned int)shard->num_tiles];
+        n >= 0;
+        n = shard->tiles[n].next)
+   {
+      const NTV2_TILE * tile = &shard->tiles[n];
 
-            /* adjust the subfile record if we cached it */
-            if ( hdr->subfiles != NTV2_NULL )
-            {
-               NTV2_FILE_SF * sf = &hdr->subfiles[i];
+      if ( tile->rec_num == rec_num &&
+           tile->trow    == trow    &&
+           tile->tcol    == tcol )
+      {
+         break;
+      }
+   }
 
-               sf->i_gs_count = rec->num;
+   return n;
+}
 
-               sf->d_s_lat =  (rec->lat_min / hdr->hdr_conv);
-               sf->d_n_lat =  (rec->lat_max / hdr->hdr_conv);
+/*------------------------------------------------------------------------
+ * Get a free tile in a shard (the shard must be locked).
+ *
+ * The CLOCK hand is advanced to find a victim tile (one not recently
+ * used), which is unlinked from its hash chain.
+ */
+static int ntv2_cache_evict(
+   NTV2_SHARD * shard)
+{
+   NTV2_TILE * tile;
+   int n;
 
-               /* Note the sign changes here! */
+   for (;;)
+   {
+      n    = shard->hand;
+      tile = &shard->tiles[n];
+      shard->hand = (shard->hand + 1) % shard->num_tiles;
 
-               sf->d_e_lon = -(rec->lon_max / hdr->hdr_conv);
-               sf->d_w_lon = -(rec->lon_min / hdr->hdr_conv);
-            }
-         }
-      }
+      if ( !tile->used )
+         break;
+      tile->used = FALSE;
    }
 
-   /* check if any records have been deleted */
-
-   if ( nrecs != hdr->num_recs )
+   if ( tile->rec_num >= 0 )
    {
-      /* error if no records are left */
-      if ( nrecs == 0 )
-         return NTV2_ERR_INVALID_EXTENT;
+      unsigned int h = ntv2_tile_hash(tile->rec_num, tile->trow, tile->tcol);
+      int * pn;
 
-      /* fix number of files in overview record if present */
-      if ( hdr->overview != NTV2_NULL )
-         hdr->overview->i_num_file = nrecs;
+      pn = &shard->chains[h % (unsigned int)shard->num_tiles];
+      while ( *pn != n )
+         pn = &shard->tiles[*pn].next;
+      *pn = tile->next;
 
-      /* readjust all pointers */
-      rc = ntv2_fix_ptrs(hdr);
+      tile->rec_num = -1;
    }
 
-   return rc;
+   return n;
 }
 
 /*------------------------------------------------------------------------
- * Read in binary shift data for all sub-files.
+ * Link a filled-in tile into its hash chain (the shard must be locked).
  */
-static int ntv2_read_data_bin(
-   NTV2_HDR *hdr)
+static void ntv2_cache_link(
+   NTV2_SHARD * shard,
+   unsigned int h,
+   int          n,
+   int          rec_num)
 {
-   int i;
+   NTV2_TILE * tile  = &shard->tiles[n];
+   int         chain = (int)(h % (unsigned int)shard->num_tiles);
 
-   for (i = 0; i < hdr->num_recs; i++)
-   {
-      NTV2_REC * rec = &hdr->recs[i];
-      int row;
-      int col;
-      int j;
+   tile->rec_num        = rec_num;
+   tile->next           = shard->chains[chain];
+   shard->chains[chain] = n;
+}
 
-      if ( !rec->active )
-         continue;
+#define NTV2_CACHE_SHARD(cache,h) \
+   ( &(cache)->shards[((h) >> 8) % (unsigned int)(cache)->num_shards] )
 
-      /* allocate our arrays */
+/*------------------------------------------------------------------------
+ * Get a shift value through the tile cache.
+ *
+ * The value is copied out while the shard is locked, so the tile may
+ * safely be evicted by another thread afterwards.
+ *
+ * If the tile is not in the cache, it is read with the shard unlocked,
+ * so that threads needing other tiles of the shard don't wait on the
+ * read.  Another thread may read the same tile meanwhile, so we look
+ * for it again before putting it into a free tile.
+ */
+static int ntv2_cache_get_shift(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type,
+   double         * pshift)
+{
+   NTV2_CACHE * cache = (NTV2_CACHE *)hdr->cache;
+   NTV2_SHARD * shard;
+   NTV2_TILE    tile;
+   unsigned int h;
+   int trow = irow / NTV2_TILE_DIM;
+   int tcol = icol / NTV2_TILE_DIM;
+   int i    = (irow % NTV2_TILE_DIM) * NTV2_TILE_DIM + (icol % NTV2_TILE_DIM);
+   int rc;
+   int n;
 
-      {
-         rec->shifts = (NTV2_SHIFT *)
-                       ntv2_memalloc(sizeof(*rec->shifts) * rec->num);
-         if ( rec->shifts == NTV2_NULL )
-            return NTV2_ERR_NO_MEMORY;
-      }
+   h     = ntv2_tile_hash(rec->rec_num, trow, tcol);
+   shard = NTV2_CACHE_SHARD(cache, h);
 
-      if ( hdr->keep_orig )
+   ntv2_mutex_enter(shard->mutex);
+   {
+      n = ntv2_cache_find(shard, h, rec->rec_num, trow, tcol);
+      if ( n >= 0 )
       {
-         rec->accurs = (NTV2_SHIFT *)
-                       ntv2_memalloc(sizeof(*rec->accurs) * rec->num);
-         if ( rec->accurs == NTV2_NULL )
-            return NTV2_ERR_NO_MEMORY;
+         shard->tiles[n].used = TRUE;
+         *pshift = shard->tiles[n].shifts[i][coord_type];
       }
+   }
+   ntv2_mutex_leave(shard->mutex);
 
-      /* position to start of data to read */
+   if ( n >= 0 )
+      return NTV2_ERR_OK;
 
-      fseek(hdr->fp, rec->offset + rec->sskip, SEEK_SET);
+   tile.trow = trow;
+   tile.tcol = tcol;
+   rc = ntv2_tile_read(hdr, rec, &tile);
+   if ( rc != NTV2_ERR_OK )
+      return rc;
 
-      /* now read the data */
-      /* Remember that data in a latitude row goes East to West! */
+   *pshift = tile.shifts[i][coord_type];
 
-      j = 0;
-      for (row = 0; row < rec->nrows; row++)
+   ntv2_mutex_enter(shard->mutex);
+   {
+      n = ntv2_cache_find(shard, h, rec->rec_num, trow, tcol);
+      if ( n < 0 )
       {
-         if ( rec->eskip > 0 )
-            fseek(hdr->fp, rec->eskip, SEEK_CUR);
-
-         for (col = 0; col < rec->ncols; col++)
-         {
-            NTV2_FILE_GS gs;
-            size_t nr;
+         n = ntv2_cache_evict(shard);
 
-            nr = fread(&gs, sizeof(gs), 1, hdr->fp);
-            if ( nr != 1 )
-               return NTV2_ERR_IOERR;
-
-            NTV2_SWAPF(&gs.f_lat_shift, 1);
-            NTV2_SWAPF(&gs.f_lon_shift, 1);
+         shard->tiles[n].trow = trow;
+         shard->tiles[n].tcol = tcol;
+         memcpy(shard->tiles[n].shifts, tile.shifts, sizeof(tile.shifts));
+         ntv2_cache_link(shard, h, n, rec->rec_num);
+      }
 
-            rec->shifts[j][NTV2_COORD_LAT] = gs.f_lat_shift;
-            rec->shifts[j][NTV2_COORD_LON] = gs.f_lon_shift;
+      shard->tiles[n].used = TRUE;
+   }
+   ntv2_mutex_leave(shard->mutex);
 
-            if ( rec->accurs != NTV2_NULL )
-            {
-               NTV2_SWAPF(&gs.f_lat_accuracy, 1);
-               NTV2_SWAPF(&gs.f_lon_accuracy, 1);
+   return NTV2_ERR_OK;
+}
 
-               rec->accurs[j][NTV2_COORD_LAT] = gs.f_lat_accuracy;
-               rec->accurs[j][NTV2_COORD_LON] = gs.f_lon_accuracy;
-            }
+/*------------------------------------------------------------------------
+ * Check whether a tile is in the cache.
+ */
+static NTV2_BOOL ntv2_cache_has(
+   const NTV2_HDR * hdr,
+   int              rec_num,
+   int              trow,
+   int              tcol)
+{
+   NTV2_CACHE * cache = (NTV2_CACHE *)hdr->cache;
+   NTV2_SHARD * shard;
+   unsigned int h;
+   int n;
 
-            j++;
-         }
+   h     = ntv2_tile_hash(rec_num, trow, tcol);
+   shard = NTV2_CACHE_SHARD(cache, h);
 
-         if ( rec->wskip > 0 )
-            fseek(hdr->fp, rec->wskip, SEEK_CUR);
-      }
+   ntv2_mutex_enter(shard->mutex);
+   {
+      n = ntv2_cache_find(shard, h, rec_num, trow, tcol);
    }
+   ntv2_mutex_leave(shard->mutex);
 
-   return NTV2_ERR_OK;
+   return (n >= 0);
 }
 
 /*------------------------------------------------------------------------
- * Load a binary NTv2 file into memory.
+ * Add a tile to the cache from raw grid-shift records already read in.
  *
- * This routine combines all the lower-level read routines into one.
+ * The rows array points to the raw data for each row of the tile.
+ * Nothing is done if the tile is already there.
  */
-static NTV2_HDR * ntv2_load_file_bin(
-   const char *  ntv2file,
-   NTV2_BOOL     keep_orig,
-   NTV2_BOOL     read_data,
-   NTV2_EXTENT * extent,
-   int *         prc)
+static void ntv2_cache_put(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              trow,
+   int              tcol,
+   const void     * rows[])
 {
-   NTV2_HDR * hdr = NTV2_NULL;
-   int rc = NTV2_ERR_OK;
-
-   hdr = ntv2_create(ntv2file, NTV2_FILE_TYPE_BIN, prc);
-   if ( hdr == NTV2_NULL )
-   {
-      return NTV2_NULL;
-   }
-
-   hdr->keep_orig      = keep_orig;
+   NTV2_CACHE * cache = (NTV2_CACHE *)hdr->cache;
+   NTV2_SHARD * shard;
+   unsigned int h;
+   int nrows, ncols;
+   int n;
 
-   if ( rc == NTV2_ERR_OK )
-   {
-      rc = ntv2_read_hdrs_bin(hdr);
-   }
+   ntv2_tile_size(rec, trow, tcol, &nrows, &ncols);
 
-   if ( rc == NTV2_ERR_OK && extent != NTV2_NULL )
-   {
-      rc = ntv2_process_extent(hdr, extent);
-   }
+   h     = ntv2_tile_hash(rec->rec_num, trow, tcol);
+   shard = NTV2_CACHE_SHARD(cache, h);
 
-   if ( rc != NTV2_ERR_OK )
-   {
-      fclose(hdr->fp);
-      hdr->fp = NTV2_NULL;
-   }
-   else
+   ntv2_mutex_enter(shard->mutex);
    {
-      if ( read_data )
+      n = ntv2_cache_find(shard, h, rec->rec_num, trow, tcol);
+      if ( n < 0 )
       {
-         rc = ntv2_read_data_bin(hdr);
+         NTV2_TILE * tile;
+         int row;
 
-         /* done with the file whether successful or not */
-         fclose(hdr->fp);
-         hdr->fp = NTV2_NULL;
-      }
-      else
-      {
-         if ( hdr->file_type == NTV2_FILE_TYPE_BIN )
-         {
-            hdr->mutex = (void *)ntv2_mutex_create();
-         }
-         else
+         n    = ntv2_cache_evict(shard);
+         tile = &shard->tiles[n];
+
+         tile->trow = trow;
+         tile->tcol = tcol;
+         for (row = 0; row < nrows; row++)
          {
-            /* No reading on-the-fly if it's an ascii file. */
-            fclose(hdr->fp);
-            hdr->fp = NTV2_NULL;
+            ntv2_tile_decode_row(hdr, tile->shifts + (row * NTV2_TILE_DIM),
+                                 rows[row], ncols);
          }
-      }
 
+         ntv2_cache_link(shard, h, n, rec->rec_num);
+      }
    }
-
-   *prc = rc;
-   return hdr;
+   ntv2_mutex_leave(shard->mutex);
 }
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 ascii read routines                                                  */
-/* ------------------------------------------------------------------------- */
-
-#define RT(n)    if ( ntv2_read_toks(hdr->fp, &tok, n) <= 0 ) \
-                    return NTV2_ERR_UNEXPECTED_EOF
-
-#define TOK(i)   tok.toks[i]
-
 /*------------------------------------------------------------------------
- * Read a ascii overview record.
+ * Set the size of the tile cache.
  */
-static int ntv2_read_ov_asc(
-   NTV2_HDR     *hdr,
-   NTV2_FILE_OV *ov)
+int ntv2_set_cache_size(
+   NTV2_HDR *hdr,
+   size_t    nbytes)
 {
-   NTV2_TOKEN tok;
-
-   /* -------- NUM_OREC */
-
-   RT(2);
-   ntv2_strcpy_pad(ov->n_num_orec,  TOK(0));
-   ov->i_num_orec =            atoi(TOK(1));
-   ov->p_num_orec = 0;
+   if ( hdr == NTV2_NULL )
+      return NTV2_ERR_NULL_HDR;
 
-   if ( ov->i_num_orec != 11 )
-      return NTV2_ERR_INVALID_NUM_OREC;
+   ntv2_cache_delete((NTV2_CACHE *)hdr->cache);
+   hdr->cache = NTV2_NULL;
 
-   /* -------- NUM_SREC */
+   /* A cache is only useful if data is read from the file on-the-fly
+      or is kept compressed (and each thread doesn't decode its own). */
+   if ( hdr->data_mode == NTV2_DATA_IN_MEMORY ||
+        (hdr->data_mode != NTV2_DATA_COMPRESSED &&
+         (hdr->io.read_at == NTV2_NULL ||
+          hdr->file_type == NTV2_FILE_TYPE_ASC)) )
+   {
+      return NTV2_ERR_OK;
+   }
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_num_srec,  TOK(0));
-   ov->i_num_srec =            atoi(TOK(1));
-   ov->p_num_srec = 0;
+#if defined(NTV2_THREAD_LOCAL)
+   if ( hdr->data_mode == NTV2_DATA_COMPRESSED )
+      return NTV2_ERR_OK;
+#endif
 
-   if ( ov->i_num_srec != 11 )
-      return NTV2_ERR_INVALID_NUM_SREC;
+   if ( nbytes > 0 )
+   {
+      hdr->cache = (void *)ntv2_cache_create(nbytes);
+      if ( hdr->cache == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+   }
 
-   /* -------- NUM_FILE */
+   return NTV2_ERR_OK;
+}
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_num_file,  TOK(0));
-   ov->i_num_file =            atoi(TOK(1));
-   ov->p_num_file = 0;
+/*------------------------------------------------------------------------
+ * Determine whether the data for batches of points can be fetched
+ * ahead of time in a given way.
+ */
+static NTV2_BOOL ntv2_fetch_supported(
+   const NTV2_HDR *hdr,
+   int             mode)
+{
+   void * ring;
 
-   if ( ov->i_num_file <= 0 )
-      return NTV2_ERR_INVALID_NUM_FILE;
-   hdr->num_recs = ov->i_num_file;
+   if ( mode == NTV2_FETCH_NONE )
+      return TRUE;
 
-   /* -------- GS_TYPE */
+   /* Tiles are only fetched when read from a binary file on-the-fly. */
+   if ( hdr->data_mode != NTV2_DATA_HDRS_ONLY ||
+        hdr->file_type != NTV2_FILE_TYPE_BIN  ||
+        hdr->io.read_at == NTV2_NULL )
+   {
+      return FALSE;
+   }
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_gs_type,   TOK(0));
-   ntv2_strcpy_pad(ov->s_gs_type,   TOK(1));
+   if ( mode == NTV2_FETCH_READ )
+      return TRUE;
 
-   /* -------- VERSION */
+   /* Asynchronous reads need the file descriptor, and a ring
+      (which needs the build and the kernel to support it). */
+   if ( ntv2_io_fp(hdr) == NTV2_NULL )
+      return FALSE;
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_version,   TOK(0));
-   ntv2_strcpy_pad(ov->s_version,   TOK(1));
+   ring = ntv2_ring_create(1);
+   if ( ring == NTV2_NULL )
+      return FALSE;
+   ntv2_ring_delete(ring);
 
-   /* -------- SYSTEM_F */
+   return TRUE;
+}
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_system_f,  TOK(0));
-   ntv2_strcpy_pad(ov->s_system_f,  TOK(1));
+/*------------------------------------------------------------------------
+ * Set how the data for batches of points is fetched ahead of time.
+ */
+int ntv2_set_fetch_mode(
+   NTV2_HDR *hdr,
+   int       mode)
+{
+   if ( hdr == NTV2_NULL )
+      return NTV2_ERR_NULL_HDR;
 
-   /* -------- SYSTEM_T */
+   if ( mode != NTV2_FETCH_NONE &&
+        mode != NTV2_FETCH_READ &&
+        mode != NTV2_FETCH_ASYNC )
+   {
+      return NTV2_ERR_INVALID_ARG;
+   }
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_system_t,  TOK(0));
-   ntv2_strcpy_pad(ov->s_system_t,  TOK(1));
+   if ( !ntv2_fetch_supported(hdr, mode) )
+      return NTV2_ERR_NOT_SUPPORTED;
 
-   /* -------- MAJOR_F */
+   hdr->fetch_mode = mode;
+   return NTV2_ERR_OK;
+}
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_major_f,   TOK(0));
-   ov->d_major_f =        ntv2_atod(TOK(1));
+/* ------------------------------------------------------------------------- */
+/* NTv2 common routines                                                      */
+/* ------------------------------------------------------------------------- */
 
-   /* -------- MINOR_F */
+/*------------------------------------------------------------------------
+ * Determine the file type of a name
+ *
+ * This is done solely by checking the filename extension.
+ * No examination of the file contents (if any) is done.
+ */
+int ntv2_filetype(const char *ntv2file)
+{
+   const char *ext;
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_minor_f,   TOK(0));
-   ov->d_minor_f =        ntv2_atod(TOK(1));
+   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
+      return NTV2_FILE_TYPE_UNK;
 
-   /* -------- MAJOR_T */
+   ext = strrchr(ntv2file, '.');
+   if ( ext != NTV2_NULL )
+   {
+      ext++;
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_major_t,   TOK(0));
-   ov->d_major_t =        ntv2_atod(TOK(1));
+      if ( ntv2_strcmp_i(ext, NTV2_FILE_BIN_EXTENSION) == 0 )
+         return NTV2_FILE_TYPE_BIN;
 
-   /* -------- MINOR_T */
+      if ( ntv2_strcmp_i(ext, NTV2_FILE_ASC_EXTENSION) == 0 )
+         return NTV2_FILE_TYPE_ASC;
 
-   RT(2);
-   ntv2_strcpy_pad(ov->n_minor_t,   TOK(0));
-   ov->d_minor_t =        ntv2_atod(TOK(1));
+      if ( ntv2_strcmp_i(ext, NTV2_FILE_TIL_EXTENSION) == 0 )
+         return NTV2_FILE_TYPE_TIL;
+   }
 
-   /* -------- get the conversion */
+   return NTV2_FILE_TYPE_UNK;
+}
 
-   ntv2_cleanup_str(hdr, hdr->gs_type, ov->s_gs_type, FALSE);
+/*------------------------------------------------------------------------
+ * Create an empty NTv2 struct, and open the file.
+ *
+ * If a buffer or I/O routines are given, the file is read from them
+ * instead.
+ */
+static NTV2_HDR * ntv2_create(
+   const char *    ntv2file,
+   const void *    buf,
+   size_t          len,
+   const NTV2_IO * io,
+   int             type,
+   int *           prc)
+{
+   NTV2_HDR * hdr;
 
-   if      ( strncmp(hdr->gs_type, "SECONDS ", NTV2_NAME_LEN) == 0 )
+   hdr = (NTV2_HDR *)ntv2_memalloc(sizeof(*hdr));
+   if ( hdr == NTV2_NULL )
    {
-      hdr->hdr_conv = ( 1.0 / 3600.0 );
-      hdr->dat_conv = ( 1.0          );
+      if ( io != NTV2_NULL && io->close != NTV2_NULL )
+         io->close(io->ctx);
+      *prc = NTV2_ERR_NO_MEMORY;
+      return NTV2_NULL;
    }
-   else if ( strncmp(hdr->gs_type, "MINUTES ", NTV2_NAME_LEN) == 0 )
+
+   memset(hdr, 0, sizeof(*hdr));
+
+   strcpy(hdr->path, ntv2file);
+   hdr->file_type = type;
+   hdr->lon_min   =  360.0;
+   hdr->lat_min   =   90.0;
+   hdr->lon_max   = -360.0;
+   hdr->lat_max   =  -90.0;
+
+   if ( buf != NTV2_NULL )
    {
-      hdr->hdr_conv = ( 1.0 / 60.0   );
-      hdr->dat_conv = ( 60.0         );
+      hdr->map_data  = (const unsigned char *)buf;
+      hdr->map_size  = len;
+      hdr->map_owned = FALSE;
    }
-   else if ( strncmp(hdr->gs_type, "DEGREES ", NTV2_NAME_LEN) == 0 )
+   else if ( io != NTV2_NULL )
    {
-      hdr->hdr_conv = ( 1.0          );
-      hdr->dat_conv = ( 3600.0       );
+      hdr->io = *io;
    }
    else
    {
-      return NTV2_ERR_INVALID_GS_TYPE;
+      FILE * fp = fopen(hdr->path, "rb");
+      if ( fp == NTV2_NULL )
+      {
+         ntv2_memdealloc(hdr);
+         *prc = NTV2_ERR_CANNOT_OPEN_FILE;
+         return NTV2_NULL;
+      }
+
+      hdr->io.ctx     = fp;
+      hdr->io.read_at = ntv2_io_file_read_at;
+      hdr->io.size    = ntv2_io_file_size;
+      hdr->io.close   = ntv2_io_file_close;
    }
 
-   return NTV2_ERR_OK;
+   hdr->mutex = ntv2_mutex_create();
+
+   *prc = NTV2_ERR_OK;
+   return hdr;
 }
 
 /*------------------------------------------------------------------------
- * Read a ascii subfile record.
+ * Delete a NTv2 object
  */
-static int ntv2_read_sf_asc(
-   NTV2_HDR     *hdr,
-   NTV2_FILE_SF *sf)
+void ntv2_delete(NTV2_HDR *hdr)
 {
-   NTV2_TOKEN tok;
+   if ( hdr != NTV2_NULL )
+   {
+      int i;
 
-   /* -------- SUB_NAME */
+      ntv2_io_close(hdr);
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_sub_name,  TOK(0));
-   ntv2_strcpy_pad(sf->s_sub_name,  TOK(1));
+      if ( hdr->mutex != NTV2_NULL )
+      {
+         ntv2_mutex_delete(hdr->mutex);
+      }
 
-   /* -------- PARENT */
+      if ( hdr->map_data != NTV2_NULL && hdr->map_owned )
+      {
+         ntv2_unmap_file((void *)hdr->map_data, hdr->map_size);
+      }
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_parent,    TOK(0));
-   ntv2_strcpy_pad(sf->s_parent,    TOK(1));
+      ntv2_cache_delete((NTV2_CACHE *)hdr->cache);
 
-   /* -------- CREATED */
+      for (i = 0; i < hdr->num_recs; i++)
+      {
+         ntv2_grid_free(hdr, hdr->recs[i].shifts);
+         ntv2_grid_free(hdr, hdr->recs[i].accurs);
+         ntv2_memdealloc(hdr->recs[i].packed);
+      }
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_created,   TOK(0));
-   ntv2_strcpy_pad(sf->s_created,   TOK(1));
+      if ( hdr->shm_data != NTV2_NULL )
+      {
+         ntv2_unmap_file((void *)hdr->shm_data, hdr->shm_size);
+      }
 
-   /* -------- UPDATED */
+      if ( hdr->arena != NTV2_NULL )
+      {
+         /* This struct is in the arena, so this must be done last. */
+         void * arena = hdr->arena;
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_updated,   TOK(0));
-   ntv2_strcpy_pad(sf->s_updated,   TOK(1));
+         hdr->arena = NTV2_NULL;
+         ntv2_grid_free(hdr, arena);
+      }
+      else
+      {
+         ntv2_memdealloc(hdr->overview);
+         ntv2_memdealloc(hdr->subfiles);
 
-   /* -------- S_LAT */
+         ntv2_memdealloc(hdr->recs);
+         ntv2_memdealloc(hdr);
+      }
+   }
+}
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_s_lat,     TOK(0));
-   sf->d_s_lat =          ntv2_atod(TOK(1));
+/*------------------------------------------------------------------------
+ * Determine whether the accuracies are read in along with the shifts.
+ *
+ * Accuracies are only wanted if the original data is kept, and even then
+ * they are left in the file and read when asked for, since most uses
+ * only need the shifts.  The exception is data copied out of a caller's
+ * buffer, which isn't kept.
+ */
+static NTV2_BOOL ntv2_read_accurs(
+   const NTV2_HDR *hdr)
+{
+   return ( hdr->keep_orig && hdr->io.read_at == NTV2_NULL );
+}
 
-   /* -------- N_LAT */
+/*------------------------------------------------------------------------
+ * Get the next record in traversal order.
+ *
+ * This is the order in which records are looked at when finding the
+ * record a point is in: each parent followed by its sub-files, depth
+ * first.  Use hdr->first_parent to start.
+ */
+static NTV2_REC * ntv2_next_rec(
+   const NTV2_REC *rec)
+{
+   if ( rec->sub != NTV2_NULL )
+      return rec->sub;
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_n_lat,     TOK(0));
-   sf->d_n_lat =          ntv2_atod(TOK(1));
+   while ( rec != NTV2_NULL && rec->next == NTV2_NULL )
+      rec = rec->parent;
 
-   /* -------- E_LONG */
+   return (rec == NTV2_NULL) ? NTV2_NULL : rec->next;
+}
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_e_lon,     TOK(0));
-   sf->d_e_lon =          ntv2_atod(TOK(1));
+/*------------------------------------------------------------------------
+ * Move an NTv2 object into an arena.
+ *
+ * This is called once the headers have been read.  The arena is sized
+ * to hold the object, its records, and the grid arrays of all active
+ * records, and the grid arrays are then allocated from it in traversal
+ * order (as long as they are read in that order).  Any arrays already
+ * read in are moved into it.
+ *
+ * The new object is returned, and the old one is freed.  If there isn't
+ * enough memory, NULL is returned and the old object is left as it is.
+ */
+#define NTV2_RELOC(p)  if ( (p) != NTV2_NULL ) \
+                          (p) = rep->recs + ((p) - hdr->recs)
 
-   /* -------- W_LONG */
+static NTV2_HDR * ntv2_arena_make(
+   NTV2_HDR *hdr)
+{
+   size_t       recs_size = sizeof(*hdr->recs) * hdr->num_recs;
+   size_t       ov_size   = 0;
+   size_t       sf_size   = 0;
+   size_t       hdr_size;
+   size_t       data_size = 0;
+   NTV2_ARENA * arena;
+   NTV2_HDR *   rep;
+   NTV2_REC *   rec;
+   unsigned char * p;
+   int i;
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_w_lon,     TOK(0));
-   sf->d_w_lon =          ntv2_atod(TOK(1));
+   if ( hdr->overview != NTV2_NULL )
+      ov_size = sizeof(*hdr->overview);
+   if ( hdr->subfiles != NTV2_NULL )
+      sf_size = sizeof(*hdr->subfiles) * hdr->num_recs;
 
-   /* -------- LAT_INC */
+   hdr_size = NTV2_LINE_ROUND(sizeof(*arena)) +
+              NTV2_LINE_ROUND(sizeof(*hdr))   +
+              NTV2_LINE_ROUND(recs_size)      +
+              NTV2_LINE_ROUND(ov_size)        +
+              NTV2_LINE_ROUND(sf_size);
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_lat_inc,   TOK(0));
-   sf->d_lat_inc =        ntv2_atod(TOK(1));
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      rec = &hdr->recs[i];
+      if ( rec->active )
+      {
+         size_t size = NTV2_LINE_ROUND(sizeof(NTV2_SHIFT) * rec->num);
 
-   /* -------- LONG_INC */
+         data_size += size;
+         if ( rec->accurs != NTV2_NULL || ntv2_read_accurs(hdr) )
+            data_size += size;
+      }
+   }
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_lon_inc,   TOK(0));
-   sf->d_lon_inc =        ntv2_atod(TOK(1));
+   /* This may not start on a cache line, so allow for aligning it. */
+   p = (unsigned char *)ntv2_grid_alloc(hdr, NTV2_CACHE_LINE +
+                                             hdr_size + data_size);
+   if ( p == NTV2_NULL )
+      return NTV2_NULL;
+   hdr->alloc.arena_bytes = NTV2_CACHE_LINE + hdr_size + data_size;
 
-   /* -------- GS_COUNT */
+   arena = (NTV2_ARENA *)p;
+   p += NTV2_LINE_ROUND(sizeof(*arena));
+   p += (NTV2_CACHE_LINE - ((size_t)p % NTV2_CACHE_LINE)) % NTV2_CACHE_LINE;
 
-   RT(2);
-   ntv2_strcpy_pad(sf->n_gs_count,  TOK(0));
-   sf->i_gs_count =            atoi(TOK(1));
-   sf->p_gs_count = 0;
+   /* -------- copy the object and its records into it */
 
-   return NTV2_ERR_OK;
-}
+   rep = (NTV2_HDR *)p;
+   p  += NTV2_LINE_ROUND(sizeof(*hdr));
+   memcpy(rep, hdr, sizeof(*rep));
 
-/*------------------------------------------------------------------------
- * Read in ascii shift data
- *
- * Note that it is OK if only shift data is on a line (i.e. no
- * accuracy data).  In that case, the accuracies are set to 0.
- */
-static int ntv2_read_data_asc(
-   NTV2_HDR *hdr,
-   NTV2_REC *rec,
-   NTV2_BOOL read_data)
-{
-   NTV2_TOKEN tok;
-   int i;
+   rep->recs = (NTV2_REC *)p;
+   p  += NTV2_LINE_ROUND(recs_size);
+   memcpy(rep->recs, hdr->recs, recs_size);
 
-   /* allocate our arrays */
+   if ( hdr->overview != NTV2_NULL )
+   {
+      rep->overview = (NTV2_FILE_OV *)p;
+      memcpy(rep->overview, hdr->overview, ov_size);
+   }
+   p += NTV2_LINE_ROUND(ov_size);
 
-   if ( read_data )
+   if ( hdr->subfiles != NTV2_NULL )
    {
-      {
-         rec->shifts = (NTV2_SHIFT *)
-                       ntv2_memalloc(sizeof(*rec->shifts) * rec->num);
-         if ( rec->shifts == NTV2_NULL )
-            return NTV2_ERR_NO_MEMORY;
-      }
+      rep->subfiles = (NTV2_FILE_SF *)p;
+      memcpy(rep->subfiles, hdr->subfiles, sf_size);
+   }
+   p += NTV2_LINE_ROUND(sf_size);
 
-      if ( hdr->keep_orig )
-      {
-         rec->accurs = (NTV2_SHIFT *)
-                       ntv2_memalloc(sizeof(*rec->accurs) * rec->num);
-         if ( rec->accurs == NTV2_NULL )
-            return NTV2_ERR_NO_MEMORY;
-      }
+   NTV2_RELOC(rep->first_parent);
+   for (i = 0; i < rep->num_recs; i++)
+   {
+      rec = &rep->recs[i];
+
+      NTV2_RELOC(rec->parent);
+      NTV2_RELOC(rec->sub);
+      NTV2_RELOC(rec->next);
    }
 
-   /* now read the data */
+   arena->data = p;
+   arena->size = data_size;
+   arena->used = 0;
+   rep->arena  = arena;
 
-   for (i = 0; i < rec->num; i++)
+   /* -------- move any grid arrays already read in */
+
+   for (rec = rep->first_parent; rec != NTV2_NULL; rec = ntv2_next_rec(rec))
    {
-      RT(4);
+      NTV2_SHIFT ** arrays[2];
+      int a;
+
+      arrays[0] = &rec->shifts;
+      arrays[1] = &rec->accurs;
 
-      if ( tok.num == 2 || tok.num == 4 )
+      for (a = 0; a < 2 && rec->active; a++)
       {
-         if ( read_data )
-         {
-            rec->shifts[i][NTV2_COORD_LAT] = (float)ntv2_atod(TOK(0));
-            rec->shifts[i][NTV2_COORD_LON] = (float)ntv2_atod(TOK(1));
+         NTV2_SHIFT * copy;
 
-            if ( rec->accurs != NTV2_NULL )
-            {
-               /* Note that if there are only 2 tokens in the line,
-                  these token pointers will point to empty strings.
-               */
-               rec->accurs[i][NTV2_COORD_LAT] = (float)ntv2_atod(TOK(2));
-               rec->accurs[i][NTV2_COORD_LON] = (float)ntv2_atod(TOK(3));
-            }
+         if ( *arrays[a] == NTV2_NULL )
+            continue;
+
+         copy = (NTV2_SHIFT *)ntv2_grid_alloc(rep,
+                                              sizeof(*copy) * rec->num);
+         if ( copy != NTV2_NULL )
+         {
+            memcpy(copy, *arrays[a], sizeof(*copy) * rec->num);
+            ntv2_grid_free(rep, *arrays[a]);
+            *arrays[a] = copy;
          }
       }
-      else
-      {
-         return NTV2_ERR_INVALID_LINE;
-      }
    }
 
-   return NTV2_ERR_OK;
+   ntv2_memdealloc(hdr->overview);
+   ntv2_memdealloc(hdr->subfiles);
+   ntv2_memdealloc(hdr->recs);
+   ntv2_memdealloc(hdr);
+
+   return rep;
 }
 
+#undef NTV2_RELOC
+
 /*------------------------------------------------------------------------
- * Read a ascii end record.
+ * Get the conversion factors for the GS_TYPE of an overview record.
+ *
+ * Note that this conversion factor applies to both the header values
+ * and the shift values, but in different ways.
+ *
+ * So far, the only data type we've encountered in any published
+ * NTv2 file is "SECONDS".
  */
-static int ntv2_read_er_asc(
-   NTV2_HDR *hdr)
+static int ntv2_get_conv(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_OV *ov)
 {
-   NTV2_TOKEN tok;
-   int num;
-   int rc = 0;
+   ntv2_cleanup_str(hdr, hdr->gs_type, ov->s_gs_type, FALSE);
 
-   num = ntv2_read_toks(hdr->fp, &tok, 1);
-   if ( num <= 0 )
+   if      ( strncmp(hdr->gs_type, "SECONDS ", NTV2_NAME_LEN) == 0 )
    {
-      hdr->fixed |= NTV2_FIX_END_REC_NOT_FOUND;
+      hdr->hdr_conv = ( 1.0 / 3600.0 );
+      hdr->dat_conv = ( 1.0          );
+   }
+   else if ( strncmp(hdr->gs_type, "MINUTES ", NTV2_NAME_LEN) == 0 )
+   {
+      hdr->hdr_conv = ( 1.0 / 60.0   );
+      hdr->dat_conv = ( 60.0         );
+   }
+   else if ( strncmp(hdr->gs_type, "DEGREES ", NTV2_NAME_LEN) == 0 )
+   {
+      hdr->hdr_conv = ( 1.0          );
+      hdr->dat_conv = ( 3600.0       );
    }
    else
    {
-      if ( ntv2_strcmp_i(tok.toks[0], "END") != 0 )
-         hdr->fixed |= NTV2_FIX_END_REC_NOT_FOUND;
+      return NTV2_ERR_INVALID_GS_TYPE;
    }
 
-   return rc;
+   return NTV2_ERR_OK;
 }
 
 /*------------------------------------------------------------------------
- * Load a NTv2 ascii file into memory.
+ * Allocate the records for all sub-files, and the file record cache
+ * if wanted.
  */
-static NTV2_HDR * ntv2_load_file_asc(
-   const char *  ntv2file,
-   NTV2_BOOL     keep_orig,
-   NTV2_BOOL     read_data,
-   NTV2_EXTENT * extent,
-   int *         prc)
+static int ntv2_create_recs(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_OV *ov)
 {
-   NTV2_HDR *hdr;
-   NTV2_FILE_OV  ov_rec;
-   NTV2_FILE_SF  sf_rec;
-   int i;
-   int rc;
-
-   NTV2_UNUSED_PARAMETER(extent);
-
-   hdr = ntv2_create(ntv2file, NTV2_FILE_TYPE_ASC, prc);
-   if ( hdr == NTV2_NULL )
-   {
-      return NTV2_NULL;
-   }
-
-   hdr->keep_orig = keep_orig;
-
-   /* -------- read in the overview record */
-
-   rc = ntv2_read_ov_asc(hdr, &ov_rec);
-   if ( rc != NTV2_ERR_OK )
-   {
-      ntv2_delete(hdr);
-      *prc = rc;
-      return NTV2_NULL;
-   }
-
    hdr->num_parents = 0;
    hdr->recs        = (NTV2_REC *)
                       ntv2_memalloc(sizeof(*hdr->recs) * hdr->num_recs);
    if ( hdr->recs == NTV2_NULL )
    {
-      ntv2_delete(hdr);
-      *prc = NTV2_ERR_NO_MEMORY;
-      return NTV2_NULL;
+      return NTV2_ERR_NO_MEMORY;
    }
 
    memset(hdr->recs, 0, sizeof(*hdr->recs) * hdr->num_recs);
@@ -3026,1570 +4064,8134 @@ static NTV2_HDR * ntv2_load_file_asc(
                       ntv2_memalloc(sizeof(*hdr->overview));
       if ( hdr->overview == NTV2_NULL )
       {
-         ntv2_delete(hdr);
-         *prc = NTV2_ERR_NO_MEMORY;
-         return NTV2_NULL;
+         return NTV2_ERR_NO_MEMORY;
       }
 
-      memcpy(hdr->overview, &ov_rec, sizeof(*hdr->overview));
+      memcpy(hdr->overview, ov, sizeof(*hdr->overview));
 
       hdr->subfiles = (NTV2_FILE_SF *)
                       ntv2_memalloc(sizeof(*hdr->subfiles) * hdr->num_recs);
       if ( hdr->subfiles == NTV2_NULL )
       {
-         ntv2_delete(hdr);
-         *prc = NTV2_ERR_NO_MEMORY;
-         return NTV2_NULL;
-      }
-   }
-
-   /* -------- read in all subfile records */
-
-   for (i = 0; i < hdr->num_recs; i++)
-   {
-      rc = ntv2_read_sf_asc(hdr, &sf_rec);
-      if ( rc == NTV2_ERR_OK )
-      {
-         if ( hdr->subfiles != NTV2_NULL )
-            memcpy(&hdr->subfiles[i], &sf_rec, sizeof(*hdr->subfiles));
-
-         rc = ntv2_sf_to_rec(hdr, &sf_rec, i);
-         if ( rc == NTV2_ERR_OK )
-            rc = ntv2_read_data_asc(hdr, hdr->recs + i, read_data);
-      }
-
-      if ( rc != NTV2_ERR_OK )
-      {
-         ntv2_delete(hdr);
-         *prc = rc;
-         return NTV2_NULL;
+         return NTV2_ERR_NO_MEMORY;
       }
    }
 
-   /* -------- read in the end record */
-
-   ntv2_read_er_asc(hdr);
-
-   /* -------- adjust all pointers */
-
-   rc = ntv2_fix_ptrs(hdr);
-   if ( rc != NTV2_ERR_OK )
-   {
-      ntv2_delete(hdr);
-      hdr = NTV2_NULL;
-   }
-
-   *prc = rc;
-   return hdr;
+   return NTV2_ERR_OK;
 }
 
 /* ------------------------------------------------------------------------- */
-/* NTv2 read routines                                                        */
+/* NTv2 binary read routines                                                 */
 /* ------------------------------------------------------------------------- */
 
 /*------------------------------------------------------------------------
- * Load a NTv2 file into memory.
- */
-NTV2_HDR * ntv2_load_file(
-   const char *  ntv2file,
-   NTV2_BOOL     keep_orig,
-   NTV2_BOOL     read_data,
-   NTV2_EXTENT * extent,
-   int *         prc)
-{
-   NTV2_HDR * hdr;
-   int        type;
-   int        rc;
-
-   if ( prc == NTV2_NULL )
-      prc = &rc;
-   *prc = NTV2_ERR_OK;
-
-   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
-   {
-      *prc = NTV2_ERR_NULL_PATH;
-      return NTV2_NULL;
-   }
-
-   type = ntv2_filetype(ntv2file);
-   switch (type)
-   {
-      case NTV2_FILE_TYPE_ASC:
-         hdr = ntv2_load_file_asc(ntv2file,
-                                  keep_orig,
-                                  read_data,
-                                  extent,
-                                  prc);
-         break;
-
-      case NTV2_FILE_TYPE_BIN:
+ * Read a binary overview record.
+ *
+ * The original Canadian specification for NTv2 files included
+ * a 4-byte pad of zeros after each int in the headers, which
+ * kept the length of each record (overview field, sub-file field,
+ * or grid-shift entry) to be 16 bytes.  This was probably done
+ * so they could read the files in FORTRAN or on a main-frame using
+ * "DCB=(RECFM=FB,LRECL=16,...)".
+ *
+ * However, when Australia started using this file format, they
+ * misunderstood the reason for the padding and thought it was a compiler
+ * issue.  The Canadians had implemented NTv2 using FORTRAN,
+ * and information at the time suggested that the use of records in
+ * a FORTRAN binary file would create a file that other languages
+ * would have a difficult time reading and writing.  Thus, the
+ * Australians decided to format the file as specified, but to
+ * ignore any "auxiliary record identifiers" that FORTRAN used (i.e.
+ * the padding bytes).
+ *
+ * To make matters worse, New Zealand copied the Australian
+ * format.  Blimey!  However, it became apparent that the NTv2 binary
+ * format is not compiler dependent, and since 2000 both Australia
+ * and New Zealand have been writing new files correctly.
+ *
+ * But this means that when reading a NTv2 header record we have to
+ * determine whether these pad bytes are there, since we may be reading
+ * an older Australian or New Zealand NTv2 file.
+ *
+ * Also, there is nothing in the NTv2 specification that states
+ * whether the file should be written big-endian or little-endian,
+ * so we also have to determine how it was written, so we can know if
+ * we have to byte-swap the numbers.  However, all files we've seen
+ * so far are all little-endian.
+ *
+ * Also, when we cache the overview and subfile records, they are always
+ * stored in native-endian format.  They get byte-swapped back, if needed,
+ * when written out.  This allows us to choose how they are written out,
+ * and makes it easier to dump the data.
+ *
+ *------------------------------------------------------------------------
+ * Implementation note:
+ *   In GCC, a function can be declared with the attribute "warn_unused_result",
+ *   which results in a warning being issued if the return value from that
+ *   function is not used.  This, of course, will cause a compilation to
+ *   fail if "-Werror" (treat warnings as errors) is specified on the
+ *   command line (which we like to do).  For details, see
+ *   "http://gcc.gnu.org/onlinedocs/gcc-3.4.6/gcc/Function-Attributes.html".
+ *
+ *   Despite flames from the user community, Ubuntu Linux sets this attribute
+ *   for the fread() function.  Unfortunately, we don't bother to check the
+ *   result from each call to fread(), since that makes the code real ugly
+ *   and it is easier just to check ferror() at the end.  But, because of
+ *   Ubuntu's insistence on requiring that the return value be used, we store
+ *   the result but we don't bother checking it.
+ *------------------------------------------------------------------------
+ */
+static int ntv2_read_ov_bin(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_OV *ov)
+{
+   size_t nr;
+
+   /* -------- NUM_OREC */
+
+   nr = ntv2_fread(hdr,  ov->n_num_orec, NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &ov->i_num_orec, NTV2_SIZE_INT, 1);
+
+   /* determine if byte-swapping is needed */
+
+   if ( ov->i_num_orec != 11 )
+   {
+      hdr->swap_data = TRUE;
+      NTV2_SWAPI(&ov->i_num_orec, 1);
+      if ( ov->i_num_orec != 11 )
+         return NTV2_ERR_INVALID_NUM_OREC;
+   }
+
+   /* determine if pad-bytes are present */
+
+   nr = ntv2_fread(hdr, &ov->p_num_orec, NTV2_SIZE_INT, 1);
+   if ( ov->p_num_orec == 0 )
+   {
+      hdr->pads_present = TRUE;
+   }
+   else
+   {
+      ov->p_num_orec = 0;
+      ntv2_fseek(hdr, -NTV2_SIZE_INT, SEEK_CUR);
+   }
+
+   /* -------- NUM_SREC */
+
+   nr = ntv2_fread(hdr,  ov->n_num_srec, NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr, &ov->i_num_srec, NTV2_SIZE_INT,  1);
+   ov->p_num_srec = 0;
+
+   NTV2_SWAPI(&ov->i_num_srec, 1);
+   if ( ov->i_num_srec != 11 )
+      return NTV2_ERR_INVALID_NUM_SREC;
+
+   if ( hdr->pads_present )
+      ntv2_fseek(hdr, NTV2_SIZE_INT, SEEK_CUR);
+
+   /* -------- NUM_FILE */
+
+   nr = ntv2_fread(hdr,  ov->n_num_file,  NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &ov->i_num_file,  NTV2_SIZE_INT, 1);
+   ov->p_num_file = 0;
+
+   NTV2_SWAPI(&ov->i_num_file, 1);
+   if ( ov->i_num_file <= 0 )
+      return NTV2_ERR_INVALID_NUM_FILE;
+   hdr->num_recs = ov->i_num_file;
+
+   if ( hdr->pads_present )
+      ntv2_fseek(hdr, NTV2_SIZE_INT, SEEK_CUR);
+
+   /* -------- GS_TYPE */
+
+   nr = ntv2_fread(hdr,  ov->n_gs_type,  NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr,  ov->s_gs_type,  NTV2_NAME_LEN,  1);
+
+   /* -------- VERSION */
+
+   nr = ntv2_fread(hdr,  ov->n_version,  NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr,  ov->s_version,  NTV2_NAME_LEN,  1);
+
+   /* -------- SYSTEM_F */
+
+   nr = ntv2_fread(hdr,  ov->n_system_f, NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr,  ov->s_system_f, NTV2_NAME_LEN,  1);
+
+   /* -------- SYSTEM_T */
+
+   nr = ntv2_fread(hdr,  ov->n_system_t, NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr,  ov->s_system_t, NTV2_NAME_LEN,  1);
+
+   /* -------- MAJOR_F */
+
+   nr = ntv2_fread(hdr,  ov->n_major_f,  NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr, &ov->d_major_f,  NTV2_SIZE_DBL,  1);
+   NTV2_SWAPD(&ov->d_major_f, 1);
+
+   /* -------- MINOR_F */
+
+   nr = ntv2_fread(hdr,  ov->n_minor_f,  NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr, &ov->d_minor_f,  NTV2_SIZE_DBL,  1);
+   NTV2_SWAPD(&ov->d_minor_f, 1);
+
+   /* -------- MAJOR_T */
+
+   nr = ntv2_fread(hdr,  ov->n_major_t,  NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr, &ov->d_major_t,  NTV2_SIZE_DBL,  1);
+   NTV2_SWAPD(&ov->d_major_t, 1);
+
+   /* -------- MINOR_T */
+
+   nr = ntv2_fread(hdr,  ov->n_minor_t,  NTV2_NAME_LEN,  1);
+   nr = ntv2_fread(hdr, &ov->d_minor_t,  NTV2_SIZE_DBL,  1);
+   NTV2_SWAPD(&ov->d_minor_t, 1);
+
+   /* -------- check for I/O error */
+
+   if ( ntv2_ferror(hdr) || nr != 1 )
+   {
+      return NTV2_ERR_IOERR;
+   }
+
+   /* -------- get the conversion */
+
+   return ntv2_get_conv(hdr, ov);
+}
+
+/*------------------------------------------------------------------------
+ * Read a binary subfile record.
+ *
+ * See above implementation comment.
+ */
+static int ntv2_read_sf_bin(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_SF *sf)
+{
+   size_t nr;
+
+   /* -------- SUB_NAME */
+
+   nr = ntv2_fread(hdr,  sf->n_sub_name, NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr,  sf->s_sub_name, NTV2_NAME_LEN, 1);
+
+   /* -------- PARENT */
+
+   nr = ntv2_fread(hdr,  sf->n_parent,   NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr,  sf->s_parent,   NTV2_NAME_LEN, 1);
+
+   /* -------- CREATED */
+
+   nr = ntv2_fread(hdr,  sf->n_created,  NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr,  sf->s_created,  NTV2_NAME_LEN, 1);
+
+   /* -------- UPDATED */
+
+   nr = ntv2_fread(hdr,  sf->n_updated,  NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr,  sf->s_updated,  NTV2_NAME_LEN, 1);
+
+   /* -------- S_LAT */
+
+   nr = ntv2_fread(hdr,  sf->n_s_lat,    NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->d_s_lat,    NTV2_SIZE_DBL, 1);
+   NTV2_SWAPD(&sf->d_s_lat, 1);
+
+   /* -------- N_LAT */
+
+   nr = ntv2_fread(hdr,  sf->n_n_lat,    NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->d_n_lat,    NTV2_SIZE_DBL, 1);
+   NTV2_SWAPD(&sf->d_n_lat, 1);
+
+   /* -------- E_LONG */
+
+   nr = ntv2_fread(hdr,  sf->n_e_lon,    NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->d_e_lon,    NTV2_SIZE_DBL, 1);
+   NTV2_SWAPD(&sf->d_e_lon, 1);
+
+   /* -------- W_LONG */
+
+   nr = ntv2_fread(hdr,  sf->n_w_lon,    NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->d_w_lon,    NTV2_SIZE_DBL, 1);
+   NTV2_SWAPD(&sf->d_w_lon, 1);
+
+   /* -------- LAT_INC */
+
+   nr = ntv2_fread(hdr,  sf->n_lat_inc,  NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->d_lat_inc,  NTV2_SIZE_DBL, 1);
+   NTV2_SWAPD(&sf->d_lat_inc, 1);
+
+   /* -------- LONG_INC */
+
+   nr = ntv2_fread(hdr,  sf->n_lon_inc,  NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->d_lon_inc,  NTV2_SIZE_DBL, 1);
+   NTV2_SWAPD(&sf->d_lon_inc, 1);
+
+   /* -------- GS_COUNT */
+
+   nr = ntv2_fread(hdr,  sf->n_gs_count, NTV2_NAME_LEN, 1);
+   nr = ntv2_fread(hdr, &sf->i_gs_count, NTV2_SIZE_INT, 1);
+   sf->p_gs_count = 0;
+
+   NTV2_SWAPI(&sf->i_gs_count, 1);
+   if ( sf->i_gs_count <= 0 )
+      return NTV2_ERR_INVALID_GS_COUNT;
+
+   if ( hdr->pads_present )
+      ntv2_fseek(hdr, NTV2_SIZE_INT, SEEK_CUR);
+
+   /* -------- check for I/O error */
+
+   if ( ntv2_ferror(hdr) || nr != 1 )
+   {
+      return NTV2_ERR_IOERR;
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read a binary end record.
+ *
+ * The only NTv2 file I've seen that would generate an error here
+ * is the file "italy/rer.gsb", which omits the end record completely.
+ * Maybe we should make them an offer they can't refuse...
+ */
+static int ntv2_read_er_bin(
+   NTV2_HDR      *hdr,
+   NTV2_FILE_END *er)
+{
+   size_t nr = ntv2_fread(hdr, er, sizeof(*er), 1);
+   return (nr == 1) ? NTV2_ERR_OK : NTV2_ERR_IOERR;
+}
+
+/*------------------------------------------------------------------------
+ * Convert a subfile record to a ntv2-rec.
+ *
+ * The NTv2 specification uses the convention of positive-west /
+ * negative-east (probably since Canada is all in the west).
+ * However, this is backwards from the standard negative-west /
+ * positive-east notation.
+ *
+ * Thus, when converting the sub-file records, we flip the sign of
+ * the longitude-max (the east value) and the longitude-min
+ * (the west value).  This way, the longitude-min (west) is less than
+ * the longitude-max (east).  This may have to be rethought if an NTv2
+ * file ever spans the dateline (+/-180 degrees).
+ *
+ * However, we still have to remember that the grid-shift records
+ * are written (backwards) east-to-west, and the longitude shift values
+ * are positive-west/negative-east.
+ */
+static int ntv2_sf_to_rec(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_SF *sf,
+   int           n)
+{
+   NTV2_REC * rec = hdr->recs + n;
+
+   ntv2_cleanup_str(hdr, rec->record_name, sf->s_sub_name, TRUE);
+   ntv2_cleanup_str(hdr, rec->parent_name, sf->s_parent,   TRUE);
+   rec->record_name[NTV2_NAME_LEN] = 0;
+   rec->parent_name[NTV2_NAME_LEN] = 0;
+
+   rec->active     =  TRUE;
+   rec->parent     =  NTV2_NULL;
+   rec->sub        =  NTV2_NULL;
+   rec->next       =  NTV2_NULL;
+   rec->num_subs   =  0;
+   rec->rec_num    =  n;
+
+   rec->offset     =  ntv2_ftell(hdr);
+   rec->sskip      =  0;
+   rec->nskip      =  0;
+   rec->wskip      =  0;
+   rec->eskip      =  0;
+
+   rec->shifts     =  NTV2_NULL;
+   rec->accurs     =  NTV2_NULL;
+
+   rec->lat_min    =  sf->d_s_lat;
+   rec->lat_min   *=  hdr->hdr_conv;
+
+   rec->lat_max    =  sf->d_n_lat;
+   rec->lat_max   *=  hdr->hdr_conv;
+
+   rec->lat_inc    =  sf->d_lat_inc;
+   rec->lat_inc   *=  hdr->hdr_conv;
+
+   rec->lon_max    =  sf->d_e_lon;
+   rec->lon_max   *= -hdr->hdr_conv;      /* NOTE: reversing sign! */
+
+   rec->lon_min    =  sf->d_w_lon;
+   rec->lon_min   *= -hdr->hdr_conv;      /* NOTE: reversing sign! */
+
+   rec->lon_inc    =  sf->d_lon_inc;
+   rec->lon_inc   *=  hdr->hdr_conv;
+
+   rec->num        =  sf->i_gs_count;
+
+   rec->nrows      =  ntv2_dtoi((rec->lat_max - rec->lat_min) / rec->lat_inc) + 1;
+   rec->ncols      =  ntv2_dtoi((rec->lon_max - rec->lon_min) / rec->lon_inc) + 1;
+
+   /* collect the min/max of all the sub-files */
+
+   if ( hdr->lon_min > rec->lon_min )  hdr->lon_min = rec->lon_min;
+   if ( hdr->lat_min > rec->lat_min )  hdr->lat_min = rec->lat_min;
+   if ( hdr->lon_max < rec->lon_max )  hdr->lon_max = rec->lon_max;
+   if ( hdr->lat_max < rec->lat_max )  hdr->lat_max = rec->lat_max;
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read binary header data from the file.
+ */
+static int ntv2_read_hdrs_bin(
+   NTV2_HDR *hdr)
+{
+   NTV2_FILE_OV  ov_rec;
+   NTV2_FILE_SF  sf_rec;
+   NTV2_FILE_END en_rec;
+   int i;
+   int rc;
+
+   /* -------- read in the overview record */
+
+   rc = ntv2_read_ov_bin(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   rc = ntv2_create_recs(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   /* -------- read in all subfile records (but not the actual data)
+
+      We don't read in the data now, since we may be doing
+      extent processing later, which would affect the reading
+      of the data.
+   */
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      long offset;
+
+      rc = ntv2_read_sf_bin(hdr, &sf_rec);
+      if ( rc != NTV2_ERR_OK )
+      {
+         return rc;
+      }
+
+      if ( hdr->subfiles != NTV2_NULL )
+      {
+         memcpy(&hdr->subfiles[i], &sf_rec, sizeof(*hdr->subfiles));
+      }
+
+      rc = ntv2_sf_to_rec(hdr, &sf_rec, i);
+      if ( rc != NTV2_ERR_OK )
+      {
+         return rc;
+      }
+
+      /* skip over grid-shift records */
+      offset = hdr->recs[i].num * sizeof(NTV2_FILE_GS);
+      ntv2_fseek(hdr, offset, SEEK_CUR);
+   }
+
+   /* -------- read in the end record
+
+      Note that we don't bail if we can't read the end record,
+      since it is certainly possible to use the file without it because
+      we know the number of records and thus where the end should be.
+      But we do note that the file "needs fixing" if it isn't there,
+      or if it isn't in "standard" format.
+
+      Interestingly enough, all the Canadian NTv2 files properly
+      zero out the filler bytes in the end record, but the name
+      field is "END xxxx" (ie "END " and four trailing garbage bytes).
+      And it's their specification!
+   */
+
+   rc = ntv2_read_er_bin(hdr, &en_rec);
+   if ( rc == NTV2_ERR_OK )
+   {
+      if ( strncmp(en_rec.n_end, NTV2_END_NAME,  NTV2_NAME_LEN) != 0 )
+         hdr->fixed |= NTV2_FIX_END_REC_NAME_NOT_ALPHA;
+
+      if ( memcmp(en_rec.filler, NTV2_ALL_ZEROS, NTV2_NAME_LEN) != 0 )
+         hdr->fixed |= NTV2_FIX_END_REC_PAD_NOT_ZERO;
+   }
+   else
+   {
+      hdr->fixed |= NTV2_FIX_END_REC_NOT_FOUND;
+   }
+
+   /* -------- adjust all pointers */
+
+   rc = ntv2_fix_ptrs(hdr);
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Mark a sub-file and all its children as inactive.
+ *
+ * This is called if a sub-file is to be skipped due to extent processing.
+ */
+static int ntv2_inactivate(
+   NTV2_HDR *hdr,
+   NTV2_REC *rec,
+   int       nrecs)
+{
+   if ( rec->active )
+   {
+      NTV2_REC *sub;
+
+      nrecs--;
+      rec->active = FALSE;
+
+      for (sub = rec->sub; sub != NTV2_NULL; sub = sub->next)
+      {
+         nrecs = ntv2_inactivate(hdr, sub, nrecs);
+      }
+   }
+
+   return nrecs;
+}
+
+/*------------------------------------------------------------------------
+ * Apply an extent to an NTv2 object.
+ */
+static int ntv2_process_extent(
+   NTV2_HDR    *hdr,
+   NTV2_EXTENT *extent)
+{
+   double wlon;
+   double slat;
+   double elon;
+   double nlat;
+   int    nrecs;
+   int    i;
+   int    rc = NTV2_ERR_OK;
+
+   if ( ntv2_extent_is_empty(extent) )
+   {
+      return NTV2_ERR_OK;
+   }
+
+   nrecs = hdr->num_recs;
+
+   /* get extent values */
+
+   wlon = extent->wlon;
+   slat = extent->slat;
+   elon = extent->elon;
+   nlat = extent->nlat;
+
+   /* apply the extent to all records */
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      NTV2_REC * rec = &hdr->recs[i];
+      double d;
+      int    nskip = 0;
+      int    sskip = 0;
+      int    wskip = 0;
+      int    eskip = 0;
+      int    ocols = rec->ncols;
+      int    k;
+
+      /* check if this record has already been marked as out-of-range */
+
+      if ( !rec->active )
+         continue;
+
+      /* check if this record is out-of-range */
+
+      if ( NTV2_GE(wlon, rec->lon_max) ||
+           NTV2_GE(slat, rec->lat_max) ||
+           NTV2_LE(elon, rec->lon_min) ||
+           NTV2_LE(nlat, rec->lat_min) )
+      {
+         nrecs = ntv2_inactivate(hdr, rec, nrecs);
+         continue;
+      }
+
+      /* check if this extent is a subset of the record */
+
+      if ( NTV2_GT(wlon, rec->lon_min) ||
+           NTV2_GT(slat, rec->lat_min) ||
+           NTV2_LT(elon, rec->lon_max) ||
+           NTV2_LT(nlat, rec->lat_max) )
+      {
+         /* Force our extent to be a proper multiple of the deltas.
+            We move the extent edges out to the next delta
+            multiple to do this.
+
+            Note that the deltas we use are the parent's deltas if
+            we have a parent.  This is to make sure we stay lined
+            up on a parent grid line.
+         */
+         double lat_inc = rec->lat_inc;
+         double lon_inc = rec->lon_inc;
+         int    lat_mul = 1;
+         int    lon_mul = 1;
+
+         if ( rec->parent != NTV2_NULL )
+         {
+            lat_inc = rec->parent->lat_inc;
+            lon_inc = rec->parent->lon_inc;
+            lat_mul = ntv2_dtoi(lat_inc / rec->lat_inc);
+            lon_mul = ntv2_dtoi(lon_inc / rec->lon_inc);
+         }
+
+         if ( NTV2_GT(wlon, rec->lon_min) )
+         {
+            d = (wlon - rec->lon_min) / lon_inc;
+            k = (int)floor(d) * lon_mul;
+
+            if ( k > 0 )
+            {
+               wskip = k;
+               rec->lon_min += (k * rec->lon_inc);
+               rec->ncols   -= k;
+            }
+         }
+
+         if ( NTV2_LT(elon, rec->lon_max) )
+         {
+            d = (rec->lon_max - elon) / lon_inc;
+            k = (int)floor(d) * lon_mul;
+
+            if ( k > 0 )
+            {
+               eskip = k;
+               rec->lon_max -= (k * rec->lon_inc);
+               rec->ncols   -= k;
+            }
+         }
+
+         if ( NTV2_GT(slat, rec->lat_min) )
+         {
+            d = (slat - rec->lat_min) / lat_inc;
+            k = (int)floor(d) * lat_mul;
+
+            if ( k > 0 )
+            {
+               sskip = k;
+               rec->lat_min += (k * rec->lat_inc);
+               rec->nrows   -= k;
+            }
+         }
+
+         if ( NTV2_LT(nlat, rec->lat_max) )
+         {
+            d = (rec->lat_max - nlat) / lat_inc;
+            k = (int)floor(d) * lat_mul;
+
+            if ( k > 0 )
+            {
+               nskip = k;
+               rec->lat_max -= (k * rec->lat_inc);
+               rec->nrows   -= k;
+            }
+         }
+
+         /* Check if there is any data left.
+            I think that this will always be the case, but it is
+            easier to do the check than to think out all
+            possible scenarios.  Also, better safe than sorry.
+         */
+
+         if ( rec->ncols <= 0 || rec->nrows <= 0 )
+         {
+            nrecs = ntv2_inactivate(hdr, rec, nrecs);
+            continue;
+         }
+
+         /* check if this record has changed */
+
+         if ( nskip > 0 || sskip > 0 || wskip > 0 || eskip > 0 )
+         {
+            rec->num   = (rec->ncols * rec->nrows);
+            rec->sskip = (sskip * sizeof(NTV2_FILE_GS)) * ocols;
+            rec->nskip = (nskip * sizeof(NTV2_FILE_GS)) * ocols;
+            rec->wskip = (wskip * sizeof(NTV2_FILE_GS));
+            rec->eskip = (eskip * sizeof(NTV2_FILE_GS));
+
+            /* adjust the subfile record if we cached it */
+            if ( hdr->subfiles != NTV2_NULL )
+            {
+               NTV2_FILE_SF * sf = &hdr->subfiles[i];
+
+               sf->i_gs_count = rec->num;
+
+               sf->d_s_lat =  (rec->lat_min / hdr->hdr_conv);
+               sf->d_n_lat =  (rec->lat_max / hdr->hdr_conv);
+
+               /* Note the sign changes here! */
+
+               sf->d_e_lon = -(rec->lon_max / hdr->hdr_conv);
+               sf->d_w_lon = -(rec->lon_min / hdr->hdr_conv);
+            }
+         }
+      }
+   }
+
+   /* check if any records have been deleted */
+
+   if ( nrecs != hdr->num_recs )
+   {
+      /* error if no records are left */
+      if ( nrecs == 0 )
+         return NTV2_ERR_INVALID_EXTENT;
+
+      /* fix number of files in overview record if present */
+      if ( hdr->overview != NTV2_NULL )
+         hdr->overview->i_num_file = nrecs;
+
+      /* readjust all pointers */
+      rc = ntv2_fix_ptrs(hdr);
+   }
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Determine how the rows of a sub-file cut down by an extent are read.
+ *
+ * If an extent skips only a little of each row, whole rows (including
+ * the skipped data east and west of the extent) are read in one read.
+ * If most of each row is skipped, as when a small extent is cut out of
+ * a large grid, just the wanted span of each row is read instead.
+ */
+#define NTV2_SKIP_MIN  NTV2_STREAM_BUFSIZE
+
+static NTV2_BOOL ntv2_read_spans(
+   const NTV2_REC *rec)
+{
+   size_t span_len = rec->ncols * sizeof(NTV2_FILE_GS);
+   size_t skip_len = rec->eskip + rec->wskip;
+
+   return ( skip_len > span_len && skip_len >= NTV2_SKIP_MIN );
+}
+
+/* Get the buffer space needed for each row read. */
+static size_t ntv2_read_row_len(
+   const NTV2_REC *rec)
+{
+   size_t span_len = rec->ncols * sizeof(NTV2_FILE_GS);
+
+   if ( ntv2_read_spans(rec) )
+      return span_len;
+
+   return rec->eskip + span_len + rec->wskip;
+}
+
+/*------------------------------------------------------------------------
+ * Read a block of rows of binary shift data for one sub-file.
+ *
+ * The rows are read into the buffer (which must have room for
+ * ntv2_read_row_len() bytes per row), the buffer is swapped in one
+ * pass, and the values copied out while stepping over any skips.
+ * The shifts and the accuracies are each only copied out if their
+ * array is not null.
+ */
+static int ntv2_read_rows_bin(
+   NTV2_HDR *      hdr,
+   const NTV2_REC *rec,
+   int             row,
+   int             nrows,
+   NTV2_SHIFT *    shifts,
+   NTV2_SHIFT *    accurs,
+   NTV2_FILE_GS *  buf)
+{
+   size_t span_len = rec->ncols * sizeof(NTV2_FILE_GS);
+   size_t skip_len = rec->eskip + rec->wskip;
+   int    row_gs;
+   int    first;
+   int    j;
+   int    r;
+
+   /* Remember that data in a latitude row goes East to West! */
+
+   if ( ntv2_read_spans(rec) )
+   {
+      for (r = 0; r < nrows; r++)
+      {
+         if ( ntv2_fread_at(hdr, buf + (r * rec->ncols), span_len,
+                            ntv2_data_offset(rec, 0, row + r)) != span_len )
+         {
+            return NTV2_ERR_IOERR;
+         }
+      }
+
+      row_gs = rec->ncols;
+      first  = 0;
+   }
+   else
+   {
+      size_t row_len = skip_len + span_len;
+
+      ntv2_fseek(hdr, ntv2_data_offset(rec, 0, row) - rec->eskip, SEEK_SET);
+      if ( ntv2_fread(hdr, buf, row_len, nrows) != (size_t)nrows )
+      {
+         return NTV2_ERR_IOERR;
+      }
+
+      row_gs = (int)(row_len / sizeof(NTV2_FILE_GS));
+      first  = (int)(rec->eskip / sizeof(NTV2_FILE_GS));
+   }
+
+   NTV2_SWAPF((float *)buf, row_gs * 4 * nrows);
+
+   j = 0;
+   for (r = 0; r < nrows; r++)
+   {
+      const NTV2_FILE_GS * gs = buf + (r * row_gs) + first;
+      int col;
+
+      if ( shifts != NTV2_NULL )
+      {
+         for (col = 0; col < rec->ncols; col++)
+         {
+            shifts[j+col][NTV2_COORD_LAT] = gs[col].f_lat_shift;
+            shifts[j+col][NTV2_COORD_LON] = gs[col].f_lon_shift;
+         }
+      }
+
+      if ( accurs != NTV2_NULL )
+      {
+         for (col = 0; col < rec->ncols; col++)
+         {
+            accurs[j+col][NTV2_COORD_LAT] = gs[col].f_lat_accuracy;
+            accurs[j+col][NTV2_COORD_LON] = gs[col].f_lon_accuracy;
+         }
+      }
+
+      j += rec->ncols;
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read in binary shift data for one sub-file.
+ *
+ * Rather than reading one grid-shift record at a time, we read as many
+ * whole rows as fit in a buffer at a time.
+ *
+ * The buffer is passed in so it can be reused for all sub-files.
+ * The arrays are only stored in the record once they are complete,
+ * so another thread never sees a partially-read record.
+ */
+#ifndef   NTV2_READ_BUFSIZE
+#  define NTV2_READ_BUFSIZE  (256 * 1024)
+#endif
+
+static int ntv2_read_rec_bin(
+   NTV2_HDR *      hdr,
+   NTV2_REC *      rec,
+   NTV2_FILE_GS ** pbuf,
+   size_t *        pbuf_len)
+{
+   NTV2_SHIFT * shifts = NTV2_NULL;
+   NTV2_SHIFT * accurs = NTV2_NULL;
+   size_t row_len;
+   int    nrows_per_read;
+   int    row;
+
+   /* allocate our arrays */
+
+   {
+      shifts = (NTV2_SHIFT *)ntv2_grid_alloc(hdr, sizeof(*shifts) * rec->num);
+      if ( shifts == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+   }
+
+   if ( ntv2_read_accurs(hdr) )
+   {
+      accurs = (NTV2_SHIFT *)ntv2_grid_alloc(hdr, sizeof(*accurs) * rec->num);
+      if ( accurs == NTV2_NULL )
+      {
+         ntv2_grid_free(hdr, shifts);
+         return NTV2_ERR_NO_MEMORY;
+      }
+   }
+
+   /* get a buffer big enough for at least one row */
+   /* (the skips are always a multiple of the record size) */
+
+   row_len = ntv2_read_row_len(rec);
+
+   nrows_per_read = (int)(NTV2_READ_BUFSIZE / row_len);
+   if ( nrows_per_read < 1 )
+      nrows_per_read = 1;
+   if ( nrows_per_read > rec->nrows )
+      nrows_per_read = rec->nrows;
+
+   if ( *pbuf_len < row_len * nrows_per_read )
+   {
+      ntv2_memdealloc(*pbuf);
+      *pbuf_len = row_len * nrows_per_read;
+      *pbuf     = (NTV2_FILE_GS *)ntv2_memalloc(*pbuf_len);
+      if ( *pbuf == NTV2_NULL )
+      {
+         *pbuf_len = 0;
+         ntv2_grid_free(hdr, shifts);
+         ntv2_grid_free(hdr, accurs);
+         return NTV2_ERR_NO_MEMORY;
+      }
+   }
+
+   /* now read the data */
+
+   for (row = 0; row < rec->nrows; row += nrows_per_read)
+   {
+      int nrows = rec->nrows - row;
+      int rc;
+
+      if ( nrows > nrows_per_read )
+         nrows = nrows_per_read;
+
+      rc = ntv2_read_rows_bin(hdr, rec, row, nrows,
+                              shifts + (row * rec->ncols),
+                              (accurs == NTV2_NULL) ? NTV2_NULL :
+                              accurs + (row * rec->ncols),
+                              *pbuf);
+      if ( rc != NTV2_ERR_OK )
+      {
+         ntv2_grid_free(hdr, shifts);
+         ntv2_grid_free(hdr, accurs);
+         return rc;
+      }
+   }
+
+   /* make sure the data is visible before the pointers are */
+
+   ntv2_store_ptr(&rec->accurs, accurs);
+   ntv2_store_ptr(&rec->shifts, shifts);
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read tiled header data from the file.
+ *
+ * The tile index for each sub-file follows its sub-file record, and
+ * gives where its data starts.  Everything about the layout is checked
+ * against what we would write, since that is all we know how to read.
+ */
+static int ntv2_read_hdrs_til(
+   NTV2_HDR *hdr)
+{
+   NTV2_FILE_TH  th_rec;
+   NTV2_FILE_OV  ov_rec;
+   NTV2_FILE_SF  sf_rec;
+   NTV2_FILE_TI  ti_rec;
+   int i;
+   int rc;
+
+   /* -------- read in the tiled file header */
+
+   if ( ntv2_fread(hdr, &th_rec, sizeof(th_rec), 1) != 1 )
+   {
+      return NTV2_ERR_IOERR;
+   }
+
+   if ( memcmp(th_rec.magic, NTV2_TIL_MAGIC, NTV2_NAME_LEN) != 0 ||
+        th_rec.byte_order != NTV2_TIL_BYTE_ORDER                 ||
+        th_rec.version    != NTV2_TIL_VERSION                    ||
+        th_rec.page_size  != NTV2_TIL_PAGE_SIZE                  ||
+        th_rec.tile_dim   != NTV2_TIL_DIM )
+   {
+      return NTV2_ERR_FILE_NOT_TILED;
+   }
+
+   /* -------- read in the overview record */
+
+   if ( ntv2_fread(hdr, &ov_rec, sizeof(ov_rec), 1) != 1 )
+   {
+      return NTV2_ERR_IOERR;
+   }
+
+   if ( ov_rec.i_num_file <= 0 || ov_rec.i_num_file != th_rec.num_recs )
+   {
+      return NTV2_ERR_INVALID_NUM_FILE;
+   }
+   hdr->num_recs = ov_rec.i_num_file;
+
+   rc = ntv2_get_conv(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   rc = ntv2_create_recs(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   /* -------- read in all subfile records and tile indexes */
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      NTV2_REC * rec = &hdr->recs[i];
+      int row0, col0, ntrows, ntcols;
+      long plane_size;
+
+      if ( ntv2_fread(hdr, &sf_rec, sizeof(sf_rec), 1) != 1 ||
+           ntv2_fread(hdr, &ti_rec, sizeof(ti_rec), 1) != 1 )
+      {
+         return NTV2_ERR_IOERR;
+      }
+
+      if ( hdr->subfiles != NTV2_NULL )
+      {
+         memcpy(&hdr->subfiles[i], &sf_rec, sizeof(*hdr->subfiles));
+      }
+
+      rc = ntv2_sf_to_rec(hdr, &sf_rec, i);
+      if ( rc != NTV2_ERR_OK )
+      {
+         return rc;
+      }
+
+      if ( rec->nrows <= 0 || rec->nrows != ti_rec.nrows ||
+           rec->ncols <= 0 || rec->ncols != ti_rec.ncols ||
+           rec->num != (rec->nrows * rec->ncols) )
+      {
+         return NTV2_ERR_INVALID_GS_COUNT;
+      }
+
+      rec->offset = (long)ti_rec.shift_page * NTV2_TIL_PAGE_SIZE;
+
+      ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+      plane_size = ntv2_til_plane_size(ntrows, ntcols);
+
+      if ( ti_rec.ntrows     != ntrows                 ||
+           ti_rec.ntcols     != ntcols                 ||
+           ti_rec.shift_page <  th_rec.hdr_pages       ||
+           (long)ti_rec.accur_page * NTV2_TIL_PAGE_SIZE !=
+              rec->offset + plane_size )
+      {
+         return NTV2_ERR_FILE_NOT_TILED;
+      }
+   }
+
+   /* -------- adjust all pointers */
+
+   rc = ntv2_fix_ptrs(hdr);
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Get the size of a header index for a number of sub-files.
+ */
+#define NTV2_IDX_SIZE(n) \
+   ( sizeof(NTV2_FILE_IX) + sizeof(NTV2_FILE_OV) + \
+     (size_t)(n) * (sizeof(NTV2_FILE_SF) + sizeof(long)) )
+
+/*------------------------------------------------------------------------
+ * Read header data from a header index.
+ *
+ * The index has already been checked against the file (see
+ * ntv2_read_index()), so its records are taken as they are, and only
+ * the sub-file records and their pointers are set up from them.
+ * Note that the data offsets are kept as they were found in the file.
+ */
+static int ntv2_read_hdrs_idx(
+   NTV2_HDR   *hdr,
+   const void *idx)
+{
+   const unsigned char * p = (const unsigned char *)idx;
+   NTV2_FILE_IX  ix_rec;
+   NTV2_FILE_OV  ov_rec;
+   NTV2_FILE_SF  sf_rec;
+   int i;
+   int rc;
+
+   memcpy(&ix_rec, p, sizeof(ix_rec));  p += sizeof(ix_rec);
+   memcpy(&ov_rec, p, sizeof(ov_rec));  p += sizeof(ov_rec);
+
+   hdr->num_recs     = ix_rec.num_recs;
+   hdr->pads_present = (ix_rec.pads_present != 0);
+   hdr->swap_data    = (ix_rec.swap_data    != 0);
+
+   rc = ntv2_get_conv(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   rc = ntv2_create_recs(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      long offset;
+
+      memcpy(&sf_rec, p, sizeof(sf_rec));  p += sizeof(sf_rec);
+      memcpy(&offset, p, sizeof(offset));  p += sizeof(offset);
+
+      if ( hdr->subfiles != NTV2_NULL )
+      {
+         memcpy(&hdr->subfiles[i], &sf_rec, sizeof(*hdr->subfiles));
+      }
+
+      rc = ntv2_sf_to_rec(hdr, &sf_rec, i);
+      if ( rc != NTV2_ERR_OK )
+      {
+         return rc;
+      }
+
+      hdr->recs[i].offset = offset;
+   }
+
+   /* -------- adjust all pointers */
+
+   rc = ntv2_fix_ptrs(hdr);
+
+   hdr->fixed = ix_rec.fixed;
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Read a block of rows of one plane (0 for the shifts, 1 for the
+ * accuracies) of tiled data for one sub-file.
+ *
+ * The tiles in a row of tiles that cover the sub-file (which may be
+ * cut down by an extent) are read with one read into the strip buffer
+ * (which must hold a whole row of tiles), and the values for all the
+ * grid rows in it are copied out.
+ */
+static int ntv2_read_rows_til(
+   NTV2_HDR *      hdr,
+   const NTV2_REC *rec,
+   int             plane,
+   int             row,
+   int             nrows,
+   NTV2_SHIFT *    data,
+   NTV2_SHIFT *    strip)
+{
+   size_t strip_len;
+   long   plane_size;
+   int    row0, col0, ntrows, ntcols;
+   int    tcol0;
+   int    trow = -1;
+   int    r;
+
+   ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+   plane_size = ntv2_til_plane_size(ntrows, ntcols);
+
+   tcol0     = col0 / NTV2_TIL_DIM;
+   strip_len = (size_t)((col0 + rec->ncols - 1) / NTV2_TIL_DIM - tcol0 + 1) *
+               NTV2_TIL_TILE_SIZE;
+
+   for (r = 0; r < nrows; r++)
+   {
+      int orow = row0 + row + r;
+      int col;
+
+      if ( (orow / NTV2_TIL_DIM) != trow )
+      {
+         trow = orow / NTV2_TIL_DIM;
+
+         if ( ntv2_fread_at(hdr, strip, strip_len,
+                            rec->offset + (plane * plane_size) +
+                            ((long)(trow * ntcols + tcol0) *
+                             NTV2_TIL_TILE_SIZE)) != strip_len )
+         {
+            return NTV2_ERR_IOERR;
+         }
+      }
+
+      for (col = 0; col < rec->ncols; col++)
+      {
+         int ocol = col0 + col;
+         const NTV2_SHIFT * s = strip +
+            ((ocol / NTV2_TIL_DIM - tcol0) * NTV2_TIL_DIM * NTV2_TIL_DIM) +
+            ((orow % NTV2_TIL_DIM) * NTV2_TIL_DIM) +
+             (ocol % NTV2_TIL_DIM);
+
+         data[r * rec->ncols + col][NTV2_COORD_LAT] = (*s)[NTV2_COORD_LAT];
+         data[r * rec->ncols + col][NTV2_COORD_LON] = (*s)[NTV2_COORD_LON];
+      }
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read in tiled shift data for one sub-file.
+ *
+ * The accuracies are only read if wanted (see ntv2_read_accurs()), and
+ * are in their own plane after the shifts.
+ */
+static int ntv2_read_rec_til(
+   NTV2_HDR *      hdr,
+   NTV2_REC *      rec)
+{
+   NTV2_SHIFT * planes[2];
+   NTV2_SHIFT * strip;
+   int    row0, col0, ntrows, ntcols;
+   int    rc = NTV2_ERR_OK;
+   int    p;
+
+   ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+
+   /* allocate our arrays */
+
+   planes[0] = (NTV2_SHIFT *)ntv2_grid_alloc(hdr,
+                                             sizeof(NTV2_SHIFT) * rec->num);
+   planes[1] = NTV2_NULL;
+   strip     = (NTV2_SHIFT *)ntv2_memalloc(sizeof(NTV2_SHIFT) * ntcols *
+                                           NTV2_TIL_DIM * NTV2_TIL_DIM);
+
+   if ( ntv2_read_accurs(hdr) )
+      planes[1] = (NTV2_SHIFT *)ntv2_grid_alloc(hdr,
+                                                sizeof(NTV2_SHIFT) * rec->num);
+
+   if ( planes[0] == NTV2_NULL || strip == NTV2_NULL ||
+        (ntv2_read_accurs(hdr) && planes[1] == NTV2_NULL) )
+   {
+      rc = NTV2_ERR_NO_MEMORY;
+   }
+
+   /* now read the data */
+
+   for (p = 0; p < 2 && rc == NTV2_ERR_OK; p++)
+   {
+      if ( planes[p] != NTV2_NULL )
+         rc = ntv2_read_rows_til(hdr, rec, p, 0, rec->nrows, planes[p], strip);
+   }
+
+   ntv2_memdealloc(strip);
+
+   if ( rc != NTV2_ERR_OK )
+   {
+      ntv2_grid_free(hdr, planes[0]);
+      ntv2_grid_free(hdr, planes[1]);
+      return rc;
+   }
+
+   /* make sure the data is visible before the pointers are */
+
+   ntv2_store_ptr(&rec->accurs, planes[1]);
+   ntv2_store_ptr(&rec->shifts, planes[0]);
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read in binary shift data for all sub-files.
+ *
+ * The sub-files are read in traversal order, so that grid arrays taken
+ * from an arena are laid out in the order they are looked at.
+ */
+static int ntv2_read_data_bin(
+   NTV2_HDR *hdr)
+{
+   NTV2_FILE_GS * buf     = NTV2_NULL;
+   size_t         buf_len = 0;
+   int            rc      = NTV2_ERR_OK;
+   NTV2_REC *     rec;
+
+   for (rec = hdr->first_parent;
+        rec != NTV2_NULL && rc == NTV2_ERR_OK;
+        rec = ntv2_next_rec(rec))
+   {
+      if ( rec->active )
+      {
+         if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+            rc = ntv2_read_rec_til(hdr, rec);
+         else
+            rc = ntv2_read_rec_bin(hdr, rec, &buf, &buf_len);
+         if ( rc == NTV2_ERR_OK && hdr->data_mode == NTV2_DATA_COMPRESSED )
+            ntv2_pack_rec(hdr, rec);
+      }
+   }
+
+   ntv2_memdealloc(buf);
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Read in the binary shift data for a sub-file on first use.
+ *
+ * This is called when a point is found in a record whose data
+ * has not been read in yet.  The check is repeated once the mutex
+ * is held, so the data is only read once even if several threads
+ * get here at the same time.  If the data can't be read in (say,
+ * there isn't enough memory), the record is marked so that it isn't
+ * tried again, and the shifts will just be read from the file
+ * on-the-fly.
+ */
+static void ntv2_demand_rec_bin(
+   const NTV2_HDR *hdr,
+   const NTV2_REC *rec)
+{
+   ntv2_mutex_enter(hdr->mutex);
+   {
+      if ( rec->shifts == NTV2_NULL && !rec->load_failed &&
+           hdr->io.read_at != NTV2_NULL )
+      {
+         NTV2_FILE_GS * buf     = NTV2_NULL;
+         size_t         buf_len = 0;
+         int            rc;
+
+         if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+            rc = ntv2_read_rec_til((NTV2_HDR *)hdr, (NTV2_REC *)rec);
+         else
+            rc = ntv2_read_rec_bin((NTV2_HDR *)hdr, (NTV2_REC *)rec,
+                                   &buf, &buf_len);
+         ntv2_memdealloc(buf);
+
+         if ( rc != NTV2_ERR_OK || rec->shifts == NTV2_NULL )
+            ntv2_store_flag(&((NTV2_REC *)rec)->load_failed, TRUE);
+      }
+   }
+   ntv2_mutex_leave(hdr->mutex);
+}
+
+/*------------------------------------------------------------------------
+ * Map a binary (or tiled) NTv2 file into memory.
+ *
+ * No data is copied: shifts are read directly from the mapped grid-shift
+ * records when transforming points.  If the file cannot be mapped, the
+ * map pointer is left null and the caller should read the data instead.
+ * If the file is being read from a buffer, the buffer is used as is.
+ */
+static int ntv2_map_data_bin(
+   NTV2_HDR *hdr)
+{
+   int i;
+
+   if ( hdr->map_data == NTV2_NULL )
+   {
+      /* Only a file read by the built-in routines can be mapped. */
+      if ( ntv2_io_fp(hdr) == NTV2_NULL )
+         return NTV2_ERR_OK;
+
+      hdr->map_data = (const unsigned char *)
+                      ntv2_map_file(hdr->path, &hdr->map_size);
+      if ( hdr->map_data == NTV2_NULL )
+         return NTV2_ERR_OK;
+      hdr->map_owned = TRUE;
+   }
+
+   /* make sure the file is big enough for all the grid data we'll access */
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+
+      long end;
+
+      if ( !rec->active )
+         continue;
+
+      if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+      {
+         int row0, col0, ntrows, ntcols;
+
+         ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+         end = rec->offset + ntv2_til_plane_size(ntrows, ntcols);
+      }
+      else
+      {
+         end = ntv2_data_offset(rec, 0, rec->nrows);
+      }
+
+      if ( (size_t)end > hdr->map_size )
+      {
+         return NTV2_ERR_IOERR;
+      }
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Load a binary (or tiled) NTv2 file into memory.
+ *
+ * This routine combines all the lower-level read routines into one.
+ */
+static NTV2_HDR * ntv2_load_file_bin(
+   const char *  ntv2file,
+   const void *  buf,
+   size_t        len,
+   const NTV2_IO *io,
+   const void *  idx,
+   int           type,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc)
+{
+   NTV2_HDR * hdr = NTV2_NULL;
+   int rc = NTV2_ERR_OK;
+
+   hdr = ntv2_create(ntv2file, buf, len, io, type, prc);
+   if ( hdr == NTV2_NULL )
+   {
+      return NTV2_NULL;
+   }
+
+   hdr->alloc.policy = (read_data & NTV2_ALLOC_FLAGS);
+   read_data &= ~NTV2_ALLOC_FLAGS;
+
+   /* Quantized data is compressed data with the shifts rounded. */
+   if ( read_data == NTV2_DATA_QUANTIZED )
+   {
+      hdr->quantized = TRUE;
+      read_data      = NTV2_DATA_COMPRESSED;
+   }
+
+   if ( read_data != NTV2_DATA_HDRS_ONLY &&
+        read_data != NTV2_DATA_MAPPED    &&
+        read_data != NTV2_DATA_ON_DEMAND &&
+        read_data != NTV2_DATA_COMPRESSED )
+   {
+      read_data = NTV2_DATA_IN_MEMORY;
+   }
+
+   /* A buffer is used in place unless a copy of the data is wanted. */
+   if ( buf != NTV2_NULL && read_data != NTV2_DATA_IN_MEMORY &&
+                            read_data != NTV2_DATA_COMPRESSED )
+   {
+      read_data = NTV2_DATA_MAPPED;
+   }
+
+   hdr->keep_orig      = keep_orig;
+   hdr->data_mode      = read_data;
+
+   if ( rc == NTV2_ERR_OK )
+   {
+      if ( idx != NTV2_NULL )
+         rc = ntv2_read_hdrs_idx(hdr, idx);
+      else if ( type == NTV2_FILE_TYPE_TIL )
+         rc = ntv2_read_hdrs_til(hdr);
+      else
+         rc = ntv2_read_hdrs_bin(hdr);
+   }
+
+   if ( rc == NTV2_ERR_OK && extent != NTV2_NULL )
+   {
+      rc = ntv2_process_extent(hdr, extent);
+   }
+
+   if ( rc != NTV2_ERR_OK )
+   {
+      ntv2_io_close(hdr);
+
+      if ( !hdr->map_owned )
+      {
+         hdr->map_data = NTV2_NULL;
+         hdr->map_size = 0;
+      }
+   }
+   else
+   {
+      if ( hdr->data_mode == NTV2_DATA_MAPPED )
+      {
+         rc = ntv2_map_data_bin(hdr);
+
+         /* If we can't map the file, just read it in. */
+         if ( rc == NTV2_ERR_OK && hdr->map_data == NTV2_NULL )
+            hdr->data_mode = NTV2_DATA_IN_MEMORY;
+      }
+
+      if ( hdr->data_mode == NTV2_DATA_IN_MEMORY &&
+           (hdr->alloc.policy & NTV2_ALLOC_ARENA) )
+      {
+         /* Not fatal if there's no room for an arena. */
+         NTV2_HDR * rep = ntv2_arena_make(hdr);
+         if ( rep != NTV2_NULL )
+            hdr = rep;
+      }
+
+      if ( hdr->data_mode == NTV2_DATA_IN_MEMORY ||
+           hdr->data_mode == NTV2_DATA_COMPRESSED )
+      {
+         rc = ntv2_read_data_bin(hdr);
+      }
+
+      if ( hdr->data_mode == NTV2_DATA_IN_MEMORY ||
+           hdr->data_mode == NTV2_DATA_MAPPED    ||
+           hdr->data_mode == NTV2_DATA_COMPRESSED )
+      {
+         /* The file is kept open if the original data is kept, since
+            the accuracies are left in it until they are asked for. */
+         NTV2_BOOL keep_file = ( rc == NTV2_ERR_OK && hdr->keep_orig &&
+                                 hdr->data_mode != NTV2_DATA_MAPPED &&
+                                 hdr->io.read_at != NTV2_NULL );
+
+         /* Otherwise we're done with the file whether successful or not */
+         if ( !keep_file )
+            ntv2_io_close(hdr);
+
+         /* and with the caller's buffer if the data was copied */
+         if ( hdr->data_mode != NTV2_DATA_MAPPED && !hdr->map_owned )
+         {
+            hdr->map_data = NTV2_NULL;
+            hdr->map_size = 0;
+         }
+
+         /* and the mutex is only needed for reading from the file */
+         if ( !keep_file )
+         {
+            ntv2_mutex_delete(hdr->mutex);
+            hdr->mutex = NTV2_NULL;
+         }
+      }
+
+      if ( hdr->data_mode == NTV2_DATA_HDRS_ONLY ||
+           hdr->data_mode == NTV2_DATA_COMPRESSED )
+      {
+         /* Not fatal if there's no room for a cache. */
+         ntv2_set_cache_size(hdr, NTV2_CACHE_SIZE_DEFAULT);
+      }
+
+      /* Fetch data for batches of points in the best way we can. */
+      if ( ntv2_fetch_supported(hdr, NTV2_FETCH_ASYNC) )
+         hdr->fetch_mode = NTV2_FETCH_ASYNC;
+      else if ( ntv2_fetch_supported(hdr, NTV2_FETCH_READ) )
+         hdr->fetch_mode = NTV2_FETCH_READ;
+      else
+         hdr->fetch_mode = NTV2_FETCH_NONE;
+   }
+
+   *prc = rc;
+   return hdr;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 ascii read routines                                                  */
+/* ------------------------------------------------------------------------- */
+
+#define RT(n)    if ( ntv2_read_toks(hdr, &tok, n) <= 0 ) \
+                    return NTV2_ERR_UNEXPECTED_EOF
+
+#define TOK(i)   tok.toks[i]
+
+/*------------------------------------------------------------------------
+ * Read a ascii overview record.
+ */
+static int ntv2_read_ov_asc(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_OV *ov)
+{
+   NTV2_TOKEN tok;
+
+   /* -------- NUM_OREC */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_num_orec,  TOK(0));
+   ov->i_num_orec =            atoi(TOK(1));
+   ov->p_num_orec = 0;
+
+   if ( ov->i_num_orec != 11 )
+      return NTV2_ERR_INVALID_NUM_OREC;
+
+   /* -------- NUM_SREC */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_num_srec,  TOK(0));
+   ov->i_num_srec =            atoi(TOK(1));
+   ov->p_num_srec = 0;
+
+   if ( ov->i_num_srec != 11 )
+      return NTV2_ERR_INVALID_NUM_SREC;
+
+   /* -------- NUM_FILE */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_num_file,  TOK(0));
+   ov->i_num_file =            atoi(TOK(1));
+   ov->p_num_file = 0;
+
+   if ( ov->i_num_file <= 0 )
+      return NTV2_ERR_INVALID_NUM_FILE;
+   hdr->num_recs = ov->i_num_file;
+
+   /* -------- GS_TYPE */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_gs_type,   TOK(0));
+   ntv2_strcpy_pad(ov->s_gs_type,   TOK(1));
+
+   /* -------- VERSION */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_version,   TOK(0));
+   ntv2_strcpy_pad(ov->s_version,   TOK(1));
+
+   /* -------- SYSTEM_F */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_system_f,  TOK(0));
+   ntv2_strcpy_pad(ov->s_system_f,  TOK(1));
+
+   /* -------- SYSTEM_T */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_system_t,  TOK(0));
+   ntv2_strcpy_pad(ov->s_system_t,  TOK(1));
+
+   /* -------- MAJOR_F */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_major_f,   TOK(0));
+   ov->d_major_f =        ntv2_atod(TOK(1));
+
+   /* -------- MINOR_F */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_minor_f,   TOK(0));
+   ov->d_minor_f =        ntv2_atod(TOK(1));
+
+   /* -------- MAJOR_T */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_major_t,   TOK(0));
+   ov->d_major_t =        ntv2_atod(TOK(1));
+
+   /* -------- MINOR_T */
+
+   RT(2);
+   ntv2_strcpy_pad(ov->n_minor_t,   TOK(0));
+   ov->d_minor_t =        ntv2_atod(TOK(1));
+
+   /* -------- get the conversion */
+
+   return ntv2_get_conv(hdr, ov);
+}
+
+/*------------------------------------------------------------------------
+ * Read a ascii subfile record.
+ */
+static int ntv2_read_sf_asc(
+   NTV2_HDR     *hdr,
+   NTV2_FILE_SF *sf)
+{
+   NTV2_TOKEN tok;
+
+   /* -------- SUB_NAME */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_sub_name,  TOK(0));
+   ntv2_strcpy_pad(sf->s_sub_name,  TOK(1));
+
+   /* -------- PARENT */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_parent,    TOK(0));
+   ntv2_strcpy_pad(sf->s_parent,    TOK(1));
+
+   /* -------- CREATED */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_created,   TOK(0));
+   ntv2_strcpy_pad(sf->s_created,   TOK(1));
+
+   /* -------- UPDATED */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_updated,   TOK(0));
+   ntv2_strcpy_pad(sf->s_updated,   TOK(1));
+
+   /* -------- S_LAT */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_s_lat,     TOK(0));
+   sf->d_s_lat =          ntv2_atod(TOK(1));
+
+   /* -------- N_LAT */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_n_lat,     TOK(0));
+   sf->d_n_lat =          ntv2_atod(TOK(1));
+
+   /* -------- E_LONG */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_e_lon,     TOK(0));
+   sf->d_e_lon =          ntv2_atod(TOK(1));
+
+   /* -------- W_LONG */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_w_lon,     TOK(0));
+   sf->d_w_lon =          ntv2_atod(TOK(1));
+
+   /* -------- LAT_INC */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_lat_inc,   TOK(0));
+   sf->d_lat_inc =        ntv2_atod(TOK(1));
+
+   /* -------- LONG_INC */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_lon_inc,   TOK(0));
+   sf->d_lon_inc =        ntv2_atod(TOK(1));
+
+   /* -------- GS_COUNT */
+
+   RT(2);
+   ntv2_strcpy_pad(sf->n_gs_count,  TOK(0));
+   sf->i_gs_count =            atoi(TOK(1));
+   sf->p_gs_count = 0;
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read a number of ascii grid-shift lines from the current position.
+ *
+ * The shifts and the accuracies are each only stored if their array
+ * is not null.
+ */
+static int ntv2_read_vals_asc(
+   NTV2_HDR   *hdr,
+   int         num,
+   NTV2_SHIFT *shifts,
+   NTV2_SHIFT *accurs)
+{
+   int i;
+
+   for (i = 0; i < num; i++)
+   {
+      double vals[4];
+      int    n = ntv2_read_nums(hdr, vals, 4);
+
+      if ( n <= 0 )
+         return NTV2_ERR_UNEXPECTED_EOF;
+
+      if ( n == 2 || n == 4 )
+      {
+         if ( shifts != NTV2_NULL )
+         {
+            shifts[i][NTV2_COORD_LAT] = (float)vals[0];
+            shifts[i][NTV2_COORD_LON] = (float)vals[1];
+         }
+
+         if ( accurs != NTV2_NULL )
+         {
+            /* Note that if there are only 2 values in the line,
+               the accuracies are zero.
+            */
+            accurs[i][NTV2_COORD_LAT] = (n == 4) ? (float)vals[2] : 0;
+            accurs[i][NTV2_COORD_LON] = (n == 4) ? (float)vals[3] : 0;
+         }
+      }
+      else
+      {
+         return NTV2_ERR_INVALID_LINE;
+      }
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Read in ascii shift data
+ *
+ * Note that it is OK if only shift data is on a line (i.e. no
+ * accuracy data).  In that case, the accuracies are set to 0.
+ */
+static int ntv2_read_data_asc(
+   NTV2_HDR *hdr,
+   NTV2_REC *rec,
+   NTV2_BOOL read_data)
+{
+   /* allocate our arrays */
+
+   if ( read_data )
+   {
+      {
+         rec->shifts = (NTV2_SHIFT *)
+                       ntv2_grid_alloc(hdr, sizeof(*rec->shifts) * rec->num);
+         if ( rec->shifts == NTV2_NULL )
+            return NTV2_ERR_NO_MEMORY;
+      }
+
+      if ( ntv2_read_accurs(hdr) )
+      {
+         rec->accurs = (NTV2_SHIFT *)
+                       ntv2_grid_alloc(hdr, sizeof(*rec->accurs) * rec->num);
+         if ( rec->accurs == NTV2_NULL )
+            return NTV2_ERR_NO_MEMORY;
+      }
+   }
+
+   /* now read the data */
+
+   return ntv2_read_vals_asc(hdr, rec->num, rec->shifts, rec->accurs);
+}
+
+/*------------------------------------------------------------------------
+ * Read a ascii end record.
+ */
+static int ntv2_read_er_asc(
+   NTV2_HDR *hdr)
+{
+   NTV2_TOKEN tok;
+   int num;
+   int rc = 0;
+
+   num = ntv2_read_toks(hdr, &tok, 1);
+   if ( num <= 0 )
+   {
+      hdr->fixed |= NTV2_FIX_END_REC_NOT_FOUND;
+   }
+   else
+   {
+      if ( ntv2_strcmp_i(tok.toks[0], "END") != 0 )
+         hdr->fixed |= NTV2_FIX_END_REC_NOT_FOUND;
+   }
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Read ascii header data (and the grid data if wanted) from the file.
+ *
+ * The data has to be read through (if only to skip it) to get from one
+ * sub-file record to the next.
+ */
+static int ntv2_read_hdrs_asc(
+   NTV2_HDR *hdr,
+   NTV2_BOOL read_data)
+{
+   NTV2_FILE_OV  ov_rec;
+   NTV2_FILE_SF  sf_rec;
+   int i;
+   int rc;
+
+   /* -------- read in the overview record */
+
+   rc = ntv2_read_ov_asc(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   rc = ntv2_create_recs(hdr, &ov_rec);
+   if ( rc != NTV2_ERR_OK )
+   {
+      return rc;
+   }
+
+   /* -------- read in all subfile records */
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      rc = ntv2_read_sf_asc(hdr, &sf_rec);
+      if ( rc == NTV2_ERR_OK )
+      {
+         if ( hdr->subfiles != NTV2_NULL )
+            memcpy(&hdr->subfiles[i], &sf_rec, sizeof(*hdr->subfiles));
+
+         rc = ntv2_sf_to_rec(hdr, &sf_rec, i);
+         if ( rc == NTV2_ERR_OK )
+            rc = ntv2_read_data_asc(hdr, hdr->recs + i, read_data);
+         if ( rc == NTV2_ERR_OK && hdr->data_mode == NTV2_DATA_COMPRESSED )
+            ntv2_pack_rec(hdr, hdr->recs + i);
+      }
+
+      if ( rc != NTV2_ERR_OK )
+      {
+         return rc;
+      }
+   }
+
+   /* -------- read in the end record */
+
+   ntv2_read_er_asc(hdr);
+
+   /* -------- adjust all pointers */
+
+   rc = ntv2_fix_ptrs(hdr);
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Read ascii grid data for all sub-files, once their headers have been
+ * read from a header index.
+ *
+ * The index gives where the data of each sub-file starts, so nothing
+ * has to be read from the file if only the headers are wanted.  The
+ * sub-files are read in traversal order (see ntv2_read_data_bin()).
+ */
+static int ntv2_read_idx_asc(
+   NTV2_HDR   *hdr,
+   NTV2_BOOL   read_data)
+{
+   NTV2_REC * rec;
+   int rc;
+
+   for (rec = hdr->first_parent; rec != NTV2_NULL; rec = ntv2_next_rec(rec))
+   {
+      ntv2_fseek(hdr, rec->offset, SEEK_SET);
+
+      rc = ntv2_read_data_asc(hdr, rec, read_data);
+      if ( rc != NTV2_ERR_OK )
+      {
+         return rc;
+      }
+
+      if ( hdr->data_mode == NTV2_DATA_COMPRESSED )
+         ntv2_pack_rec(hdr, rec);
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Load a NTv2 ascii file into memory.
+ */
+static NTV2_HDR * ntv2_load_file_asc(
+   const char *  ntv2file,
+   const void *  buf,
+   size_t        len,
+   const NTV2_IO *io,
+   const void *  idx,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc)
+{
+   NTV2_HDR *hdr;
+   int rc;
+
+   NTV2_UNUSED_PARAMETER(extent);
+
+   hdr = ntv2_create(ntv2file, buf, len, io, NTV2_FILE_TYPE_ASC, prc);
+   if ( hdr == NTV2_NULL )
+   {
+      return NTV2_NULL;
+   }
+
+   hdr->alloc.policy = (read_data & NTV2_ALLOC_FLAGS);
+   read_data &= ~NTV2_ALLOC_FLAGS;
+
+   hdr->keep_orig = keep_orig;
+   if ( read_data == NTV2_DATA_QUANTIZED )
+      hdr->quantized = TRUE;
+   if ( read_data == NTV2_DATA_COMPRESSED || hdr->quantized )
+      hdr->data_mode = NTV2_DATA_COMPRESSED;
+   else
+      hdr->data_mode = read_data ? NTV2_DATA_IN_MEMORY : NTV2_DATA_HDRS_ONLY;
+
+   /* -------- read in the headers (and the data if wanted) */
+
+   if ( idx != NTV2_NULL )
+      rc = ntv2_read_hdrs_idx(hdr, idx);
+   else
+      rc = ntv2_read_hdrs_asc(hdr, read_data);
+
+   /* -------- move it into an arena if wanted (not fatal if no room) */
+
+   if ( rc == NTV2_ERR_OK && hdr->data_mode == NTV2_DATA_IN_MEMORY &&
+        (hdr->alloc.policy & NTV2_ALLOC_ARENA) )
+   {
+      NTV2_HDR * rep = ntv2_arena_make(hdr);
+      if ( rep != NTV2_NULL )
+         hdr = rep;
+   }
+
+   /* -------- read in the data if the headers came from an index */
+
+   if ( rc == NTV2_ERR_OK && idx != NTV2_NULL && read_data )
+      rc = ntv2_read_idx_asc(hdr, read_data);
+
+   /* -------- done with the caller's buffer (if any) */
+
+   hdr->map_data = NTV2_NULL;
+   hdr->map_size = 0;
+
+   if ( rc != NTV2_ERR_OK )
+   {
+      ntv2_delete(hdr);
+      hdr = NTV2_NULL;
+   }
+   else if ( hdr->data_mode == NTV2_DATA_COMPRESSED )
+   {
+      /* Not fatal if there's no room for a cache. */
+      ntv2_set_cache_size(hdr, NTV2_CACHE_SIZE_DEFAULT);
+   }
+
+   *prc = rc;
+   return hdr;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 read routines                                                        */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Load a NTv2 file into memory.
+ */
+NTV2_HDR * ntv2_load_file(
+   const char *  ntv2file,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc)
+{
+   NTV2_HDR * hdr;
+   int        type;
+   int        rc;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+   *prc = NTV2_ERR_OK;
+
+   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
+   {
+      *prc = NTV2_ERR_NULL_PATH;
+      return NTV2_NULL;
+   }
+
+   type = ntv2_filetype(ntv2file);
+   switch (type)
+   {
+      case NTV2_FILE_TYPE_ASC:
+         hdr = ntv2_load_file_asc(ntv2file,
+                                  NTV2_NULL,
+                                  0,
+                                  NTV2_NULL,
+                                  NTV2_NULL,
+                                  keep_orig,
+                                  read_data,
+                                  extent,
+                                  prc);
+         break;
+
+      case NTV2_FILE_TYPE_BIN:
+      case NTV2_FILE_TYPE_TIL:
          hdr = ntv2_load_file_bin(ntv2file,
+                                  NTV2_NULL,
+                                  0,
+                                  NTV2_NULL,
+                                  NTV2_NULL,
+                                  type,
+                                  keep_orig,
+                                  read_data,
+                                  extent,
+                                  prc);
+         break;
+
+      default:
+         hdr  = NTV2_NULL;
+         *prc = NTV2_ERR_UNKNOWN_FILE_TYPE;
+         break;
+   }
+
+   return hdr;
+}
+
+/*------------------------------------------------------------------------
+ * Load a NTv2 file from a memory buffer.
+ */
+NTV2_HDR * ntv2_load_buffer(
+   const void *  buf,
+   size_t        len,
+   int           type,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc)
+{
+   NTV2_HDR * hdr;
+   int        rc;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+   *prc = NTV2_ERR_OK;
+
+   if ( buf == NTV2_NULL || len == 0 )
+   {
+      *prc = NTV2_ERR_NULL_PATH;
+      return NTV2_NULL;
+   }
+
+   switch (type)
+   {
+      case NTV2_FILE_TYPE_ASC:
+         /* the text is not kept, so the data must be read now */
+         if ( (read_data & ~NTV2_ALLOC_FLAGS) != NTV2_DATA_COMPRESSED &&
+              (read_data & ~NTV2_ALLOC_FLAGS) != NTV2_DATA_QUANTIZED )
+         {
+            read_data = NTV2_DATA_IN_MEMORY | (read_data & NTV2_ALLOC_FLAGS);
+         }
+         hdr = ntv2_load_file_asc("",
+                                  buf,
+                                  len,
+                                  NTV2_NULL,
+                                  NTV2_NULL,
+                                  keep_orig,
+                                  read_data,
+                                  extent,
+                                  prc);
+         break;
+
+      case NTV2_FILE_TYPE_BIN:
+      case NTV2_FILE_TYPE_TIL:
+         hdr = ntv2_load_file_bin("",
+                                  buf,
+                                  len,
+                                  NTV2_NULL,
+                                  NTV2_NULL,
+                                  type,
+                                  keep_orig,
+                                  read_data,
+                                  extent,
+                                  prc);
+         break;
+
+      default:
+         hdr  = NTV2_NULL;
+         *prc = NTV2_ERR_UNKNOWN_FILE_TYPE;
+         break;
+   }
+
+   return hdr;
+}
+
+/*------------------------------------------------------------------------
+ * Load a NTv2 file using caller-supplied I/O routines.
+ */
+NTV2_HDR * ntv2_load_io(
+   const NTV2_IO * io,
+   int             type,
+   NTV2_BOOL       keep_orig,
+   NTV2_BOOL       read_data,
+   NTV2_EXTENT *   extent,
+   int *           prc)
+{
+   NTV2_HDR * hdr;
+   int        rc;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+   *prc = NTV2_ERR_OK;
+
+   if ( io == NTV2_NULL || io->read_at == NTV2_NULL )
+   {
+      *prc = NTV2_ERR_CANNOT_OPEN_FILE;
+      return NTV2_NULL;
+   }
+
+   switch (type)
+   {
+      case NTV2_FILE_TYPE_ASC:
+         hdr = ntv2_load_file_asc("",
+                                  NTV2_NULL,
+                                  0,
+                                  io,
+                                  NTV2_NULL,
                                   keep_orig,
                                   read_data,
                                   extent,
                                   prc);
          break;
 
-      default:
-         hdr  = NTV2_NULL;
-         *prc = NTV2_ERR_UNKNOWN_FILE_TYPE;
-         break;
-   }
+      case NTV2_FILE_TYPE_BIN:
+      case NTV2_FILE_TYPE_TIL:
+         hdr = ntv2_load_file_bin("",
+                                  NTV2_NULL,
+                                  0,
+                                  io,
+                                  NTV2_NULL,
+                                  type,
+                                  keep_orig,
+                                  read_data,
+                                  extent,
+                                  prc);
+         break;
+
+      default:
+         if ( io->close != NTV2_NULL )
+            io->close(io->ctx);
+         hdr  = NTV2_NULL;
+         *prc = NTV2_ERR_UNKNOWN_FILE_TYPE;
+         break;
+   }
+
+   return hdr;
+}
+
+/*------------------------------------------------------------------------
+ * Check that the data offsets in a header index are all within the file.
+ *
+ * A file can be changed without its stamp changing (say, on a file
+ * system with coarse times), and then the offsets are not to be trusted.
+ */
+static NTV2_BOOL ntv2_check_index(
+   const void * idx,
+   NTV2_INT64   file_size)
+{
+   const NTV2_FILE_IX *  ix = (const NTV2_FILE_IX *)idx;
+   const unsigned char * p  = (const unsigned char *)idx +
+                              sizeof(NTV2_FILE_IX) + sizeof(NTV2_FILE_OV);
+   int i;
+
+   for (i = 0; i < ix->num_recs; i++)
+   {
+      long offset;
+
+      p += sizeof(NTV2_FILE_SF);
+      memcpy(&offset, p, sizeof(offset));
+      p += sizeof(offset);
+
+      if ( offset <= 0 || (NTV2_INT64)offset >= file_size )
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Read in a header index and check that it is up to date.
+ *
+ * This returns NULL if the index can't be read, or if it is not valid
+ * or doesn't match the file it was made from.
+ */
+static void * ntv2_read_index(
+   const char *       idxfile,
+   int                type,
+   const NTV2_STAMP * stamp)
+{
+   NTV2_FILE_IX ix_rec;
+   FILE *       fp;
+   void *       idx = NTV2_NULL;
+   size_t       len;
+
+   fp = fopen(idxfile, "rb");
+   if ( fp == NTV2_NULL )
+   {
+      return NTV2_NULL;
+   }
+
+   if ( fread(&ix_rec, sizeof(ix_rec), 1, fp) == 1                 &&
+        memcmp(ix_rec.magic, NTV2_IDX_MAGIC, NTV2_NAME_LEN) == 0   &&
+        ix_rec.byte_order == NTV2_IDX_BYTE_ORDER                   &&
+        ix_rec.version    == NTV2_IDX_VERSION                      &&
+        ix_rec.hdr_size   == (int)sizeof(ix_rec)                   &&
+        ix_rec.file_type  == type                                  &&
+        ix_rec.file_dev   == stamp->dev                            &&
+        ix_rec.file_ino   == stamp->ino                            &&
+        ix_rec.file_size  == stamp->size                           &&
+        ix_rec.file_time  == stamp->time                           &&
+        ix_rec.file_nsec  == stamp->nsec                           &&
+        ix_rec.num_recs   >  0                                     &&
+        fseek(fp, 0, SEEK_END) == 0                                &&
+        ftell(fp) == (long)NTV2_IDX_SIZE(ix_rec.num_recs) )
+   {
+      len = NTV2_IDX_SIZE(ix_rec.num_recs) - sizeof(ix_rec);
+      idx = ntv2_memalloc(sizeof(ix_rec) + len);
+      if ( idx != NTV2_NULL )
+      {
+         memcpy(idx, &ix_rec, sizeof(ix_rec));
+
+         if ( fseek(fp, (long)sizeof(ix_rec), SEEK_SET) != 0     ||
+              fread((char *)idx + sizeof(ix_rec), len, 1, fp) != 1 ||
+              !ntv2_check_index(idx, stamp->size) )
+         {
+            ntv2_memdealloc(idx);
+            idx = NTV2_NULL;
+         }
+      }
+   }
+
+   fclose(fp);
+   return idx;
+}
+
+/*------------------------------------------------------------------------
+ * Make a header index from a NTv2 object.
+ *
+ * The object must have been loaded with keep_orig set and with no
+ * extent, so that the original records and data offsets are all there.
+ */
+static void * ntv2_make_index(
+   const NTV2_HDR *   hdr,
+   const NTV2_STAMP * stamp)
+{
+   NTV2_FILE_IX    ix_rec;
+   unsigned char * idx;
+   unsigned char * p;
+   int i;
+
+   if ( hdr->overview == NTV2_NULL || hdr->subfiles == NTV2_NULL )
+   {
+      return NTV2_NULL;
+   }
+
+   idx = (unsigned char *)ntv2_memalloc(NTV2_IDX_SIZE(hdr->num_recs));
+   if ( idx == NTV2_NULL )
+   {
+      return NTV2_NULL;
+   }
+
+   memset(&ix_rec, 0, sizeof(ix_rec));
+   memcpy(ix_rec.magic, NTV2_IDX_MAGIC, NTV2_NAME_LEN);
+   ix_rec.byte_order   = NTV2_IDX_BYTE_ORDER;
+   ix_rec.version      = NTV2_IDX_VERSION;
+   ix_rec.hdr_size     = (int)sizeof(ix_rec);
+   ix_rec.file_type    = hdr->file_type;
+   ix_rec.num_recs     = hdr->num_recs;
+   ix_rec.pads_present = hdr->pads_present;
+   ix_rec.swap_data    = hdr->swap_data;
+   ix_rec.fixed        = hdr->fixed;
+   ix_rec.file_dev     = stamp->dev;
+   ix_rec.file_ino     = stamp->ino;
+   ix_rec.file_size    = stamp->size;
+   ix_rec.file_time    = stamp->time;
+   ix_rec.file_nsec    = stamp->nsec;
+
+   p = idx;
+   memcpy(p, &ix_rec,       sizeof(ix_rec));          p += sizeof(ix_rec);
+   memcpy(p, hdr->overview, sizeof(*hdr->overview));  p += sizeof(*hdr->overview);
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      memcpy(p, &hdr->subfiles[i],    sizeof(*hdr->subfiles));
+      p += sizeof(*hdr->subfiles);
+      memcpy(p, &hdr->recs[i].offset, sizeof(long));
+      p += sizeof(long);
+   }
+
+   return idx;
+}
+
+/*------------------------------------------------------------------------
+ * Write out a header index.
+ *
+ * It is written to a temporary file that is then renamed, so a partly
+ * written index is never seen under its real name.  Any failure just
+ * leaves the index to be rebuilt the next time.
+ */
+static void ntv2_write_index(
+   const char * idxfile,
+   const void * idx)
+{
+   const NTV2_FILE_IX * ix = (const NTV2_FILE_IX *)idx;
+   char      tmpfile[NTV2_MAX_PATH_LEN + 8];
+   FILE *    fp;
+   NTV2_BOOL ok;
+
+   sprintf(tmpfile, "%s.tmp", idxfile);
+
+   fp = fopen(tmpfile, "wb");
+   if ( fp == NTV2_NULL )
+   {
+      return;
+   }
+
+   ok = ( fwrite(idx, NTV2_IDX_SIZE(ix->num_recs), 1, fp) == 1 );
+   if ( fclose(fp) != 0 )
+      ok = FALSE;
+
+   if ( ok )
+      ok = ntv2_replace_file(tmpfile, idxfile);
+
+   if ( !ok )
+      remove(tmpfile);
+}
+
+/*------------------------------------------------------------------------
+ * Load a NTv2 file into memory, using a header index.
+ */
+NTV2_HDR * ntv2_load_indexed(
+   const char *  ntv2file,
+   const char *  idxfile,
+   NTV2_BOOL     keep_orig,
+   NTV2_BOOL     read_data,
+   NTV2_EXTENT * extent,
+   int *         prc)
+{
+   char       idxname[NTV2_MAX_PATH_LEN];
+   NTV2_HDR * hdr;
+   void *     idx;
+   NTV2_STAMP stamp;
+   int        type;
+   int        rc;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+   *prc = NTV2_ERR_OK;
+
+   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
+   {
+      *prc = NTV2_ERR_NULL_PATH;
+      return NTV2_NULL;
+   }
+
+   type = ntv2_filetype(ntv2file);
+
+   if ( idxfile == NTV2_NULL || *idxfile == 0 )
+   {
+      if ( strlen(ntv2file) + 1 + strlen(NTV2_FILE_IDX_EXTENSION) >=
+           sizeof(idxname) )
+      {
+         return ntv2_load_file(ntv2file, keep_orig, read_data, extent, prc);
+      }
+
+      sprintf(idxname, "%s.%s", ntv2file, NTV2_FILE_IDX_EXTENSION);
+      idxfile = idxname;
+   }
+   else if ( strlen(idxfile) >= NTV2_MAX_PATH_LEN )
+   {
+      return ntv2_load_file(ntv2file, keep_orig, read_data, extent, prc);
+   }
+
+   /* Without a stamp for the file, we can't tell if an index is good. */
+
+   if ( type == NTV2_FILE_TYPE_UNK ||
+        !ntv2_file_stamp(ntv2file, &stamp) )
+   {
+      return ntv2_load_file(ntv2file, keep_orig, read_data, extent, prc);
+   }
+
+   /* -------- get the index, rebuilding it if it's missing or stale */
+
+   idx = ntv2_read_index(idxfile, type, &stamp);
+   if ( idx == NTV2_NULL )
+   {
+      hdr = ntv2_load_file(ntv2file, TRUE, NTV2_DATA_HDRS_ONLY,
+                           NTV2_NULL, &rc);
+      if ( hdr != NTV2_NULL && rc == NTV2_ERR_OK )
+         idx = ntv2_make_index(hdr, &stamp);
+      ntv2_delete(hdr);
+
+      /* If there's no index, the file just gets loaded as usual. */
+      if ( idx == NTV2_NULL )
+         return ntv2_load_file(ntv2file, keep_orig, read_data, extent, prc);
+
+      ntv2_write_index(idxfile, idx);
+   }
+
+   /* -------- now load the file using the index */
+
+   if ( type == NTV2_FILE_TYPE_ASC )
+   {
+      hdr = ntv2_load_file_asc(ntv2file,
+                               NTV2_NULL,
+                               0,
+                               NTV2_NULL,
+                               idx,
+                               keep_orig,
+                               read_data,
+                               extent,
+                               prc);
+   }
+   else
+   {
+      hdr = ntv2_load_file_bin(ntv2file,
+                               NTV2_NULL,
+                               0,
+                               NTV2_NULL,
+                               idx,
+                               type,
+                               keep_orig,
+                               read_data,
+                               extent,
+                               prc);
+   }
+
+   ntv2_memdealloc(idx);
+   return hdr;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 write block routines                                                 */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * A block of rows of a sub-file being written out (or dumped).
+ *
+ * A sub-file is written a block of rows at a time.  If its data is in
+ * memory, the block just points into it.  Otherwise the rows are read
+ * from the input file (or decompressed) into the block's own arrays, so
+ * a file loaded without its data can be written out with no more memory
+ * than one block takes.  The same goes for accuracies, which are left in
+ * the file unless they were read in with the shifts.
+ */
+#ifndef   NTV2_WRITE_BUFSIZE
+#  define NTV2_WRITE_BUFSIZE  (256 * 1024)
+#endif
+
+typedef struct ntv2_blk NTV2_BLK;
+struct ntv2_blk
+{
+   const NTV2_SHIFT * shifts;          /* Shifts of the block's rows    */
+   const NTV2_SHIFT * accurs;          /* Accuracies or NULL if zeros   */
+   int                max_rows;        /* Max number of rows in a block */
+
+   NTV2_SHIFT *       sbuf;            /* Shifts read in    [max_rows]  */
+   NTV2_SHIFT *       abuf;            /* Accuracies read in[max_rows]  */
+   void *             rbuf;            /* Raw data read from the file   */
+   long               next;            /* Offset of next row if ascii   */
+};
+
+/*------------------------------------------------------------------------
+ * Determine whether data not in memory can be read from the input file.
+ */
+static NTV2_BOOL ntv2_have_source(
+   const NTV2_HDR *hdr)
+{
+   return ( hdr->io.read_at != NTV2_NULL || hdr->map_data != NTV2_NULL );
+}
+
+/*------------------------------------------------------------------------
+ * Release the block for a sub-file.
+ */
+static void ntv2_blk_term(
+   NTV2_BLK *blk)
+{
+   ntv2_memdealloc(blk->sbuf);
+   ntv2_memdealloc(blk->abuf);
+   ntv2_memdealloc(blk->rbuf);
+   memset(blk, 0, sizeof(*blk));
+}
+
+/*------------------------------------------------------------------------
+ * Set up a block for a sub-file.
+ *
+ * The number of rows in a block is a multiple of the given number
+ * (unless it is the whole sub-file).
+ */
+static int ntv2_blk_init(
+   const NTV2_HDR *hdr,
+   const NTV2_REC *rec,
+   NTV2_BLK       *blk,
+   int             multiple)
+{
+   NTV2_BOOL read_shifts = ( rec->shifts == NTV2_NULL &&
+                             rec->packed == NTV2_NULL );
+   NTV2_BOOL read_accurs = ( rec->accurs == NTV2_NULL &&
+                             ntv2_have_source(hdr) );
+   size_t raw_len = 0;
+   int    nrows;
+
+   memset(blk, 0, sizeof(*blk));
+
+   if ( read_shifts && !ntv2_have_source(hdr) )
+   {
+      return NTV2_ERR_DATA_NOT_READ;
+   }
+
+   if ( rec->shifts != NTV2_NULL && !read_accurs )
+   {
+      blk->max_rows = rec->nrows;
+      return NTV2_ERR_OK;
+   }
+
+   nrows = (int)(NTV2_WRITE_BUFSIZE / (rec->ncols * sizeof(NTV2_FILE_GS)));
+   nrows = (nrows / multiple) * multiple;
+   if ( nrows < multiple )
+      nrows = multiple;
+   if ( nrows > rec->nrows )
+      nrows = rec->nrows;
+   blk->max_rows = nrows;
+
+   if ( read_shifts || read_accurs )
+   {
+      if ( hdr->file_type == NTV2_FILE_TYPE_BIN )
+      {
+         raw_len = ntv2_read_row_len(rec) * nrows;
+      }
+      else if ( hdr->file_type == NTV2_FILE_TYPE_TIL )
+      {
+         int row0, col0, ntrows, ntcols;
+
+         ntv2_til_layout(rec, &row0, &col0, &ntrows, &ntcols);
+         raw_len = sizeof(NTV2_SHIFT) * ntcols * NTV2_TIL_DIM * NTV2_TIL_DIM;
+      }
+
+      if ( raw_len > 0 )
+      {
+         blk->rbuf = ntv2_memalloc(raw_len);
+         if ( blk->rbuf == NTV2_NULL )
+            return NTV2_ERR_NO_MEMORY;
+      }
+   }
+
+   if ( rec->shifts == NTV2_NULL )
+   {
+      blk->sbuf = (NTV2_SHIFT *)ntv2_memalloc(sizeof(NTV2_SHIFT) *
+                                              nrows * rec->ncols);
+      if ( blk->sbuf == NTV2_NULL )
+      {
+         ntv2_blk_term(blk);
+         return NTV2_ERR_NO_MEMORY;
+      }
+   }
+
+   if ( read_accurs )
+   {
+      blk->abuf = (NTV2_SHIFT *)ntv2_memalloc(sizeof(NTV2_SHIFT) *
+                                              nrows * rec->ncols);
+      if ( blk->abuf == NTV2_NULL )
+      {
+         ntv2_blk_term(blk);
+         return NTV2_ERR_NO_MEMORY;
+      }
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Decompress a block of rows of a sub-file.
+ */
+static void ntv2_blk_unpack(
+   const NTV2_REC *rec,
+   NTV2_BLK       *blk,
+   int             row,
+   int             nrows)
+{
+   NTV2_SHIFT tile[NTV2_TILE_NUM];
+   int ntcols = (rec->ncols + NTV2_TILE_DIM - 1) / NTV2_TILE_DIM;
+   int trow;
+   int tcol;
+
+   for (trow = row / NTV2_TILE_DIM;
+        trow <= (row + nrows - 1) / NTV2_TILE_DIM; trow++)
+   {
+      for (tcol = 0; tcol < ntcols; tcol++)
+      {
+         int tnrows, tncols;
+         int r;
+
+         ntv2_tile_size(rec, trow, tcol, &tnrows, &tncols);
+         ntv2_unpack_rec_tile(rec, trow, tcol, tile);
+
+         for (r = 0; r < tnrows; r++)
+         {
+            int irow = (trow * NTV2_TILE_DIM) + r;
+
+            if ( irow < row || irow >= row + nrows )
+               continue;
+
+            memcpy(blk->sbuf + ((irow - row) * rec->ncols) +
+                               (tcol * NTV2_TILE_DIM),
+                   tile + (r * NTV2_TILE_DIM),
+                   sizeof(NTV2_SHIFT) * tncols);
+         }
+      }
+   }
+}
+
+/*------------------------------------------------------------------------
+ * Get a block of rows of a sub-file.
+ *
+ * Rows are asked for in order.  This matters for an ascii file, which
+ * can only be read from the start of the sub-file's data onward, so
+ * where the next row starts is kept in the block.
+ *
+ * The mutex is held while reading the file, since data may also be read
+ * in on demand by another thread with the same stream routines.
+ */
+static int ntv2_blk_get(
+   NTV2_HDR       *hdr,
+   const NTV2_REC *rec,
+   NTV2_BLK       *blk,
+   int             row,
+   int             nrows)
+{
+   NTV2_SHIFT * shifts = NTV2_NULL;
+   NTV2_SHIFT * accurs = NTV2_NULL;
+   int rc = NTV2_ERR_OK;
+
+   /* get the shifts from memory or see where to read them to */
+
+   if ( rec->shifts != NTV2_NULL )
+   {
+      blk->shifts = rec->shifts + (row * rec->ncols);
+   }
+   else
+   {
+      blk->shifts = blk->sbuf;
+
+      if ( rec->packed != NTV2_NULL )
+         ntv2_blk_unpack(rec, blk, row, nrows);
+      else
+         shifts = blk->sbuf;
+   }
+
+   /* likewise for the accuracies */
+
+   if ( rec->accurs != NTV2_NULL )
+   {
+      blk->accurs = rec->accurs + (row * rec->ncols);
+   }
+   else
+   {
+      blk->accurs = blk->abuf;
+      accurs      = blk->abuf;
+   }
+
+   if ( shifts == NTV2_NULL && accurs == NTV2_NULL )
+      return NTV2_ERR_OK;
+
+   ntv2_mutex_enter(hdr->mutex);
+   {
+      switch (hdr->file_type)
+      {
+         case NTV2_FILE_TYPE_BIN:
+            rc = ntv2_read_rows_bin(hdr, rec, row, nrows, shifts, accurs,
+                                    (NTV2_FILE_GS *)blk->rbuf);
+            break;
+
+         case NTV2_FILE_TYPE_TIL:
+            if ( shifts != NTV2_NULL )
+               rc = ntv2_read_rows_til(hdr, rec, 0, row, nrows,
+                                       shifts, (NTV2_SHIFT *)blk->rbuf);
+            if ( accurs != NTV2_NULL && rc == NTV2_ERR_OK )
+               rc = ntv2_read_rows_til(hdr, rec, 1, row, nrows,
+                                       accurs, (NTV2_SHIFT *)blk->rbuf);
+            break;
+
+         case NTV2_FILE_TYPE_ASC:
+            ntv2_fseek(hdr, (row == 0) ? rec->offset : blk->next, SEEK_SET);
+            rc = ntv2_read_vals_asc(hdr, nrows * rec->ncols, shifts, accurs);
+            blk->next = ntv2_ftell(hdr);
+            break;
+      }
+   }
+   ntv2_mutex_leave(hdr->mutex);
+
+   return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 replication routines                                                 */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Get the number of bytes of grid data owned by an NTv2 object.
+ */
+size_t ntv2_data_size(
+   const NTV2_HDR *hdr)
+{
+   size_t size = 0;
+   int i;
+
+   if ( hdr == NTV2_NULL )
+      return 0;
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+
+      if ( rec->shifts != NTV2_NULL )
+         size += sizeof(*rec->shifts) * rec->num;
+
+      if ( rec->accurs != NTV2_NULL )
+         size += sizeof(*rec->accurs) * rec->num;
+
+      if ( rec->packed != NTV2_NULL )
+         size += ((const NTV2_PACKED *)rec->packed)->size;
+   }
+
+   return size;
+}
+
+/*------------------------------------------------------------------------
+ * Get how the grid arrays of an NTv2 object are allocated.
+ *
+ * Arrays may be read in on demand by another thread, so the stats
+ * are copied with the mutex (if any) held.
+ */
+int ntv2_alloc_stats(
+   const NTV2_HDR *   hdr,
+   NTV2_ALLOC_STATS * stats)
+{
+   if ( hdr == NTV2_NULL )
+      return NTV2_ERR_NULL_HDR;
+
+   if ( stats != NTV2_NULL )
+   {
+      ntv2_mutex_enter(hdr->mutex);
+      memcpy(stats, &hdr->alloc, sizeof(*stats));
+      ntv2_mutex_leave(hdr->mutex);
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Set the memory allocator used by the library.
+ */
+int ntv2_set_allocator(
+   const NTV2_ALLOCATOR *allocator)
+{
+   if ( allocator == NTV2_NULL )
+   {
+      memset(&ntv2_allocator, 0, sizeof(ntv2_allocator));
+      return NTV2_ERR_OK;
+   }
+
+   if ( allocator->alloc == NTV2_NULL || allocator->free == NTV2_NULL )
+      return NTV2_ERR_INVALID_ALLOCATOR;
+
+   memcpy(&ntv2_allocator, allocator, sizeof(ntv2_allocator));
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * Get the memory allocator used by the library.
+ */
+void ntv2_get_allocator(
+   NTV2_ALLOCATOR *allocator)
+{
+   if ( allocator != NTV2_NULL )
+      memcpy(allocator, &ntv2_allocator, sizeof(*allocator));
+}
+
+/*------------------------------------------------------------------------
+ * Copy an array of shift values.
+ *
+ * The copy is done by the calling thread, so with a first-touch
+ * memory policy the new pages end up on the caller's NUMA node.
+ */
+static NTV2_SHIFT * ntv2_copy_shifts(
+   NTV2_HDR *        rep,
+   const NTV2_SHIFT *shifts,
+   int               num)
+{
+   NTV2_SHIFT * copy;
+
+   if ( shifts == NTV2_NULL )
+      return NTV2_NULL;
+
+   copy = (NTV2_SHIFT *)ntv2_grid_alloc(rep, sizeof(*copy) * num);
+   if ( copy != NTV2_NULL )
+      memcpy(copy, shifts, sizeof(*copy) * num);
+
+   return copy;
+}
+
+/*------------------------------------------------------------------------
+ * Copy a block of compressed shifts for a replica.
+ *
+ * The index and data live in the same block, so they are relocated.
+ * The id is kept, since the tiles decode to the same shifts.
+ */
+static void * ntv2_copy_packed(
+   const void *p)
+{
+   const NTV2_PACKED * packed = (const NTV2_PACKED *)p;
+   NTV2_PACKED *       copy;
+
+   copy = (NTV2_PACKED *)ntv2_memalloc(packed->size);
+   if ( copy != NTV2_NULL )
+   {
+      memcpy(copy, packed, packed->size);
+      copy->index = (unsigned int *)((unsigned char *)copy +
+                    ((const unsigned char *)packed->index -
+                     (const unsigned char *)packed));
+      copy->data  = (unsigned char *)copy +
+                    (packed->data - (const unsigned char *)packed);
+   }
+
+   return copy;
+}
+
+/*------------------------------------------------------------------------
+ * Copy the data of a record into a replica.
+ *
+ * Compressed shifts are copied as they are.  Otherwise the shifts and
+ * accuracies are got a block of rows at a time, from memory if they
+ * are there or else from the input file, since the replica has no file.
+ */
+static int ntv2_copy_data(
+   NTV2_HDR *        rep,
+   const NTV2_HDR *  hdr,
+   NTV2_REC *        rec,
+   const NTV2_REC *  src)
+{
+   NTV2_BOOL read_accurs = FALSE;
+   NTV2_BLK  blk;
+   int       row;
+   int       rc;
+
+   if ( src->packed != NTV2_NULL )
+   {
+      rec->packed = ntv2_copy_packed(src->packed);
+      if ( rec->packed == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+   }
+   else
+   {
+      rec->shifts = (NTV2_SHIFT *)ntv2_grid_alloc(rep,
+                                               sizeof(NTV2_SHIFT) * rec->num);
+      if ( rec->shifts == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+   }
+
+   if ( src->accurs != NTV2_NULL ||
+        (hdr->keep_orig && ntv2_have_source(hdr)) )
+   {
+      read_accurs = TRUE;
+      rec->accurs = (NTV2_SHIFT *)ntv2_grid_alloc(rep,
+                                               sizeof(NTV2_SHIFT) * rec->num);
+      if ( rec->accurs == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+   }
+
+   if ( rec->shifts == NTV2_NULL && !read_accurs )
+      return NTV2_ERR_OK;
+
+   rc = ntv2_blk_init(hdr, src, &blk, 1);
+   for (row = 0; row < src->nrows && rc == NTV2_ERR_OK; row += blk.max_rows)
+   {
+      size_t offset = (size_t)row * rec->ncols;
+      size_t len;
+      int    nrows  = src->nrows - row;
+
+      if ( nrows > blk.max_rows )
+         nrows = blk.max_rows;
+      len = sizeof(NTV2_SHIFT) * nrows * rec->ncols;
+
+      rc = ntv2_blk_get((NTV2_HDR *)hdr, src, &blk, row, nrows);
+      if ( rc == NTV2_ERR_OK && read_accurs && blk.accurs == NTV2_NULL )
+         rc = NTV2_ERR_DATA_NOT_READ;
+      if ( rc != NTV2_ERR_OK )
+         break;
+
+      if ( rec->shifts != NTV2_NULL )
+         memcpy(rec->shifts + offset, blk.shifts, len);
+      if ( read_accurs )
+         memcpy(rec->accurs + offset, blk.accurs, len);
+   }
+   ntv2_blk_term(&blk);
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Create a replica of an NTv2 object.
+ *
+ * All pointers within the record array are relocated to point into
+ * the new record array.  No stream or mutex is kept, since all the
+ * data is copied into memory.
+ */
+#define NTV2_RELOC(p)  if ( (p) != NTV2_NULL ) \
+                          (p) = rep->recs + ((p) - hdr->recs)
+
+NTV2_HDR * ntv2_replicate(
+   const NTV2_HDR *hdr,
+   int             node,
+   int *           prc)
+{
+   NTV2_HDR *       rep;
+   NTV2_NUMA_POLICY policy;
+   int              rc;
+   int              i;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+   *prc = NTV2_ERR_OK;
+
+   if ( hdr == NTV2_NULL )
+   {
+      *prc = NTV2_ERR_NULL_HDR;
+      return NTV2_NULL;
+   }
+
+   if ( node < -1 )
+   {
+      *prc = NTV2_ERR_INVALID_ARG;
+      return NTV2_NULL;
+   }
+
+   /* data not in memory must be read from the input file */
+
+   if ( !ntv2_have_source(hdr) )
+   {
+      for (i = 0; i < hdr->num_recs; i++)
+      {
+         const NTV2_REC * rec = &hdr->recs[i];
+
+         if ( rec->active && rec->shifts == NTV2_NULL &&
+                             rec->packed == NTV2_NULL )
+         {
+            *prc = NTV2_ERR_DATA_NOT_READ;
+            return NTV2_NULL;
+         }
+      }
+   }
+
+   rep = (NTV2_HDR *)ntv2_memalloc(sizeof(*rep));
+   if ( rep == NTV2_NULL )
+   {
+      *prc = NTV2_ERR_NO_MEMORY;
+      return NTV2_NULL;
+   }
+
+   memcpy(rep, hdr, sizeof(*rep));
+   memset(&rep->io, 0, sizeof(rep->io));
+   rep->io_pos    = 0;
+   rep->io_err    = FALSE;
+   rep->io_buf    = NTV2_NULL;
+   rep->io_buf_pos = 0;
+   rep->io_buf_len = 0;
+   rep->mutex     = NTV2_NULL;
+   rep->map_data  = NTV2_NULL;
+   rep->map_size  = 0;
+   rep->map_owned = FALSE;
+   rep->shm_data  = NTV2_NULL;
+   rep->shm_size  = 0;
+   rep->cache     = NTV2_NULL;
+   rep->arena     = NTV2_NULL;
+
+   memset(&rep->alloc, 0, sizeof(rep->alloc));
+   rep->alloc.policy = hdr->alloc.policy;
+   rep->data_mode = (hdr->data_mode == NTV2_DATA_COMPRESSED) ?
+                    NTV2_DATA_COMPRESSED : NTV2_DATA_IN_MEMORY;
+   rep->overview  = NTV2_NULL;
+   rep->subfiles  = NTV2_NULL;
+   rep->num_recs  = 0;
+
+   /* -------- copy the record array and fix all pointers */
+
+   rep->recs = (NTV2_REC *)ntv2_memalloc(sizeof(*rep->recs) * hdr->num_recs);
+   if ( rep->recs == NTV2_NULL )
+   {
+      ntv2_delete(rep);
+      *prc = NTV2_ERR_NO_MEMORY;
+      return NTV2_NULL;
+   }
+
+   memcpy(rep->recs, hdr->recs, sizeof(*rep->recs) * hdr->num_recs);
+   rep->num_recs = hdr->num_recs;
+
+   NTV2_RELOC(rep->first_parent);
+   for (i = 0; i < rep->num_recs; i++)
+   {
+      NTV2_REC * rec = &rep->recs[i];
+
+      NTV2_RELOC(rec->parent);
+      NTV2_RELOC(rec->sub);
+      NTV2_RELOC(rec->next);
+
+      rec->shifts = NTV2_NULL;
+      rec->accurs = NTV2_NULL;
+      rec->packed = NTV2_NULL;
+   }
+
+   /* -------- copy the file record cache if present */
+
+   if ( hdr->overview != NTV2_NULL )
+   {
+      rep->overview = (NTV2_FILE_OV *)ntv2_memalloc(sizeof(*rep->overview));
+      if ( rep->overview == NTV2_NULL )
+      {
+         ntv2_delete(rep);
+         *prc = NTV2_ERR_NO_MEMORY;
+         return NTV2_NULL;
+      }
+      memcpy(rep->overview, hdr->overview, sizeof(*rep->overview));
+   }
+
+   if ( hdr->subfiles != NTV2_NULL )
+   {
+      rep->subfiles = (NTV2_FILE_SF *)
+                      ntv2_memalloc(sizeof(*rep->subfiles) * rep->num_recs);
+      if ( rep->subfiles == NTV2_NULL )
+      {
+         ntv2_delete(rep);
+         *prc = NTV2_ERR_NO_MEMORY;
+         return NTV2_NULL;
+      }
+      memcpy(rep->subfiles, hdr->subfiles,
+             sizeof(*rep->subfiles) * rep->num_recs);
+   }
+
+   /* -------- copy the data, placing it on the requested node */
+
+   if ( !ntv2_numa_bind(node, &policy) )
+   {
+      ntv2_delete(rep);
+      *prc = NTV2_ERR_INVALID_ARG;
+      return NTV2_NULL;
+   }
+   {
+      for (i = 0; i < rep->num_recs && *prc == NTV2_ERR_OK; i++)
+      {
+         NTV2_REC * rec = &rep->recs[i];
+         NTV2_REC   src;
+
+         if ( !rec->active )
+            continue;
+
+         /* the source's data may be read in on demand meanwhile */
+         ntv2_mutex_enter(hdr->mutex);
+         memcpy(&src, &hdr->recs[i], sizeof(src));
+         ntv2_mutex_leave(hdr->mutex);
+
+         *prc = ntv2_copy_data(rep, hdr, rec, &src);
+      }
+   }
+   ntv2_numa_unbind(&policy);
+
+   if ( *prc != NTV2_ERR_OK )
+   {
+      ntv2_delete(rep);
+      return NTV2_NULL;
+   }
+
+   return rep;
+}
+
+#undef NTV2_RELOC
+
+/*------------------------------------------------------------------------
+ * Get the NUMA node the calling thread is running on.
+ */
+int ntv2_numa_node(void)
+{
+   return ntv2_numa_current();
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 shared segment routines                                              */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * A shared segment starts with this header, followed by a table of
+ * NTV2_SHM_REC entries (one per sub-file) and then the shifts of each
+ * active sub-file, each on a cache-line boundary.
+ *
+ * The path, stamp, and extent say what the segment was made from, and
+ * the rest says how it is laid out, so a stale or foreign segment is
+ * never used.
+ */
+#define NTV2_SHM_MAGIC      "NTv2SHM "
+#define NTV2_SHM_BYTE_ORDER 0x01020304
+#define NTV2_SHM_VERSION    1
+#define NTV2_SHM_ALIGN      64
+
+/* Segments are sized in multiples of this, so one can be made on a
+   hugetlbfs mount.  It costs nothing in a tmpfs, where only the pages
+   written to use memory. */
+#define NTV2_SHM_ROUND      (2 * 1024 * 1024)
+
+typedef struct ntv2_shm_hdr NTV2_SHM_HDR;
+struct ntv2_shm_hdr
+{
+   char           magic [NTV2_NAME_LEN];  /* NTV2_SHM_MAGIC           */
+   int            byte_order;             /* NTV2_SHM_BYTE_ORDER      */
+   int            version;                /* NTV2_SHM_VERSION         */
+   int            hdr_size;               /* sizeof(NTV2_SHM_HDR)     */
+   int            shift_size;             /* sizeof(NTV2_SHIFT)       */
+   int            num_recs;               /* Number of sub-files      */
+   int            has_extent;             /* TRUE if extent is used   */
+   NTV2_STAMP     stamp;                  /* Stamp of the NTv2 file   */
+   NTV2_EXTENT    extent;                 /* Extent (if used)         */
+   size_t         seg_size;               /* Size of the segment      */
+   char           path [NTV2_MAX_PATH_LEN];
+                                          /* Full pathname of file    */
+};
+
+typedef struct ntv2_shm_rec NTV2_SHM_REC;
+struct ntv2_shm_rec
+{
+   size_t         offset;                 /* Offset of shifts or 0    */
+   int            nrows;                  /* Number of rows           */
+   int            ncols;                  /* Number of columns        */
+};
+
+/*------------------------------------------------------------------------
+ * Fill in a shared segment header for a file.
+ */
+static void ntv2_shm_init(
+   NTV2_SHM_HDR *      sh,
+   const char *        path,
+   const NTV2_EXTENT * extent,
+   const NTV2_STAMP *  stamp,
+   int                 num_recs)
+{
+   memset(sh, 0, sizeof(*sh));
+   memcpy(sh->magic, NTV2_SHM_MAGIC, NTV2_NAME_LEN);
+   sh->byte_order = NTV2_SHM_BYTE_ORDER;
+   sh->version    = NTV2_SHM_VERSION;
+   sh->hdr_size   = (int)sizeof(*sh);
+   sh->shift_size = (int)sizeof(NTV2_SHIFT);
+   sh->num_recs   = num_recs;
+   memcpy(&sh->stamp, stamp, sizeof(sh->stamp));
+   strcpy(sh->path, path);
+
+   if ( extent != NTV2_NULL )
+   {
+      sh->has_extent = TRUE;
+      sh->extent     = *extent;
+   }
+}
+
+/*------------------------------------------------------------------------
+ * Get the pathname of the shared segment for a file.
+ *
+ * The name is a hash of the full pathname, device and inode of the file,
+ * and the extent, so each can have its own segment however the file is
+ * named.  The header in the segment tells if it's the right one.
+ */
+static void ntv2_shm_name(
+   char *              name,
+   const char *        shm_dir,
+   const char *        path,
+   const NTV2_STAMP *  stamp,
+   const NTV2_EXTENT * extent)
+{
+   const unsigned char * p = (const unsigned char *)path;
+   unsigned long hash = 2166136261UL;
+   size_t i;
+
+   /* FNV-1a */
+   for (; *p; p++)
+      hash = (hash ^ *p) * 16777619UL;
+
+   p = (const unsigned char *)&stamp->dev;
+   for (i = 0; i < sizeof(stamp->dev); i++)
+      hash = (hash ^ p[i]) * 16777619UL;
+
+   p = (const unsigned char *)&stamp->ino;
+   for (i = 0; i < sizeof(stamp->ino); i++)
+      hash = (hash ^ p[i]) * 16777619UL;
+
+   if ( extent != NTV2_NULL )
+   {
+      p = (const unsigned char *)extent;
+      for (i = 0; i < sizeof(*extent); i++)
+         hash = (hash ^ p[i]) * 16777619UL;
+   }
+
+   sprintf(name, "%s/ntv2-%08lx.shm", shm_dir, hash & 0xffffffffUL);
+}
+
+/*------------------------------------------------------------------------
+ * Find the shared segment for a file.
+ *
+ * This gets the full pathname and stamp of the file, and the pathname
+ * of its segment.  Returns FALSE if the file can't be found.
+ */
+static NTV2_BOOL ntv2_shm_find(
+   const char *        ntv2file,
+   const char *        shm_dir,
+   const NTV2_EXTENT * extent,
+   char *              path,
+   NTV2_STAMP *        stamp,
+   char *              name)
+{
+   if ( shm_dir == NTV2_NULL || *shm_dir == 0 )
+      shm_dir = NTV2_SHM_DIR;
+
+   if ( ntv2file == NTV2_NULL || *ntv2file == 0                   ||
+        strlen(shm_dir) >= NTV2_MAX_PATH_LEN                      ||
+        !ntv2_full_path(ntv2file, path, NTV2_MAX_PATH_LEN)        ||
+        !ntv2_file_stamp(path, stamp) )
+   {
+      return FALSE;
+   }
+
+   ntv2_shm_name(name, shm_dir, path, stamp, extent);
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Check a shared segment against what it should be made from,
+ * and check its table against the records of an object.
+ */
+static NTV2_BOOL ntv2_shm_check(
+   const NTV2_HDR *     hdr,
+   const NTV2_SHM_HDR * want,
+   const unsigned char *seg,
+   size_t               seg_size)
+{
+   const NTV2_SHM_HDR * sh  = (const NTV2_SHM_HDR *)seg;
+   const NTV2_SHM_REC * tab = (const NTV2_SHM_REC *)(sh + 1);
+   int i;
+
+   if ( seg_size < sizeof(*sh) ||
+        memcmp(sh, want, NTV2_OFFSET_OF(NTV2_SHM_HDR, seg_size)) != 0 ||
+        strcmp(sh->path, want->path) != 0 ||
+        sh->seg_size > seg_size ||
+        sizeof(*sh) + sizeof(*tab) * sh->num_recs > sh->seg_size )
+   {
+      return FALSE;
+   }
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+
+      if ( !rec->active )
+         continue;
+
+      if ( tab[i].offset == 0                       ||
+           tab[i].nrows  != rec->nrows              ||
+           tab[i].ncols  != rec->ncols              ||
+           tab[i].offset + sizeof(NTV2_SHIFT) * rec->num > sh->seg_size )
+      {
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Use the shifts in a (checked) shared segment for an object.
+ *
+ * Any shifts already read in are freed.  An object loaded with only
+ * its headers becomes one with its data in memory, so its file can be
+ * closed if it is not wanted for the accuracies.
+ */
+static void ntv2_shm_use(
+   NTV2_HDR *           hdr,
+   const unsigned char *seg,
+   size_t               seg_size)
+{
+   const NTV2_SHM_REC * tab =
+      (const NTV2_SHM_REC *)((const NTV2_SHM_HDR *)seg + 1);
+   int i;
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      NTV2_REC * rec = &hdr->recs[i];
+
+      if ( rec->active )
+      {
+         ntv2_grid_free(hdr, rec->shifts);
+         rec->shifts = (NTV2_SHIFT *)(seg + tab[i].offset);
+      }
+   }
+
+   hdr->shm_data = seg;
+   hdr->shm_size = seg_size;
+
+   if ( hdr->data_mode != NTV2_DATA_IN_MEMORY )
+   {
+      ntv2_set_cache_size(hdr, 0);
+      hdr->data_mode = NTV2_DATA_IN_MEMORY;
+
+      if ( !hdr->keep_orig )
+      {
+         ntv2_io_close(hdr);
+         ntv2_mutex_delete(hdr->mutex);
+         hdr->mutex = NTV2_NULL;
+      }
+   }
+}
+
+/*------------------------------------------------------------------------
+ * Create a shared segment from the shifts of an object.
+ *
+ * The segment is built under a temporary name and then renamed, so no
+ * process ever sees a partial one.  Returns FALSE if it can't be made.
+ */
+static NTV2_BOOL ntv2_shm_make(
+   const NTV2_HDR *     hdr,
+   const NTV2_SHM_HDR * want,
+   const char *         name)
+{
+   char            tmpl[NTV2_MAX_PATH_LEN + 48];
+   NTV2_SHM_HDR *  sh;
+   NTV2_SHM_REC *  tab;
+   unsigned char * seg;
+   size_t          size;
+   size_t          alloc;
+   int i;
+
+   /* -------- lay out the segment */
+
+   size = sizeof(*sh) + sizeof(*tab) * hdr->num_recs;
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+
+      if ( rec->active )
+      {
+         size  = (size + NTV2_SHM_ALIGN - 1) & ~(size_t)(NTV2_SHM_ALIGN - 1);
+         size += sizeof(NTV2_SHIFT) * rec->num;
+      }
+   }
+
+   alloc = (size + NTV2_SHM_ROUND - 1) & ~(size_t)(NTV2_SHM_ROUND - 1);
+
+   sprintf(tmpl, "%s.XXXXXX", name);
+   seg = (unsigned char *)ntv2_shm_create(tmpl, alloc);
+   if ( seg == NTV2_NULL )
+      return FALSE;
+
+   /* -------- fill it in */
+
+   sh  = (NTV2_SHM_HDR *)seg;
+   tab = (NTV2_SHM_REC *)(sh + 1);
+
+   memcpy(sh, want, sizeof(*sh));
+   sh->seg_size = size;
+
+   size = sizeof(*sh) + sizeof(*tab) * hdr->num_recs;
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+
+      tab[i].offset = 0;
+      tab[i].nrows  = rec->nrows;
+      tab[i].ncols  = rec->ncols;
+
+      if ( rec->active )
+      {
+         size = (size + NTV2_SHM_ALIGN - 1) & ~(size_t)(NTV2_SHM_ALIGN - 1);
+         tab[i].offset = size;
+         memcpy(seg + size, rec->shifts, sizeof(NTV2_SHIFT) * rec->num);
+         size += sizeof(NTV2_SHIFT) * rec->num;
+      }
+   }
+
+   ntv2_unmap_file(seg, alloc);
+
+   /* -------- publish it */
+
+   if ( rename(tmpl, name) != 0 )
+   {
+      remove(tmpl);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Load an NTv2 file into memory shared by all processes on a host.
+ */
+NTV2_HDR * ntv2_load_shared(
+   const char *  ntv2file,
+   const char *  shm_dir,
+   NTV2_BOOL     keep_orig,
+   NTV2_EXTENT * extent,
+   int *         prc)
+{
+   char                  name[NTV2_MAX_PATH_LEN + 32];
+   char                  path[NTV2_MAX_PATH_LEN];
+   NTV2_STAMP            stamp;
+   NTV2_SHM_HDR          want;
+   NTV2_HDR *            hdr;
+   const unsigned char * seg;
+   size_t                seg_size;
+   int                   rc;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+
+   /* Without a stamp for the file, we can't tell if a segment is good. */
+
+   if ( !ntv2_shm_find(ntv2file, shm_dir, extent, path, &stamp, name) )
+   {
+      return ntv2_load_file(ntv2file, keep_orig, NTV2_DATA_IN_MEMORY,
+                            extent, prc);
+   }
+
+   /* -------- attach to an existing segment if it's good */
+
+   seg = (const unsigned char *)ntv2_shm_map(name, &seg_size);
+   if ( seg != NTV2_NULL )
+   {
+      hdr = ntv2_load_file(ntv2file, keep_orig, NTV2_DATA_HDRS_ONLY,
+                           extent, prc);
+      if ( hdr == NTV2_NULL || *prc != NTV2_ERR_OK )
+      {
+         ntv2_unmap_file((void *)seg, seg_size);
+         return hdr;
+      }
+
+      ntv2_shm_init(&want, path, extent, &stamp, hdr->num_recs);
+
+      if ( ntv2_shm_check(hdr, &want, seg, seg_size) )
+      {
+         ntv2_shm_use(hdr, seg, seg_size);
+         return hdr;
+      }
+
+      ntv2_unmap_file((void *)seg, seg_size);
+      ntv2_delete(hdr);
+   }
+
+   /* -------- read the data in and make a new segment from it */
+
+   hdr = ntv2_load_file(ntv2file, keep_orig, NTV2_DATA_IN_MEMORY,
+                        extent, prc);
+   if ( hdr == NTV2_NULL || *prc != NTV2_ERR_OK )
+   {
+      return hdr;
+   }
+
+   ntv2_shm_init(&want, path, extent, &stamp, hdr->num_recs);
+
+   if ( ntv2_shm_make(hdr, &want, name) )
+   {
+      /* Another process may have replaced it by now, which is fine
+         as long as it is still good. */
+      seg = (const unsigned char *)ntv2_shm_map(name, &seg_size);
+      if ( seg != NTV2_NULL )
+      {
+         if ( ntv2_shm_check(hdr, &want, seg, seg_size) )
+            ntv2_shm_use(hdr, seg, seg_size);
+         else
+            ntv2_unmap_file((void *)seg, seg_size);
+      }
+   }
+
+   return hdr;
+}
+
+/*------------------------------------------------------------------------
+ * Remove the shared segment for a file.
+ */
+int ntv2_shared_unlink(
+   const char *  ntv2file,
+   const char *  shm_dir,
+   NTV2_EXTENT * extent)
+{
+   char       name[NTV2_MAX_PATH_LEN + 32];
+   char       path[NTV2_MAX_PATH_LEN];
+   NTV2_STAMP stamp;
+
+   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
+   {
+      return NTV2_ERR_NULL_PATH;
+   }
+
+   if ( !ntv2_shm_find(ntv2file, shm_dir, extent, path, &stamp, name) ||
+        remove(name) != 0 )
+   {
+      return NTV2_ERR_CANNOT_OPEN_FILE;
+   }
+
+   return NTV2_ERR_OK;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 binary write routines                                                */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Write a binary overview record
+ */
+static void ntv2_write_ov_bin(
+   FILE     *fp,
+   NTV2_HDR *hdr,
+   NTV2_BOOL swap_data)
+{
+   NTV2_FILE_OV   ov;
+   NTV2_FILE_OV * pov;
+
+   ntv2_validate_ov(hdr, NTV2_NULL, 0);
+
+   pov = hdr->overview;
+   if ( swap_data )
+   {
+      memcpy(&ov, pov, sizeof(ov));
+      ntv2_swap_int( &ov.i_num_orec, 1);
+      ntv2_swap_int( &ov.i_num_srec, 1);
+      ntv2_swap_int( &ov.i_num_file, 1);
+      ntv2_swap_dbl( &ov.d_major_f,  1);
+      ntv2_swap_dbl( &ov.d_minor_f,  1);
+      ntv2_swap_dbl( &ov.d_major_t,  1);
+      ntv2_swap_dbl( &ov.d_minor_t,  1);
+      pov = &ov;
+   }
+
+   fwrite(pov, sizeof(*pov), 1, fp);
+}
+
+/*------------------------------------------------------------------------
+ * Write a binary sub-file record and its children.
+ */
+static int ntv2_write_sf_bin(
+   FILE     *fp,
+   NTV2_HDR *hdr,
+   NTV2_REC *rec,
+   NTV2_BOOL swap_data)
+{
+   NTV2_REC * sub;
+   NTV2_BLK   blk;
+   int row;
+   int rc;
+
+   /* this shouldn't happen */
+   if ( !rec->active )
+      return NTV2_ERR_OK;
+
+   rc = ntv2_blk_init(hdr, rec, &blk, 1);
+   if ( rc != NTV2_ERR_OK )
+      return rc;
+
+   ntv2_validate_sf(hdr, NTV2_NULL, rec->rec_num, 0);
+
+   /* write the sub-file header */
+   {
+      NTV2_FILE_SF   sf;
+      NTV2_FILE_SF * psf;
+
+      psf = &hdr->subfiles[rec->rec_num];
+      if ( swap_data )
+      {
+         memcpy(&sf, psf, sizeof(sf));
+         ntv2_swap_dbl( &sf.d_s_lat,    1);
+         ntv2_swap_dbl( &sf.d_n_lat,    1);
+         ntv2_swap_dbl( &sf.d_e_lon,    1);
+         ntv2_swap_dbl( &sf.d_w_lon,    1);
+         ntv2_swap_dbl( &sf.d_lat_inc,  1);
+         ntv2_swap_dbl( &sf.d_lon_inc,  1);
+         ntv2_swap_int( &sf.i_gs_count, 1);
+         psf = &sf;
+      }
+      fwrite(psf, sizeof(*psf), 1, fp);
+   }
+
+   /* write all grid-shift records a block of rows at a time */
+   for (row = 0; row < rec->nrows && rc == NTV2_ERR_OK; row += blk.max_rows)
+   {
+      int nrows = rec->nrows - row;
+      int i;
+
+      if ( nrows > blk.max_rows )
+         nrows = blk.max_rows;
+
+      rc = ntv2_blk_get(hdr, rec, &blk, row, nrows);
+      if ( rc != NTV2_ERR_OK )
+         break;
+
+      for (i = 0; i < nrows * rec->ncols; i++)
+      {
+         NTV2_FILE_GS gs;
+
+         gs.f_lat_shift = blk.shifts[i][NTV2_COORD_LAT];
+         gs.f_lon_shift = blk.shifts[i][NTV2_COORD_LON];
+
+         if ( blk.accurs != NTV2_NULL )
+         {
+            gs.f_lat_accuracy = blk.accurs[i][NTV2_COORD_LAT];
+            gs.f_lon_accuracy = blk.accurs[i][NTV2_COORD_LON];
+         }
+         else
+         {
+            gs.f_lat_accuracy = 0.0;
+            gs.f_lon_accuracy = 0.0;
+         }
+
+         if ( swap_data )
+         {
+            ntv2_swap_flt((float *)&gs, 4);
+         }
+
+         fwrite(&gs, sizeof(gs), 1, fp);
+      }
+   }
+
+   ntv2_blk_term(&blk);
+
+   /* recursively write all its children */
+   for (sub = rec->sub; sub != NTV2_NULL && rc == NTV2_ERR_OK; sub = sub->next)
+   {
+      rc = ntv2_write_sf_bin(fp, hdr, sub, swap_data);
+   }
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Write a binary end record
+ */
+static void ntv2_write_end_bin(
+   FILE     *fp)
+{
+   NTV2_FILE_END end_rec;
+
+   memcpy(end_rec.n_end,   NTV2_END_NAME,  NTV2_NAME_LEN);
+   memcpy (end_rec.filler, NTV2_ALL_ZEROS, NTV2_NAME_LEN);
+   fwrite(&end_rec, sizeof(end_rec), 1, fp);
+}
+
+/*------------------------------------------------------------------------
+ * Write out the NTV2_HDR object to a binary file.
+ */
+static int ntv2_write_file_bin(
+   NTV2_HDR   *hdr,
+   const char *path,
+   int         byte_order)
+{
+   FILE *    fp;
+   NTV2_BOOL swap_data;
+   int       rc;
+
+   swap_data = hdr->swap_data;
+   switch (byte_order)
+   {
+      case NTV2_ENDIAN_BIG:    swap_data ^= !ntv2_is_big_endian(); break;
+      case NTV2_ENDIAN_LITTLE: swap_data ^= !ntv2_is_ltl_endian(); break;
+      case NTV2_ENDIAN_NATIVE: swap_data  = FALSE;                 break;
+   }
+
+   fp = fopen(path, "wb");
+   if ( fp == NTV2_NULL )
+   {
+      rc = NTV2_ERR_CANNOT_OPEN_FILE;
+   }
+   else
+   {
+      NTV2_REC * sf;
+
+      ntv2_write_ov_bin(fp, hdr, swap_data);
+
+      rc = NTV2_ERR_OK;
+      for (sf = hdr->first_parent; sf != NTV2_NULL && rc == NTV2_ERR_OK;
+           sf = sf->next)
+      {
+         rc = ntv2_write_sf_bin(fp, hdr, sf, swap_data);
+      }
+
+      ntv2_write_end_bin(fp);
+
+      if ( rc == NTV2_ERR_OK && ferror(fp) != 0 )
+         rc = NTV2_ERR_IOERR;
+      fclose(fp);
+   }
+
+   return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 tiled write routines                                                 */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Collect all active records in the order they are written out
+ * (i.e. each parent followed by all its children).
+ */
+static int ntv2_order_recs_til(
+   NTV2_REC  *rec,
+   NTV2_REC **recs,
+   int        n)
+{
+   for (; rec != NTV2_NULL; rec = rec->next)
+   {
+      if ( rec->active )
+      {
+         recs[n++] = rec;
+         n = ntv2_order_recs_til(rec->sub, recs, n);
+      }
+   }
+
+   return n;
+}
+
+/*------------------------------------------------------------------------
+ * Write zeros out to the next page boundary.
+ */
+static void ntv2_write_pad_til(
+   FILE *fp,
+   long  nbytes)
+{
+   for (; (nbytes % NTV2_TIL_PAGE_SIZE) != 0; nbytes++)
+      fputc(0, fp);
+}
+
+/*------------------------------------------------------------------------
+ * Write a row of tiles of one plane (either shifts or accuracies) for a
+ * record, given the grid rows in it.
+ *
+ * A null data pointer writes a row of tiles of zeros.
+ */
+static void ntv2_write_strip_til(
+   FILE             *fp,
+   const NTV2_REC   *rec,
+   const NTV2_SHIFT *data,
+   int               nrows,
+   int               ntcols)
+{
+   NTV2_SHIFT tile[NTV2_TIL_DIM * NTV2_TIL_DIM];
+   int tcol;
+
+   for (tcol = 0; tcol < ntcols; tcol++)
+   {
+      int r, c;
+
+      memset(tile, 0, sizeof(tile));
+
+      for (r = 0; data != NTV2_NULL && r < nrows; r++)
+      {
+         for (c = 0; c < NTV2_TIL_DIM; c++)
+         {
+            int col = tcol * NTV2_TIL_DIM + c;
+
+            if ( col >= rec->ncols )
+               break;
+
+            tile[r * NTV2_TIL_DIM + c][NTV2_COORD_LAT] =
+               data[r * rec->ncols + col][NTV2_COORD_LAT];
+            tile[r * NTV2_TIL_DIM + c][NTV2_COORD_LON] =
+               data[r * rec->ncols + col][NTV2_COORD_LON];
+         }
+      }
+
+      fwrite(tile, sizeof(tile), 1, fp);
+   }
+}
+
+/*------------------------------------------------------------------------
+ * Write out the NTV2_HDR object to a tiled file.
+ *
+ * Tiled files are always written in native byte order, so any other
+ * order asked for is an error.
+ */
+static int ntv2_write_file_til(
+   NTV2_HDR   *hdr,
+   const char *path,
+   int         byte_order)
+{
+   NTV2_REC ** recs;
+   FILE *      fp;
+   int         nrecs;
+   int         rc;
+
+   if ( (byte_order == NTV2_ENDIAN_BIG    && !ntv2_is_big_endian()) ||
+        (byte_order == NTV2_ENDIAN_LITTLE && !ntv2_is_ltl_endian()) )
+   {
+      return NTV2_ERR_INVALID_ARG;
+   }
+
+   recs = (NTV2_REC **)ntv2_memalloc(sizeof(*recs) * hdr->num_recs);
+   if ( recs == NTV2_NULL )
+   {
+      return NTV2_ERR_NO_MEMORY;
+   }
+
+   nrecs = ntv2_order_recs_til(hdr->first_parent, recs, 0);
+
+   fp = fopen(path, "wb");
+   if ( fp == NTV2_NULL )
+   {
+      rc = NTV2_ERR_CANNOT_OPEN_FILE;
+   }
+   else
+   {
+      NTV2_FILE_TH th;
+      long hdr_len;
+      long pos;
+      int  page;
+      int  i;
+
+      /* -------- write the tiled file header */
+
+      hdr_len = (long)sizeof(NTV2_FILE_TH) +
+                (long)sizeof(NTV2_FILE_OV) +
+                (long)(sizeof(NTV2_FILE_SF) + sizeof(NTV2_FILE_TI)) * nrecs;
+
+      memset(&th, 0, sizeof(th));
+      memcpy(th.magic, NTV2_TIL_MAGIC, NTV2_NAME_LEN);
+      th.byte_order = NTV2_TIL_BYTE_ORDER;
+      th.version    = NTV2_TIL_VERSION;
+      th.page_size  = NTV2_TIL_PAGE_SIZE;
+      th.tile_dim   = NTV2_TIL_DIM;
+      th.num_recs   = nrecs;
+      th.hdr_pages  = (int)((hdr_len + NTV2_TIL_PAGE_SIZE - 1) /
+                            NTV2_TIL_PAGE_SIZE);
+
+      fwrite(&th, sizeof(th), 1, fp);
+
+      /* -------- write the overview record */
+
+      ntv2_validate_ov(hdr, NTV2_NULL, 0);
+      fwrite(hdr->overview, sizeof(*hdr->overview), 1, fp);
+
+      /* -------- write all sub-file records and tile indexes */
+
+      page = th.hdr_pages;
+      for (i = 0; i < nrecs; i++)
+      {
+         NTV2_REC *   rec = recs[i];
+         NTV2_FILE_TI ti;
+         int          plane_pages;
+
+         ntv2_validate_sf(hdr, NTV2_NULL, rec->rec_num, 0);
+         fwrite(&hdr->subfiles[rec->rec_num], sizeof(NTV2_FILE_SF), 1, fp);
+
+         memset(&ti, 0, sizeof(ti));
+         ti.nrows  = rec->nrows;
+         ti.ncols  = rec->ncols;
+         ti.ntrows = (rec->nrows + NTV2_TIL_DIM - 1) / NTV2_TIL_DIM;
+         ti.ntcols = (rec->ncols + NTV2_TIL_DIM - 1) / NTV2_TIL_DIM;
+
+         plane_pages = (int)(ntv2_til_plane_size(ti.ntrows, ti.ntcols) /
+                             NTV2_TIL_PAGE_SIZE);
+
+         ti.shift_page = page;
+         ti.accur_page = page + plane_pages;
+         page += 2 * plane_pages;
+
+         fwrite(&ti, sizeof(ti), 1, fp);
+      }
+
+      ntv2_write_pad_til(fp, hdr_len);
+
+      /* -------- write all tiles */
+
+      /* Both planes of a record are written in one pass over its data,
+         a row of tiles at a time, so we position to each in turn. */
+
+      rc  = NTV2_ERR_OK;
+      pos = (long)th.hdr_pages * NTV2_TIL_PAGE_SIZE;
+      for (i = 0; i < nrecs && rc == NTV2_ERR_OK; i++)
+      {
+         NTV2_REC * rec    = recs[i];
+         int        ntrows = (rec->nrows + NTV2_TIL_DIM - 1) / NTV2_TIL_DIM;
+         int        ntcols = (rec->ncols + NTV2_TIL_DIM - 1) / NTV2_TIL_DIM;
+         long       plane_size = ntv2_til_plane_size(ntrows, ntcols);
+         long       tiles_size = (long)ntrows * ntcols * NTV2_TIL_TILE_SIZE;
+         NTV2_BLK   blk;
+         int        trow;
+
+         rc = ntv2_blk_init(hdr, rec, &blk, NTV2_TIL_DIM);
+
+         for (trow = 0; trow < ntrows && rc == NTV2_ERR_OK; trow++)
+         {
+            long toff  = (long)trow * ntcols * NTV2_TIL_TILE_SIZE;
+            int  row   = trow * NTV2_TIL_DIM;
+            int  nrows = rec->nrows - row;
+            int  boff;
+
+            if ( nrows > NTV2_TIL_DIM )
+               nrows = NTV2_TIL_DIM;
+
+            if ( (row % blk.max_rows) == 0 )
+            {
+               int n = rec->nrows - row;
+
+               if ( n > blk.max_rows )
+                  n = blk.max_rows;
+
+               rc = ntv2_blk_get(hdr, rec, &blk, row, n);
+               if ( rc != NTV2_ERR_OK )
+                  break;
+            }
+            boff = (row % blk.max_rows) * rec->ncols;
+
+            fseek(fp, pos + toff, SEEK_SET);
+            ntv2_write_strip_til(fp, rec, blk.shifts + boff, nrows, ntcols);
+
+            fseek(fp, pos + plane_size + toff, SEEK_SET);
+            ntv2_write_strip_til(fp, rec,
+                                 (blk.accurs == NTV2_NULL) ? NTV2_NULL :
+                                 blk.accurs + boff, nrows, ntcols);
+         }
+
+         ntv2_blk_term(&blk);
+
+         fseek(fp, pos + tiles_size, SEEK_SET);
+         ntv2_write_pad_til(fp, tiles_size);
+
+         fseek(fp, pos + plane_size + tiles_size, SEEK_SET);
+         ntv2_write_pad_til(fp, tiles_size);
+
+         pos += 2 * plane_size;
+      }
+
+      if ( rc == NTV2_ERR_OK && ferror(fp) != 0 )
+         rc = NTV2_ERR_IOERR;
+      fclose(fp);
+   }
+
+   ntv2_memdealloc(recs);
+   return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 ascii write routines                                                 */
+/* ------------------------------------------------------------------------- */
+
+#define T(x)   ntv2_strip( strncpy(stemp, x, NTV2_NAME_LEN) )
+#define D(x)   ntv2_dtoa (         ntemp, x)
+
+/*------------------------------------------------------------------------
+ * Write a ascii overview record
+ */
+static void ntv2_write_ov_asc(
+   FILE     *fp,
+   NTV2_HDR *hdr)
+{
+   NTV2_FILE_OV * pov = hdr->overview;
+   char stemp[NTV2_NAME_LEN+1];
+   char ntemp[32];
+
+   ntv2_validate_ov(hdr, NTV2_NULL, 0);
+   stemp[NTV2_NAME_LEN] = 0;
+
+   fprintf(fp, "NUM_OREC %d\n",   pov->i_num_orec  );
+   fprintf(fp, "NUM_SREC %d\n",   pov->i_num_srec  );
+   fprintf(fp, "NUM_FILE %d\n",   pov->i_num_file  );
+   fprintf(fp, "GS_TYPE  %s\n", T(pov->s_gs_type)  );
+   fprintf(fp, "VERSION  %s\n", T(pov->s_version)  );
+   fprintf(fp, "SYSTEM_F %s\n", T(pov->s_system_f) );
+   fprintf(fp, "SYSTEM_T %s\n", T(pov->s_system_t) );
+   fprintf(fp, "MAJOR_F  %s\n", D(pov->d_major_f)  );
+   fprintf(fp, "MINOR_F  %s\n", D(pov->d_minor_f)  );
+   fprintf(fp, "MAJOR_T  %s\n", D(pov->d_major_t)  );
+   fprintf(fp, "MINOR_T  %s\n", D(pov->d_minor_t)  );
+}
+
+/*------------------------------------------------------------------------
+ * Write a ascii sub-file record and its children.
+ */
+static int ntv2_write_sf_asc(
+   FILE     *fp,
+   NTV2_HDR *hdr,
+   NTV2_REC *rec)
+{
+   NTV2_REC * sub;
+   NTV2_BLK   blk;
+   char stemp[NTV2_NAME_LEN+1];
+   char ntemp[32];
+   char ntemp1[32], ntemp2[32], ntemp3[32], ntemp4[32];
+   int row;
+   int rc;
+
+   /* this shouldn't happen */
+   if ( !rec->active )
+      return NTV2_ERR_OK;
+
+   rc = ntv2_blk_init(hdr, rec, &blk, 1);
+   if ( rc != NTV2_ERR_OK )
+      return rc;
+
+   ntv2_validate_sf(hdr, NTV2_NULL, rec->rec_num, 0);
+   stemp[NTV2_NAME_LEN] = 0;
+
+   /* write the sub-file header */
+   {
+      NTV2_FILE_SF * psf = &hdr->subfiles[rec->rec_num];
+
+      fprintf(fp, "\n");
+      fprintf(fp, "SUB_NAME %s\n", T(psf->s_sub_name) );
+      fprintf(fp, "PARENT   %s\n", T(psf->s_parent)   );
+      fprintf(fp, "CREATED  %s\n", T(psf->s_created)  );
+      fprintf(fp, "UPDATED  %s\n", T(psf->s_updated)  );
+      fprintf(fp, "S_LAT    %s\n", D(psf->d_s_lat)    );
+      fprintf(fp, "N_LAT    %s\n", D(psf->d_n_lat)    );
+      fprintf(fp, "E_LONG   %s\n", D(psf->d_e_lon)    );
+      fprintf(fp, "W_LONG   %s\n", D(psf->d_w_lon)    );
+      fprintf(fp, "LAT_INC  %s\n", D(psf->d_lat_inc)  );
+      fprintf(fp, "LONG_INC %s\n", D(psf->d_lon_inc)  );
+      fprintf(fp, "GS_COUNT %d\n",   psf->i_gs_count  );
+      fprintf(fp, "\n");
+   }
+
+   /* write all grid-shift records a block of rows at a time */
+   for (row = 0; row < rec->nrows && rc == NTV2_ERR_OK; row += blk.max_rows)
+   {
+      int nrows = rec->nrows - row;
+      int i;
+
+      if ( nrows > blk.max_rows )
+         nrows = blk.max_rows;
+
+      rc = ntv2_blk_get(hdr, rec, &blk, row, nrows);
+      if ( rc != NTV2_ERR_OK )
+         break;
+
+      for (i = 0; i < nrows * rec->ncols; i++)
+      {
+         NTV2_FILE_GS gs;
+
+         gs.f_lat_shift    = blk.shifts[i][NTV2_COORD_LAT];
+         gs.f_lon_shift    = blk.shifts[i][NTV2_COORD_LON];
+
+         if ( blk.accurs != NTV2_NULL )
+         {
+            gs.f_lat_accuracy = blk.accurs[i][NTV2_COORD_LAT];
+            gs.f_lon_accuracy = blk.accurs[i][NTV2_COORD_LON];
+         }
+         else
+         {
+            gs.f_lat_accuracy = 0.0;
+            gs.f_lon_accuracy = 0.0;
+         }
+
+         fprintf(fp, "%-15s %-15s %-15s %s\n",
+            ntv2_ftoa(ntemp1, gs.f_lat_shift),
+            ntv2_ftoa(ntemp2, gs.f_lon_shift),
+            ntv2_ftoa(ntemp3, gs.f_lat_accuracy),
+            ntv2_ftoa(ntemp4, gs.f_lon_accuracy));
+      }
+   }
+
+   ntv2_blk_term(&blk);
+
+   /* recursively write all its children */
+   for (sub = rec->sub; sub != NTV2_NULL && rc == NTV2_ERR_OK; sub = sub->next)
+   {
+      rc = ntv2_write_sf_asc(fp, hdr, sub);
+   }
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Write a ascii end record
+ */
+static void ntv2_write_end_asc(
+   FILE     *fp)
+{
+   fprintf(fp, "\n");
+   fprintf(fp, "END\n");
+}
+
+/*------------------------------------------------------------------------
+ * Write out the NTV2_HDR object to an ascii file.
+ */
+static int ntv2_write_file_asc(
+   NTV2_HDR   *hdr,
+   const char *path)
+{
+   FILE *  fp;
+   int     rc;
+
+   fp = fopen(path, "w");
+   if ( fp == NTV2_NULL )
+   {
+      rc = NTV2_ERR_CANNOT_OPEN_FILE;
+   }
+   else
+   {
+      NTV2_REC * sf;
+
+      ntv2_write_ov_asc(fp, hdr);
+
+      rc = NTV2_ERR_OK;
+      for (sf = hdr->first_parent; sf != NTV2_NULL && rc == NTV2_ERR_OK;
+           sf = sf->next)
+      {
+         rc = ntv2_write_sf_asc(fp, hdr, sf);
+      }
+
+      ntv2_write_end_asc(fp);
+
+      if ( rc == NTV2_ERR_OK && ferror(fp) != 0 )
+         rc = NTV2_ERR_IOERR;
+      fclose(fp);
+   }
+
+   return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 write routines                                                       */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Write out the NTV2_HDR object to a file.
+ */
+int ntv2_write_file(
+   NTV2_HDR   *hdr,
+   const char *path,
+   NTV2_BOOL   byte_order)
+{
+   char        tmpfile[NTV2_MAX_PATH_LEN + 8];
+   const char *out      = path;
+   NTV2_BOOL   in_place = FALSE;
+   int type;
+   int rc;
+
+   if ( hdr == NTV2_NULL )
+   {
+      return NTV2_ERR_NULL_HDR;
+   }
+
+   if ( path == NTV2_NULL || *path == 0 )
+   {
+      return NTV2_ERR_NULL_PATH;
+   }
+
+   if ( hdr->num_recs == 0 )
+   {
+      return NTV2_ERR_HDRS_NOT_READ;
+   }
+
+   if ( !hdr->keep_orig )
+   {
+      return NTV2_ERR_ORIG_DATA_NOT_KEPT;
+   }
+
+   /* Any data not in memory (including accuracies left in the file)
+      is read from the input file as it is written, so we can't write
+      over it.  If the output file is the input file, a temporary file
+      is written and then renamed. */
+   {
+      NTV2_BOOL from_source = FALSE;
+      int i;
+
+      for (i = 0; i < hdr->num_recs; i++)
+      {
+         const NTV2_REC * rec = &hdr->recs[i];
+
+         if ( !rec->active )
+            continue;
+
+         if ( rec->shifts == NTV2_NULL && rec->packed == NTV2_NULL )
+         {
+            if ( !ntv2_have_source(hdr) )
+               return NTV2_ERR_DATA_NOT_READ;
+            from_source = TRUE;
+         }
+
+         if ( rec->accurs == NTV2_NULL && ntv2_have_source(hdr) )
+            from_source = TRUE;
+      }
+
+      if ( from_source )
+         in_place = ntv2_same_file(hdr->path, path);
+   }
+
+   if ( in_place )
+   {
+      if ( strlen(path) >= NTV2_MAX_PATH_LEN )
+         return NTV2_ERR_SAME_FILE;
+
+      sprintf(tmpfile, "%s.tmp", path);
+      out = tmpfile;
+   }
+
+   type = ntv2_filetype(path);
+   switch (type)
+   {
+      case NTV2_FILE_TYPE_ASC:
+         rc = ntv2_write_file_asc(hdr, out);
+         break;
+
+      case NTV2_FILE_TYPE_BIN:
+         rc = ntv2_write_file_bin(hdr, out, byte_order);
+         break;
+
+      case NTV2_FILE_TYPE_TIL:
+         rc = ntv2_write_file_til(hdr, out, byte_order);
+         break;
+
+      default:
+         rc = NTV2_ERR_UNKNOWN_FILE_TYPE;
+         break;
+   }
+
+   if ( in_place )
+   {
+#if defined(_WIN32)
+      /* Windows won't replace a file that is open, so the input file is
+         closed first.  Data not in memory can't be read after this. */
+      if ( rc == NTV2_ERR_OK )
+      {
+         ntv2_mutex_enter(hdr->mutex);
+         ntv2_io_close(hdr);
+         ntv2_mutex_leave(hdr->mutex);
+      }
+#endif
+
+      if ( rc == NTV2_ERR_OK && !ntv2_replace_file(tmpfile, path) )
+         rc = NTV2_ERR_IOERR;
+
+      if ( rc != NTV2_ERR_OK )
+         remove(tmpfile);
+   }
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Convert a NTv2 file to another file without loading its data.
+ */
+int ntv2_convert_file(
+   const char *  inpfile,
+   const char *  outfile,
+   int           byte_order,
+   NTV2_EXTENT * extent)
+{
+   NTV2_HDR * hdr;
+   int        rc;
+
+   hdr = ntv2_load_file(inpfile, TRUE, NTV2_DATA_HDRS_ONLY, extent, &rc);
+   if ( hdr == NTV2_NULL )
+   {
+      return rc;
+   }
+
+   if ( rc == NTV2_ERR_OK )
+   {
+      /* no need for a cache, since the data is only read once */
+      ntv2_set_cache_size(hdr, 0);
+
+      rc = ntv2_write_file(hdr, outfile, byte_order);
+   }
+
+   ntv2_delete(hdr);
+   return rc;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 snapshot routines                                                    */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * A snapshot starts with this header, which gives the offsets of an
+ * image of the NTV2_HDR struct, the record array, a table of
+ * NTV2_SNAP_REC entries (one per sub-file), the file record cache (if
+ * kept), and then the grid arrays of each active sub-file in traversal
+ * order.  Everything is on a cache-line boundary.
+ *
+ * All pointers in the images are null.  The links between records are
+ * kept in the table as indexes, and the grid arrays as offsets, so the
+ * images can be used wherever the snapshot is mapped.  The sizes say
+ * how the library that saved it was built, so a foreign one is never
+ * used.
+ */
+#define NTV2_SNAP_MAGIC      "NTv2SNAP"
+#define NTV2_SNAP_BYTE_ORDER 0x01020304
+#define NTV2_SNAP_VERSION    1
+
+typedef struct ntv2_snap_hdr NTV2_SNAP_HDR;
+struct ntv2_snap_hdr
+{
+   char           magic [NTV2_NAME_LEN];  /* NTV2_SNAP_MAGIC          */
+   int            byte_order;             /* NTV2_SNAP_BYTE_ORDER     */
+   int            version;                /* NTV2_SNAP_VERSION        */
+   int            snap_size;              /* sizeof(NTV2_SNAP_HDR)    */
+   int            hdr_size;               /* sizeof(NTV2_HDR)         */
+   int            rec_size;               /* sizeof(NTV2_REC)         */
+   int            ptr_size;               /* sizeof(void *)           */
+   int            num_recs;               /* Number of sub-files      */
+   int            first_parent;           /* Index of first parent    */
+   size_t         hdr_offset;             /* Offset of NTV2_HDR image */
+   size_t         rec_offset;             /* Offset of record images  */
+   size_t         tab_offset;             /* Offset of NTV2_SNAP_RECs */
+   size_t         ov_offset;              /* Offset of overview or 0  */
+   size_t         sf_offset;              /* Offset of sub-files or 0 */
+   size_t         file_size;              /* Size of the snapshot     */
+};
+
+typedef struct ntv2_snap_rec NTV2_SNAP_REC;
+struct ntv2_snap_rec
+{
+   int            parent;                 /* Index of parent or -1    */
+   int            sub;                    /* Index of first sub or -1 */
+   int            next;                   /* Index of next or -1      */
+   int            pad;
+   size_t         shifts;                 /* Offset of shifts or 0    */
+   size_t         accurs;                 /* Offset of accurs or 0    */
+};
+
+#define NTV2_SNAP_INDEX(hdr, p) \
+   ( ((p) == NTV2_NULL) ? -1 : (int)((p) - (hdr)->recs) )
+
+/* This is written so that a bad offset or length in a snapshot can't
+   overflow it. */
+#define NTV2_SNAP_FITS(off, len, size) \
+   ( (off) <= (size) && (len) <= (size) - (off) )
+
+/*------------------------------------------------------------------------
+ * Lay out a snapshot of an object, filling in its header and table.
+ */
+static void ntv2_snap_layout(
+   const NTV2_HDR * hdr,
+   NTV2_SNAP_HDR *  sh,
+   NTV2_SNAP_REC *  tab)
+{
+   const NTV2_REC * rec;
+   size_t           off;
+   int i;
+
+   memset(sh, 0, sizeof(*sh));
+   memcpy(sh->magic, NTV2_SNAP_MAGIC, NTV2_NAME_LEN);
+   sh->byte_order   = NTV2_SNAP_BYTE_ORDER;
+   sh->version      = NTV2_SNAP_VERSION;
+   sh->snap_size    = (int)sizeof(*sh);
+   sh->hdr_size     = (int)sizeof(*hdr);
+   sh->rec_size     = (int)sizeof(*hdr->recs);
+   sh->ptr_size     = (int)sizeof(void *);
+   sh->num_recs     = hdr->num_recs;
+   sh->first_parent = NTV2_SNAP_INDEX(hdr, hdr->first_parent);
+
+   off = NTV2_LINE_ROUND(sizeof(*sh));
+   sh->hdr_offset = off;
+   off = NTV2_LINE_ROUND(off + sizeof(*hdr));
+   sh->rec_offset = off;
+   off = NTV2_LINE_ROUND(off + sizeof(*hdr->recs) * hdr->num_recs);
+   sh->tab_offset = off;
+   off += sizeof(*tab) * hdr->num_recs;
+
+   if ( hdr->overview != NTV2_NULL )
+   {
+      off = NTV2_LINE_ROUND(off);
+      sh->ov_offset = off;
+      off += sizeof(*hdr->overview);
+   }
+
+   if ( hdr->subfiles != NTV2_NULL )
+   {
+      off = NTV2_LINE_ROUND(off);
+      sh->sf_offset = off;
+      off += sizeof(*hdr->subfiles) * hdr->num_recs;
+   }
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      rec = &hdr->recs[i];
+
+      memset(&tab[i], 0, sizeof(tab[i]));
+      tab[i].parent = NTV2_SNAP_INDEX(hdr, rec->parent);
+      tab[i].sub    = NTV2_SNAP_INDEX(hdr, rec->sub);
+      tab[i].next   = NTV2_SNAP_INDEX(hdr, rec->next);
+   }
+
+   /* The accuracies are saved if they are kept and can be had. */
+
+   for (rec = hdr->first_parent; rec != NTV2_NULL; rec = ntv2_next_rec(rec))
+   {
+      NTV2_SNAP_REC * t = &tab[rec - hdr->recs];
+
+      if ( !rec->active )
+         continue;
+
+      off = NTV2_LINE_ROUND(off);
+      t->shifts = off;
+      off += sizeof(NTV2_SHIFT) * rec->num;
+
+      if ( hdr->keep_orig &&
+           (rec->accurs != NTV2_NULL || ntv2_have_source(hdr)) )
+      {
+         off = NTV2_LINE_ROUND(off);
+         t->accurs = off;
+         off += sizeof(NTV2_SHIFT) * rec->num;
+      }
+   }
+
+   sh->file_size = off;
+}
+
+/*------------------------------------------------------------------------
+ * Write something to a snapshot at an offset.
+ *
+ * Any gap before it is filled with zeros by the seek.
+ */
+static void ntv2_snap_write(
+   FILE *       fp,
+   size_t       off,
+   const void * data,
+   size_t       len)
+{
+   if ( fseek(fp, (long)off, SEEK_SET) == 0 )
+      fwrite(data, len, 1, fp);
+}
+
+/*------------------------------------------------------------------------
+ * Write the grid arrays of a sub-file to a snapshot.
+ *
+ * They are gotten a block of rows at a time, so data that is not in
+ * memory is read from the input file (or decompressed) as it is written.
+ */
+static int ntv2_snap_write_rec(
+   FILE *                fp,
+   NTV2_HDR *            hdr,
+   const NTV2_REC *      rec,
+   const NTV2_SNAP_REC * t)
+{
+   NTV2_BLK blk;
+   int      row;
+   int      rc;
+
+   rc = ntv2_blk_init(hdr, rec, &blk, 1);
+   if ( rc != NTV2_ERR_OK )
+      return rc;
+
+   for (row = 0; row < rec->nrows && rc == NTV2_ERR_OK; row += blk.max_rows)
+   {
+      int    nrows = rec->nrows - row;
+      size_t boff;
+      size_t blen;
+
+      if ( nrows > blk.max_rows )
+         nrows = blk.max_rows;
+
+      rc = ntv2_blk_get(hdr, rec, &blk, row, nrows);
+      if ( rc != NTV2_ERR_OK )
+         break;
+
+      boff = sizeof(NTV2_SHIFT) * row * rec->ncols;
+      blen = sizeof(NTV2_SHIFT) * nrows * rec->ncols;
+
+      ntv2_snap_write(fp, t->shifts + boff, blk.shifts, blen);
+
+      if ( t->accurs != 0 )
+      {
+         if ( blk.accurs != NTV2_NULL )
+            ntv2_snap_write(fp, t->accurs + boff, blk.accurs, blen);
+         else
+            rc = NTV2_ERR_DATA_NOT_READ;
+      }
+   }
+
+   ntv2_blk_term(&blk);
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Save a snapshot of a NTv2 object.
+ */
+int ntv2_save_snapshot(
+   NTV2_HDR   *hdr,
+   const char *path)
+{
+   char            tmpfile[NTV2_MAX_PATH_LEN + 8];
+   NTV2_SNAP_HDR   sh;
+   NTV2_SNAP_REC * tab;
+   NTV2_HDR        img;
+   FILE *          fp;
+   int rc = NTV2_ERR_OK;
+   int i;
+
+   if ( hdr == NTV2_NULL )
+   {
+      return NTV2_ERR_NULL_HDR;
+   }
+
+   if ( path == NTV2_NULL || *path == 0 )
+   {
+      return NTV2_ERR_NULL_PATH;
+   }
+
+   if ( strlen(path) >= NTV2_MAX_PATH_LEN )
+   {
+      return NTV2_ERR_CANNOT_OPEN_FILE;
+   }
+
+   if ( hdr->num_recs == 0 )
+   {
+      return NTV2_ERR_HDRS_NOT_READ;
+   }
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+
+      if ( rec->active && rec->shifts == NTV2_NULL &&
+           rec->packed == NTV2_NULL && !ntv2_have_source(hdr) )
+      {
+         return NTV2_ERR_DATA_NOT_READ;
+      }
+   }
+
+   if ( ntv2_same_file(hdr->path, path) )
+   {
+      return NTV2_ERR_SAME_FILE;
+   }
+
+   tab = (NTV2_SNAP_REC *)ntv2_memalloc(sizeof(*tab) * hdr->num_recs);
+   if ( tab == NTV2_NULL )
+   {
+      return NTV2_ERR_NO_MEMORY;
+   }
+
+   ntv2_snap_layout(hdr, &sh, tab);
+
+   /* -------- make the image of the object, with no pointers in it */
+
+   memcpy(&img, hdr, sizeof(img));
+   memset(&img.io, 0, sizeof(img.io));
+   img.io_pos       = 0;
+   img.io_err       = FALSE;
+   img.io_buf       = NTV2_NULL;
+   img.io_buf_pos   = 0;
+   img.io_buf_len   = 0;
+   img.mutex        = NTV2_NULL;
+   img.cache        = NTV2_NULL;
+   img.map_data     = NTV2_NULL;
+   img.map_size     = 0;
+   img.map_owned    = FALSE;
+   img.shm_data     = NTV2_NULL;
+   img.shm_size     = 0;
+   img.data_mode    = NTV2_DATA_IN_MEMORY;
+   img.arena        = NTV2_NULL;
+   img.recs         = NTV2_NULL;
+   img.first_parent = NTV2_NULL;
+   img.overview     = NTV2_NULL;
+   img.subfiles     = NTV2_NULL;
+   memset(&img.alloc, 0, sizeof(img.alloc));
+
+   /* -------- write it all out */
+
+   sprintf(tmpfile, "%s.tmp", path);
+
+   fp = fopen(tmpfile, "wb");
+   if ( fp == NTV2_NULL )
+   {
+      ntv2_memdealloc(tab);
+      return NTV2_ERR_CANNOT_OPEN_FILE;
+   }
+
+   ntv2_snap_write(fp, 0,              &sh,  sizeof(sh));
+   ntv2_snap_write(fp, sh.hdr_offset,  &img, sizeof(img));
+   ntv2_snap_write(fp, sh.tab_offset,  tab,  sizeof(*tab) * hdr->num_recs);
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      NTV2_REC rec;
+
+      memcpy(&rec, &hdr->recs[i], sizeof(rec));
+      rec.parent = NTV2_NULL;
+      rec.sub    = NTV2_NULL;
+      rec.next   = NTV2_NULL;
+      rec.shifts = NTV2_NULL;
+      rec.accurs = NTV2_NULL;
+      rec.packed = NTV2_NULL;
+      rec.load_failed = FALSE;
+
+      ntv2_snap_write(fp, sh.rec_offset + sizeof(rec) * i, &rec, sizeof(rec));
+   }
+
+   if ( sh.ov_offset != 0 )
+   {
+      ntv2_snap_write(fp, sh.ov_offset, hdr->overview,
+                      sizeof(*hdr->overview));
+   }
+
+   if ( sh.sf_offset != 0 )
+   {
+      ntv2_snap_write(fp, sh.sf_offset, hdr->subfiles,
+                      sizeof(*hdr->subfiles) * hdr->num_recs);
+   }
+
+   for (i = 0; i < hdr->num_recs && rc == NTV2_ERR_OK; i++)
+   {
+      if ( hdr->recs[i].active )
+         rc = ntv2_snap_write_rec(fp, hdr, &hdr->recs[i], &tab[i]);
+   }
+
+   ntv2_memdealloc(tab);
+
+   if ( rc == NTV2_ERR_OK && ferror(fp) != 0 )
+      rc = NTV2_ERR_IOERR;
+   if ( fclose(fp) != 0 && rc == NTV2_ERR_OK )
+      rc = NTV2_ERR_IOERR;
+
+   if ( rc == NTV2_ERR_OK && !ntv2_replace_file(tmpfile, path) )
+      rc = NTV2_ERR_IOERR;
+
+   if ( rc != NTV2_ERR_OK )
+      remove(tmpfile);
+
+   return rc;
+}
+
+/*------------------------------------------------------------------------
+ * Read a whole snapshot into memory, if it can't be mapped.
+ */
+static unsigned char * ntv2_snap_read(
+   const char * path,
+   size_t *     psize)
+{
+   unsigned char * buf = NTV2_NULL;
+   FILE *          fp;
+   long            len;
+
+   *psize = 0;
+
+   fp = fopen(path, "rb");
+   if ( fp == NTV2_NULL )
+      return NTV2_NULL;
+
+   if ( fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 &&
+        fseek(fp, 0, SEEK_SET) == 0 )
+   {
+      buf = (unsigned char *)ntv2_memalloc((size_t)len);
+      if ( buf != NTV2_NULL )
+      {
+         if ( fread(buf, (size_t)len, 1, fp) == 1 )
+         {
+            *psize = (size_t)len;
+         }
+         else
+         {
+            ntv2_memdealloc(buf);
+            buf = NTV2_NULL;
+         }
+      }
+   }
+
+   fclose(fp);
+   return buf;
+}
+
+/*------------------------------------------------------------------------
+ * Check that a snapshot was saved by this build and is all there.
+ */
+static NTV2_BOOL ntv2_snap_check(
+   const unsigned char *img,
+   size_t               size)
+{
+   const NTV2_SNAP_HDR * sh = (const NTV2_SNAP_HDR *)img;
+
+   if ( size < sizeof(*sh)                                     ||
+        memcmp(sh->magic, NTV2_SNAP_MAGIC, NTV2_NAME_LEN) != 0 ||
+        sh->byte_order != NTV2_SNAP_BYTE_ORDER                 ||
+        sh->version    != NTV2_SNAP_VERSION                    ||
+        sh->snap_size  != (int)sizeof(NTV2_SNAP_HDR)           ||
+        sh->hdr_size   != (int)sizeof(NTV2_HDR)                ||
+        sh->rec_size   != (int)sizeof(NTV2_REC)                ||
+        sh->ptr_size   != (int)sizeof(void *)                  ||
+        sh->file_size  != size                                 ||
+        sh->num_recs   <= 0                                    ||
+        sh->first_parent < 0 || sh->first_parent >= sh->num_recs )
+   {
+      return FALSE;
+   }
+
+   if ( (size_t)sh->num_recs > size / sizeof(NTV2_REC)                      ||
+        !NTV2_SNAP_FITS(sh->hdr_offset, sizeof(NTV2_HDR), size)             ||
+        !NTV2_SNAP_FITS(sh->rec_offset,
+                        sizeof(NTV2_REC) * sh->num_recs, size)              ||
+        !NTV2_SNAP_FITS(sh->tab_offset,
+                        sizeof(NTV2_SNAP_REC) * sh->num_recs, size)         ||
+        !NTV2_SNAP_FITS(sh->ov_offset, sizeof(NTV2_FILE_OV), size)          ||
+        !NTV2_SNAP_FITS(sh->sf_offset,
+                        sizeof(NTV2_FILE_SF) * sh->num_recs, size) )
+   {
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Get a grid array of a sub-file from a snapshot.
+ *
+ * If the snapshot is mapped, the array is used where it is.
+ * Otherwise it is copied out of the buffer it was read into.
+ */
+static NTV2_SHIFT * ntv2_snap_array(
+   NTV2_HDR *           hdr,
+   const NTV2_REC *     rec,
+   const unsigned char *img,
+   size_t               size,
+   size_t               off,
+   NTV2_BOOL            mapped,
+   int *                prc)
+{
+   if ( off == 0 )
+      return NTV2_NULL;
+
+   if ( !NTV2_SNAP_FITS(off, sizeof(NTV2_SHIFT) * rec->num, size) )
+   {
+      *prc = NTV2_ERR_INVALID_SNAPSHOT;
+      return NTV2_NULL;
+   }
+
+   if ( mapped )
+      return (NTV2_SHIFT *)(img + off);
+
+   return ntv2_copy_shifts(hdr, (const NTV2_SHIFT *)(img + off), rec->num);
+}
+
+/*------------------------------------------------------------------------
+ * Release a snapshot image not (or no longer) used by an object.
+ */
+static void ntv2_snap_release(
+   const unsigned char *img,
+   size_t               size,
+   NTV2_BOOL            mapped)
+{
+   if ( mapped )
+      ntv2_unmap_file((void *)img, size);
+   else
+      ntv2_memdealloc((void *)img);
+}
+
+/*------------------------------------------------------------------------
+ * Set up an object from the image of its header in a snapshot.
+ *
+ * Only the plain data that describes the file is copied.  Everything
+ * else is set up as for a new object, so nothing that was in the file
+ * is ever used as a pointer.
+ */
+static void ntv2_snap_hdr(
+   NTV2_HDR *       hdr,
+   const NTV2_HDR * img)
+{
+   memset(hdr, 0, sizeof(*hdr));
+
+   memcpy(hdr->path,    img->path,    sizeof(hdr->path));
+   memcpy(hdr->gs_type, img->gs_type, sizeof(hdr->gs_type));
+   hdr->path[NTV2_MAX_PATH_LEN-1] = 0;
+   hdr->gs_type[NTV2_NAME_LEN]    = 0;
+
+   hdr->file_type    = img->file_type;
+   hdr->num_parents  = img->num_parents;
+   hdr->keep_orig    = img->keep_orig;
+   hdr->pads_present = img->pads_present;
+   hdr->swap_data    = img->swap_data;
+   hdr->fixed        = img->fixed;
+   hdr->hdr_conv     = img->hdr_conv;
+   hdr->dat_conv     = img->dat_conv;
+   hdr->lat_min      = img->lat_min;
+   hdr->lat_max      = img->lat_max;
+   hdr->lon_min      = img->lon_min;
+   hdr->lon_max      = img->lon_max;
+
+   hdr->data_mode    = NTV2_DATA_IN_MEMORY;
+   hdr->mutex        = ntv2_mutex_create();
+}
+
+/*------------------------------------------------------------------------
+ * Copy the records and file record cache out of a snapshot into an
+ * object, and fix up the links and the grid arrays.
+ */
+#define NTV2_SNAP_LINK(i)  ( ((i) < 0) ? NTV2_NULL : hdr->recs + (i) )
+
+static int ntv2_snap_load(
+   NTV2_HDR *           hdr,
+   const unsigned char *img,
+   size_t               size,
+   NTV2_BOOL            mapped)
+{
+   const NTV2_SNAP_HDR * sh  = (const NTV2_SNAP_HDR *)img;
+   const NTV2_SNAP_REC * tab = (const NTV2_SNAP_REC *)(img + sh->tab_offset);
+   int rc = NTV2_ERR_OK;
+   int i;
+
+   hdr->recs = (NTV2_REC *)ntv2_memalloc(sizeof(*hdr->recs) * sh->num_recs);
+   if ( hdr->recs == NTV2_NULL )
+   {
+      return NTV2_ERR_NO_MEMORY;
+   }
+
+   memcpy(hdr->recs, img + sh->rec_offset, sizeof(*hdr->recs) * sh->num_recs);
+   hdr->num_recs     = sh->num_recs;
+   hdr->first_parent = hdr->recs + sh->first_parent;
+
+   /* Nothing in the images can be trusted to be a pointer, so they are
+      all cleared before anything else is done, since the object is
+      deleted if the snapshot turns out to be bad. */
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      NTV2_REC * rec = &hdr->recs[i];
+
+      rec->record_name[NTV2_NAME_LEN] = 0;
+      rec->parent_name[NTV2_NAME_LEN] = 0;
+      rec->parent      = NTV2_NULL;
+      rec->sub         = NTV2_NULL;
+      rec->next        = NTV2_NULL;
+      rec->shifts      = NTV2_NULL;
+      rec->accurs      = NTV2_NULL;
+      rec->packed      = NTV2_NULL;
+      rec->load_failed = FALSE;
+   }
+
+   for (i = 0; i < hdr->num_recs; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[i];
+      size_t           len = sizeof(NTV2_SHIFT) * (size_t)rec->num;
+
+      if ( tab[i].parent < -1 || tab[i].parent >= hdr->num_recs ||
+           tab[i].sub    < -1 || tab[i].sub    >= hdr->num_recs ||
+           tab[i].next   < -1 || tab[i].next   >= hdr->num_recs ||
+           rec->nrows < 0 || rec->ncols < 0                    ||
+           (rec->ncols > 0 && rec->nrows > INT_MAX / rec->ncols) ||
+           rec->num != rec->nrows * rec->ncols                 ||
+           (rec->active && tab[i].shifts == 0)                 ||
+           !NTV2_SNAP_FITS(tab[i].shifts, len, size)           ||
+           !NTV2_SNAP_FITS(tab[i].accurs, len, size) )
+      {
+         return NTV2_ERR_INVALID_SNAPSHOT;
+      }
+   }
+
+   for (i = 0; i < hdr->num_recs && rc == NTV2_ERR_OK; i++)
+   {
+      NTV2_REC * rec = &hdr->recs[i];
+
+      rec->parent = NTV2_SNAP_LINK(tab[i].parent);
+      rec->sub    = NTV2_SNAP_LINK(tab[i].sub);
+      rec->next   = NTV2_SNAP_LINK(tab[i].next);
+
+      if ( rec->active )
+      {
+         rec->shifts = ntv2_snap_array(hdr, rec, img, size, tab[i].shifts,
+                                       mapped, &rc);
+         rec->accurs = ntv2_snap_array(hdr, rec, img, size, tab[i].accurs,
+                                       mapped, &rc);
+
+         if ( rc == NTV2_ERR_OK &&
+              (rec->shifts == NTV2_NULL ||
+               (tab[i].accurs != 0 && rec->accurs == NTV2_NULL)) )
+         {
+            rc = NTV2_ERR_NO_MEMORY;
+         }
+      }
+   }
+
+   if ( rc == NTV2_ERR_OK && sh->ov_offset != 0 )
+   {
+      hdr->overview = (NTV2_FILE_OV *)ntv2_memalloc(sizeof(*hdr->overview));
+      if ( hdr->overview == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+      memcpy(hdr->overview, img + sh->ov_offset, sizeof(*hdr->overview));
+   }
+
+   if ( rc == NTV2_ERR_OK && sh->sf_offset != 0 )
+   {
+      hdr->subfiles = (NTV2_FILE_SF *)
+                      ntv2_memalloc(sizeof(*hdr->subfiles) * hdr->num_recs);
+      if ( hdr->subfiles == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+      memcpy(hdr->subfiles, img + sh->sf_offset,
+             sizeof(*hdr->subfiles) * hdr->num_recs);
+   }
+
+   return rc;
+}
+
+#undef NTV2_SNAP_LINK
+
+/*------------------------------------------------------------------------
+ * Open a snapshot of a NTv2 object.
+ */
+NTV2_HDR * ntv2_open_snapshot(
+   const char *path,
+   int *       prc)
+{
+   const unsigned char * img;
+   NTV2_HDR *            hdr;
+   size_t                size;
+   NTV2_BOOL             mapped;
+   int                   rc;
+
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+   *prc = NTV2_ERR_OK;
+
+   if ( path == NTV2_NULL || *path == 0 )
+   {
+      *prc = NTV2_ERR_NULL_PATH;
+      return NTV2_NULL;
+   }
+
+   img    = (const unsigned char *)ntv2_map_file(path, &size);
+   mapped = ( img != NTV2_NULL );
+   if ( !mapped )
+   {
+      img = ntv2_snap_read(path, &size);
+      if ( img == NTV2_NULL )
+      {
+         *prc = NTV2_ERR_CANNOT_OPEN_FILE;
+         return NTV2_NULL;
+      }
+   }
+
+   if ( !ntv2_snap_check(img, size) )
+   {
+      ntv2_snap_release(img, size, mapped);
+      *prc = NTV2_ERR_INVALID_SNAPSHOT;
+      return NTV2_NULL;
+   }
+
+   hdr = (NTV2_HDR *)ntv2_memalloc(sizeof(*hdr));
+   if ( hdr == NTV2_NULL )
+   {
+      ntv2_snap_release(img, size, mapped);
+      *prc = NTV2_ERR_NO_MEMORY;
+      return NTV2_NULL;
+   }
+
+   ntv2_snap_hdr(hdr, (const NTV2_HDR *)
+                      (img + ((const NTV2_SNAP_HDR *)img)->hdr_offset));
+
+   /* A mapped snapshot is now unmapped along with the object. */
+
+   if ( mapped )
+   {
+      hdr->shm_data = img;
+      hdr->shm_size = size;
+   }
+
+   *prc = ntv2_snap_load(hdr, img, size, mapped);
+
+   if ( !mapped )
+      ntv2_snap_release(img, size, mapped);
+
+   if ( *prc != NTV2_ERR_OK )
+   {
+      ntv2_delete(hdr);
+      return NTV2_NULL;
+   }
+
+   return hdr;
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 dump routines                                                        */
+/* ------------------------------------------------------------------------- */
+
+#define T1(x)   ntv2_strip( strncpy(stemp1, x, NTV2_NAME_LEN) )
+#define T2(x)   ntv2_strip( strncpy(stemp2, x, NTV2_NAME_LEN) )
+#define D1(x)   ntv2_dtoa (         ntemp1, x)
+#define D2(x)   ntv2_dtoa (         ntemp2, x)
+#define CV(x)   D2(x * hdr->hdr_conv)
+
+/*------------------------------------------------------------------------
+ * Dump the file overview struct to a stream.
+ */
+static void ntv2_dump_ov(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             mode)
+{
+   const NTV2_FILE_OV * ov = hdr->overview;
+   char   stemp1[NTV2_NAME_LEN+1];
+   char   stemp2[NTV2_NAME_LEN+1];
+   char   ntemp1[32];
+
+   if ( ov == NTV2_NULL )
+      return;
+
+   if ( (mode & NTV2_DUMP_HDRS_EXT) == 0 )
+      return;
+
+   stemp1[NTV2_NAME_LEN] = 0;
+   stemp2[NTV2_NAME_LEN] = 0;
+
+   fprintf(fp, "filename %s\n", hdr->path);
+   fprintf(fp, "========  hdr ===================================\n");
+
+   fprintf(fp, "%-8s %d\n", T1(ov->n_num_orec),    ov->i_num_orec  );
+   fprintf(fp, "%-8s %d\n", T1(ov->n_num_srec),    ov->i_num_srec  );
+   fprintf(fp, "%-8s %d\n", T1(ov->n_num_file),    ov->i_num_file  );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_gs_type ), T2(ov->s_gs_type)  );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_version ), T2(ov->s_version)  );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_system_f), T2(ov->s_system_f) );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_system_t), T2(ov->s_system_t) );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_major_f ), D1(ov->d_major_f)  );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_minor_f ), D1(ov->d_minor_f)  );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_major_t ), D1(ov->d_major_t)  );
+   fprintf(fp, "%-8s %s\n", T1(ov->n_minor_t ), D1(ov->d_minor_t)  );
+
+   fprintf(fp, "\n");
+}
+
+/*------------------------------------------------------------------------
+ * Dump a file sub-file struct to a stream.
+ */
+static void ntv2_dump_sf(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             n,
+   int             mode)
+{
+   const NTV2_FILE_SF * sf;
+   char   stemp1[NTV2_NAME_LEN+1];
+   char   stemp2[NTV2_NAME_LEN+1];
+   char   ntemp1[32];
+   char   ntemp2[32];
+
+   if ( (mode & NTV2_DUMP_HDRS_EXT)     == 0 )
+      return;
+
+   if ( (mode & NTV2_DUMP_HDRS_SUMMARY) != 0 )
+      return;
+
+   if ( !hdr->recs[n].active )
+      return;
+
+   if ( hdr->subfiles == NTV2_NULL )
+      return;
+
+   sf = hdr->subfiles+n;
+
+   stemp1[NTV2_NAME_LEN] = 0;
+   stemp2[NTV2_NAME_LEN] = 0;
+
+   fprintf(fp, "======== %4d ===================================\n", n);
+
+   fprintf(fp, "%-8s %s\n",               T1(sf->n_sub_name),
+                                          T2(sf->s_sub_name) );
+
+   fprintf(fp, "%-8s %s\n",               T1(sf->n_parent),
+                                          T2(sf->s_parent)   );
+
+   fprintf(fp, "%-8s %s\n",               T1(sf->n_created),
+                                          T2(sf->s_created)  );
+
+   fprintf(fp, "%-8s %s\n",               T1(sf->n_updated),
+                                          T2(sf->s_updated)  );
+
+   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_s_lat),
+                                          D1(sf->d_s_lat),
+                                          CV(sf->d_s_lat)    );
+
+   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_n_lat),
+                                          D1(sf->d_n_lat),
+                                          CV(sf->d_n_lat)    );
+
+   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_e_lon),
+                                          D1(sf->d_e_lon),
+                                          CV(sf->d_e_lon)    );
+
+   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_w_lon),
+                                          D1(sf->d_w_lon),
+                                          CV(sf->d_w_lon)    );
+
+   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_lat_inc),
+                                          D1(sf->d_lat_inc),
+                                          CV(sf->d_lat_inc)  );
+
+   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_lon_inc),
+                                          D1(sf->d_lon_inc),
+                                          CV(sf->d_lon_inc)  );
+
+   fprintf(fp, "%-8s %d\n", T1(sf->n_gs_count), sf->i_gs_count  );
+
+   fprintf(fp, "\n");
+}
+
+/*------------------------------------------------------------------------
+ * Dump the internal overview header struct to a stream.
+ */
+static void ntv2_dump_hdr(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             mode)
+{
+   char ntemp1[32];
+
+   if ( (mode & NTV2_DUMP_HDRS_INT    ) == 0 )
+      return;
+
+   if ( (mode & NTV2_DUMP_HDRS_SUMMARY) != 0 )
+      return;
+
+   if ( (mode & NTV2_DUMP_HDRS_EXT) == 0 )
+   {
+      fprintf(fp, "filename    %s\n",  hdr->path);
+      fprintf(fp, "========  overview ==============\n");
+   }
+
+   fprintf(fp, "num-recs    %6d\n", hdr->num_recs);
+   fprintf(fp, "num-parents %6d\n", hdr->num_parents);
+   if ( hdr->num_parents > 0 )
+   {
+     NTV2_REC * rec = hdr->first_parent;
+     const char * t = "parents  ";
+
+     while ( rec != NTV2_NULL )
+     {
+        fprintf(fp, "%-11s %4d [ %s ]\n", t, rec->rec_num, rec->record_name);
+        rec = rec->next;
+        t = "";
+     }
+   }
+
+   fprintf(fp, "conversion  %s  [ %s ]\n",
+      D1(hdr->hdr_conv), hdr->gs_type);
+
+   fprintf(fp, "\n");
+}
+
+/*------------------------------------------------------------------------
+ * Dump an internal sub-file record struct to a stream.
+ */
+static void ntv2_dump_rec(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             n,
+   int             mode)
+{
+   const NTV2_REC * rec = hdr->recs+n;
+   char ntemp1[32];
+
+   if ( (mode & NTV2_DUMP_HDRS_INT)     == 0 )
+      return;
+
+   if ( (mode & NTV2_DUMP_HDRS_SUMMARY) != 0 )
+      return;
+
+   if ( !rec->active )
+      return;
+
+   if ( (mode & NTV2_DUMP_HDRS_EXT) == 0 )
+   {
+      fprintf(fp, "======== sub-file %d ==============\n", n);
+   }
+
+   fprintf(fp, "name        %s\n",    rec->record_name);
+   fprintf(fp, "parent      %s",      rec->parent_name);
+
+   if ( rec->parent != NTV2_NULL )
+      fprintf(fp, "  [ %d ]", rec->parent->rec_num);
+   fprintf(fp, "\n");
+
+   fprintf(fp, "num subs    %d\n",    rec->num_subs);
+
+   if ( rec->sub != NTV2_NULL )
+   {
+     const NTV2_REC * sub = rec->sub;
+     const char * t = "sub files";
+
+     while ( sub != NTV2_NULL )
+     {
+        fprintf(fp, "%-11s %4d [ %s ]\n", t, sub->rec_num, sub->record_name);
+        sub = sub->next;
+        t = "";
+     }
+   }
+
+   fprintf(fp, "num recs    %d\n",    rec->num);
+   fprintf(fp, "num cols    %d\n",    rec->ncols);
+   fprintf(fp, "num rows    %d\n",    rec->nrows);
+
+   fprintf(fp, "lat min     %s\n", D1(rec->lat_min));
+   fprintf(fp, "lat max     %s\n", D1(rec->lat_max));
+   fprintf(fp, "lat inc     %s\n", D1(rec->lat_inc));
+   fprintf(fp, "lon min     %s\n", D1(rec->lon_min));
+   fprintf(fp, "lon max     %s\n", D1(rec->lon_max));
+   fprintf(fp, "lon inc     %s\n", D1(rec->lon_inc));
+
+   fprintf(fp, "\n");
+}
+
+/*------------------------------------------------------------------------
+ * Dump the data for a subfile.
+ *
+ * Any data that isn't in memory is read from the file a block at a time.
+ */
+static void ntv2_dump_data(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             n,
+   int             mode)
+{
+   const NTV2_REC * rec = hdr->recs+n;
+   char ntemp1[32], ntemp2[32], ntemp3[32], ntemp4[32];
+   NTV2_BLK blk;
+   int row, col;
+
+   if ( !rec->active || ntv2_blk_init(hdr, rec, &blk, 1) != NTV2_ERR_OK )
+      return;
+
+   for (row = 0; row < rec->nrows; row++)
+   {
+      const NTV2_SHIFT * shifts;
+      const NTV2_SHIFT * accurs;
+      NTV2_BOOL dump_acc = FALSE;
+      int boff = (row % blk.max_rows) * rec->ncols;
+
+      if ( boff == 0 )
+      {
+         int nrows = rec->nrows - row;
+
+         if ( nrows > blk.max_rows )
+            nrows = blk.max_rows;
+
+         /* the stream position isn't anything the caller can see */
+         if ( ntv2_blk_get((NTV2_HDR *)hdr, rec, &blk, row, nrows)
+              != NTV2_ERR_OK )
+         {
+            break;
+         }
+      }
+
+      shifts = blk.shifts + boff;
+      accurs = (blk.accurs == NTV2_NULL) ? NTV2_NULL : blk.accurs + boff;
+
+      if ( (mode & NTV2_DUMP_DATA_ACC) == NTV2_DUMP_DATA_ACC &&
+           accurs != NTV2_NULL )
+      {
+         dump_acc = TRUE;
+      }
+
+      if ( dump_acc )
+      {
+         fprintf(fp, "   row     col       lat-shift       lon-shift  "
+                     "  lat-accuracy    lon-accuracy\n");
+         fprintf(fp, "------  ------  --------------  --------------  "
+                     "--------------  --------------\n");
+      }
+      else
+      {
+         fprintf(fp, "   row     col        latitude       longitude  "
+                     "     lat-shift       lon-shift\n");
+         fprintf(fp, "------  ------  --------------  --------------  "
+                     "--------------  --------------\n");
+      }
+
+      for (col = 0; col < rec->ncols; col++)
+      {
+         if ( dump_acc )
+         {
+            fprintf(fp, "%6d  %6d  %14s  %14s  %14s  %14s\n",
+               row, col,
+               ntv2_ftoa(ntemp1, (*shifts)[NTV2_COORD_LAT]),
+               ntv2_ftoa(ntemp2, (*shifts)[NTV2_COORD_LON]),
+               ntv2_ftoa(ntemp3, (*accurs)[NTV2_COORD_LAT]),
+               ntv2_ftoa(ntemp4, (*accurs)[NTV2_COORD_LON]));
+            shifts++;
+            accurs++;
+         }
+         else
+         {
+            fprintf(fp, "%6d  %6d  %14.8f  %14.8f  %14s  %14s\n",
+               row, col,
+               rec->lat_min + (rec->lat_inc * row),
+               rec->lon_max - (rec->lon_inc * col),
+               ntv2_ftoa(ntemp1, (*shifts)[NTV2_COORD_LAT]),
+               ntv2_ftoa(ntemp2, (*shifts)[NTV2_COORD_LON]));
+            shifts++;
+         }
+      }
+
+      fprintf(fp, "\n");
+   }
+
+   ntv2_blk_term(&blk);
+}
+
+/*------------------------------------------------------------------------
+ * Dump the contents of all headers in an NTv2 file.
+ */
+void ntv2_dump(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             mode)
+{
+   if ( hdr != NTV2_NULL && fp != NTV2_NULL )
+   {
+      int i;
+
+      ntv2_dump_ov (hdr, fp, mode);
+      ntv2_dump_hdr(hdr, fp, mode);
+
+      for (i = 0; i < hdr->num_recs; i++)
+      {
+         ntv2_dump_sf (hdr, fp, i, mode);
+         ntv2_dump_rec(hdr, fp, i, mode);
+
+         if ( (mode & NTV2_DUMP_DATA) != 0 )
+            ntv2_dump_data(hdr, fp, i, mode);
+      }
+   }
+}
+
+/*------------------------------------------------------------------------
+ * List the contents of all headers in an NTv2 file.
+ */
+void ntv2_list(
+   const NTV2_HDR *hdr,
+   FILE           *fp,
+   int             mode,
+   NTV2_BOOL       do_hdr_line)
+{
+   if ( hdr != NTV2_NULL && fp != NTV2_NULL )
+   {
+      int i;
+
+      if ( do_hdr_line )
+      {
+         if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
+         {
+            fprintf(fp, "filename\n");
+            fprintf(fp, "  num sub-file par  lon-min  lat-min "
+                        " lon-max  lat-max  d-lon  d-lat nrow ncol\n");
+            fprintf(fp, "  --- -------- --- -------- -------- "
+                        "-------- -------- ------ ------ ---- ----\n");
+         }
+         else
+         {
+            fprintf(fp,
+               "filename                             num  lon-min"
+               "  lat-min  lon-max  lat-max\n");
+            fprintf(fp,
+               "-----------------------------------  --- --------"
+               " -------- -------- --------\n");
+         }
+      }
+
+      if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
+         fprintf(fp, "%s\n", hdr->path);
+
+      for (i = 0; i < hdr->num_recs; i++)
+      {
+         const NTV2_REC * rec = &hdr->recs[i];
+
+         if ( rec->active )
+         {
+            char parent[4];
+
+            if ( rec->parent == NTV2_NULL )
+            {
+               strcpy(parent, " --");
+            }
+            else
+            {
+                sprintf(parent, "%3d", (rec->parent)->rec_num);
+            }
+
+            if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
+            {
+               fprintf(fp,
+               "  %3d %-8s %3s %8.3f %8.3f %8.3f %8.3f %6.3f %6.3f %4d %4d\n",
+                  i,
+                  rec->record_name,
+                  parent,
+                  rec->lon_min,
+                  rec->lat_min,
+                  rec->lon_max,
+                  rec->lat_max,
+                  rec->lon_inc,
+                  rec->lat_inc,
+                  rec->nrows,
+                  rec->ncols);
+            }
+         }
+      }
+
+      if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
+      {
+         if ( hdr->num_recs > 1 )
+         {
+            fprintf(fp, "  %3s %-8s %3s %8.3f %8.3f %8.3f %8.3f\n",
+               "tot",
+               "--------",
+               "   ",
+               hdr->lon_min,
+               hdr->lat_min,
+               hdr->lon_max,
+               hdr->lat_max);
+         }
+      }
+      else
+      {
+         fprintf(fp, "%-36s %3d %8.3f %8.3f %8.3f %8.3f\n",
+            hdr->path,
+            hdr->num_recs,
+            hdr->lon_min,
+            hdr->lat_min,
+            hdr->lon_max,
+            hdr->lat_max);
+      }
+
+      if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
+         fprintf(fp, "\n");
+   }
+}
+
+/* ------------------------------------------------------------------------- */
+/* NTv2 forward / inverse routines                                           */
+/* ------------------------------------------------------------------------- */
+
+/*------------------------------------------------------------------------
+ * Find the best ntv2 record containing a given point.
+ *
+ * The NTv2 specification states that points on the edge of a
+ * grid should be processed using the parent grid or be ignored, and
+ * points outside of the top-level grid should be ignored completely.
+ * However, this creates a situation where a point inside can be
+ * shifted to a point outside or to the edge, and then it cannot
+ * be shifted back.  Not good.
+ *
+ * Thus, we pretend that there is a one-cell zone around each grid
+ * that has a shift value of zero.  This allows for a point that was
+ * shifted out to be properly shifted back, and also allows for
+ * a gradual change rather than an abrupt jump.  Much better!
+ *
+ * However, this creates a problem when two grids are adjacent, either
+ * at a corner or along an edge (or both).  In fact, a point on the
+ * corner of a grid could be adjacent to up to three other grids!  In this
+ * case, a point in the imaginary outside cell of one grid could then
+ * magically appear inside another grid and vice-versa.  So we have a lot
+ * of esoteric code to deal with those cases.
+ */
+const NTV2_REC * ntv2_find_rec(
+   const NTV2_HDR * hdr,
+   double           lon,
+   double           lat,
+   int            * pstatus)
+{
+   const NTV2_REC * ps;
+   const NTV2_REC * psc      = NTV2_NULL;
+   NTV2_BOOL  next_gen = TRUE;
+   int n_stat_5_pinged = 0;
+   int status_ps       = (NTV2_STATUS_OUTSIDE_CELL + 1);
+   int status_psc      = (NTV2_STATUS_OUTSIDE_CELL + 1);
+   int status_tmp;
+   int npings;
+
+   if ( pstatus == NTV2_NULL )
+      pstatus = &status_tmp;
+
+   if ( hdr == NTV2_NULL )
+   {
+      *pstatus = NTV2_STATUS_NOTFOUND;
+      return NTV2_NULL;
+   }
+
+   /* First, find the top-level parent that contains this point.
+      There can only be one, since top-level parents cannot overlap.
+      But we have to deal with edge conditions.
+   */
+
+   for (ps = hdr->first_parent; ps != NTV2_NULL; ps = ps->next)
+   {
+      if ( NTV2_LE(lat, ps->lat_max) &&
+           NTV2_GT(lat, ps->lat_min) &&
+           NTV2_LE(lon, ps->lon_max) &&
+           NTV2_GT(lon, ps->lon_min) )
+      {
+         /* Total containment */
+         psc  = ps;
+         status_ps = NTV2_STATUS_CONTAINED;
+         break;
+      }
+
+      if ( NTV2_LE(lon, ps->lon_max) &&
+           NTV2_GT(lon, ps->lon_min) &&
+           NTV2_EQ(lat, ps->lat_max) &&
+           status_ps > NTV2_STATUS_NORTH )
+      {
+         /* Border condition - on North limit */
+         psc = ps;
+         status_ps = NTV2_STATUS_NORTH;
+      }
+
+      else
+      if ( NTV2_LE(lon, ps->lon_max) &&
+           NTV2_GT(lon, ps->lon_min) &&
+           NTV2_EQ(lat, ps->lat_max) &&
+           status_ps > NTV2_STATUS_WEST )
+      {
+         /* Border condition - on West limit */
+         psc = ps;
+         status_ps = NTV2_STATUS_WEST;
+      }
+
+      else
+      if ( NTV2_EQ(lon, ps->lon_min) &&
+           NTV2_EQ(lat, ps->lat_max) &&
+           status_ps > NTV2_STATUS_NORTH_WEST )
+      {
+         /* Border condition - on North & West limit */
+         psc = ps;
+         status_ps = NTV2_STATUS_NORTH_WEST;
+      }
+
+      else
+      if ( NTV2_GT(lon, (ps->lon_min - ps->lon_inc)) &&
+           NTV2_LT(lon, (ps->lon_max + ps->lon_inc)) &&
+           NTV2_GT(lat, (ps->lat_min - ps->lat_inc)) &&
+           NTV2_LT(lat, (ps->lat_max + ps->lat_inc)) &&
+           status_ps > NTV2_STATUS_OUTSIDE_CELL )
+      {
+         /* Is it just within one cell outside of the border? */
+         status_ps = NTV2_STATUS_OUTSIDE_CELL;
+
+         /* Do a parent counter, and figure out if it is a
+            one point corner or two point edge situation.
+            Always take the two-pointer over a one-pointer.
+            Always take the last two-pointer as the parent.
+         */
+
+         npings = 1;
+         if ( NTV2_GE(lon, ps->lon_min) && NTV2_LE(lon, ps->lon_max) ) npings++;
+         if ( NTV2_GE(lat, ps->lat_min) && NTV2_LE(lat, ps->lat_max) ) npings++;
+
+         if ( npings >= n_stat_5_pinged )
+         {
+            psc = ps;
+            n_stat_5_pinged = npings;
+         }
+      }
+   }
+
+   /* If no parent was found, we're done. */
+
+   if ( psc == NTV2_NULL )
+   {
+      *pstatus = NTV2_STATUS_NOTFOUND;
+      return NTV2_NULL;
+   }
+
+   /* If this parent has no children or the point lies outside the
+      parent border, we're done. */
+
+   if ( psc->sub == NTV2_NULL || status_ps == NTV2_STATUS_OUTSIDE_CELL )
+   {
+      *pstatus = status_ps;
+      return psc;
+   }
+
+   /* Now run recursively through the child grids to find the
+      best one.  Again, there can only be one best record, since
+      children cannot overlap but can only nest.
+      But here also we have to deal with edge conditions.
+   */
+
+   ps  = psc;
+   psc = NTV2_NULL;
+   while ( ps->sub != NTV2_NULL && next_gen )
+   {
+      next_gen = FALSE;
+
+      for (psc = ps->sub; psc != NTV2_NULL; psc = psc->next)
+      {
+         if ( NTV2_LE(lon, psc->lon_max) &&
+              NTV2_GT(lon, psc->lon_min) &&
+              NTV2_GE(lat, psc->lat_min) &&
+              NTV2_LT(lat, psc->lat_max) &&
+              status_psc >= NTV2_STATUS_CONTAINED )
+         {
+            /* Total containment */
+            next_gen = TRUE;
+            ps = psc;
+            status_psc = NTV2_STATUS_CONTAINED;
+            status_ps  = NTV2_STATUS_CONTAINED;
+            break;
+         }
+
+         else
+         if ( NTV2_LE(lon, psc->lon_max) &&
+              NTV2_GT(lon, psc->lon_min) &&
+              NTV2_EQ(lat, psc->lat_max) &&
+              status_psc >= NTV2_STATUS_NORTH )
+         {
+            /* Border condition - on North limit */
+            next_gen = TRUE;
+            ps = psc;
+            status_psc = NTV2_STATUS_NORTH;
+            status_ps  = NTV2_STATUS_NORTH;
+         }
+
+         else
+         if ( NTV2_EQ(lon, psc->lon_min) &&
+              NTV2_GE(lat, psc->lat_min) &&
+              NTV2_LT(lat, psc->lat_max) &&
+              status_psc >= NTV2_STATUS_WEST )
+         {
+            /* Border condition - on West limit */
+            next_gen = TRUE;
+            ps = psc;
+            status_psc = NTV2_STATUS_WEST;
+            status_ps  = NTV2_STATUS_WEST;
+         }
+
+         else
+         if ( NTV2_EQ(lon, psc->lon_min) &&
+              NTV2_EQ(lat, psc->lat_max) &&
+              status_psc >= NTV2_STATUS_NORTH_WEST )
+         {
+            /* Border condition - on North & West limit */
+            next_gen = TRUE;
+            ps = psc;
+            status_psc = NTV2_STATUS_NORTH_WEST;
+            status_ps  = NTV2_STATUS_NORTH_WEST;
+         }
+      }
+   }
+
+   *pstatus = status_ps;
+   return ps;
+}
+
+/*------------------------------------------------------------------------
+ * Get a lat/lon shift value (either from a file or memory).
+ *
+ * Note that these routines are called only if a sub-file record
+ * was found that contains the point.  Thus we know that the row
+ * and column values are valid.  However, it is possible to have
+ * not read the data (only the headers) and then closed the file,
+ * so we have to check for that.
+ */
+static double ntv2_get_shift_from_file(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+   float shift = 0.0;
+   long  offs  = ntv2_shift_offset(hdr, rec, icol, irow, coord_type);
+
+   if ( hdr->cache != NTV2_NULL )
+   {
+      double dshift;
+
+      if ( ntv2_cache_get_shift(hdr, rec, icol, irow, coord_type, &dshift)
+           == NTV2_ERR_OK )
+      {
+         return dshift;
+      }
+      return 0.0;
+   }
+
+   if ( ntv2_read_at(hdr, &shift, NTV2_SIZE_FLT, offs) != NTV2_ERR_OK )
+   {
+      shift = 0.0;
+   }
+   else
+   {
+      NTV2_SWAPF(&shift, 1);
+   }
+
+   return shift;
+}
+
+static double ntv2_get_shift_from_map(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+   float shift;
+   long  offs  = ntv2_shift_offset(hdr, rec, icol, irow, coord_type);
+
+   /* The mapped data may not be aligned, so we copy it out. */
+   memcpy(&shift, hdr->map_data + offs, NTV2_SIZE_FLT);
+   NTV2_SWAPF(&shift, 1);
+
+   return shift;
+}
+
+static double ntv2_get_shift_from_data(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+   double shift;
+   int   offs = (irow * rec->ncols) + icol;
+
+   NTV2_UNUSED_PARAMETER(hdr);
+
+   shift = rec->shifts[offs][coord_type];
+
+   return shift;
+}
+
+#if defined(NTV2_THREAD_LOCAL)
+
+/*------------------------------------------------------------------------
+ * Get a decoded tile of a compressed record from the calling thread's
+ * own tiles, decoding it into one of them if it isn't there.
+ *
+ * Since each thread only ever looks at its own tiles, no lock is taken.
+ * A tile is found by the id of the compressed block it came from, which
+ * is never reused, so a tile left over from a deleted object is never
+ * mistaken for one of a new object.  The four tiles a cell may span
+ * always go into different slots.
+ */
+#define NTV2_TLS_TILES       8        /* must be a power of 2 */
+
+typedef struct ntv2_tls_tile NTV2_TLS_TILE;
+struct ntv2_tls_tile
+{
+   long       id;                      /* Id of packed block or 0 */
+   int        trow;
+   int        tcol;
+   NTV2_SHIFT shifts[NTV2_TILE_NUM];
+};
+
+static NTV2_THREAD_LOCAL NTV2_TLS_TILE ntv2_tls_tiles[NTV2_TLS_TILES];
+
+static const NTV2_SHIFT * ntv2_packed_tile(
+   const NTV2_REC * rec,
+   int              trow,
+   int              tcol)
+{
+   const NTV2_PACKED * packed = (const NTV2_PACKED *)rec->packed;
+   NTV2_TLS_TILE *     tile;
+
+   tile = &ntv2_tls_tiles[(trow * 3 + tcol) & (NTV2_TLS_TILES - 1)];
+
+   if ( tile->id   != packed->id ||
+        tile->trow != trow       ||
+        tile->tcol != tcol )
+   {
+      ntv2_unpack_rec_tile(rec, trow, tcol, tile->shifts);
+      tile->id   = packed->id;
+      tile->trow = trow;
+      tile->tcol = tcol;
+   }
+
+   return tile->shifts;
+}
+
+#endif
+
+static double ntv2_get_shift_from_packed(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+#if defined(NTV2_THREAD_LOCAL)
+   const NTV2_SHIFT * shifts;
+
+   NTV2_UNUSED_PARAMETER(hdr);
+
+   shifts = ntv2_packed_tile(rec, irow / NTV2_TILE_DIM, icol / NTV2_TILE_DIM);
+#else
+   NTV2_SHIFT shifts[NTV2_TILE_NUM];
+   double     shift;
+
+   if ( hdr->cache != NTV2_NULL &&
+        ntv2_cache_get_shift(hdr, rec, icol, irow, coord_type, &shift)
+        == NTV2_ERR_OK )
+   {
+      return shift;
+   }
+
+   /* no cache, so decode the whole tile just for this value */
+   ntv2_unpack_rec_tile(rec, irow / NTV2_TILE_DIM, icol / NTV2_TILE_DIM,
+                        shifts);
+#endif
+
+   return shifts[(irow % NTV2_TILE_DIM) * NTV2_TILE_DIM +
+                 (icol % NTV2_TILE_DIM)][coord_type];
+}
+
+static double ntv2_get_shift(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              icol,
+   int              irow,
+   int              coord_type)
+{
+   if ( rec->shifts != NTV2_NULL )
+      return ntv2_get_shift_from_data(hdr, rec, irow, icol, coord_type);
+
+   if ( rec->packed != NTV2_NULL )
+      return ntv2_get_shift_from_packed(hdr, rec, irow, icol, coord_type);
+
+   if ( hdr->map_data != NTV2_NULL )
+      return ntv2_get_shift_from_map (hdr, rec, irow, icol, coord_type);
+
+   return ntv2_get_shift_from_file(hdr, rec, irow, icol, coord_type);
+}
+
+/*------------------------------------------------------------------------
+ * Get the shifts (lat or lon) at the corners of the cell containing
+ * a point.
+ *
+ * In this routine we deal with our idea of a phantom row/col of
+ * zero-shift values along each edge of the top-level-grid.
+ * Shifts are always stored as floats, so no precision is lost by
+ * returning them as floats.  Returns FALSE for an unknown status.
+ */
+typedef struct ntv2_corners NTV2_CORNERS;
+struct ntv2_corners
+{
+   float ll_shift;
+   float lr_shift;
+   float ul_shift;
+   float ur_shift;
+};
+
+static NTV2_BOOL ntv2_get_corners(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              status,
+   int              icol,
+   int              irow,
+   int              move_shifts_horz,
+   int              move_shifts_vert,
+   int              coord_type,
+   NTV2_CORNERS *   corners)
+{
+   float ll_shift = 0, lr_shift = 0, ul_shift = 0, ur_shift = 0;
+
+#define GET_SHIFT(i,j)   (float)ntv2_get_shift(hdr, rec, i, j, coord_type)
+
+   /* get the shift values for the "corners" of the cell
+      containing the point */
+
+   switch ( status )
+   {
+      case NTV2_STATUS_CONTAINED:
+         lr_shift = GET_SHIFT(irow,   icol  );
+         ll_shift = GET_SHIFT(irow,   icol+1);
+         ur_shift = GET_SHIFT(irow+1, icol  );
+         ul_shift = GET_SHIFT(irow+1, icol+1);
+         break;
+
+      case NTV2_STATUS_NORTH:
+         lr_shift = GET_SHIFT(irow,   icol  );
+         ll_shift = GET_SHIFT(irow,   icol+1);
+         ur_shift = lr_shift;
+         ul_shift = ll_shift;
+         break;
+
+      case NTV2_STATUS_WEST:
+         lr_shift = GET_SHIFT(irow,   icol  );
+         ll_shift = lr_shift;
+         ur_shift = GET_SHIFT(irow+1, icol  );
+         ul_shift = ur_shift;
+         break;
+
+      case NTV2_STATUS_NORTH_WEST:
+         lr_shift = GET_SHIFT(irow,   icol  );
+         ll_shift = lr_shift;
+         ur_shift = lr_shift;
+         ul_shift = lr_shift;
+         break;
+
+      case NTV2_STATUS_OUTSIDE_CELL:
+         lr_shift = GET_SHIFT(irow,   icol  );
+         ll_shift = GET_SHIFT(irow,   icol+1);
+         ur_shift = GET_SHIFT(irow+1, icol  );
+         ul_shift = GET_SHIFT(irow+1, icol+1);
+
+         if ( move_shifts_horz == -1 )
+         {
+            lr_shift = ll_shift;
+            ur_shift = ul_shift;
+            ll_shift = 0.0;
+            ul_shift = 0.0;
+         }
+         if ( move_shifts_horz == +1 )
+         {
+            ll_shift = lr_shift;
+            ul_shift = ur_shift;
+            ur_shift = 0.0;
+            lr_shift = 0.0;
+         }
+         if ( move_shifts_vert == -1 )
+         {
+            ul_shift = ll_shift;
+            ur_shift = lr_shift;
+            ll_shift = 0.0;
+            lr_shift = 0.0;
+         }
+         if ( move_shifts_vert == +1 )
+         {
+            ll_shift = ul_shift;
+            lr_shift = ur_shift;
+            ul_shift = 0.0;
+            ur_shift = 0.0;
+         }
+         break;
+
+      default:
+         return FALSE;
+   }
+
+#undef GET_SHIFT
+
+   corners->ll_shift = ll_shift;
+   corners->lr_shift = lr_shift;
+   corners->ul_shift = ul_shift;
+   corners->ur_shift = ur_shift;
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * Calculate one shift (lat or lon).
+ */
+static double ntv2_calculate_one_shift(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              status,
+   int              icol,
+   int              irow,
+   int              move_shifts_horz,
+   int              move_shifts_vert,
+   double           x_cellfrac,
+   double           y_cellfrac,
+   int              coord_type)
+{
+   NTV2_CORNERS corners;
+   double ll_shift, lr_shift, ul_shift, ur_shift;
+   double b, c, d;
+   double shift;
+
+   if ( !ntv2_get_corners(hdr, rec, status, icol, irow,
+                          move_shifts_horz, move_shifts_vert,
+                          coord_type, &corners) )
+   {
+      return 0.0;
+   }
+
+   ll_shift = corners.ll_shift;
+   lr_shift = corners.lr_shift;
+   ul_shift = corners.ul_shift;
+   ur_shift = corners.ur_shift;
+
+   /* do the bilinear interpolation of the corner shift values */
+
+   b = (ll_shift - lr_shift);
+   c = (ur_shift - lr_shift);
+   d = (ul_shift - ll_shift) - (ur_shift - lr_shift);
+
+   shift = lr_shift + (b * x_cellfrac)
+                    + (c * y_cellfrac)
+                    + (d * x_cellfrac * y_cellfrac);
+
+   /* The shift at this point is in decimal seconds, so convert to degrees. */
+   return (shift * hdr->dat_conv) / 3600.0;
+}
+
+/*------------------------------------------------------------------------
+ * Calculate one shift (lat or lon) in single precision.
+ *
+ * This is the same as ntv2_calculate_one_shift(), but all arithmetic
+ * is done in floats.  With the cell fractions in [0,1), each term is
+ * at most 4 times the largest corner shift, so the result is within
+ * about 64 float roundings (2^-18) of the largest corner shift of the
+ * exact value.  See ntv2_transform_float().
+ */
+static float ntv2_calculate_one_shift_flt(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   int              status,
+   int              icol,
+   int              irow,
+   int              move_shifts_horz,
+   int              move_shifts_vert,
+   float            x_cellfrac,
+   float            y_cellfrac,
+   int              coord_type)
+{
+   NTV2_CORNERS corners;
+   float b, c, d;
+   float shift;
+
+   if ( !ntv2_get_corners(hdr, rec, status, icol, irow,
+                          move_shifts_horz, move_shifts_vert,
+                          coord_type, &corners) )
+   {
+      return 0.0f;
+   }
+
+   b = (corners.ll_shift - corners.lr_shift);
+   c = (corners.ur_shift - corners.lr_shift);
+   d = (corners.ul_shift - corners.ll_shift) -
+       (corners.ur_shift - corners.lr_shift);
+
+   shift = corners.lr_shift + (b * x_cellfrac)
+                            + (c * y_cellfrac)
+                            + (d * x_cellfrac * y_cellfrac);
+
+   /* The shift at this point is in decimal seconds, so convert to degrees. */
+   return shift * (float)(hdr->dat_conv / 3600.0);
+}
+
+/*------------------------------------------------------------------------
+ * Find the cell of a record containing a given lon/lat, and where the
+ * point is within it.
+ *
+ * In this routine we deal with our idea of a phantom row/col of
+ * zero-shift values along each edge of the top-level-grid.
+ */
+typedef struct ntv2_cell NTV2_CELL;
+struct ntv2_cell
+{
+   int    icol;                        /* Column of lower-right corner */
+   int    irow;                        /* Row    of lower-right corner */
+   int    horz;                        /* Horizontal move of corners   */
+   int    vert;                        /* Vertical   move of corners   */
+   double x_cellfrac;                  /* Fraction of a cell westward  */
+   double y_cellfrac;                  /* Fraction of a cell northward */
+};
+
+static void ntv2_locate_cell(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   double           lon,
+   double           lat,
+   int              status,
+   NTV2_CELL *      cell)
+{
+   double xgrid_index, ygrid_index, x_cellfrac, y_cellfrac;
+   int    horz = 0, vert = 0;
+   int    icol, irow;
+
+   if ( hdr->data_mode == NTV2_DATA_ON_DEMAND          &&
+        ntv2_load_ptr(&rec->shifts) == NTV2_NULL       &&
+        !ntv2_load_flag(&rec->load_failed) )
+   {
+      ntv2_demand_rec_bin(hdr, rec);
+   }
+
+   /* lat goes S to N, lon goes E to W */
+   xgrid_index = (rec->lon_max - lon) / rec->lon_inc;
+   ygrid_index = (lat - rec->lat_min) / rec->lat_inc;
+
+   icol = (int)xgrid_index;
+   irow = (int)ygrid_index;
+
+   /* If the status is NTV2_STATUS_OUTSIDE_CELL, it is within one cell of the
+      edge of a parent grid.  Have to do something different.
+   */
+   if ( status == NTV2_STATUS_OUTSIDE_CELL )
+   {
+      icol = (xgrid_index < 0.0) ? -1 : (int)xgrid_index;
+      irow = (ygrid_index < 0.0) ? -1 : (int)ygrid_index;
+   }
+
+   x_cellfrac = xgrid_index - icol;
+   y_cellfrac = ygrid_index - irow;
+
+   if ( status == NTV2_STATUS_OUTSIDE_CELL )
+   {
+      horz = (icol < 0) ? +1
+                        : (icol > rec->ncols-2) ? -1 : 0;
+      vert = (irow < 0) ? -1
+                        : (irow > rec->nrows-2) ? +1 : 0;
+
+      icol = (icol < 0) ? 0
+                        : (icol > rec->ncols-2) ? rec->ncols-2 : icol;
+      irow = (irow < 0) ? 0
+                        : (irow > rec->nrows-2) ? rec->nrows-2 : irow;
+   }
+
+   cell->icol       = icol;
+   cell->irow       = irow;
+   cell->horz       = horz;
+   cell->vert       = vert;
+   cell->x_cellfrac = x_cellfrac;
+   cell->y_cellfrac = y_cellfrac;
+}
+
+/*------------------------------------------------------------------------
+ * Calculate the lon & lat shifts for a given lon/lat.
+ */
+static void ntv2_calculate_shifts(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   double           lon,
+   double           lat,
+   int              status,
+   double *         plon_shift,
+   double *         plat_shift)
+{
+   NTV2_CELL c;
+
+   ntv2_locate_cell(hdr, rec, lon, lat, status, &c);
+
+   /* The longitude shifts are built for (+west/-east) longitude values,
+      so we flip the sign of the calculated longitude shift to make
+      it standard (-west/+east).
+   */
+
+   *plon_shift = -ntv2_calculate_one_shift(hdr, rec, status,
+      c.icol, c.irow, c.horz, c.vert, c.x_cellfrac, c.y_cellfrac,
+      NTV2_COORD_LON);
+
+   *plat_shift =  ntv2_calculate_one_shift(hdr, rec, status,
+      c.icol, c.irow, c.horz, c.vert, c.x_cellfrac, c.y_cellfrac,
+      NTV2_COORD_LAT);
+}
+
+/*------------------------------------------------------------------------
+ * Calculate the lon & lat shifts for a given lon/lat in single precision.
+ *
+ * The cell is found in double precision just as for the double shifts,
+ * so the same cell and edge handling is always used, and only the
+ * interpolation is done in floats.
+ */
+static void ntv2_calculate_shifts_flt(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   double           lon,
+   double           lat,
+   int              status,
+   float *          plon_shift,
+   float *          plat_shift)
+{
+   NTV2_CELL c;
+   float     x_cellfrac, y_cellfrac;
+
+   ntv2_locate_cell(hdr, rec, lon, lat, status, &c);
+
+   x_cellfrac = (float)c.x_cellfrac;
+   y_cellfrac = (float)c.y_cellfrac;
+
+   *plon_shift = -ntv2_calculate_one_shift_flt(hdr, rec, status,
+      c.icol, c.irow, c.horz, c.vert, x_cellfrac, y_cellfrac,
+      NTV2_COORD_LON);
+
+   *plat_shift =  ntv2_calculate_one_shift_flt(hdr, rec, status,
+      c.icol, c.irow, c.horz, c.vert, x_cellfrac, y_cellfrac,
+      NTV2_COORD_LAT);
+}
+
+/*------------------------------------------------------------------------
+ * Read in the ascii accuracies for a sub-file on first use.
+ *
+ * Values can't be found in an ascii file without parsing it, so the
+ * whole sub-file's accuracies are read in at once.  As with shifts read
+ * on demand, the check is repeated once the mutex is held.  Returns the
+ * accuracies (as seen with the mutex held), or NULL if they can't be
+ * read.
+ */
+static const NTV2_SHIFT * ntv2_demand_accurs_asc(
+   const NTV2_HDR *hdr,
+   const NTV2_REC *rec)
+{
+   const NTV2_SHIFT * result;
+
+   ntv2_mutex_enter(hdr->mutex);
+   {
+      if ( rec->accurs == NTV2_NULL && hdr->io.read_at != NTV2_NULL )
+      {
+         NTV2_HDR *   h      = (NTV2_HDR *)hdr;
+         NTV2_SHIFT * accurs = (NTV2_SHIFT *)
+                               ntv2_grid_alloc(h, sizeof(*accurs) * rec->num);
+
+         if ( accurs != NTV2_NULL )
+         {
+            ntv2_fseek(h, rec->offset, SEEK_SET);
+            if ( ntv2_read_vals_asc(h, rec->num, NTV2_NULL, accurs)
+                 == NTV2_ERR_OK )
+            {
+               ntv2_store_ptr(&((NTV2_REC *)rec)->accurs, accurs);
+            }
+            else
+            {
+               ntv2_grid_free(h, accurs);
+            }
+         }
+      }
+
+      result = rec->accurs;
+   }
+   ntv2_mutex_leave(hdr->mutex);
+
+   return result;
+}
+
+/*------------------------------------------------------------------------
+ * Get an accuracy value (lat or lon) for a grid point.
+ *
+ * Accuracies not in memory are read from the file, one value at a time,
+ * since they are seldom asked for.
+ */
+static double ntv2_get_accur(
+   const NTV2_HDR *   hdr,
+   const NTV2_REC *   rec,
+   const NTV2_SHIFT * accurs,
+   int                icol,
+   int                irow,
+   int                coord_type)
+{
+   float accur = 0.0;
+   long  offs;
+
+   if ( accurs != NTV2_NULL )
+      return accurs[(irow * rec->ncols) + icol][coord_type];
+
+   offs = ntv2_accur_offset(hdr, rec, icol, irow, coord_type);
+
+   if ( hdr->map_data != NTV2_NULL )
+   {
+      /* The mapped data may not be aligned, so we copy it out. */
+      memcpy(&accur, hdr->map_data + offs, NTV2_SIZE_FLT);
+      NTV2_SWAPF(&accur, 1);
+   }
+   else if ( ntv2_read_at(hdr, &accur, NTV2_SIZE_FLT, offs) == NTV2_ERR_OK )
+   {
+      NTV2_SWAPF(&accur, 1);
+   }
+   else
+   {
+      accur = 0.0;
+   }
+
+   return accur;
+}
+
+/*------------------------------------------------------------------------
+ * Calculate the lon & lat accuracies for a given lon/lat.
+ *
+ * The accuracies are interpolated the same way as the shifts, but the
+ * edges of a grid are just extended rather than going to zero.
+ * Returns FALSE if there are no accuracies for the record.
+ */
+static NTV2_BOOL ntv2_calculate_accurs(
+   const NTV2_HDR * hdr,
+   const NTV2_REC * rec,
+   double           lon,
+   double           lat,
+   double *         plon_accur,
+   double *         plat_accur)
+{
+   const NTV2_SHIFT * accurs;
+   double xgrid_index, ygrid_index, x_cellfrac, y_cellfrac;
+   int    icol, irow;
+   int    icol1, irow1;
+   int    c;
+
+   /* The accuracies may be read in by another thread at any time. */
+
+   accurs = (const NTV2_SHIFT *)ntv2_load_ptr(&rec->accurs);
+   if ( accurs == NTV2_NULL && hdr->file_type == NTV2_FILE_TYPE_ASC )
+      accurs = ntv2_demand_accurs_asc(hdr, rec);
+
+   if ( accurs == NTV2_NULL && !ntv2_have_source(hdr) )
+      return FALSE;
+
+   /* lat goes S to N, lon goes E to W */
+   xgrid_index = (rec->lon_max - lon) / rec->lon_inc;
+   ygrid_index = (lat - rec->lat_min) / rec->lat_inc;
+
+   if ( xgrid_index < 0.0 )               xgrid_index = 0.0;
+   if ( xgrid_index > rec->ncols - 1 )    xgrid_index = rec->ncols - 1;
+   if ( ygrid_index < 0.0 )               ygrid_index = 0.0;
+   if ( ygrid_index > rec->nrows - 1 )    ygrid_index = rec->nrows - 1;
+
+   icol = (int)xgrid_index;
+   irow = (int)ygrid_index;
+
+   x_cellfrac = xgrid_index - icol;
+   y_cellfrac = ygrid_index - irow;
+
+   icol1 = (icol < rec->ncols - 1) ? icol + 1 : icol;
+   irow1 = (irow < rec->nrows - 1) ? irow + 1 : irow;
+
+   for (c = 0; c < 2; c++)
+   {
+      int    coord_type = (c == 0) ? NTV2_COORD_LON : NTV2_COORD_LAT;
+      double lr = ntv2_get_accur(hdr, rec, accurs, icol,  irow,  coord_type);
+      double ll = ntv2_get_accur(hdr, rec, accurs, icol1, irow,  coord_type);
+      double ur = ntv2_get_accur(hdr, rec, accurs, icol,  irow1, coord_type);
+      double ul = ntv2_get_accur(hdr, rec, accurs, icol1, irow1, coord_type);
+      double accur;
+
+      accur = lr + ((ll - lr) * x_cellfrac)
+                 + ((ur - lr) * y_cellfrac)
+                 + (((ul - ll) - (ur - lr)) * x_cellfrac * y_cellfrac);
+
+      if ( coord_type == NTV2_COORD_LON )
+         *plon_accur = accur;
+      else
+         *plat_accur = accur;
+   }
+
+   return TRUE;
+}
+
+/*------------------------------------------------------------------------
+ * The points being transformed.
+ *
+ * The lons and lats are read from one pair of arrays and written to
+ * another (which may be the same), each with its own stride, so an
+ * array of NTV2_COORDs is just a pair of arrays with a stride of 2.
+ * The arrays are either doubles or (if flt is set) floats.
+ */
+typedef struct ntv2_pts NTV2_PTS;
+struct ntv2_pts
+{
+   const double * lon_in;              /* Input  lons                 */
+   const double * lat_in;              /* Input  lats                 */
+   size_t         in_stride;           /* Values between input  pts   */
+   double *       lon_out;             /* Output lons                 */
+   double *       lat_out;             /* Output lats                 */
+   size_t         out_stride;          /* Values between output pts   */
+
+   NTV2_BOOL      flt;                 /* TRUE if arrays are floats   */
+   const float *  flon_in;             /* Input  lons if floats       */
+   const float *  flat_in;             /* Input  lats if floats       */
+   float *        flon_out;            /* Output lons if floats       */
+   float *        flat_out;            /* Output lats if floats       */
+};
+
+#define NTV2_PTS_IN(p, a, fa, i) \
+   ( (p)->flt ? (double)(p)->fa[(size_t)(i) * (p)->in_stride] \
+              :         (p)->a [(size_t)(i) * (p)->in_stride] )
+
+#define NTV2_PTS_LON(p, i)      NTV2_PTS_IN(p, lon_in, flon_in, i)
+#define NTV2_PTS_LAT(p, i)      NTV2_PTS_IN(p, lat_in, flat_in, i)
+#define NTV2_PTS_SET_LON(p, i)  (p)->lon_out [(size_t)(i) * (p)->out_stride]
+#define NTV2_PTS_SET_LAT(p, i)  (p)->lat_out [(size_t)(i) * (p)->out_stride]
+#define NTV2_PTS_SET_FLON(p, i) (p)->flon_out[(size_t)(i) * (p)->out_stride]
+#define NTV2_PTS_SET_FLAT(p, i) (p)->flat_out[(size_t)(i) * (p)->out_stride]
+
+/*------------------------------------------------------------------------
+ * Set up the points for an array of NTV2_COORDs, changed in place.
+ */
+static void ntv2_pts_coord(
+   NTV2_PTS *  pts,
+   NTV2_COORD  coord[])
+{
+   memset(pts, 0, sizeof(*pts));
+   pts->lon_in     = &coord[0][NTV2_COORD_LON];
+   pts->lat_in     = &coord[0][NTV2_COORD_LAT];
+   pts->in_stride  = 2;
+   pts->lon_out    = &coord[0][NTV2_COORD_LON];
+   pts->lat_out    = &coord[0][NTV2_COORD_LAT];
+   pts->out_stride = 2;
+}
+
+/*------------------------------------------------------------------------
+ * Fetch the shift data needed for a batch of points ahead of time.
+ *
+ * When shifts are read from the file on-the-fly, each tile read would
+ * otherwise wait on the disk in turn.  So the points are processed in
+ * blocks, and before a block is transformed we find all the tiles its
+ * points will touch that aren't already cached, convert them to file
+ * ranges, and sort and merge those ranges.
+ *
+ * With NTV2_FETCH_ASYNC, all the ranges for a block are read with a
+ * single submission, and the reads for the next block are in flight
+ * while the current block is being transformed.  With NTV2_FETCH_READ
+ * (or if a ring can't be had), each range is read in one call of the
+ * read_at routine, which works with any source.  Either way, the tiles
+ * are then decoded into the cache.  For any ranges that don't fit in the
+ * buffer, we just ask the OS to start reading them if it is our file.
+ * The tile reads then (mostly) find their data already in memory, and
+ * the source sees a few sequential reads instead of many seeks.
+ */
+#ifndef   NTV2_PREFETCH_POINTS
+#  define NTV2_PREFETCH_POINTS  4096      /* points per prefetch batch */
+#endif
+
+#ifndef   NTV2_PREFETCH_MIN
+#  define NTV2_PREFETCH_MIN     16        /* don't bother for fewer points */
+#endif
+
+#ifndef   NTV2_PREFETCH_GAP
+#  define NTV2_PREFETCH_GAP     65536     /* merge ranges closer than this */
+#endif
+
+#ifndef   NTV2_FETCH_RING_SIZE
+#  define NTV2_FETCH_RING_SIZE  256       /* max async reads per batch */
+#endif
+
+#ifndef   NTV2_FETCH_BUFSIZE
+#  define NTV2_FETCH_BUFSIZE    (4 * 1024 * 1024) /* max bytes per batch */
+#endif
+
+typedef struct ntv2_tile_key NTV2_TILE_KEY;
+struct ntv2_tile_key
+{
+   int rec_num;
+   int trow;
+   int tcol;
+};
+
+typedef struct ntv2_range NTV2_RANGE;
+struct ntv2_range
+{
+   long            offset;
+   long            length;
+   unsigned char * data;               /* NULL if not being read */
+   long            buf_off;            /* Offset in buffer or -1 */
+   NTV2_BOOL       ok;                 /* TRUE if read completed */
+};
+
+typedef struct ntv2_fetch NTV2_FETCH;
+struct ntv2_fetch
+{
+   void *          ring;               /* Async read ring or NULL */
+   NTV2_TILE_KEY * keys;               /* Tiles being read        */
+   int             nkeys;
+   NTV2_RANGE *    ranges;             /* Merged file ranges      */
+   int             nranges;
+   unsigned char * buf;                /* Data for all ranges     */
+};
+
+static int ntv2_tile_key_cmp(const void *p1, const void *p2)
+{
+   const NTV2_TILE_KEY * k1 = (const NTV2_TILE_KEY *)p1;
+   const NTV2_TILE_KEY * k2 = (const NTV2_TILE_KEY *)p2;
+
+   if ( k1->rec_num != k2->rec_num )  return (k1->rec_num < k2->rec_num) ? -1 : 1;
+   if ( k1->trow    != k2->trow    )  return (k1->trow    < k2->trow   ) ? -1 : 1;
+   if ( k1->tcol    != k2->tcol    )  return (k1->tcol    < k2->tcol   ) ? -1 : 1;
+   return 0;
+}
+
+static int ntv2_range_cmp(const void *p1, const void *p2)
+{
+   const NTV2_RANGE * r1 = (const NTV2_RANGE *)p1;
+   const NTV2_RANGE * r2 = (const NTV2_RANGE *)p2;
 
-   return hdr;
+   if ( r1->offset != r2->offset )  return (r1->offset < r2->offset) ? -1 : 1;
+   return 0;
 }
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 binary write routines                                                */
-/* ------------------------------------------------------------------------- */
+/*------------------------------------------------------------------------
+ * Release everything from a batch.
+ */
+static void ntv2_fetch_clear(
+   NTV2_FETCH *fetch)
+{
+   ntv2_memdealloc(fetch->keys);
+   ntv2_memdealloc(fetch->ranges);
+   ntv2_memdealloc(fetch->buf);
+
+   fetch->keys    = NTV2_NULL;
+   fetch->nkeys   = 0;
+   fetch->ranges  = NTV2_NULL;
+   fetch->nranges = 0;
+   fetch->buf     = NTV2_NULL;
+}
 
 /*------------------------------------------------------------------------
- * Write a binary overview record
+ * Wait for all outstanding reads of a batch to complete.
  */
-static void ntv2_write_ov_bin(
-   FILE     *fp,
-   NTV2_HDR *hdr,
-   NTV2_BOOL swap_data)
+static void ntv2_fetch_wait(
+   NTV2_FETCH *fetch)
 {
-   NTV2_FILE_OV   ov;
-   NTV2_FILE_OV * pov;
+   void * udata;
+   long   result;
 
-   ntv2_validate_ov(hdr, NTV2_NULL, 0);
+   if ( fetch->ring == NTV2_NULL )
+      return;
 
-   pov = hdr->overview;
-   if ( swap_data )
+   while ( ntv2_ring_wait(fetch->ring, &udata, &result) )
    {
-      memcpy(&ov, pov, sizeof(ov));
-      ntv2_swap_int( &ov.i_num_orec, 1);
-      ntv2_swap_int( &ov.i_num_srec, 1);
-      ntv2_swap_int( &ov.i_num_file, 1);
-      ntv2_swap_dbl( &ov.d_major_f,  1);
-      ntv2_swap_dbl( &ov.d_minor_f,  1);
-      ntv2_swap_dbl( &ov.d_major_t,  1);
-      ntv2_swap_dbl( &ov.d_minor_t,  1);
-      pov = &ov;
+      NTV2_RANGE * range = (NTV2_RANGE *)udata;
+
+      range->ok = (result == range->length);
    }
+}
 
-   fwrite(pov, sizeof(*pov), 1, fp);
+/*------------------------------------------------------------------------
+ * Find the (merged) range containing a block of data.
+ */
+static const unsigned char * ntv2_fetch_find(
+   const NTV2_FETCH *fetch,
+   long              offset,
+   long              length)
+{
+   int lo = 0;
+   int hi = fetch->nranges - 1;
+
+   while ( lo <= hi )
+   {
+      int                mid   = (lo + hi) / 2;
+      const NTV2_RANGE * range = &fetch->ranges[mid];
+
+      if ( offset < range->offset )
+      {
+         hi = mid - 1;
+      }
+      else if ( offset >= range->offset + range->length )
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         if ( !range->ok || offset + length > range->offset + range->length )
+            return NTV2_NULL;
+         return range->data + (offset - range->offset);
+      }
+   }
+
+   return NTV2_NULL;
 }
 
 /*------------------------------------------------------------------------
- * Write a binary sub-file record and its children.
+ * Start fetching the data for a batch of points.
  */
-static void ntv2_write_sf_bin(
-   FILE     *fp,
-   NTV2_HDR *hdr,
-   NTV2_REC *rec,
-   NTV2_BOOL swap_data)
+static void ntv2_fetch_start(
+   const NTV2_HDR *hdr,
+   NTV2_FETCH     *fetch,
+   double          deg_factor,
+   int             n,
+   const NTV2_PTS *pts,
+   int             first)
 {
-   NTV2_REC * sub;
-   int i;
+   NTV2_TILE_KEY * keys;
+   NTV2_RANGE *    ranges;
+   size_t          buf_len = 0;
+   int nkeys   = 0;
+   int nranges = 0;
+   int nreads  = 0;
+   int i, j;
 
-   /* this shouldn't happen */
-   if ( !rec->active )
+   if ( hdr->fetch_mode == NTV2_FETCH_NONE || n < NTV2_PREFETCH_MIN )
+   {
       return;
+   }
 
-   ntv2_validate_sf(hdr, NTV2_NULL, rec->rec_num, 0);
+   /* -------- collect all tiles touched (a cell may span 4 tiles) */
 
-   /* write the sub-file header */
+   keys = (NTV2_TILE_KEY *)ntv2_memalloc(sizeof(*keys) * 4 * n);
+   if ( keys == NTV2_NULL )
+      return;
+
+   for (i = 0; i < n; i++)
    {
-      NTV2_FILE_SF   sf;
-      NTV2_FILE_SF * psf;
+      const NTV2_REC * rec;
+      double lon = (NTV2_PTS_LON(pts, first + i) * deg_factor);
+      double lat = (NTV2_PTS_LAT(pts, first + i) * deg_factor);
+      int    icol, irow;
+      int    r, c;
 
-      psf = &hdr->subfiles[rec->rec_num];
-      if ( swap_data )
+      rec = ntv2_find_rec(hdr, lon, lat, NTV2_NULL);
+      if ( rec == NTV2_NULL )
+         continue;
+
+      icol = (int)((rec->lon_max - lon) / rec->lon_inc);
+      irow = (int)((lat - rec->lat_min) / rec->lat_inc);
+
+      icol = (icol < 0) ? 0 : (icol > rec->ncols-1) ? rec->ncols-1 : icol;
+      irow = (irow < 0) ? 0 : (irow > rec->nrows-1) ? rec->nrows-1 : irow;
+
+      for (r = irow; r <= irow+1 && r < rec->nrows; r++)
       {
-         memcpy(&sf, psf, sizeof(sf));
-         ntv2_swap_dbl( &sf.d_s_lat,    1);
-         ntv2_swap_dbl( &sf.d_n_lat,    1);
-         ntv2_swap_dbl( &sf.d_e_lon,    1);
-         ntv2_swap_dbl( &sf.d_w_lon,    1);
-         ntv2_swap_dbl( &sf.d_lat_inc,  1);
-         ntv2_swap_dbl( &sf.d_lon_inc,  1);
-         ntv2_swap_int( &sf.i_gs_count, 1);
-         psf = &sf;
+         for (c = icol; c <= icol+1 && c < rec->ncols; c++)
+         {
+            if ( (r == irow || (r % NTV2_TILE_DIM) == 0) &&
+                 (c == icol || (c % NTV2_TILE_DIM) == 0) )
+            {
+               keys[nkeys].rec_num = rec->rec_num;
+               keys[nkeys].trow    = r / NTV2_TILE_DIM;
+               keys[nkeys].tcol    = c / NTV2_TILE_DIM;
+               nkeys++;
+            }
+         }
       }
-      fwrite(psf, sizeof(*psf), 1, fp);
    }
 
-   /* write all grid-shift records */
-   for (i = 0; i < rec->num; i++)
-   {
-      NTV2_FILE_GS gs;
+   /* -------- remove duplicates and tiles already cached */
 
-      gs.f_lat_shift = rec->shifts[i][NTV2_COORD_LAT];
-      gs.f_lon_shift = rec->shifts[i][NTV2_COORD_LON];
+   if ( nkeys > 1 )
+      qsort(keys, nkeys, sizeof(*keys), ntv2_tile_key_cmp);
 
-      if ( rec->accurs != NTV2_NULL )
-      {
-         gs.f_lat_accuracy = rec->accurs[i][NTV2_COORD_LAT];
-         gs.f_lon_accuracy = rec->accurs[i][NTV2_COORD_LON];
-      }
-      else
-      {
-         gs.f_lat_accuracy = 0.0;
-         gs.f_lon_accuracy = 0.0;
-      }
+   for (i = 0, j = 0; i < nkeys; i++)
+   {
+      if ( j > 0 && ntv2_tile_key_cmp(&keys[i], &keys[j-1]) == 0 )
+         continue;
 
-      if ( swap_data )
+      if ( hdr->cache != NTV2_NULL &&
+           ntv2_cache_has(hdr, keys[i].rec_num, keys[i].trow, keys[i].tcol) )
       {
-         ntv2_swap_flt((float *)&gs, 4);
+         continue;
       }
 
-      fwrite(&gs, sizeof(gs), 1, fp);
+      keys[j++] = keys[i];
    }
+   nkeys = j;
 
-   /* recursively write all its children */
-   for (sub = rec->sub; sub != NTV2_NULL; sub = sub->next)
+   /* -------- convert each tile to one file range per tile row */
+
+   ranges = (NTV2_RANGE *)
+            ntv2_memalloc(sizeof(*ranges) * NTV2_TILE_DIM * (nkeys + 1));
+   if ( ranges == NTV2_NULL )
    {
-      ntv2_write_sf_bin(fp, hdr, sub, swap_data);
+      ntv2_memdealloc(keys);
+      return;
    }
-}
-
-/*------------------------------------------------------------------------
- * Write a binary end record
- */
-static void ntv2_write_end_bin(
-   FILE     *fp)
-{
-   NTV2_FILE_END end_rec;
 
-   memcpy(end_rec.n_end,   NTV2_END_NAME,  NTV2_NAME_LEN);
-   memcpy (end_rec.filler, NTV2_ALL_ZEROS, NTV2_NAME_LEN);
-   fwrite(&end_rec, sizeof(end_rec), 1, fp);
-}
+   for (i = 0; i < nkeys; i++)
+   {
+      const NTV2_REC * rec = &hdr->recs[keys[i].rec_num];
+      int nrows, ncols;
+      int row;
 
-/*------------------------------------------------------------------------
- * Write out the NTV2_HDR object to a binary file.
- */
-static int ntv2_write_file_bin(
-   NTV2_HDR   *hdr,
-   const char *path,
-   int         byte_order)
-{
-   FILE *    fp;
-   NTV2_BOOL swap_data;
-   int       rc;
+      ntv2_tile_size(rec, keys[i].trow, keys[i].tcol, &nrows, &ncols);
 
-   swap_data = hdr->swap_data;
-   switch (byte_order)
-   {
-      case NTV2_ENDIAN_BIG:    swap_data ^= !ntv2_is_big_endian(); break;
-      case NTV2_ENDIAN_LITTLE: swap_data ^= !ntv2_is_ltl_endian(); break;
-      case NTV2_ENDIAN_NATIVE: swap_data  = FALSE;                 break;
+      for (row = 0; row < nrows; row++)
+      {
+         ranges[nranges].offset =
+            ntv2_data_offset(rec, keys[i].tcol * NTV2_TILE_DIM,
+                                  keys[i].trow * NTV2_TILE_DIM + row);
+         ranges[nranges].length = ncols * (long)sizeof(NTV2_FILE_GS);
+         nranges++;
+      }
    }
 
-   fp = fopen(path, "wb");
-   if ( fp == NTV2_NULL )
+   /* -------- sort & merge the ranges */
+
+   if ( nranges > 1 )
+      qsort(ranges, nranges, sizeof(*ranges), ntv2_range_cmp);
+
+   for (i = 0, j = 0; i < nranges; i++)
    {
-      rc = NTV2_ERR_CANNOT_OPEN_FILE;
+      long end = ranges[i].offset + ranges[i].length;
+
+      if ( j > 0 &&
+           ranges[i].offset <= ranges[j-1].offset + ranges[j-1].length +
+                               NTV2_PREFETCH_GAP )
+      {
+         if ( end > ranges[j-1].offset + ranges[j-1].length )
+            ranges[j-1].length = end - ranges[j-1].offset;
+         continue;
+      }
+
+      ranges[j++] = ranges[i];
    }
-   else
-   {
-      NTV2_REC * sf;
+   nranges = j;
 
-      ntv2_write_ov_bin(fp, hdr, swap_data);
+   /* -------- see which ranges we can read */
 
-      for (sf = hdr->first_parent; sf != NTV2_NULL; sf = sf->next)
-         ntv2_write_sf_bin(fp, hdr, sf, swap_data);
+   /* A range too big for what is left of the buffer is skipped, but
+      later (smaller) ones may still fit, so each chosen range is given
+      its place in the buffer here.  The data read goes into the cache,
+      so there is no point in reading it if there isn't one. */
 
-      ntv2_write_end_bin(fp);
+   for (i = 0; i < nranges; i++)
+   {
+      ranges[i].data    = NTV2_NULL;
+      ranges[i].buf_off = -1;
+      ranges[i].ok      = FALSE;
 
-      rc = (ferror(fp) == 0) ? NTV2_ERR_OK : NTV2_ERR_IOERR;
-      fclose(fp);
+      if ( hdr->cache != NTV2_NULL                                     &&
+           (fetch->ring == NTV2_NULL || nreads < NTV2_FETCH_RING_SIZE) &&
+           buf_len + ranges[i].length <= NTV2_FETCH_BUFSIZE )
+      {
+         ranges[i].buf_off = (long)buf_len;
+         buf_len += ranges[i].length;
+         nreads++;
+      }
    }
 
-   return rc;
-}
+   if ( nreads > 0 )
+   {
+      fetch->buf = (unsigned char *)ntv2_memalloc(buf_len);
+      if ( fetch->buf == NTV2_NULL )
+         nreads = 0;
+   }
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 ascii write routines                                                 */
-/* ------------------------------------------------------------------------- */
+   /* -------- start reading them */
 
-#define T(x)   ntv2_strip( strncpy(stemp, x, NTV2_NAME_LEN) )
-#define D(x)   ntv2_dtoa (         ntemp, x)
+   for (i = 0; i < nranges; i++)
+   {
+      NTV2_RANGE * range = &ranges[i];
 
-/*------------------------------------------------------------------------
- * Write a ascii overview record
- */
-static void ntv2_write_ov_asc(
-   FILE     *fp,
-   NTV2_HDR *hdr)
-{
-   NTV2_FILE_OV * pov = hdr->overview;
-   char stemp[NTV2_NAME_LEN+1];
-   char ntemp[32];
+      if ( nreads > 0 && range->buf_off >= 0 )
+      {
+         range->data = fetch->buf + range->buf_off;
 
-   ntv2_validate_ov(hdr, NTV2_NULL, 0);
-   stemp[NTV2_NAME_LEN] = 0;
+         if ( fetch->ring == NTV2_NULL )
+         {
+            range->ok = ( ntv2_read_at(hdr, range->data, range->length,
+                                       range->offset) == NTV2_ERR_OK );
+            continue;
+         }
 
-   fprintf(fp, "NUM_OREC %d\n",   pov->i_num_orec  );
-   fprintf(fp, "NUM_SREC %d\n",   pov->i_num_srec  );
-   fprintf(fp, "NUM_FILE %d\n",   pov->i_num_file  );
-   fprintf(fp, "GS_TYPE  %s\n", T(pov->s_gs_type)  );
-   fprintf(fp, "VERSION  %s\n", T(pov->s_version)  );
-   fprintf(fp, "SYSTEM_F %s\n", T(pov->s_system_f) );
-   fprintf(fp, "SYSTEM_T %s\n", T(pov->s_system_t) );
-   fprintf(fp, "MAJOR_F  %s\n", D(pov->d_major_f)  );
-   fprintf(fp, "MINOR_F  %s\n", D(pov->d_minor_f)  );
-   fprintf(fp, "MAJOR_T  %s\n", D(pov->d_major_t)  );
-   fprintf(fp, "MINOR_T  %s\n", D(pov->d_minor_t)  );
+         if ( ntv2_ring_read(fetch->ring, ntv2_io_fp(hdr), range->data,
+                             range->length, range->offset, range) )
+         {
+            continue;
+         }
+         range->data = NTV2_NULL;
+      }
+
+      if ( ntv2_io_fp(hdr) != NTV2_NULL )
+         ntv2_prefetch(ntv2_io_fp(hdr), range->offset, range->length);
+   }
+
+   if ( nreads > 0 )
+   {
+      fetch->keys    = keys;
+      fetch->nkeys   = nkeys;
+      fetch->ranges  = ranges;
+      fetch->nranges = nranges;
+
+      if ( fetch->ring != NTV2_NULL && !ntv2_ring_submit(fetch->ring) )
+      {
+         /* Something is wrong with the ring, so don't use it anymore. */
+         ntv2_fetch_wait(fetch);
+         ntv2_ring_delete(fetch->ring);
+         fetch->ring = NTV2_NULL;
+         ntv2_fetch_clear(fetch);
+      }
+   }
+   else
+   {
+      ntv2_memdealloc(keys);
+      ntv2_memdealloc(ranges);
+   }
 }
 
 /*------------------------------------------------------------------------
- * Write a ascii sub-file record and its children.
+ * Finish fetching the data for a batch of points.
+ *
+ * Once all reads are done, every tile whose rows were all read
+ * successfully is added to the cache.
  */
-static void ntv2_write_sf_asc(
-   FILE     *fp,
-   NTV2_HDR *hdr,
-   NTV2_REC *rec)
+static void ntv2_fetch_finish(
+   const NTV2_HDR *hdr,
+   NTV2_FETCH     *fetch)
 {
-   NTV2_REC * sub;
-   char stemp[NTV2_NAME_LEN+1];
-   char ntemp[32];
    int i;
 
-   /* this shouldn't happen */
-   if ( !rec->active )
+   if ( fetch->nkeys == 0 )
       return;
 
-   ntv2_validate_sf(hdr, NTV2_NULL, rec->rec_num, 0);
-   stemp[NTV2_NAME_LEN] = 0;
-
-   /* write the sub-file header */
-   {
-      NTV2_FILE_SF * psf = &hdr->subfiles[rec->rec_num];
-
-      fprintf(fp, "\n");
-      fprintf(fp, "SUB_NAME %s\n", T(psf->s_sub_name) );
-      fprintf(fp, "PARENT   %s\n", T(psf->s_parent)   );
-      fprintf(fp, "CREATED  %s\n", T(psf->s_created)  );
-      fprintf(fp, "UPDATED  %s\n", T(psf->s_updated)  );
-      fprintf(fp, "S_LAT    %s\n", D(psf->d_s_lat)    );
-      fprintf(fp, "N_LAT    %s\n", D(psf->d_n_lat)    );
-      fprintf(fp, "E_LONG   %s\n", D(psf->d_e_lon)    );
-      fprintf(fp, "W_LONG   %s\n", D(psf->d_w_lon)    );
-      fprintf(fp, "LAT_INC  %s\n", D(psf->d_lat_inc)  );
-      fprintf(fp, "LONG_INC %s\n", D(psf->d_lon_inc)  );
-      fprintf(fp, "GS_COUNT %d\n",   psf->i_gs_count  );
-      fprintf(fp, "\n");
-   }
+   ntv2_fetch_wait(fetch);
 
-   /* write all grid-shift records */
-   for (i = 0; i < rec->num; i++)
+   for (i = 0; i < fetch->nkeys; i++)
    {
-      NTV2_FILE_GS gs;
+      const NTV2_REC *      rec = &hdr->recs[fetch->keys[i].rec_num];
+      const void *          rows[NTV2_TILE_DIM];
+      int nrows, ncols;
+      int row;
 
-      gs.f_lat_shift    = rec->shifts[i][NTV2_COORD_LAT];
-      gs.f_lon_shift    = rec->shifts[i][NTV2_COORD_LON];
+      ntv2_tile_size(rec, fetch->keys[i].trow, fetch->keys[i].tcol,
+                     &nrows, &ncols);
 
-      if ( rec->accurs != NTV2_NULL )
+      for (row = 0; row < nrows; row++)
       {
-         gs.f_lat_accuracy = rec->accurs[i][NTV2_COORD_LAT];
-         gs.f_lon_accuracy = rec->accurs[i][NTV2_COORD_LON];
+         rows[row] = ntv2_fetch_find(fetch,
+            ntv2_data_offset(rec, fetch->keys[i].tcol * NTV2_TILE_DIM,
+                                  fetch->keys[i].trow * NTV2_TILE_DIM + row),
+            ncols * (long)sizeof(NTV2_FILE_GS));
+         if ( rows[row] == NTV2_NULL )
+            break;
       }
-      else
+
+      if ( row == nrows )
       {
-         gs.f_lat_accuracy = 0.0;
-         gs.f_lon_accuracy = 0.0;
+         ntv2_cache_put(hdr, rec, fetch->keys[i].trow, fetch->keys[i].tcol,
+                        rows);
       }
-
-      fprintf(fp, "%-16s", D(gs.f_lat_shift)    );
-      fprintf(fp, "%-16s", D(gs.f_lon_shift)    );
-      fprintf(fp, "%-16s", D(gs.f_lat_accuracy) );
-      fprintf(fp, "%s\n",  D(gs.f_lon_accuracy) );
    }
 
-   /* recursively write all its children */
-   for (sub = rec->sub; sub != NTV2_NULL; sub = sub->next)
-   {
-      ntv2_write_sf_asc(fp, hdr, sub);
-   }
+   ntv2_fetch_clear(fetch);
 }
 
 /*------------------------------------------------------------------------
- * Write a ascii end record
+ * Set up fetching for an array of points.
  */
-static void ntv2_write_end_asc(
-   FILE     *fp)
+static void ntv2_fetch_init(
+   const NTV2_HDR *hdr,
+   NTV2_FETCH     *fetch,
+   int             n)
 {
-   fprintf(fp, "\n");
-   fprintf(fp, "END\n");
+   memset(fetch, 0, sizeof(*fetch));
+
+   /* Async reads need a cache to put the data into.  If a ring can't
+      be had, the data is read synchronously instead. */
+   if ( hdr->fetch_mode == NTV2_FETCH_ASYNC &&
+        hdr->cache != NTV2_NULL             &&
+        n >= NTV2_PREFETCH_MIN )
+   {
+      fetch->ring = ntv2_ring_create(NTV2_FETCH_RING_SIZE);
+   }
 }
 
 /*------------------------------------------------------------------------
- * Write out the NTV2_HDR object to an ascii file.
+ * Finish the current batch and start fetching the next one.
+ *
+ * This is called for the first point of each batch.
  */
-static int ntv2_write_file_asc(
-   NTV2_HDR   *hdr,
-   const char *path)
+static void ntv2_fetch_next(
+   const NTV2_HDR *hdr,
+   NTV2_FETCH     *fetch,
+   double          deg_factor,
+   int             n,
+   const NTV2_PTS *pts,
+   int             i)
 {
-   FILE *  fp;
-   int     rc;
-
-   fp = fopen(path, "w");
-   if ( fp == NTV2_NULL )
-   {
-      rc = NTV2_ERR_CANNOT_OPEN_FILE;
-   }
-   else
-   {
-      NTV2_REC * sf;
+#define NTV2_BATCH(i)   ( (n - (i) < NTV2_PREFETCH_POINTS) ? \
+                          (n - (i)) : NTV2_PREFETCH_POINTS )
 
-      ntv2_write_ov_asc(fp, hdr);
-
-      for (sf = hdr->first_parent; sf != NTV2_NULL; sf = sf->next)
-         ntv2_write_sf_asc(fp, hdr, sf);
+   if ( i == 0 )
+      ntv2_fetch_start(hdr, fetch, deg_factor, NTV2_BATCH(0), pts, 0);
 
-      ntv2_write_end_asc(fp);
+   ntv2_fetch_finish(hdr, fetch);
 
-      rc = (ferror(fp) == 0) ? NTV2_ERR_OK : NTV2_ERR_IOERR;
-      fclose(fp);
-   }
+   i += NTV2_PREFETCH_POINTS;
+   if ( i < n )
+      ntv2_fetch_start(hdr, fetch, deg_factor, NTV2_BATCH(i), pts, i);
 
-   return rc;
+#undef NTV2_BATCH
 }
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 write routines                                                       */
-/* ------------------------------------------------------------------------- */
+/*------------------------------------------------------------------------
+ * Clean up after fetching for an array of points.
+ */
+static void ntv2_fetch_term(
+   const NTV2_HDR *hdr,
+   NTV2_FETCH     *fetch)
+{
+   ntv2_fetch_finish(hdr, fetch);
+   ntv2_ring_delete(fetch->ring);
+   fetch->ring = NTV2_NULL;
+}
 
 /*------------------------------------------------------------------------
- * Write out the NTV2_HDR object to a file.
+ * Perform a forward transformation on a set of points.
+ *
+ * Note that the return value is the number of points successfully
+ * transformed, and points that can't be transformed (usually because
+ * they are outside of the grid) are left unchanged.  However, there
+ * is no indication of which points were changed and which were not.
  */
-int ntv2_write_file(
-   NTV2_HDR   *hdr,
-   const char *path,
-   NTV2_BOOL   byte_order)
+static int ntv2_forward_pts(
+   const NTV2_HDR *hdr,
+   double          deg_factor,
+   int             n,
+   const NTV2_PTS *pts)
 {
-   int type;
-   int rc;
+   NTV2_FETCH fetch;
+   int num = 0;
+   int i;
 
-   if ( hdr == NTV2_NULL )
-   {
-      return NTV2_ERR_NULL_HDR;
-   }
+   if ( hdr == NTV2_NULL || n <= 0 )
+      return 0;
 
-   if ( path == NTV2_NULL || *path == 0 )
-   {
-      return NTV2_ERR_NULL_PATH;
-   }
+   if ( deg_factor <= 0.0 )
+      deg_factor = 1.0;
 
-   if ( hdr->num_recs == 0 )
-   {
-      return NTV2_ERR_HDRS_NOT_READ;
-   }
+   ntv2_fetch_init(hdr, &fetch, n);
 
-   if ( !hdr->keep_orig )
+   for (i = 0; i < n; i++)
    {
-      return NTV2_ERR_ORIG_DATA_NOT_KEPT;
-   }
+      const NTV2_REC * rec;
+      double lon, lat;
+      int status;
 
-   if ( (hdr->first_parent)->shifts == NTV2_NULL )
-   {
-      return NTV2_ERR_DATA_NOT_READ;
-   }
+      if ( (i % NTV2_PREFETCH_POINTS) == 0 )
+         ntv2_fetch_next(hdr, &fetch, deg_factor, n, pts, i);
 
-   type = ntv2_filetype(path);
-   switch (type)
-   {
-      case NTV2_FILE_TYPE_ASC:
-         rc = ntv2_write_file_asc(hdr, path);
-         break;
+      lon = (NTV2_PTS_LON(pts, i) * deg_factor);
+      lat = (NTV2_PTS_LAT(pts, i) * deg_factor);
 
-      case NTV2_FILE_TYPE_BIN:
-         rc = ntv2_write_file_bin(hdr, path, byte_order);
-         break;
+      rec = ntv2_find_rec(hdr, lon, lat, &status);
+      if ( rec != NTV2_NULL )
+      {
+         double lon_shift, lat_shift;
 
-      default:
-         rc = NTV2_ERR_UNKNOWN_FILE_TYPE;
-         break;
+         ntv2_calculate_shifts(hdr, rec, lon, lat, status,
+            &lon_shift, &lat_shift);
+
+         NTV2_PTS_SET_LON(pts, i) = ((lon + lon_shift) / deg_factor);
+         NTV2_PTS_SET_LAT(pts, i) = ((lat + lat_shift) / deg_factor);
+         num++;
+      }
+      else
+      {
+         NTV2_PTS_SET_LON(pts, i) = NTV2_PTS_LON(pts, i);
+         NTV2_PTS_SET_LAT(pts, i) = NTV2_PTS_LAT(pts, i);
+      }
    }
 
-   return rc;
+   ntv2_fetch_term(hdr, &fetch);
+   return num;
 }
 
-/* ------------------------------------------------------------------------- */
-/* NTv2 dump routines                                                        */
-/* ------------------------------------------------------------------------- */
-
-#define T1(x)   ntv2_strip( strncpy(stemp1, x, NTV2_NAME_LEN) )
-#define T2(x)   ntv2_strip( strncpy(stemp2, x, NTV2_NAME_LEN) )
-#define D1(x)   ntv2_dtoa (         ntemp1, x)
-#define D2(x)   ntv2_dtoa (         ntemp2, x)
-#define CV(x)   D2(x * hdr->hdr_conv)
-
 /*------------------------------------------------------------------------
- * Dump the file overview struct to a stream.
+ * Perform a inverse transformation on a set of points.
+ *
+ * Note that the return value is the number of points successfully
+ * transformed, and points that can't be transformed (usually because
+ * they are outside of the grid) are left unchanged.  However, there
+ * is no indication of which points were changed and which were not.
  */
-static void ntv2_dump_ov(
+#ifndef   MAX_ITERATIONS
+#  define MAX_ITERATIONS  50
+#endif
+
+static int ntv2_inverse_pts(
    const NTV2_HDR *hdr,
-   FILE           *fp,
-   int             mode)
+   double          deg_factor,
+   int             n,
+   const NTV2_PTS *pts)
 {
-   const NTV2_FILE_OV * ov = hdr->overview;
-   char   stemp1[NTV2_NAME_LEN+1];
-   char   stemp2[NTV2_NAME_LEN+1];
-   char   ntemp1[32];
-
-   if ( ov == NTV2_NULL )
-      return;
-
-   if ( (mode & NTV2_DUMP_HDRS_EXT) == 0 )
-      return;
-
-   stemp1[NTV2_NAME_LEN] = 0;
-   stemp2[NTV2_NAME_LEN] = 0;
+   NTV2_FETCH fetch;
+   int max_iterations = MAX_ITERATIONS;
+   int num = 0;
+   int i;
 
-   fprintf(fp, "filename %s\n", hdr->path);
-   fprintf(fp, "========  hdr ===================================\n");
+   if ( hdr == NTV2_NULL || n <= 0 )
+      return 0;
 
-   fprintf(fp, "%-8s %d\n", T1(ov->n_num_orec),    ov->i_num_orec  );
-   fprintf(fp, "%-8s %d\n", T1(ov->n_num_srec),    ov->i_num_srec  );
-   fprintf(fp, "%-8s %d\n", T1(ov->n_num_file),    ov->i_num_file  );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_gs_type ), T2(ov->s_gs_type)  );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_version ), T2(ov->s_version)  );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_system_f), T2(ov->s_system_f) );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_system_t), T2(ov->s_system_t) );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_major_f ), D1(ov->d_major_f)  );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_minor_f ), D1(ov->d_minor_f)  );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_major_t ), D1(ov->d_major_t)  );
-   fprintf(fp, "%-8s %s\n", T1(ov->n_minor_t ), D1(ov->d_minor_t)  );
+   if ( deg_factor <= 0.0 )
+      deg_factor = 1.0;
 
-   fprintf(fp, "\n");
-}
+   ntv2_fetch_init(hdr, &fetch, n);
 
-/*------------------------------------------------------------------------
- * Dump a file sub-file struct to a stream.
- */
-static void ntv2_dump_sf(
-   const NTV2_HDR *hdr,
-   FILE           *fp,
-   int             n,
-   int             mode)
-{
-   const NTV2_FILE_SF * sf;
-   char   stemp1[NTV2_NAME_LEN+1];
-   char   stemp2[NTV2_NAME_LEN+1];
-   char   ntemp1[32];
-   char   ntemp2[32];
+   for (i = 0; i < n; i++)
+   {
+      double  lon,      lat;
+      double  lon_next, lat_next;
+      int num_iterations;
 
-   if ( (mode & NTV2_DUMP_HDRS_EXT)     == 0 )
-      return;
+      if ( (i % NTV2_PREFETCH_POINTS) == 0 )
+         ntv2_fetch_next(hdr, &fetch, deg_factor, n, pts, i);
 
-   if ( (mode & NTV2_DUMP_HDRS_SUMMARY) != 0 )
-      return;
+      lon_next = lon = (NTV2_PTS_LON(pts, i) * deg_factor);
+      lat_next = lat = (NTV2_PTS_LAT(pts, i) * deg_factor);
 
-   if ( !hdr->recs[n].active )
-      return;
+      /* The inverse is not a simple transformation like the forward.
+         We have to iteratively zero in on the answer by successively
+         calculating what the forward delta is at the point, and then
+         subtracting it instead of adding it.  The assumption here
+         is that all the shifts are smooth, which should be the case.
 
-   if ( hdr->subfiles == NTV2_NULL )
-      return;
+         If we can't get the lat and lon deltas between two steps to be
+         both within a given tolerance (NTV2_EPS) in max_iterations,
+         we just give up and use the last value we calculated.
+      */
 
-   sf = hdr->subfiles+n;
+      for (num_iterations = 0;
+           num_iterations < max_iterations;
+           num_iterations++)
+      {
+         const NTV2_REC * rec;
+         double lon_shift, lat_shift;
+         double lon_delta, lat_delta;
+         double lon_est,   lat_est;
+         int status;
 
-   stemp1[NTV2_NAME_LEN] = 0;
-   stemp2[NTV2_NAME_LEN] = 0;
+         /* It may seem unnecessary to find the subfile this point is
+            in each time, since it would seem that it *shouldn't* change.
+            However, if the point was outside of a grid but within one cell
+            of the edge, a shift may move it inside and then it could
+            possibly be found in some subfile.  It is also possible
+            that a point inside could shift to be on the edge or outside,
+            in which case the record for it would be a higher-up parent or
+            even a different sub-grid.
+         */
 
-   fprintf(fp, "======== %4d ===================================\n", n);
+         rec = ntv2_find_rec(hdr, lon_next, lat_next, &status);
+         if ( rec == NTV2_NULL )
+            break;
 
-   fprintf(fp, "%-8s %s\n",               T1(sf->n_sub_name),
-                                          T2(sf->s_sub_name) );
+         ntv2_calculate_shifts(hdr, rec, lon_next, lat_next, status,
+            &lon_shift, &lat_shift);
 
-   fprintf(fp, "%-8s %s\n",               T1(sf->n_parent),
-                                          T2(sf->s_parent)   );
+         lon_est   = (lon_next + lon_shift);
+         lat_est   = (lat_next + lat_shift);
 
-   fprintf(fp, "%-8s %s\n",               T1(sf->n_created),
-                                          T2(sf->s_created)  );
+         lon_delta = (lon_est  - lon);
+         lat_delta = (lat_est  - lat);
 
-   fprintf(fp, "%-8s %s\n",               T1(sf->n_updated),
-                                          T2(sf->s_updated)  );
+#if DEBUG_INVERSE
+         {
+            char buf1[32], buf2[32];
+            fprintf(stderr, "iteration %2d: value: %s %s\n",
+               num_iterations+1,
+               ntv2_dtoa(buf1, lon_next - lon_delta),
+               ntv2_dtoa(buf1, lat_next - lat_delta));
+            fprintf(stderr, "              delta: %s %s\n",
+               ntv2_dtoa(buf1, lon_delta),
+               ntv2_dtoa(buf2, lat_delta));
+         }
+#endif
 
-   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_s_lat),
-                                          D1(sf->d_s_lat),
-                                          CV(sf->d_s_lat)    );
+         if ( NTV2_ZERO(lon_delta) && NTV2_ZERO(lat_delta) )
+            break;
 
-   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_n_lat),
-                                          D1(sf->d_n_lat),
-                                          CV(sf->d_n_lat)    );
+         lon_next  = (lon_next - lon_delta);
+         lat_next  = (lat_next - lat_delta);
+      }
 
-   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_e_lon),
-                                          D1(sf->d_e_lon),
-                                          CV(sf->d_e_lon)    );
+#if DEBUG_INVERSE
+      {
+         char buf1[32], buf2[32];
+         fprintf(stderr, "final         value: %s %s\n",
+            ntv2_dtoa(buf1, lon_next),
+            ntv2_dtoa(buf2, lat_next));
+      }
+#endif
 
-   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_w_lon),
-                                          D1(sf->d_w_lon),
-                                          CV(sf->d_w_lon)    );
+      if ( num_iterations > 0 )
+      {
+         NTV2_PTS_SET_LON(pts, i) = (lon_next / deg_factor);
+         NTV2_PTS_SET_LAT(pts, i) = (lat_next / deg_factor);
+         num++;
+      }
+      else
+      {
+         NTV2_PTS_SET_LON(pts, i) = NTV2_PTS_LON(pts, i);
+         NTV2_PTS_SET_LAT(pts, i) = NTV2_PTS_LAT(pts, i);
+      }
+   }
 
-   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_lat_inc),
-                                          D1(sf->d_lat_inc),
-                                          CV(sf->d_lat_inc)  );
+   ntv2_fetch_term(hdr, &fetch);
+   return num;
+}
 
-   fprintf(fp, "%-8s %-14s [ %13s ]\n",   T1(sf->n_lon_inc),
-                                          D1(sf->d_lon_inc),
-                                          CV(sf->d_lon_inc)  );
+/*------------------------------------------------------------------------
+ * Perform a forward transformation on an array of points.
+ */
+int ntv2_forward(
+   const NTV2_HDR *hdr,
+   double          deg_factor,
+   int             n,
+   NTV2_COORD      coord[])
+{
+   NTV2_PTS pts;
 
-   fprintf(fp, "%-8s %d\n", T1(sf->n_gs_count), sf->i_gs_count  );
+   if ( coord == NTV2_NULL )
+      return 0;
 
-   fprintf(fp, "\n");
+   ntv2_pts_coord(&pts, coord);
+   return ntv2_forward_pts(hdr, deg_factor, n, &pts);
 }
 
 /*------------------------------------------------------------------------
- * Dump the internal overview header struct to a stream.
+ * Perform an inverse transformation on an array of points.
  */
-static void ntv2_dump_hdr(
+int ntv2_inverse(
    const NTV2_HDR *hdr,
-   FILE           *fp,
-   int             mode)
+   double          deg_factor,
+   int             n,
+   NTV2_COORD      coord[])
 {
-   char ntemp1[32];
+   NTV2_PTS pts;
 
-   if ( (mode & NTV2_DUMP_HDRS_INT    ) == 0 )
-      return;
+   if ( coord == NTV2_NULL )
+      return 0;
 
-   if ( (mode & NTV2_DUMP_HDRS_SUMMARY) != 0 )
-      return;
+   ntv2_pts_coord(&pts, coord);
+   return ntv2_inverse_pts(hdr, deg_factor, n, &pts);
+}
 
-   if ( (mode & NTV2_DUMP_HDRS_EXT) == 0 )
-   {
-      fprintf(fp, "filename    %s\n",  hdr->path);
-      fprintf(fp, "========  overview ==============\n");
-   }
+/*------------------------------------------------------------------------
+ * Perform a transformation (forward or inverse) on an array of points.
+ */
+int ntv2_transform(
+   const NTV2_HDR *hdr,
+   double          deg_factor,
+   int             n,
+   NTV2_COORD      coord[],
+   int             direction)
+{
+   if ( direction == NTV2_CVT_INVERSE )
+      return ntv2_inverse(hdr, deg_factor, n, coord);
+   else
+      return ntv2_forward(hdr, deg_factor, n, coord);
+}
 
-   fprintf(fp, "num-recs    %6d\n", hdr->num_recs);
-   fprintf(fp, "num-parents %6d\n", hdr->num_parents);
-   if ( hdr->num_parents > 0 )
-   {
-     NTV2_REC * rec = hdr->first_parent;
-     const char * t = "parents  ";
+/*------------------------------------------------------------------------
+ * Perform a transformation (forward or inverse) on separate arrays
+ * of lons and lats.
+ */
+int ntv2_transform_strided(
+   const NTV2_HDR *hdr,
+   double          deg_factor,
+   int             n,
+   const double *  lon_in,
+   const double *  lat_in,
+   int             in_stride,
+   double *        lon_out,
+   double *        lat_out,
+   int             out_stride,
+   int             direction)
+{
+   NTV2_PTS pts;
 
-     while ( rec != NTV2_NULL )
-     {
-        fprintf(fp, "%-11s %4d [ %s ]\n", t, rec->rec_num, rec->record_name);
-        rec = rec->next;
-        t = "";
-     }
+   if ( lon_in  == NTV2_NULL || lat_in  == NTV2_NULL ||
+        lon_out == NTV2_NULL || lat_out == NTV2_NULL )
+   {
+      return 0;
    }
 
-   fprintf(fp, "conversion  %s  [ %s ]\n",
-      D1(hdr->hdr_conv), hdr->gs_type);
+   memset(&pts, 0, sizeof(pts));
+   pts.lon_in     = lon_in;
+   pts.lat_in     = lat_in;
+   pts.in_stride  = (in_stride  < 1) ? 1 : (size_t)in_stride;
+   pts.lon_out    = lon_out;
+   pts.lat_out    = lat_out;
+   pts.out_stride = (out_stride < 1) ? 1 : (size_t)out_stride;
 
-   fprintf(fp, "\n");
+   if ( direction == NTV2_CVT_INVERSE )
+      return ntv2_inverse_pts(hdr, deg_factor, n, &pts);
+   else
+      return ntv2_forward_pts(hdr, deg_factor, n, &pts);
 }
 
 /*------------------------------------------------------------------------
- * Dump an internal sub-file record struct to a stream.
+ * Perform a forward transformation on a set of float points.
+ *
+ * This is the same as ntv2_forward_pts(), but the shifts are
+ * interpolated in single precision.  Each result is rounded to
+ * a float only once, after the shift is added.
  */
-static void ntv2_dump_rec(
+static int ntv2_forward_flt(
    const NTV2_HDR *hdr,
-   FILE           *fp,
+   double          deg_factor,
    int             n,
-   int             mode)
+   const NTV2_PTS *pts)
 {
-   const NTV2_REC * rec = hdr->recs+n;
-   char ntemp1[32];
+   NTV2_FETCH fetch;
+   int num = 0;
+   int i;
 
-   if ( (mode & NTV2_DUMP_HDRS_INT)     == 0 )
-      return;
+   if ( hdr == NTV2_NULL || n <= 0 )
+      return 0;
 
-   if ( (mode & NTV2_DUMP_HDRS_SUMMARY) != 0 )
-      return;
+   if ( deg_factor <= 0.0 )
+      deg_factor = 1.0;
 
-   if ( !rec->active )
-      return;
+   ntv2_fetch_init(hdr, &fetch, n);
 
-   if ( (mode & NTV2_DUMP_HDRS_EXT) == 0 )
+   for (i = 0; i < n; i++)
    {
-      fprintf(fp, "======== sub-file %d ==============\n", n);
-   }
+      const NTV2_REC * rec;
+      double lon, lat;
+      int status;
 
-   fprintf(fp, "name        %s\n",    rec->record_name);
-   fprintf(fp, "parent      %s",      rec->parent_name);
+      if ( (i % NTV2_PREFETCH_POINTS) == 0 )
+         ntv2_fetch_next(hdr, &fetch, deg_factor, n, pts, i);
 
-   if ( rec->parent != NTV2_NULL )
-      fprintf(fp, "  [ %d ]", rec->parent->rec_num);
-   fprintf(fp, "\n");
+      lon = (NTV2_PTS_LON(pts, i) * deg_factor);
+      lat = (NTV2_PTS_LAT(pts, i) * deg_factor);
 
-   fprintf(fp, "num subs    %d\n",    rec->num_subs);
+      rec = ntv2_find_rec(hdr, lon, lat, &status);
+      if ( rec != NTV2_NULL )
+      {
+         float lon_shift, lat_shift;
 
-   if ( rec->sub != NTV2_NULL )
-   {
-     const NTV2_REC * sub = rec->sub;
-     const char * t = "sub files";
+         ntv2_calculate_shifts_flt(hdr, rec, lon, lat, status,
+            &lon_shift, &lat_shift);
 
-     while ( sub != NTV2_NULL )
-     {
-        fprintf(fp, "%-11s %4d [ %s ]\n", t, sub->rec_num, sub->record_name);
-        sub = sub->next;
-        t = "";
-     }
+         NTV2_PTS_SET_FLON(pts, i) = (float)((lon + lon_shift) / deg_factor);
+         NTV2_PTS_SET_FLAT(pts, i) = (float)((lat + lat_shift) / deg_factor);
+         num++;
+      }
+      else
+      {
+         NTV2_PTS_SET_FLON(pts, i) = (float)NTV2_PTS_LON(pts, i);
+         NTV2_PTS_SET_FLAT(pts, i) = (float)NTV2_PTS_LAT(pts, i);
+      }
    }
 
-   fprintf(fp, "num recs    %d\n",    rec->num);
-   fprintf(fp, "num cols    %d\n",    rec->ncols);
-   fprintf(fp, "num rows    %d\n",    rec->nrows);
-
-   fprintf(fp, "lat min     %s\n", D1(rec->lat_min));
-   fprintf(fp, "lat max     %s\n", D1(rec->lat_max));
-   fprintf(fp, "lat inc     %s\n", D1(rec->lat_inc));
-   fprintf(fp, "lon min     %s\n", D1(rec->lon_min));
-   fprintf(fp, "lon max     %s\n", D1(rec->lon_max));
-   fprintf(fp, "lon inc     %s\n", D1(rec->lon_inc));
-
-   fprintf(fp, "\n");
+   ntv2_fetch_term(hdr, &fetch);
+   return num;
 }
 
 /*------------------------------------------------------------------------
- * Dump the data for a subfile.
+ * Perform an inverse transformation on a set of float points.
+ *
+ * This is the same as ntv2_inverse_pts(), but the shifts are
+ * interpolated in single precision.  The estimate is still refined in
+ * double precision, but only until it stops changing by more than
+ * NTV2_EPS_FLT degrees, which is well under the resolution of a float
+ * result, since the float shifts can't get it any closer than that.
  */
-static void ntv2_dump_data(
+#ifndef   NTV2_EPS_FLT
+#  define NTV2_EPS_FLT  3.72529029846191406250000e-09 /* 2^(-28) */
+#endif
+
+static int ntv2_inverse_flt(
    const NTV2_HDR *hdr,
-   FILE           *fp,
+   double          deg_factor,
    int             n,
-   int             mode)
+   const NTV2_PTS *pts)
 {
-   const NTV2_REC * rec = hdr->recs+n;
+   NTV2_FETCH fetch;
+   int max_iterations = MAX_ITERATIONS;
+   int num = 0;
+   int i;
 
-   if ( rec->shifts != NTV2_NULL )
+   if ( hdr == NTV2_NULL || n <= 0 )
+      return 0;
+
+   if ( deg_factor <= 0.0 )
+      deg_factor = 1.0;
+
+   ntv2_fetch_init(hdr, &fetch, n);
+
+   for (i = 0; i < n; i++)
    {
-      /* GCC needs these casts for some reason... */
-      const NTV2_SHIFT * shifts   = (const NTV2_SHIFT *)(rec->shifts);
-      const NTV2_SHIFT * accurs   = (const NTV2_SHIFT *)(rec->accurs);
-      NTV2_BOOL    dump_acc = FALSE;
-      int row, col;
+      double  lon,      lat;
+      double  lon_next, lat_next;
+      int num_iterations;
 
-      if ( (mode & NTV2_DUMP_DATA_ACC) == NTV2_DUMP_DATA_ACC &&
-           accurs != NTV2_NULL )
-      {
-         dump_acc = TRUE;
-      }
+      if ( (i % NTV2_PREFETCH_POINTS) == 0 )
+         ntv2_fetch_next(hdr, &fetch, deg_factor, n, pts, i);
 
-      for (row = 0; row < rec->nrows; row++)
+      lon_next = lon = (NTV2_PTS_LON(pts, i) * deg_factor);
+      lat_next = lat = (NTV2_PTS_LAT(pts, i) * deg_factor);
+
+      for (num_iterations = 0;
+           num_iterations < max_iterations;
+           num_iterations++)
       {
-         if ( dump_acc )
-         {
-            fprintf(fp, "   row     col       lat-shift       lon-shift  "
-                        "  lat-accuracy    lon-accuracy\n");
-            fprintf(fp, "------  ------  --------------  --------------  "
-                        "--------------  --------------\n");
-         }
-         else
-         {
-            fprintf(fp, "   row     col        latitude       longitude  "
-                        "     lat-shift       lon-shift\n");
-            fprintf(fp, "------  ------  --------------  --------------  "
-                        "--------------  --------------\n");
-         }
+         const NTV2_REC * rec;
+         float  lon_shift, lat_shift;
+         double lon_delta, lat_delta;
+         int status;
 
-         for (col = 0; col < rec->ncols; col++)
-         {
-            if ( dump_acc )
-            {
-               fprintf(fp, "%6d  %6d  %14.8f  %14.8f  %14.8f  %14.8f\n",
-                  row, col,
-                  (double)(*shifts)[NTV2_COORD_LAT],
-                  (double)(*shifts)[NTV2_COORD_LON],
-                  (double)(*accurs)[NTV2_COORD_LAT],
-                  (double)(*accurs)[NTV2_COORD_LON]);
-               shifts++;
-               accurs++;
-            }
-            else
-            {
-               fprintf(fp, "%6d  %6d  %14.8f  %14.8f  %14.8f  %14.8f\n",
-                  row, col,
-                  rec->lat_min + (rec->lat_inc * row),
-                  rec->lon_max - (rec->lon_inc * col),
-                  (double)(*shifts)[NTV2_COORD_LAT],
-                  (double)(*shifts)[NTV2_COORD_LON]);
-               shifts++;
-            }
-         }
+         rec = ntv2_find_rec(hdr, lon_next, lat_next, &status);
+         if ( rec == NTV2_NULL )
+            break;
 
-         fprintf(fp, "\n");
-      }
-   }
-}
+         ntv2_calculate_shifts_flt(hdr, rec, lon_next, lat_next, status,
+            &lon_shift, &lat_shift);
 
-/*------------------------------------------------------------------------
- * Dump the contents of all headers in an NTv2 file.
- */
-void ntv2_dump(
-   const NTV2_HDR *hdr,
-   FILE           *fp,
-   int             mode)
-{
-   if ( hdr != NTV2_NULL && fp != NTV2_NULL )
-   {
-      int i;
+         lon_delta = ((lon_next + lon_shift) - lon);
+         lat_delta = ((lat_next + lat_shift) - lat);
 
-      ntv2_dump_ov (hdr, fp, mode);
-      ntv2_dump_hdr(hdr, fp, mode);
+         if ( NTV2_ZERO_EPS(lon_delta, NTV2_EPS_FLT) &&
+              NTV2_ZERO_EPS(lat_delta, NTV2_EPS_FLT) )
+         {
+            break;
+         }
+
+         lon_next  = (lon_next - lon_delta);
+         lat_next  = (lat_next - lat_delta);
+      }
 
-      for (i = 0; i < hdr->num_recs; i++)
+      if ( num_iterations > 0 )
       {
-         ntv2_dump_sf (hdr, fp, i, mode);
-         ntv2_dump_rec(hdr, fp, i, mode);
-
-         if ( (mode & NTV2_DUMP_DATA) != 0 )
-            ntv2_dump_data(hdr, fp, i, mode);
+         NTV2_PTS_SET_FLON(pts, i) = (float)(lon_next / deg_factor);
+         NTV2_PTS_SET_FLAT(pts, i) = (float)(lat_next / deg_factor);
+         num++;
+      }
+      else
+      {
+         NTV2_PTS_SET_FLON(pts, i) = (float)NTV2_PTS_LON(pts, i);
+         NTV2_PTS_SET_FLAT(pts, i) = (float)NTV2_PTS_LAT(pts, i);
       }
    }
+
+   ntv2_fetch_term(hdr, &fetch);
+   return num;
 }
 
 /*------------------------------------------------------------------------
- * List the contents of all headers in an NTv2 file.
+ * Perform a transformation (forward or inverse) on separate arrays
+ * of float lons and lats.
  */
-void ntv2_list(
+int ntv2_transform_float(
    const NTV2_HDR *hdr,
-   FILE           *fp,
-   int             mode,
-   NTV2_BOOL       do_hdr_line)
+   double          deg_factor,
+   int             n,
+   const float *   lon_in,
+   const float *   lat_in,
+   int             in_stride,
+   float *         lon_out,
+   float *         lat_out,
+   int             out_stride,
+   int             direction)
 {
-   if ( hdr != NTV2_NULL && fp != NTV2_NULL )
+   NTV2_PTS pts;
+
+   if ( lon_in  == NTV2_NULL || lat_in  == NTV2_NULL ||
+        lon_out == NTV2_NULL || lat_out == NTV2_NULL )
    {
-      int i;
+      return 0;
+   }
 
-      if ( do_hdr_line )
-      {
-         if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
-         {
-            fprintf(fp, "filename\n");
-            fprintf(fp, "  num sub-file par  lon-min  lat-min "
-                        " lon-max  lat-max  d-lon  d-lat nrow ncol\n");
-            fprintf(fp, "  --- -------- --- -------- -------- "
-                        "-------- -------- ------ ------ ---- ----\n");
-         }
-         else
-         {
-            fprintf(fp,
-               "filename                             num  lon-min"
-               "  lat-min  lon-max  lat-max\n");
-            fprintf(fp,
-               "-----------------------------------  --- --------"
-               " -------- -------- --------\n");
-         }
-      }
+   memset(&pts, 0, sizeof(pts));
+   pts.flt        = TRUE;
+   pts.flon_in    = lon_in;
+   pts.flat_in    = lat_in;
+   pts.in_stride  = (in_stride  < 1) ? 1 : (size_t)in_stride;
+   pts.flon_out   = lon_out;
+   pts.flat_out   = lat_out;
+   pts.out_stride = (out_stride < 1) ? 1 : (size_t)out_stride;
 
-      if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
-         fprintf(fp, "%s\n", hdr->path);
+   if ( direction == NTV2_CVT_INVERSE )
+      return ntv2_inverse_flt(hdr, deg_factor, n, &pts);
+   else
+      return ntv2_forward_flt(hdr, deg_factor, n, &pts);
+}
 
-      for (i = 0; i < hdr->num_recs; i++)
-      {
-         const NTV2_REC * rec = &hdr->recs[i];
+/*------------------------------------------------------------------------
+ * Get the accuracies for an array of points.
+ */
+int ntv2_accuracy(
+   const NTV2_HDR  *hdr,
+   double           deg_factor,
+   int              n,
+   const NTV2_COORD coord[],
+   NTV2_COORD       accur[])
+{
+   int num = 0;
+   int i;
 
-         if ( rec->active )
-         {
-            char parent[4];
+   if ( hdr == NTV2_NULL || coord == NTV2_NULL || accur == NTV2_NULL )
+      return 0;
 
-            if ( rec->parent == NTV2_NULL )
-            {
-               strcpy(parent, " --");
-            }
-            else
-            {
-                sprintf(parent, "%3d", (rec->parent)->rec_num);
-            }
+   if ( !hdr->keep_orig )
+      return 0;
 
-            if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
-            {
-               fprintf(fp,
-               "  %3d %-8s %3s %8.3f %8.3f %8.3f %8.3f %6.3f %6.3f %4d %4d\n",
-                  i,
-                  rec->record_name,
-                  parent,
-                  rec->lon_min,
-                  rec->lat_min,
-                  rec->lon_max,
-                  rec->lat_max,
-                  rec->lon_inc,
-                  rec->lat_inc,
-                  rec->nrows,
-                  rec->ncols);
-            }
-         }
-      }
+   for (i = 0; i < n; i++)
+   {
+      const NTV2_REC * rec;
+      double lon = coord[i][NTV2_COORD_LON] * deg_factor;
+      double lat = coord[i][NTV2_COORD_LAT] * deg_factor;
+      int    status;
 
-      if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
-      {
-         if ( hdr->num_recs > 1 )
-         {
-            fprintf(fp, "  %3s %-8s %3s %8.3f %8.3f %8.3f %8.3f\n",
-               "tot",
-               "--------",
-               "   ",
-               hdr->lon_min,
-               hdr->lat_min,
-               hdr->lon_max,
-               hdr->lat_max);
-         }
-      }
-      else
+      rec = ntv2_find_rec(hdr, lon, lat, &status);
+      if ( rec == NTV2_NULL )
+         continue;
+
+      if ( ntv2_calculate_accurs(hdr, rec, lon, lat,
+                                 &accur[i][NTV2_COORD_LON],
+                                 &accur[i][NTV2_COORD_LAT]) )
       {
-         fprintf(fp, "%-36s %3d %8.3f %8.3f %8.3f %8.3f\n",
-            hdr->path,
-            hdr->num_recs,
-            hdr->lon_min,
-            hdr->lat_min,
-            hdr->lon_max,
-            hdr->lat_max);
+         num++;
       }
-
-      if ( (mode & NTV2_DUMP_HDRS_SUMMARY) == 0 )
-         fprintf(fp, "\n");
    }
+
+   return num;
 }
 
 /* ------------------------------------------------------------------------- */
-/* NTv2 forward / inverse routines                                           */
+/* NTv2 catalog routines                                                     */
 /* ------------------------------------------------------------------------- */
 
 /*------------------------------------------------------------------------
- * Find the best ntv2 record containing a given point.
+ * A file in a catalog.
  *
- * The NTv2 specification states that points on the edge of a
- * grid should be processed using the parent grid or be ignored, and
- * points outside of the top-level grid should be ignored completely.
- * However, this creates a situation where a point inside can be
- * shifted to a point outside or to the edge, and then it cannot
- * be shifted back.  Not good.
+ * The hdr is null if the file is not loaded.  A file is pinned while
+ * points are being transformed with it, and can't be unloaded then.
  *
- * Thus, we pretend that there is a one-cell zone around each grid
- * that has a shift value of zero.  This allows for a point that was
- * shifted out to be properly shifted back, and also allows for
- * a gradual change rather than an abrupt jump.  Much better!
+ * A file that couldn't be loaded is skipped until it is retried, which
+ * is done after a delay (doubled on each failure in a row), or as soon
+ * as the file is seen to have changed.
+ */
+#ifndef   NTV2_CAT_RETRY_MIN
+#  define NTV2_CAT_RETRY_MIN       1    /* First retry delay (seconds) */
+#endif
+
+#ifndef   NTV2_CAT_RETRY_MAX
+#  define NTV2_CAT_RETRY_MAX     300    /* Max retry delay (seconds)   */
+#endif
+
+typedef struct ntv2_cat_file NTV2_CAT_FILE;
+struct ntv2_cat_file
+{
+   char           path [NTV2_MAX_PATH_LEN];
+                                       /* Pathname of file            */
+   NTV2_HDR *     hdr;                 /* Loaded object or NULL       */
+   size_t         size;                /* Data size when last used    */
+   int            pins;                /* Number of users             */
+   unsigned long  last_used;           /* Clock value when last used  */
+   NTV2_BOOL      failed;              /* TRUE if it couldn't load    */
+   int            num_failed;          /* Failures in a row           */
+   time_t         retry_time;          /* When to try loading again   */
+   time_t         check_time;          /* When last checked for change*/
+   NTV2_STAMP     stamp;               /* Stamp of file when it failed*/
+};
+
+/*------------------------------------------------------------------------
+ * A top-level grid of a file in a catalog.
+ */
+typedef struct ntv2_cat_grid NTV2_CAT_GRID;
+struct ntv2_cat_grid
+{
+   double         lat_min;             /* Latitude  min (degrees)     */
+   double         lat_max;             /* Latitude  max (degrees)     */
+   double         lat_inc;             /* Latitude  inc (degrees)     */
+   double         lon_min;             /* Longitude min (degrees)     */
+   double         lon_max;             /* Longitude max (degrees)     */
+   double         lon_inc;             /* Longitude inc (degrees)     */
+   double         cell_area;           /* Size of a cell (sq degrees) */
+   int            file;                /* Index of file it is in      */
+};
+
+/*------------------------------------------------------------------------
+ * The catalog itself.
  *
- * However, this creates a problem when two grids are adjacent, either
- * at a corner or along an edge (or both).  In fact, a point on the
- * corner of a grid could be adjacent to up to three other grids!  In this
- * case, a point in the imaginary outside cell of one grid could then
- * magically appear inside another grid and vice-versa.  So we have a lot
- * of esoteric code to deal with those cases.
+ * The spatial index is a uniform grid of cells over the extent of all
+ * grids (each taken with its one-cell outside zone).  Each cell has a
+ * list of the grids overlapping it, in order of preference, stored
+ * one after another in cell_grids, with cell_start[c] the first one of
+ * cell c and cell_start[c+1] the end.  It is rebuilt on first use after
+ * a file is added.
  */
-const NTV2_REC * ntv2_find_rec(
-   const NTV2_HDR * hdr,
-   double           lon,
-   double           lat,
-   int            * pstatus)
+#define NTV2_CAT_CELLS_PER_GRID   16    /* Index cells wanted per grid */
+#define NTV2_CAT_MAX_CELLS     65536    /* Max index cells             */
+
+struct ntv2_catalog
 {
-   const NTV2_REC * ps;
-   const NTV2_REC * psc      = NTV2_NULL;
-   NTV2_BOOL  next_gen = TRUE;
-   int n_stat_5_pinged = 0;
-   int status_ps       = (NTV2_STATUS_OUTSIDE_CELL + 1);
-   int status_psc      = (NTV2_STATUS_OUTSIDE_CELL + 1);
-   int status_tmp;
-   int npings;
+   NTV2_CAT_FILE *files;               /* Array of files              */
+   int            num_files;           /* Number of files             */
+   int            max_files;           /* Size of files array         */
+
+   NTV2_CAT_GRID *grids;               /* Array of top-level grids    */
+   int            num_grids;           /* Number of grids             */
+   int            max_grids;           /* Size of grids array         */
+
+   NTV2_BOOL      index_ok;            /* TRUE if index is up to date */
+   double         lat_min;             /* Latitude  min of index      */
+   double         lon_min;             /* Longitude min of index      */
+   double         lat_cell;            /* Latitude  size of a cell    */
+   double         lon_cell;            /* Longitude size of a cell    */
+   int            nrows;               /* Number of rows of cells     */
+   int            ncols;               /* Number of cols of cells     */
+   int *          cell_start;          /* Start of each cell's list   */
+   int *          cell_grids;          /* Grid lists of all cells     */
+
+   int            read_data;           /* How files are loaded        */
+   size_t         mem_budget;          /* Max data size (0 = none)    */
+   size_t         mem_used;            /* Data size of loaded files   */
+   unsigned long  clock;               /* Use counter for LRU         */
+
+   void *         mutex;               /* Ptr to OS-specific mutex    */
+};
 
-   if ( pstatus == NTV2_NULL )
-      pstatus = &status_tmp;
+/*------------------------------------------------------------------------
+ * Create an empty NTv2 catalog.
+ */
+NTV2_CATALOG * ntv2_catalog_create(
+   size_t        mem_budget,
+   int           read_data,
+   int *         prc)
+{
+   NTV2_CATALOG * cat;
+   int            rc;
 
-   if ( hdr == NTV2_NULL )
+   if ( prc == NTV2_NULL )
+      prc = &rc;
+
+   cat = (NTV2_CATALOG *)ntv2_memalloc(sizeof(*cat));
+   if ( cat == NTV2_NULL )
    {
-      *pstatus = NTV2_STATUS_NOTFOUND;
+      *prc = NTV2_ERR_NO_MEMORY;
       return NTV2_NULL;
    }
 
-   /* First, find the top-level parent that contains this point.
-      There can only be one, since top-level parents cannot overlap.
-      But we have to deal with edge conditions.
-   */
+   memset(cat, 0, sizeof(*cat));
+   cat->read_data  = read_data;
+   cat->mem_budget = mem_budget;
+   cat->mutex      = ntv2_mutex_create();
 
-   for (ps = hdr->first_parent; ps != NTV2_NULL; ps = ps->next)
-   {
-      if ( NTV2_LE(lat, ps->lat_max) &&
-           NTV2_GT(lat, ps->lat_min) &&
-           NTV2_LE(lon, ps->lon_max) &&
-           NTV2_GT(lon, ps->lon_min) )
-      {
-         /* Total containment */
-         psc  = ps;
-         status_ps = NTV2_STATUS_CONTAINED;
-         break;
-      }
+   *prc = NTV2_ERR_OK;
+   return cat;
+}
 
-      if ( NTV2_LE(lon, ps->lon_max) &&
-           NTV2_GT(lon, ps->lon_min) &&
-           NTV2_EQ(lat, ps->lat_max) &&
-           status_ps > NTV2_STATUS_NORTH )
-      {
-         /* Border condition - on North limit */
-         psc = ps;
-         status_ps = NTV2_STATUS_NORTH;
-      }
+/*------------------------------------------------------------------------
+ * Delete an NTv2 catalog.
+ */
+void ntv2_catalog_delete(
+   NTV2_CATALOG *cat)
+{
+   if ( cat != NTV2_NULL )
+   {
+      int i;
 
-      else
-      if ( NTV2_LE(lon, ps->lon_max) &&
-           NTV2_GT(lon, ps->lon_min) &&
-           NTV2_EQ(lat, ps->lat_max) &&
-           status_ps > NTV2_STATUS_WEST )
+      for (i = 0; i < cat->num_files; i++)
       {
-         /* Border condition - on West limit */
-         psc = ps;
-         status_ps = NTV2_STATUS_WEST;
+         ntv2_delete(cat->files[i].hdr);
       }
 
-      else
-      if ( NTV2_EQ(lon, ps->lon_min) &&
-           NTV2_EQ(lat, ps->lat_max) &&
-           status_ps > NTV2_STATUS_NORTH_WEST )
+      if ( cat->mutex != NTV2_NULL )
       {
-         /* Border condition - on North & West limit */
-         psc = ps;
-         status_ps = NTV2_STATUS_NORTH_WEST;
+         ntv2_mutex_delete(cat->mutex);
       }
 
-      else
-      if ( NTV2_GT(lon, (ps->lon_min - ps->lon_inc)) &&
-           NTV2_LT(lon, (ps->lon_max + ps->lon_inc)) &&
-           NTV2_GT(lat, (ps->lat_min - ps->lat_inc)) &&
-           NTV2_LT(lat, (ps->lat_max + ps->lat_inc)) &&
-           status_ps > NTV2_STATUS_OUTSIDE_CELL )
-      {
-         /* Is it just within one cell outside of the border? */
-         status_ps = NTV2_STATUS_OUTSIDE_CELL;
-
-         /* Do a parent counter, and figure out if it is a
-            one point corner or two point edge situation.
-            Always take the two-pointer over a one-pointer.
-            Always take the last two-pointer as the parent.
-         */
+      ntv2_memdealloc(cat->cell_start);
+      ntv2_memdealloc(cat->cell_grids);
+      ntv2_memdealloc(cat->grids);
+      ntv2_memdealloc(cat->files);
+      ntv2_memdealloc(cat);
+   }
+}
 
-         npings = 1;
-         if ( NTV2_GE(lon, ps->lon_min) && NTV2_LE(lon, ps->lon_max) ) npings++;
-         if ( NTV2_GE(lat, ps->lat_min) && NTV2_LE(lat, ps->lat_max) ) npings++;
+/*------------------------------------------------------------------------
+ * Make sure there is room for one more entry in an array.
+ */
+static int ntv2_catalog_grow(
+   void ** parray,
+   int *   pmax,
+   int     num,
+   size_t  size)
+{
+   if ( num >= *pmax )
+   {
+      int    max   = (*pmax == 0) ? 8 : (*pmax * 2);
+      void * array = ntv2_memalloc(size * max);
 
-         if ( npings >= n_stat_5_pinged )
-         {
-            psc = ps;
-            n_stat_5_pinged = npings;
-         }
+      if ( array == NTV2_NULL )
+         return NTV2_ERR_NO_MEMORY;
+
+      if ( *parray != NTV2_NULL )
+      {
+         memcpy(array, *parray, size * num);
+         ntv2_memdealloc(*parray);
       }
+
+      *parray = array;
+      *pmax   = max;
    }
 
-   /* If no parent was found, we're done. */
+   return NTV2_ERR_OK;
+}
 
-   if ( psc == NTV2_NULL )
-   {
-      *pstatus = NTV2_STATUS_NOTFOUND;
-      return NTV2_NULL;
-   }
+/*------------------------------------------------------------------------
+ * Add an NTv2 file to a catalog.
+ */
+int ntv2_catalog_add(
+   NTV2_CATALOG *cat,
+   const char *  ntv2file)
+{
+   const NTV2_REC * rec;
+   NTV2_CAT_FILE *  file;
+   NTV2_HDR *       hdr;
+   int rc;
 
-   /* If this parent has no children or the point lies outside the
-      parent border, we're done. */
+   if ( cat == NTV2_NULL )
+      return NTV2_ERR_NULL_HDR;
 
-   if ( psc->sub == NTV2_NULL || status_ps == NTV2_STATUS_OUTSIDE_CELL )
+   if ( ntv2file == NTV2_NULL || *ntv2file == 0 )
+      return NTV2_ERR_NULL_PATH;
+
+   if ( strlen(ntv2file) >= NTV2_MAX_PATH_LEN )
+      return NTV2_ERR_CANNOT_OPEN_FILE;
+
+   hdr = ntv2_load_indexed(ntv2file, NTV2_NULL, FALSE, NTV2_DATA_HDRS_ONLY,
+                           NTV2_NULL, &rc);
+   if ( hdr == NTV2_NULL || rc != NTV2_ERR_OK )
    {
-      *pstatus = status_ps;
-      return psc;
+      ntv2_delete(hdr);
+      return rc;
    }
 
-   /* Now run recursively through the child grids to find the
-      best one.  Again, there can only be one best record, since
-      children cannot overlap but can only nest.
-      But here also we have to deal with edge conditions.
-   */
-
-   ps  = psc;
-   psc = NTV2_NULL;
-   while ( ps->sub != NTV2_NULL && next_gen )
+   ntv2_mutex_enter(cat->mutex);
    {
-      next_gen = FALSE;
+      rc = ntv2_catalog_grow((void **)&cat->files, &cat->max_files,
+                             cat->num_files, sizeof(*cat->files));
 
-      for (psc = ps->sub; psc != NTV2_NULL; psc = psc->next)
+      if ( rc == NTV2_ERR_OK )
       {
-         if ( NTV2_LE(lon, psc->lon_max) &&
-              NTV2_GT(lon, psc->lon_min) &&
-              NTV2_GE(lat, psc->lat_min) &&
-              NTV2_LT(lat, psc->lat_max) &&
-              status_psc >= NTV2_STATUS_CONTAINED )
-         {
-            /* Total containment */
-            next_gen = TRUE;
-            ps = psc;
-            status_psc = NTV2_STATUS_CONTAINED;
-            status_ps  = NTV2_STATUS_CONTAINED;
-            break;
-         }
+         file = cat->files + cat->num_files;
+         memset(file, 0, sizeof(*file));
+         strcpy(file->path, ntv2file);
 
-         else
-         if ( NTV2_LE(lon, psc->lon_max) &&
-              NTV2_GT(lon, psc->lon_min) &&
-              NTV2_EQ(lat, psc->lat_max) &&
-              status_psc >= NTV2_STATUS_NORTH )
+         for (rec = hdr->first_parent; rec != NTV2_NULL; rec = rec->next)
          {
-            /* Border condition - on North limit */
-            next_gen = TRUE;
-            ps = psc;
-            status_psc = NTV2_STATUS_NORTH;
-            status_ps  = NTV2_STATUS_NORTH;
+            NTV2_CAT_GRID * grid;
+
+            rc = ntv2_catalog_grow((void **)&cat->grids, &cat->max_grids,
+                                   cat->num_grids, sizeof(*cat->grids));
+            if ( rc != NTV2_ERR_OK )
+               break;
+
+            grid = cat->grids + cat->num_grids++;
+            grid->lat_min   = rec->lat_min;
+            grid->lat_max   = rec->lat_max;
+            grid->lat_inc   = rec->lat_inc;
+            grid->lon_min   = rec->lon_min;
+            grid->lon_max   = rec->lon_max;
+            grid->lon_inc   = rec->lon_inc;
+            grid->cell_area = rec->lat_inc * rec->lon_inc;
+            grid->file      = cat->num_files;
          }
 
-         else
-         if ( NTV2_EQ(lon, psc->lon_min) &&
-              NTV2_GE(lat, psc->lat_min) &&
-              NTV2_LT(lat, psc->lat_max) &&
-              status_psc >= NTV2_STATUS_WEST )
+         /* Back out any grids added if we ran out of memory. */
+         if ( rc != NTV2_ERR_OK )
          {
-            /* Border condition - on West limit */
-            next_gen = TRUE;
-            ps = psc;
-            status_psc = NTV2_STATUS_WEST;
-            status_ps  = NTV2_STATUS_WEST;
+            while ( cat->num_grids > 0 &&
+                    cat->grids[cat->num_grids - 1].file == cat->num_files )
+            {
+               cat->num_grids--;
+            }
          }
-
          else
-         if ( NTV2_EQ(lon, psc->lon_min) &&
-              NTV2_EQ(lat, psc->lat_max) &&
-              status_psc >= NTV2_STATUS_NORTH_WEST )
          {
-            /* Border condition - on North & West limit */
-            next_gen = TRUE;
-            ps = psc;
-            status_psc = NTV2_STATUS_NORTH_WEST;
-            status_ps  = NTV2_STATUS_NORTH_WEST;
+            cat->num_files++;
+            cat->index_ok = FALSE;
          }
       }
    }
+   ntv2_mutex_leave(cat->mutex);
 
-   *pstatus = status_ps;
-   return ps;
+   ntv2_delete(hdr);
+   return rc;
 }
 
 /*------------------------------------------------------------------------
- * Get a lat/lon shift value (either from a file or memory).
- *
- * Note that these routines are called only if a sub-file record
- * was found that contains the point.  Thus we know that the row
- * and column values are valid.  However, it is possible to have
- * not read the data (only the headers) and then closed the file,
- * so we have to check for that.
+ * Get the size of the data of all files loaded by a catalog.
  */
-static double ntv2_get_shift_from_file(
-   const NTV2_HDR * hdr,
-   const NTV2_REC * rec,
-   int              icol,
-   int              irow,
-   int              coord_type)
+size_t ntv2_catalog_data_size(
+   NTV2_CATALOG *cat)
 {
-   float shift = 0.0;
-   int   offs  = rec->offset +
-                 (rec->ncols * irow + icol) * sizeof(NTV2_FILE_GS) +
-                 ((coord_type == NTV2_COORD_LAT) ?
-                    NTV2_OFFSET_OF(NTV2_FILE_GS, f_lat_shift) :
-                    NTV2_OFFSET_OF(NTV2_FILE_GS, f_lon_shift) );
-   size_t nr = 0;
+   size_t size;
 
-   if ( hdr->fp != NTV2_NULL )
-   {
-      ntv2_mutex_enter(hdr->mutex);
-      {
-         fseek(hdr->fp, offs, SEEK_SET);
-         nr = fread(&shift, NTV2_SIZE_FLT, 1, hdr->fp);
-      }
-      ntv2_mutex_leave(hdr->mutex);
-   }
+   if ( cat == NTV2_NULL )
+      return 0;
 
-   if ( nr != 1 )
-   {
-      shift = 0.0;
-   }
-   else
+   ntv2_mutex_enter(cat->mutex);
    {
-      NTV2_SWAPF(&shift, 1);
+      size = cat->mem_used;
    }
+   ntv2_mutex_leave(cat->mutex);
 
-   return shift;
+   return size;
 }
 
-static double ntv2_get_shift_from_data(
-   const NTV2_HDR * hdr,
-   const NTV2_REC * rec,
-   int              icol,
-   int              irow,
-   int              coord_type)
+/*------------------------------------------------------------------------
+ * Compare two grids by order of preference: smallest cells first,
+ * then in the order their files were added.
+ */
+static int ntv2_catalog_cmp(
+   const void *a,
+   const void *b)
 {
-   double shift;
-   int   offs = (irow * rec->ncols) + icol;
-
-   NTV2_UNUSED_PARAMETER(hdr);
-
-   shift = rec->shifts[offs][coord_type];
-
-   return shift;
+   const NTV2_CAT_GRID * ga = (const NTV2_CAT_GRID *)a;
+   const NTV2_CAT_GRID * gb = (const NTV2_CAT_GRID *)b;
+
+   if ( ga->cell_area < gb->cell_area )  return -1;
+   if ( ga->cell_area > gb->cell_area )  return  1;
+   if ( ga->file      < gb->file      )  return -1;
+   if ( ga->file      > gb->file      )  return  1;
+   if ( ga->lat_min   < gb->lat_min   )  return -1;
+   if ( ga->lat_min   > gb->lat_min   )  return  1;
+   if ( ga->lon_min   < gb->lon_min   )  return -1;
+   if ( ga->lon_min   > gb->lon_min   )  return  1;
+
+   return 0;
 }
 
-static double ntv2_get_shift(
-   const NTV2_HDR * hdr,
-   const NTV2_REC * rec,
-   int              icol,
-   int              irow,
-   int              coord_type)
+/*------------------------------------------------------------------------
+ * Get the range of index cells that a grid (with its outside zone)
+ * overlaps.
+ */
+static void ntv2_catalog_cells(
+   const NTV2_CATALOG  *cat,
+   const NTV2_CAT_GRID *grid,
+   int *                prow0,
+   int *                pcol0,
+   int *                prow1,
+   int *                pcol1)
 {
-   if ( rec->shifts == NTV2_NULL )
-      return ntv2_get_shift_from_file(hdr, rec, irow, icol, coord_type);
-   else
-      return ntv2_get_shift_from_data(hdr, rec, irow, icol, coord_type);
+   *prow0 = (int)((grid->lat_min - grid->lat_inc - cat->lat_min) / cat->lat_cell);
+   *prow1 = (int)((grid->lat_max + grid->lat_inc - cat->lat_min) / cat->lat_cell);
+   *pcol0 = (int)((grid->lon_min - grid->lon_inc - cat->lon_min) / cat->lon_cell);
+   *pcol1 = (int)((grid->lon_max + grid->lon_inc - cat->lon_min) / cat->lon_cell);
+
+   if ( *prow0 < 0 )               *prow0 = 0;
+   if ( *pcol0 < 0 )               *pcol0 = 0;
+   if ( *prow1 > cat->nrows - 1 )  *prow1 = cat->nrows - 1;
+   if ( *pcol1 > cat->ncols - 1 )  *pcol1 = cat->ncols - 1;
 }
 
 /*------------------------------------------------------------------------
- * Calculate one shift (lat or lon).
+ * Build the spatial index of a catalog.
  *
- * In this routine we deal with our idea of a phantom row/col of
- * zero-shift values along each edge of the top-level-grid.
+ * The grids are sorted by order of preference first, so each cell's
+ * list is in that order just by adding them in turn.
+ * This must be called with the catalog mutex held.
  */
-static double ntv2_calculate_one_shift(
-   const NTV2_HDR * hdr,
-   const NTV2_REC * rec,
-   int              status,
-   int              icol,
-   int              irow,
-   int              move_shifts_horz,
-   int              move_shifts_vert,
-   double           x_cellfrac,
-   double           y_cellfrac,
-   int              coord_type)
+static int ntv2_catalog_index(
+   NTV2_CATALOG *cat)
 {
-   double ll_shift = 0, lr_shift = 0, ul_shift = 0, ur_shift = 0;
-   double b, c, d;
-   double shift;
+   double lat_max = -90.0;
+   double lon_max = -360.0;
+   double area;
+   int *  fill;
+   int    num_cells;
+   int    total;
+   int    i, c;
+
+   ntv2_memdealloc(cat->cell_start);
+   ntv2_memdealloc(cat->cell_grids);
+   cat->cell_start = NTV2_NULL;
+   cat->cell_grids = NTV2_NULL;
+   cat->nrows      = 0;
+   cat->ncols      = 0;
+
+   if ( cat->num_grids == 0 )
+   {
+      cat->index_ok = TRUE;
+      return NTV2_ERR_OK;
+   }
 
-#define GET_SHIFT(i,j)   ntv2_get_shift(hdr, rec, i, j, coord_type)
+   qsort(cat->grids, cat->num_grids, sizeof(*cat->grids), ntv2_catalog_cmp);
 
-   /* get the shift values for the "corners" of the cell
-      containing the point */
+   /* -------- get the extent of all grids & the size of a cell */
 
-   switch ( status )
+   cat->lat_min =  90.0;
+   cat->lon_min = 360.0;
+
+   for (i = 0; i < cat->num_grids; i++)
    {
-      case NTV2_STATUS_CONTAINED:
-         lr_shift = GET_SHIFT(irow,   icol  );
-         ll_shift = GET_SHIFT(irow,   icol+1);
-         ur_shift = GET_SHIFT(irow+1, icol  );
-         ul_shift = GET_SHIFT(irow+1, icol+1);
-         break;
+      const NTV2_CAT_GRID * grid = cat->grids + i;
 
-      case NTV2_STATUS_NORTH:
-         lr_shift = GET_SHIFT(irow,   icol  );
-         ll_shift = GET_SHIFT(irow,   icol+1);
-         ur_shift = lr_shift;
-         ul_shift = ll_shift;
-         break;
+      if ( cat->lat_min > grid->lat_min - grid->lat_inc )
+           cat->lat_min = grid->lat_min - grid->lat_inc;
+      if ( cat->lon_min > grid->lon_min - grid->lon_inc )
+           cat->lon_min = grid->lon_min - grid->lon_inc;
+      if ( lat_max      < grid->lat_max + grid->lat_inc )
+           lat_max      = grid->lat_max + grid->lat_inc;
+      if ( lon_max      < grid->lon_max + grid->lon_inc )
+           lon_max      = grid->lon_max + grid->lon_inc;
+   }
 
-      case NTV2_STATUS_WEST:
-         lr_shift = GET_SHIFT(irow,   icol  );
-         ll_shift = lr_shift;
-         ur_shift = GET_SHIFT(irow+1, icol  );
-         ul_shift = ur_shift;
-         break;
+   num_cells = cat->num_grids * NTV2_CAT_CELLS_PER_GRID;
+   if ( num_cells > NTV2_CAT_MAX_CELLS )
+      num_cells = NTV2_CAT_MAX_CELLS;
 
-      case NTV2_STATUS_NORTH_WEST:
-         lr_shift = GET_SHIFT(irow,   icol  );
-         ll_shift = lr_shift;
-         ur_shift = lr_shift;
-         ul_shift = lr_shift;
-         break;
+   area = (lat_max - cat->lat_min) * (lon_max - cat->lon_min);
+   cat->lat_cell = cat->lon_cell = sqrt(area / num_cells);
 
-      case NTV2_STATUS_OUTSIDE_CELL:
-         lr_shift = GET_SHIFT(irow,   icol  );
-         ll_shift = GET_SHIFT(irow,   icol+1);
-         ur_shift = GET_SHIFT(irow+1, icol  );
-         ul_shift = GET_SHIFT(irow+1, icol+1);
+   cat->nrows = (int)((lat_max - cat->lat_min) / cat->lat_cell) + 1;
+   cat->ncols = (int)((lon_max - cat->lon_min) / cat->lon_cell) + 1;
+   num_cells  = cat->nrows * cat->ncols;
 
-         if ( move_shifts_horz == -1 )
-         {
-            lr_shift = ll_shift;
-            ur_shift = ul_shift;
-            ll_shift = 0.0;
-            ul_shift = 0.0;
-         }
-         if ( move_shifts_horz == +1 )
-         {
-            ll_shift = lr_shift;
-            ul_shift = ur_shift;
-            ur_shift = 0.0;
-            lr_shift = 0.0;
-         }
-         if ( move_shifts_vert == -1 )
-         {
-            ul_shift = ll_shift;
-            ur_shift = lr_shift;
-            ll_shift = 0.0;
-            lr_shift = 0.0;
-         }
-         if ( move_shifts_vert == +1 )
-         {
-            ll_shift = ul_shift;
-            lr_shift = ur_shift;
-            ul_shift = 0.0;
-            ur_shift = 0.0;
-         }
-         break;
+   /* -------- count the grids in each cell */
+
+   cat->cell_start = (int *)ntv2_memalloc(sizeof(int) * (num_cells + 1));
+   if ( cat->cell_start == NTV2_NULL )
+      return NTV2_ERR_NO_MEMORY;
+   memset(cat->cell_start, 0, sizeof(int) * (num_cells + 1));
+
+   for (i = 0; i < cat->num_grids; i++)
+   {
+      int row0, col0, row1, col1, r;
+
+      ntv2_catalog_cells(cat, cat->grids + i, &row0, &col0, &row1, &col1);
+      for (r = row0; r <= row1; r++)
+      {
+         for (c = col0; c <= col1; c++)
+            cat->cell_start[(r * cat->ncols) + c + 1]++;
+      }
+   }
+
+   for (c = 0; c < num_cells; c++)
+      cat->cell_start[c + 1] += cat->cell_start[c];
+   total = cat->cell_start[num_cells];
+
+   /* -------- fill in the lists */
+
+   cat->cell_grids = (int *)ntv2_memalloc(sizeof(int) * (total + 1));
+   fill            = (int *)ntv2_memalloc(sizeof(int) * num_cells);
+   if ( cat->cell_grids == NTV2_NULL || fill == NTV2_NULL )
+   {
+      ntv2_memdealloc(fill);
+      return NTV2_ERR_NO_MEMORY;
+   }
+
+   memcpy(fill, cat->cell_start, sizeof(int) * num_cells);
+
+   for (i = 0; i < cat->num_grids; i++)
+   {
+      int row0, col0, row1, col1, r;
+
+      ntv2_catalog_cells(cat, cat->grids + i, &row0, &col0, &row1, &col1);
+      for (r = row0; r <= row1; r++)
+      {
+         for (c = col0; c <= col1; c++)
+            cat->cell_grids[fill[(r * cat->ncols) + c]++] = i;
+      }
+   }
+
+   ntv2_memdealloc(fill);
+
+   cat->index_ok = TRUE;
+   return NTV2_ERR_OK;
+}
+
+/*------------------------------------------------------------------------
+ * See if a file that couldn't be loaded should be tried again.
+ *
+ * This is so if its retry delay is up, or if it has changed since it
+ * failed.  The file is only looked at once a second, at most.
+ * This must be called with the catalog mutex held.
+ */
+static NTV2_BOOL ntv2_catalog_retry(
+   NTV2_CAT_FILE *file)
+{
+   time_t     now = time(NTV2_NULL);
+   NTV2_STAMP stamp;
+   NTV2_BOOL  changed;
 
-      default:
-         return 0.0;
-   }
+   if ( now == file->check_time )
+      return FALSE;
+   file->check_time = now;
 
-#undef GET_SHIFT
+   if ( !ntv2_file_stamp(file->path, &stamp) )
+      memset(&stamp, 0, sizeof(stamp));
 
-   /* do the bilinear interpolation of the corner shift values */
+   changed = ( stamp.dev  != file->stamp.dev  ||
+               stamp.ino  != file->stamp.ino  ||
+               stamp.size != file->stamp.size ||
+               stamp.time != file->stamp.time ||
+               stamp.nsec != file->stamp.nsec );
 
-   b = (ll_shift - lr_shift);
-   c = (ur_shift - lr_shift);
-   d = (ul_shift - ll_shift) - (ur_shift - lr_shift);
+   if ( now < file->retry_time && !changed )
+      return FALSE;
 
-   shift = lr_shift + (b * x_cellfrac)
-                    + (c * y_cellfrac)
-                    + (d * x_cellfrac * y_cellfrac);
+   file->failed = FALSE;
+   return TRUE;
+}
 
-   /* The shift at this point is in decimal seconds, so convert to degrees. */
-   return (shift * hdr->dat_conv) / 3600.0;
+/*------------------------------------------------------------------------
+ * Note that a file of a catalog couldn't be loaded.
+ */
+static void ntv2_catalog_failed(
+   NTV2_CAT_FILE *file)
+{
+   long delay = NTV2_CAT_RETRY_MIN;
+   int  i;
+
+   for (i = 1; i < file->num_failed && delay < NTV2_CAT_RETRY_MAX; i++)
+      delay *= 2;
+   if ( delay > NTV2_CAT_RETRY_MAX )
+      delay = NTV2_CAT_RETRY_MAX;
+
+   if ( !ntv2_file_stamp(file->path, &file->stamp) )
+      memset(&file->stamp, 0, sizeof(file->stamp));
+
+   file->failed     = TRUE;
+   file->num_failed++;
+   file->check_time = time(NTV2_NULL);
+   file->retry_time = file->check_time + delay;
 }
 
 /*------------------------------------------------------------------------
- * Calculate the lon & lat shifts for a given lon/lat.
+ * Find the file to use for a point.
  *
- * In this routine we deal with our idea of a phantom row/col of
- * zero-shift values along each edge of the top-level-grid.
+ * The first grid (in order of preference) that contains the point is
+ * used, or if none do, the first that it is just outside of.
+ * Returns -1 if the point is not near any grid.
+ * This must be called with the catalog mutex held.
  */
-static void ntv2_calculate_shifts(
-   const NTV2_HDR * hdr,
-   const NTV2_REC * rec,
-   double           lon,
-   double           lat,
-   int              status,
-   double *         plon_shift,
-   double *         plat_shift)
+static int ntv2_catalog_route(
+   NTV2_CATALOG *cat,
+   double        lon,
+   double        lat)
 {
-   double xgrid_index, ygrid_index, x_cellfrac, y_cellfrac;
-   int    horz = 0, vert = 0;
-   int    icol, irow;
+   const int * list;
+   int  row, col, cell, n;
+   int  outside = -1;
+   int  j;
 
-   /* lat goes S to N, lon goes E to W */
-   xgrid_index = (rec->lon_max - lon) / rec->lon_inc;
-   ygrid_index = (lat - rec->lat_min) / rec->lat_inc;
+   if ( cat->nrows == 0 )
+      return -1;
 
-   icol = (int)xgrid_index;
-   irow = (int)ygrid_index;
+   row = (int)floor((lat - cat->lat_min) / cat->lat_cell);
+   col = (int)floor((lon - cat->lon_min) / cat->lon_cell);
+   if ( row < 0 || row >= cat->nrows || col < 0 || col >= cat->ncols )
+      return -1;
 
-   /* If the status is NTV2_STATUS_OUTSIDE_CELL, it is within one cell of the
-      edge of a parent grid.  Have to do something different.
-   */
-   if ( status == NTV2_STATUS_OUTSIDE_CELL )
+   cell = (row * cat->ncols) + col;
+   list = cat->cell_grids + cat->cell_start[cell];
+   n    = cat->cell_start[cell + 1] - cat->cell_start[cell];
+
+   for (j = 0; j < n; j++)
    {
-      icol = (xgrid_index < 0.0) ? -1 : (int)xgrid_index;
-      irow = (ygrid_index < 0.0) ? -1 : (int)ygrid_index;
-   }
+      const NTV2_CAT_GRID * grid = cat->grids + list[j];
+      NTV2_BOOL inside;
 
-   x_cellfrac = xgrid_index - icol;
-   y_cellfrac = ygrid_index - irow;
+      inside = ( NTV2_GE(lat, grid->lat_min) && NTV2_LE(lat, grid->lat_max) &&
+                 NTV2_GE(lon, grid->lon_min) && NTV2_LE(lon, grid->lon_max) );
 
-   if ( status == NTV2_STATUS_OUTSIDE_CELL )
-   {
-      horz = (icol < 0) ? +1
-                        : (icol > rec->ncols-2) ? -1 : 0;
-      vert = (irow < 0) ? -1
-                        : (irow > rec->nrows-2) ? +1 : 0;
+      if ( !inside &&
+           (outside >= 0                                    ||
+            !NTV2_GT(lat, (grid->lat_min - grid->lat_inc))  ||
+            !NTV2_LT(lat, (grid->lat_max + grid->lat_inc))  ||
+            !NTV2_GT(lon, (grid->lon_min - grid->lon_inc))  ||
+            !NTV2_LT(lon, (grid->lon_max + grid->lon_inc))) )
+      {
+         continue;
+      }
 
-      icol = (icol < 0) ? 0
-                        : (icol > rec->ncols-2) ? rec->ncols-2 : icol;
-      irow = (irow < 0) ? 0
-                        : (irow > rec->nrows-2) ? rec->nrows-2 : irow;
-   }
+      if ( cat->files[grid->file].failed &&
+           !ntv2_catalog_retry(cat->files + grid->file) )
+      {
+         continue;
+      }
 
-   /* The longitude shifts are built for (+west/-east) longitude values,
-      so we flip the sign of the calculated longitude shift to make
-      it standard (-west/+east).
-   */
+      if ( inside )
+         return grid->file;
 
-   *plon_shift = -ntv2_calculate_one_shift(hdr, rec, status,
-      icol, irow, horz, vert, x_cellfrac, y_cellfrac, NTV2_COORD_LON);
+      outside = grid->file;
+   }
 
-   *plat_shift =  ntv2_calculate_one_shift(hdr, rec, status,
-      icol, irow, horz, vert, x_cellfrac, y_cellfrac, NTV2_COORD_LAT);
+   return outside;
 }
 
 /*------------------------------------------------------------------------
- * Perform a forward transformation on an array of points.
+ * Unload least-recently-used files until the data size is in budget.
  *
- * Note that the return value is the number of points successfully
- * transformed, and points that can't be transformed (usually because
- * they are outside of the grid) are left unchanged.  However, there
- * is no indication of which points were changed and which were not.
+ * This must be called with the catalog mutex held.
  */
-int ntv2_forward(
-   const NTV2_HDR *hdr,
-   double          deg_factor,
-   int             n,
-   NTV2_COORD      coord[])
+static void ntv2_catalog_evict(
+   NTV2_CATALOG *cat)
 {
-   int num = 0;
-   int i;
+   while ( cat->mem_budget > 0 && cat->mem_used > cat->mem_budget )
+   {
+      NTV2_CAT_FILE * lru = NTV2_NULL;
+      int i;
 
-   if ( hdr == NTV2_NULL || coord == NTV2_NULL || n <= 0 )
-      return 0;
+      for (i = 0; i < cat->num_files; i++)
+      {
+         NTV2_CAT_FILE * file = cat->files + i;
 
-   if ( deg_factor <= 0.0 )
-      deg_factor = 1.0;
+         if ( file->hdr != NTV2_NULL && file->pins == 0 &&
+              (lru == NTV2_NULL || file->last_used < lru->last_used) )
+         {
+            lru = file;
+         }
+      }
 
-   for (i = 0; i < n; i++)
-   {
-      const NTV2_REC * rec;
-      double lon, lat;
-      int status;
+      if ( lru == NTV2_NULL )
+         break;
 
-      lon = (coord[i][NTV2_COORD_LON] * deg_factor);
-      lat = (coord[i][NTV2_COORD_LAT] * deg_factor);
+      cat->mem_used -= lru->size;
+      ntv2_delete(lru->hdr);
+      lru->hdr  = NTV2_NULL;
+      lru->size = 0;
+   }
+}
 
-      rec = ntv2_find_rec(hdr, lon, lat, &status);
-      if ( rec != NTV2_NULL )
+/*------------------------------------------------------------------------
+ * Get a file of a catalog ready for use, loading it if needed.
+ *
+ * This must be called with the catalog mutex held.
+ * The file is pinned until ntv2_catalog_release() is called.
+ */
+static NTV2_HDR * ntv2_catalog_acquire(
+   NTV2_CATALOG *cat,
+   int           n)
+{
+   NTV2_CAT_FILE * file = cat->files + n;
+
+   if ( file->hdr == NTV2_NULL && !file->failed )
+   {
+      int read_data = cat->read_data;
+      int rc;
+
+      /* Shifts can't be read on-the-fly from a text file. */
+      if ( (read_data & ~NTV2_ALLOC_FLAGS) == NTV2_DATA_HDRS_ONLY &&
+           ntv2_filetype(file->path) == NTV2_FILE_TYPE_ASC )
       {
-         double lon_shift, lat_shift;
+         read_data |= NTV2_DATA_IN_MEMORY;
+      }
 
-         ntv2_calculate_shifts(hdr, rec, lon, lat, status,
-            &lon_shift, &lat_shift);
+      file->hdr = ntv2_load_indexed(file->path, NTV2_NULL, FALSE,
+                                    read_data, NTV2_NULL, &rc);
+      if ( file->hdr != NTV2_NULL && rc != NTV2_ERR_OK )
+      {
+         ntv2_delete(file->hdr);
+         file->hdr = NTV2_NULL;
+      }
 
-         coord[i][NTV2_COORD_LON] = ((lon + lon_shift) / deg_factor);
-         coord[i][NTV2_COORD_LAT] = ((lat + lat_shift) / deg_factor);
-         num++;
+      if ( file->hdr == NTV2_NULL )
+      {
+         ntv2_catalog_failed(file);
+         return NTV2_NULL;
       }
+
+      file->num_failed = 0;
+      file->size       = ntv2_data_size(file->hdr);
+      cat->mem_used   += file->size;
    }
 
-   return num;
+   if ( file->hdr != NTV2_NULL )
+   {
+      file->pins++;
+      file->last_used = ++cat->clock;
+      ntv2_catalog_evict(cat);
+   }
+
+   return file->hdr;
 }
 
 /*------------------------------------------------------------------------
- * Perform a inverse transformation on an array of points.
+ * Release a file of a catalog after use.
  *
- * Note that the return value is the number of points successfully
- * transformed, and points that can't be transformed (usually because
- * they are outside of the grid) are left unchanged.  However, there
- * is no indication of which points were changed and which were not.
+ * This must be called with the catalog mutex held.
+ * Data read on demand while the file was in use is counted now.
  */
-#ifndef   MAX_ITERATIONS
-#  define MAX_ITERATIONS  50
-#endif
+static void ntv2_catalog_release(
+   NTV2_CATALOG *cat,
+   int           n)
+{
+   NTV2_CAT_FILE * file = cat->files + n;
+   size_t size = ntv2_data_size(file->hdr);
 
-int ntv2_inverse(
-   const NTV2_HDR *hdr,
-   double          deg_factor,
-   int             n,
-   NTV2_COORD      coord[])
+   cat->mem_used  = cat->mem_used - file->size + size;
+   file->size     = size;
+   file->pins--;
+
+   ntv2_catalog_evict(cat);
+}
+
+/*------------------------------------------------------------------------
+ * Perform a transformation on an array of points using a catalog.
+ */
+int ntv2_catalog_transform(
+   NTV2_CATALOG *cat,
+   double        deg_factor,
+   int           n,
+   NTV2_COORD    coord[],
+   int           direction)
 {
-   int max_iterations = MAX_ITERATIONS;
    int num = 0;
-   int i;
+   int i, j;
 
-   if ( hdr == NTV2_NULL || coord == NTV2_NULL || n <= 0 )
+   if ( cat == NTV2_NULL || coord == NTV2_NULL || n <= 0 )
       return 0;
 
    if ( deg_factor <= 0.0 )
       deg_factor = 1.0;
 
-   for (i = 0; i < n; i++)
-   {
-      double  lon,      lat;
-      double  lon_next, lat_next;
-      int num_iterations;
-
-      lon_next = lon = (coord[i][NTV2_COORD_LON] * deg_factor);
-      lat_next = lat = (coord[i][NTV2_COORD_LAT] * deg_factor);
-
-      /* The inverse is not a simple transformation like the forward.
-         We have to iteratively zero in on the answer by successively
-         calculating what the forward delta is at the point, and then
-         subtracting it instead of adding it.  The assumption here
-         is that all the shifts are smooth, which should be the case.
+   /* Each run of points routed to the same file is done in one call.
+      The run is routed and its file pinned with the mutex held, since
+      files may be added (and the index rebuilt) or unloaded meanwhile.
+      Only the transform itself is done without it. */
 
-         If we can't get the lat and lon deltas between two steps to be
-         both within a given tolerance (NTV2_EPS) in max_iterations,
-         we just give up and use the last value we calculated.
-      */
+   for (i = 0; i < n; i = j)
+   {
+      NTV2_HDR * hdr  = NTV2_NULL;
+      int        file = -1;
+      int        rc   = NTV2_ERR_OK;
 
-      for (num_iterations = 0;
-           num_iterations < max_iterations;
-           num_iterations++)
+      ntv2_mutex_enter(cat->mutex);
       {
-         const NTV2_REC * rec;
-         double lon_shift, lat_shift;
-         double lon_delta, lat_delta;
-         double lon_est,   lat_est;
-         int status;
-
-         /* It may seem unnecessary to find the subfile this point is
-            in each time, since it would seem that it *shouldn't* change.
-            However, if the point was outside of a grid but within one cell
-            of the edge, a shift may move it inside and then it could
-            possibly be found in some subfile.  It is also possible
-            that a point inside could shift to be on the edge or outside,
-            in which case the record for it would be a higher-up parent or
-            even a different sub-grid.
-         */
-
-         rec = ntv2_find_rec(hdr, lon_next, lat_next, &status);
-         if ( rec == NTV2_NULL )
-            break;
-
-         ntv2_calculate_shifts(hdr, rec, lon_next, lat_next, status,
-            &lon_shift, &lat_shift);
+         if ( !cat->index_ok )
+            rc = ntv2_catalog_index(cat);
 
-         lon_est   = (lon_next + lon_shift);
-         lat_est   = (lat_next + lat_shift);
-
-         lon_delta = (lon_est  - lon);
-         lat_delta = (lat_est  - lat);
-
-#if DEBUG_INVERSE
+         if ( rc == NTV2_ERR_OK )
          {
-            char buf1[32], buf2[32];
-            fprintf(stderr, "iteration %2d: value: %s %s\n",
-               num_iterations+1,
-               ntv2_dtoa(buf1, lon_next - lon_delta),
-               ntv2_dtoa(buf1, lat_next - lat_delta));
-            fprintf(stderr, "              delta: %s %s\n",
-               ntv2_dtoa(buf1, lon_delta),
-               ntv2_dtoa(buf2, lat_delta));
-         }
-#endif
+            file = ntv2_catalog_route(cat,
+                                      coord[i][NTV2_COORD_LON] * deg_factor,
+                                      coord[i][NTV2_COORD_LAT] * deg_factor);
 
-         if ( NTV2_ZERO(lon_delta) && NTV2_ZERO(lat_delta) )
-            break;
+            for (j = i + 1; j < n; j++)
+            {
+               int next = ntv2_catalog_route(cat,
+                                       coord[j][NTV2_COORD_LON] * deg_factor,
+                                       coord[j][NTV2_COORD_LAT] * deg_factor);
+               if ( next != file )
+                  break;
+            }
 
-         lon_next  = (lon_next - lon_delta);
-         lat_next  = (lat_next - lat_delta);
+            if ( file >= 0 )
+               hdr = ntv2_catalog_acquire(cat, file);
+         }
       }
+      ntv2_mutex_leave(cat->mutex);
 
-#if DEBUG_INVERSE
-      {
-         char buf1[32], buf2[32];
-         fprintf(stderr, "final         value: %s %s\n",
-            ntv2_dtoa(buf1, lon_next),
-            ntv2_dtoa(buf2, lat_next));
-      }
-#endif
+      if ( rc != NTV2_ERR_OK )
+         break;
 
-      if ( num_iterations > 0 )
+      if ( hdr != NTV2_NULL )
       {
-         coord[i][NTV2_COORD_LON] = (lon_next / deg_factor);
-         coord[i][NTV2_COORD_LAT] = (lat_next / deg_factor);
-         num++;
+         num += ntv2_transform(hdr, deg_factor, j - i, coord + i, direction);
+
+         ntv2_mutex_enter(cat->mutex);
+         {
+            ntv2_catalog_release(cat, file);
+         }
+         ntv2_mutex_leave(cat->mutex);
       }
    }
 
    return num;
 }
-
-/*------------------------------------------------------------------------
- * Perform a transformation (forward or inverse) on an array of points.
- */
-int ntv2_transform(
-   const NTV2_HDR *hdr,
-   double          deg_factor,
-   int             n,
-   NTV2_COORD      coord[],
-   int             direction)
-{
-   if ( direction == NTV2_CVT_INVERSE )
-      return ntv2_inverse(hdr, deg_factor, n, coord);
-   else
-      return ntv2_forward(hdr, deg_factor, n, coord);
-}
@@ -20,23 +20,264 @@
 
 /* ------------------------------------------------------------------------- */
 /* Memory routines                                                           */
+/*                                                                           */
+/* All memory the library allocates comes from these (other than file        */
+/* mappings, and huge pages it maps itself).  They use the allocator set by  */
+/* ntv2_set_allocator(), or malloc() and free() if none has been set.        */
+/*                                                                           */
+/* ntv2_memalloc_aligned() returns NULL if the allocator has no routine for  */
+/* aligned blocks, and the caller should then align within a bigger block.   */
+/* Aligned blocks are freed with ntv2_memdealloc().                          */
 /* ------------------------------------------------------------------------- */
 
+static NTV2_ALLOCATOR ntv2_allocator = { NTV2_NULL, NTV2_NULL, NTV2_NULL,
+                                         NTV2_NULL };
+
 static void * ntv2_memalloc(size_t n)
 {
+   if ( ntv2_allocator.alloc != NTV2_NULL )
+      return ntv2_allocator.alloc(ntv2_allocator.ctx, n);
+
    return malloc(n);
 }
 
+static void * ntv2_memalloc_aligned(size_t n, size_t align)
+{
+   if ( ntv2_allocator.aligned_alloc != NTV2_NULL )
+      return ntv2_allocator.aligned_alloc(ntv2_allocator.ctx, n, align);
+
+   return NTV2_NULL;
+}
+
 static void ntv2_memdealloc(void *p)
 {
    if ( p != NTV2_NULL )
    {
-      free(p);
+      if ( ntv2_allocator.free != NTV2_NULL )
+         ntv2_allocator.free(ntv2_allocator.ctx, p);
+      else
+         free(p);
+   }
+}
+
+/* ------------------------------------------------------------------------- */
+/* Huge page routines                                                        */
+/*                                                                           */
+/* These allocate (and free) anonymous memory in huge pages, for large grid  */
+/* arrays that are looked up in random order.  The size must be a multiple  */
+/* of NTV2_HUGE_PAGE_SIZE, and the address returned is aligned to it.        */
+/*                                                                           */
+/* NTV2_PAGES_HUGETLB asks for explicit huge pages (which must have been     */
+/* reserved on the system), and NTV2_PAGES_THP asks the OS to back the       */
+/* range with transparent huge pages.  If what is asked for can't be done    */
+/* (or NTV2_NO_MMAP is defined), ntv2_huge_alloc() just returns NULL, and    */
+/* the caller will fall back to something less.                              */
+/* ------------------------------------------------------------------------- */
+
+#define NTV2_HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+#define NTV2_PAGES_THP       1
+#define NTV2_PAGES_HUGETLB   2
+
+#if defined(__linux__) && !defined(NTV2_NO_MMAP)
+
+#  include <sys/mman.h>
+
+static void * ntv2_huge_alloc(size_t size, int kind)
+{
+   unsigned char * addr;
+   size_t          head;
+
+   if ( kind == NTV2_PAGES_HUGETLB )
+   {
+#  if defined(MAP_HUGETLB)
+      addr = (unsigned char *)mmap(NTV2_NULL, size, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                                   -1, 0);
+      return (addr == MAP_FAILED) ? NTV2_NULL : addr;
+#  else
+      return NTV2_NULL;
+#  endif
+   }
+
+#  if defined(MADV_HUGEPAGE)
+   /* Map an extra huge page, and trim it so the range is aligned. */
+   addr = (unsigned char *)mmap(NTV2_NULL, size + NTV2_HUGE_PAGE_SIZE,
+                                PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if ( addr == MAP_FAILED )
+      return NTV2_NULL;
+
+   head = (NTV2_HUGE_PAGE_SIZE -
+           ((size_t)addr % NTV2_HUGE_PAGE_SIZE)) % NTV2_HUGE_PAGE_SIZE;
+   if ( head > 0 )
+      munmap(addr, head);
+   if ( head < NTV2_HUGE_PAGE_SIZE )
+      munmap(addr + head + size, NTV2_HUGE_PAGE_SIZE - head);
+   addr += head;
+
+   /* This fails if transparent huge pages are not supported at all. */
+   if ( madvise(addr, size, MADV_HUGEPAGE) != 0 )
+   {
+      munmap(addr, size);
+      return NTV2_NULL;
    }
+
+   return addr;
+#  else
+   (void)(head);
+   return NTV2_NULL;
+#  endif
+}
+
+static void ntv2_huge_free(void *addr, size_t size)
+{
+   if ( addr != NTV2_NULL )
+   {
+      munmap(addr, size);
+   }
+}
+
+#else
+
+static void * ntv2_huge_alloc(size_t size, int kind)
+{
+   (void)(size);
+   (void)(kind);
+   return NTV2_NULL;
+}
+
+static void ntv2_huge_free(void *addr, size_t size)
+{
+   (void)(addr);
+   (void)(size);
 }
 
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* NUMA routines                                                             */
+/*                                                                           */
+/* These set the memory policy of the calling thread so that all pages it    */
+/* touches for the first time are placed on a given NUMA node, and then put  */
+/* back the policy the thread had before.  They are only active if compiled  */
+/* with NTV2_USE_NUMA (which requires linking with -lnuma).  Otherwise they  */
+/* are no-ops, and memory placement relies on the OS first-touch policy,     */
+/* i.e. pages are placed on the node of the thread that fills them.          */
+/* Node numbers from 0 to NTV2_NUMA_MAX_NODES-1 are allowed, and binding     */
+/* fails if the node is out of range or doesn't exist.                       */
+/*                                                                           */
+/* ntv2_numa_current() gets the node the calling thread is running on (or 0  */
+/* if that can't be found), and needs no library.                            */
+/* ------------------------------------------------------------------------- */
+
+#define NTV2_NUMA_MAX_NODES   1024
+
+#if defined(NTV2_USE_NUMA) && !defined(_WIN32)
+
+#  include <numaif.h>
+#  include <errno.h>
+
+#  define NTV2_NUMA_MASK_BITS  (8 * sizeof(unsigned long))
+#  define NTV2_NUMA_MASK_LEN   (NTV2_NUMA_MAX_NODES / NTV2_NUMA_MASK_BITS)
+
+typedef struct ntv2_numa_policy NTV2_NUMA_POLICY;
+struct ntv2_numa_policy
+{
+   NTV2_BOOL     bound;
+   int           mode;
+   unsigned long mask[NTV2_NUMA_MASK_LEN];
+};
+
+static NTV2_BOOL ntv2_numa_bind(int node, NTV2_NUMA_POLICY *old)
+{
+   unsigned long mask[NTV2_NUMA_MASK_LEN];
+
+   old->bound = FALSE;
+
+   if ( node < 0 )
+      return TRUE;
+   if ( node >= NTV2_NUMA_MAX_NODES )
+      return FALSE;
+
+   memset(mask, 0, sizeof(mask));
+   mask[node / NTV2_NUMA_MASK_BITS] = 1UL << (node % NTV2_NUMA_MASK_BITS);
+
+   if ( get_mempolicy(&old->mode, old->mask, 8 * sizeof(old->mask),
+                      NTV2_NULL, 0) != 0 )
+   {
+      return TRUE;
+   }
+
+   if ( set_mempolicy(MPOL_BIND, mask, 8 * sizeof(mask)) != 0 )
+      return (errno != EINVAL);
+
+   old->bound = TRUE;
+   return TRUE;
+}
+
+static void ntv2_numa_unbind(const NTV2_NUMA_POLICY *old)
+{
+   if ( old->bound )
+   {
+      set_mempolicy(old->mode, old->mask, 8 * sizeof(old->mask));
+   }
+}
+
+#else
+
+typedef int NTV2_NUMA_POLICY;
+
+#  define ntv2_numa_bind(node, old)   \
+   ( *(old) = 0, (node) < NTV2_NUMA_MAX_NODES )
+#  define ntv2_numa_unbind(old)       (void)(old)
+
+#endif
+
+#if defined(_WIN32)
+
+#  include <windows.h>
+
+static int ntv2_numa_current(void)
+{
+   UCHAR node;
+
+   if ( !GetNumaProcessorNode((UCHAR)GetCurrentProcessorNumber(), &node) ||
+        node == 0xFF )
+   {
+      return 0;
+   }
+
+   return (int)node;
+}
+
+#elif defined(__linux__)
+
+#  include <sys/syscall.h>
+#  include <unistd.h>
+
+static int ntv2_numa_current(void)
+{
+   unsigned int cpu;
+   unsigned int node;
+
+   if ( syscall(SYS_getcpu, &cpu, &node, NTV2_NULL) != 0 )
+      return 0;
+
+   return (int)node;
+}
+
+#else
+
+#  define ntv2_numa_current()         0
+
+#endif
+
 /* ------------------------------------------------------------------------- */
 /* Mutex routines                                                            */
+/*                                                                           */
+/* NTV2_NO_MUTEXES should only be defined if objects are never used by more  */
+/* than one thread, since data read in lazily is then published unguarded.  */
 /* ------------------------------------------------------------------------- */
 
 typedef struct ntv2_critsect NTV2_CRITSECT;
@@ -174,3 +415,807 @@ static void ntv2_mutex_delete(void *mp)
       ntv2_memdealloc(m);
    }
 }
+
+/* ------------------------------------------------------------------------- */
+/* Atomic publication routines                                               */
+/*                                                                           */
+/* These are used for data that is read in lazily and then published to     */
+/* other threads by setting a pointer (or flag) once, under the mutex.       */
+/* ntv2_store_ptr() makes sure all prior writes are visible to a thread      */
+/* before the new value is, and ntv2_load_ptr() makes sure a thread sees     */
+/* all those writes once it sees the value.                                  */
+/*                                                                           */
+/* Where there is no way to do this, the loads just return NULL (or FALSE),  */
+/* so callers only use them to check whether something still needs to be     */
+/* done, and then check again (and get the value) with the mutex held.       */
+/* ------------------------------------------------------------------------- */
+
+#if defined(NTV2_NO_MUTEXES)
+
+#  define ntv2_load_ptr(pp)        (*(pp))
+#  define ntv2_store_ptr(pp, v)    (*(pp) = (v))
+#  define ntv2_load_flag(p)        (*(p))
+#  define ntv2_store_flag(p, v)    (*(p) = (v))
+
+#elif defined(_WIN32)
+
+#  define ntv2_load_ptr(pp)        \
+   InterlockedCompareExchangePointer((PVOID volatile *)(pp), NULL, NULL)
+#  define ntv2_store_ptr(pp, v)    \
+   InterlockedExchangePointer((PVOID volatile *)(pp), (PVOID)(v))
+#  define ntv2_load_flag(p)        \
+   InterlockedCompareExchange((LONG volatile *)(p), 0, 0)
+#  define ntv2_store_flag(p, v)    \
+   InterlockedExchange((LONG volatile *)(p), (LONG)(v))
+
+#elif defined(__GNUC__) && defined(__ATOMIC_ACQUIRE)
+
+#  define ntv2_load_ptr(pp)        __atomic_load_n(pp, __ATOMIC_ACQUIRE)
+#  define ntv2_store_ptr(pp, v)    __atomic_store_n(pp, v, __ATOMIC_RELEASE)
+#  define ntv2_load_flag(p)        __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#  define ntv2_store_flag(p, v)    __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+#else
+
+#  define ntv2_load_ptr(pp)        NTV2_NULL
+#  define ntv2_store_ptr(pp, v)    (*(pp) = (v))
+#  define ntv2_load_flag(p)        FALSE
+#  define ntv2_store_flag(p, v)    (*(p) = (v))
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Thread-local storage                                                      */
+/*                                                                           */
+/* NTV2_THREAD_LOCAL is defined as the storage class for variables of which  */
+/* each thread has its own copy, if the compiler supports it, and           */
+/* ntv2_atomic_inc() then increments a (volatile long) counter atomically    */
+/* and returns the new value.  If NTV2_THREAD_LOCAL is not defined, callers  */
+/* must share data between threads instead.                                  */
+/* ------------------------------------------------------------------------- */
+
+#if defined(NTV2_NO_MUTEXES)
+#  define NTV2_THREAD_LOCAL
+#  define ntv2_atomic_inc(p)   (++*(p))
+#elif defined(_WIN32)
+#  define NTV2_THREAD_LOCAL    __declspec(thread)
+#  define ntv2_atomic_inc(p)   InterlockedIncrement(p)
+#elif defined(__GNUC__)
+#  define NTV2_THREAD_LOCAL    __thread
+#  define ntv2_atomic_inc(p)   __sync_add_and_fetch(p, 1L)
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* File mapping routines                                                     */
+/*                                                                           */
+/* These map an entire file read-only into memory, so that its pages are     */
+/* shared by all processes mapping the same file.  If mapping is not         */
+/* supported (or NTV2_NO_MMAP is defined), ntv2_map_file() should just       */
+/* return NULL, and the caller will read the data into memory instead.       */
+/* ------------------------------------------------------------------------- */
+
+#if defined(NTV2_NO_MMAP)
+
+static void * ntv2_map_file(const char *path, size_t *psize)
+{
+   (void)(path);
+   *psize = 0;
+   return NTV2_NULL;
+}
+
+static void ntv2_unmap_file(void *addr, size_t size)
+{
+   (void)(addr);
+   (void)(size);
+}
+
+#elif defined(_WIN32)
+
+#  ifndef   WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN  /* Exclude rarely-used stuff */
+#  endif
+#  include <windows.h>
+
+static void * ntv2_map_file(const char *path, size_t *psize)
+{
+   HANDLE         fh;
+   HANDLE         mh;
+   LARGE_INTEGER  size;
+   void *         addr = NTV2_NULL;
+
+   *psize = 0;
+
+   fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NTV2_NULL,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NTV2_NULL);
+   if ( fh == INVALID_HANDLE_VALUE )
+      return NTV2_NULL;
+
+   if ( GetFileSizeEx(fh, &size) && size.QuadPart > 0 )
+   {
+      mh = CreateFileMappingA(fh, NTV2_NULL, PAGE_READONLY, 0, 0, NTV2_NULL);
+      if ( mh != NTV2_NULL )
+      {
+         /* The view keeps the mapping alive after the handles are closed. */
+         addr = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+         if ( addr != NTV2_NULL )
+            *psize = (size_t)size.QuadPart;
+         CloseHandle(mh);
+      }
+   }
+
+   CloseHandle(fh);
+   return addr;
+}
+
+static void ntv2_unmap_file(void *addr, size_t size)
+{
+   (void)(size);
+
+   if ( addr != NTV2_NULL )
+   {
+      UnmapViewOfFile(addr);
+   }
+}
+
+#else
+
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+
+static void * ntv2_map_file(const char *path, size_t *psize)
+{
+   struct stat  st;
+   void *       addr = NTV2_NULL;
+   int          fd;
+
+   *psize = 0;
+
+   fd = open(path, O_RDONLY);
+   if ( fd < 0 )
+      return NTV2_NULL;
+
+   if ( fstat(fd, &st) == 0 && st.st_size > 0 )
+   {
+      /* The mapping stays valid after the descriptor is closed. */
+      addr = mmap(NTV2_NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if ( addr == MAP_FAILED )
+         addr = NTV2_NULL;
+      else
+         *psize = (size_t)st.st_size;
+   }
+
+   close(fd);
+   return addr;
+}
+
+static void ntv2_unmap_file(void *addr, size_t size)
+{
+   if ( addr != NTV2_NULL )
+   {
+      munmap(addr, size);
+   }
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Prefetch routines                                                         */
+/*                                                                           */
+/* This tells the OS that a range of a file will be read soon, so it can     */
+/* start reading it in the background.  It is a no-op where not supported    */
+/* or if NTV2_NO_PREFETCH is defined.                                        */
+/* ------------------------------------------------------------------------- */
+
+#if !defined(NTV2_NO_PREFETCH) && !defined(_WIN32)
+#  include <fcntl.h>
+#endif
+
+static void ntv2_prefetch(FILE *fp, long offset, long length)
+{
+#if !defined(NTV2_NO_PREFETCH) && defined(POSIX_FADV_WILLNEED)
+   posix_fadvise(fileno(fp), (off_t)offset, (off_t)length,
+                 POSIX_FADV_WILLNEED);
+#else
+   (void)(fp);
+   (void)(offset);
+   (void)(length);
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+/* Positional read routines                                                  */
+/*                                                                           */
+/* This reads a block of data at a given file offset.  Where pread() is      */
+/* available, this doesn't touch the stream position, so no mutex is needed  */
+/* (NTV2_READ_AT_IS_ATOMIC is TRUE).  Otherwise, it is a seek and a read,    */
+/* and the caller must serialize calls.                                      */
+/* ------------------------------------------------------------------------- */
+
+#if !defined(_WIN32) && !defined(NTV2_NO_PREAD)
+
+#  include <unistd.h>
+#  define NTV2_READ_AT_IS_ATOMIC   TRUE
+
+static size_t ntv2_file_read_at(FILE *fp, void *buf, size_t len, long offset)
+{
+   size_t  nr = 0;
+
+   while ( nr < len )
+   {
+      ssize_t n = pread(fileno(fp), (char *)buf + nr, len - nr,
+                        (off_t)offset + (off_t)nr);
+      if ( n <= 0 )
+         break;
+      nr += (size_t)n;
+   }
+
+   return nr;
+}
+
+#else
+
+#  define NTV2_READ_AT_IS_ATOMIC   FALSE
+
+static size_t ntv2_file_read_at(FILE *fp, void *buf, size_t len, long offset)
+{
+   if ( fseek(fp, offset, SEEK_SET) != 0 )
+      return 0;
+
+   return fread(buf, 1, len, fp);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* File stamp routines                                                       */
+/*                                                                           */
+/* This gets the identity (device and inode), size, and modification time   */
+/* (to the nanosecond, where the system keeps it) of a file, which are used  */
+/* to tell whether something made from it is still up to date.  A file      */
+/* rewritten in place, or replaced by a copy, gets a different stamp.        */
+/* ------------------------------------------------------------------------- */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct ntv2_stamp NTV2_STAMP;
+struct ntv2_stamp
+{
+   NTV2_INT64  dev;                    /* Device (or volume) of file  */
+   NTV2_INT64  ino;                    /* Inode (or file index)       */
+   NTV2_INT64  size;                   /* Size in bytes               */
+   NTV2_INT64  time;                   /* Modification time (seconds) */
+   long        nsec;                   /* Nanoseconds past that       */
+};
+
+#if defined(_WIN32)
+
+static NTV2_BOOL ntv2_file_stamp(const char *path, NTV2_STAMP *stamp)
+{
+   BY_HANDLE_FILE_INFORMATION info;
+   HANDLE     h;
+   NTV2_INT64 ticks;
+   BOOL       ok;
+
+   h = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE |
+                   FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                   FILE_FLAG_BACKUP_SEMANTICS, NULL);
+   if ( h == INVALID_HANDLE_VALUE )
+      return FALSE;
+
+   ok = GetFileInformationByHandle(h, &info);
+   CloseHandle(h);
+   if ( !ok )
+      return FALSE;
+
+   /* The time is in 100ns ticks. */
+   ticks = ((NTV2_INT64)info.ftLastWriteTime.dwHighDateTime << 32) |
+            (NTV2_INT64)info.ftLastWriteTime.dwLowDateTime;
+
+   memset(stamp, 0, sizeof(*stamp));
+   stamp->dev  = (NTV2_INT64)info.dwVolumeSerialNumber;
+   stamp->ino  = ((NTV2_INT64)info.nFileIndexHigh << 32) |
+                  (NTV2_INT64)info.nFileIndexLow;
+   stamp->size = ((NTV2_INT64)info.nFileSizeHigh  << 32) |
+                  (NTV2_INT64)info.nFileSizeLow;
+   stamp->time = ticks / 10000000;
+   stamp->nsec = (long)(ticks % 10000000) * 100;
+   return TRUE;
+}
+
+#else
+
+static NTV2_BOOL ntv2_file_stamp(const char *path, NTV2_STAMP *stamp)
+{
+   struct stat  st;
+
+   if ( stat(path, &st) != 0 )
+      return FALSE;
+
+   memset(stamp, 0, sizeof(*stamp));
+   stamp->dev  = (NTV2_INT64)st.st_dev;
+   stamp->ino  = (NTV2_INT64)st.st_ino;
+   stamp->size = (NTV2_INT64)st.st_size;
+   stamp->time = (NTV2_INT64)st.st_mtime;
+
+#if defined(__APPLE__)
+   stamp->nsec = (long)st.st_mtimespec.tv_nsec;
+#elif defined(st_mtime)
+   /* st_mtime is then a macro for st_mtim.tv_sec. */
+   stamp->nsec = (long)st.st_mtim.tv_nsec;
+#endif
+
+   return TRUE;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Same file routine                                                         */
+/*                                                                           */
+/* This tells whether two pathnames name the same existing file, however    */
+/* they are spelled.  On Windows (which has no inode numbers in stat()) the  */
+/* full pathnames are compared instead.                                      */
+/* ------------------------------------------------------------------------- */
+
+#if defined(_WIN32)
+
+static NTV2_BOOL ntv2_same_file(const char *path1, const char *path2)
+{
+   char full1[_MAX_PATH];
+   char full2[_MAX_PATH];
+
+   if ( _fullpath(full1, path1, sizeof(full1)) == NTV2_NULL ||
+        _fullpath(full2, path2, sizeof(full2)) == NTV2_NULL )
+   {
+      return (strcmp(path1, path2) == 0);
+   }
+
+   return (_stricmp(full1, full2) == 0);
+}
+
+#else
+
+static NTV2_BOOL ntv2_same_file(const char *path1, const char *path2)
+{
+   struct stat  st1;
+   struct stat  st2;
+
+   if ( stat(path1, &st1) != 0 || stat(path2, &st2) != 0 )
+      return FALSE;
+
+   return (st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* File replace routine                                                      */
+/*                                                                           */
+/* This renames a file over an existing one.  rename() does that in one     */
+/* step on POSIX systems, but on Windows it fails if the target exists, so   */
+/* MoveFileEx() is used there instead.                                       */
+/* ------------------------------------------------------------------------- */
+
+#if defined(_WIN32)
+
+#  include <windows.h>
+
+static NTV2_BOOL ntv2_replace_file(const char *from, const char *to)
+{
+   return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+#else
+
+static NTV2_BOOL ntv2_replace_file(const char *from, const char *to)
+{
+   return (rename(from, to) == 0);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Full pathname routine                                                     */
+/*                                                                           */
+/* This gets the full pathname of an existing file, with any links and "."  */
+/* or ".." parts resolved, so however it is spelled it has one name.         */
+/* ------------------------------------------------------------------------- */
+
+#if defined(_WIN32)
+
+static NTV2_BOOL ntv2_full_path(const char *path, char *full, size_t len)
+{
+   return (_fullpath(full, path, len) != NTV2_NULL);
+}
+
+#else
+
+static NTV2_BOOL ntv2_full_path(const char *path, char *full, size_t len)
+{
+   char *    p  = realpath(path, NTV2_NULL);
+   NTV2_BOOL ok = ( p != NTV2_NULL && strlen(p) < len );
+
+   /* This was allocated by the system, so it is freed the same way. */
+   if ( ok )
+      strcpy(full, p);
+   free(p);
+
+   return ok;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Shared segment routines                                                   */
+/*                                                                           */
+/* This creates a uniquely-named file from a template (ending in "XXXXXX")   */
+/* with a given size, and maps it read-write so it can be filled in.  The    */
+/* file is normally in a memory file system, and is published by renaming   */
+/* it and then mapped read-only with ntv2_shm_map().  If this is not         */
+/* supported (or NTV2_NO_MMAP is defined), it just returns NULL.             */
+/*                                                                           */
+/* Since the directory is normally writable by anyone, ntv2_shm_map() only   */
+/* maps a segment that is a regular file (not a symlink) owned by us or by   */
+/* root, and that nobody else can write to.  Otherwise it returns NULL.      */
+/* ------------------------------------------------------------------------- */
+
+#if defined(NTV2_NO_MMAP) || defined(_WIN32)
+
+static void * ntv2_shm_create(char *tmpl, size_t size)
+{
+   (void)(tmpl);
+   (void)(size);
+   return NTV2_NULL;
+}
+
+static void * ntv2_shm_map(const char *path, size_t *psize)
+{
+   (void)(path);
+   *psize = 0;
+   return NTV2_NULL;
+}
+
+#else
+
+static void * ntv2_shm_create(char *tmpl, size_t size)
+{
+   void * addr;
+   int    fd;
+
+   fd = mkstemp(tmpl);
+   if ( fd < 0 )
+      return NTV2_NULL;
+
+   /* Other processes only ever read it. */
+   if ( fchmod(fd, 0644) != 0 || ftruncate(fd, (off_t)size) != 0 )
+   {
+      close(fd);
+      unlink(tmpl);
+      return NTV2_NULL;
+   }
+
+   addr = mmap(NTV2_NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+
+   if ( addr == MAP_FAILED )
+   {
+      unlink(tmpl);
+      return NTV2_NULL;
+   }
+
+   return addr;
+}
+
+#ifndef O_NOFOLLOW
+#  define O_NOFOLLOW  0
+#endif
+
+static void * ntv2_shm_map(const char *path, size_t *psize)
+{
+   struct stat  st;
+   void *       addr = NTV2_NULL;
+   int          fd;
+
+   *psize = 0;
+
+   fd = open(path, O_RDONLY | O_NOFOLLOW);
+   if ( fd < 0 )
+      return NTV2_NULL;
+
+   /* Check the file we actually opened, not whatever the name is now. */
+   if ( fstat(fd, &st) == 0                                 &&
+        S_ISREG(st.st_mode)                                 &&
+        (st.st_uid == geteuid() || st.st_uid == 0)          &&
+        (st.st_mode & (S_IWGRP | S_IWOTH)) == 0             &&
+        st.st_size > 0 )
+   {
+      addr = mmap(NTV2_NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if ( addr == MAP_FAILED )
+         addr = NTV2_NULL;
+      else
+         *psize = (size_t)st.st_size;
+   }
+
+   close(fd);
+   return addr;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Asynchronous read routines                                                */
+/*                                                                           */
+/* These queue a number of reads, submit them all at once, and then wait     */
+/* for them to complete.  They are implemented using Linux io_uring (using   */
+/* the raw system calls, so liburing is not needed) if NTV2_USE_IO_URING is  */
+/* defined.  Otherwise, or if the kernel doesn't support io_uring,           */
+/* ntv2_ring_create() returns NULL and the caller falls back to reading      */
+/* synchronously.                                                            */
+/*                                                                           */
+/* A ring is not thread-safe, and is meant to be used by one thread at a     */
+/* time.  At most "entries" reads may be outstanding at once.                */
+/* ------------------------------------------------------------------------- */
+
+#if defined(NTV2_USE_IO_URING) && defined(__linux__)
+
+#  include <linux/io_uring.h>
+#  include <sys/syscall.h>
+#  include <errno.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+
+typedef struct ntv2_ring NTV2_RING;
+struct ntv2_ring
+{
+   int                   fd;
+   unsigned int          entries;
+   unsigned int          queued;      /* reads queued, but not submitted */
+   unsigned int          pending;     /* reads submitted, but not reaped */
+
+   void *                sq_ptr;
+   size_t                sq_len;
+   void *                cq_ptr;
+   size_t                cq_len;
+   struct io_uring_sqe * sqes;
+   size_t                sqes_len;
+
+   unsigned int *        sq_head;
+   unsigned int *        sq_tail;
+   unsigned int *        sq_mask;
+   unsigned int *        sq_array;
+
+   unsigned int *        cq_head;
+   unsigned int *        cq_tail;
+   unsigned int *        cq_mask;
+   struct io_uring_cqe * cqes;
+};
+
+#  define NTV2_LOAD_ACQ(p)     __atomic_load_n (p,    __ATOMIC_ACQUIRE)
+#  define NTV2_STORE_REL(p,v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static void ntv2_ring_delete(void *rp)
+{
+   NTV2_RING * r = (NTV2_RING *)rp;
+
+   if ( r != NTV2_NULL )
+   {
+      if ( r->sqes != NTV2_NULL )
+         munmap(r->sqes, r->sqes_len);
+      if ( r->cq_ptr != NTV2_NULL && r->cq_ptr != r->sq_ptr )
+         munmap(r->cq_ptr, r->cq_len);
+      if ( r->sq_ptr != NTV2_NULL )
+         munmap(r->sq_ptr, r->sq_len);
+      if ( r->fd >= 0 )
+         close(r->fd);
+
+      ntv2_memdealloc(r);
+   }
+}
+
+static void * ntv2_ring_create(unsigned int entries)
+{
+   struct io_uring_params p;
+   NTV2_RING * r;
+   void *      ptr;
+
+   r = (NTV2_RING *)ntv2_memalloc(sizeof(*r));
+   if ( r == NTV2_NULL )
+      return NTV2_NULL;
+
+   memset(r, 0, sizeof(*r));
+   memset(&p, 0, sizeof(p));
+
+   r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+   if ( r->fd < 0 || (p.features & IORING_FEAT_SINGLE_MMAP) == 0 )
+   {
+      ntv2_ring_delete(r);
+      return NTV2_NULL;
+   }
+
+   r->entries = p.sq_entries;
+
+   r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+   r->cq_len = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe);
+   if ( r->sq_len < r->cq_len )
+      r->sq_len = r->cq_len;
+
+   ptr = mmap(NTV2_NULL, r->sq_len, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+   if ( ptr == MAP_FAILED )
+   {
+      ntv2_ring_delete(r);
+      return NTV2_NULL;
+   }
+   r->sq_ptr = ptr;
+   r->cq_ptr = ptr;
+
+   r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+   ptr = mmap(NTV2_NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+   if ( ptr == MAP_FAILED )
+   {
+      ntv2_ring_delete(r);
+      return NTV2_NULL;
+   }
+   r->sqes = (struct io_uring_sqe *)ptr;
+
+   r->sq_head  = (unsigned int *)((char *)r->sq_ptr + p.sq_off.head);
+   r->sq_tail  = (unsigned int *)((char *)r->sq_ptr + p.sq_off.tail);
+   r->sq_mask  = (unsigned int *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+   r->sq_array = (unsigned int *)((char *)r->sq_ptr + p.sq_off.array);
+
+   r->cq_head  = (unsigned int *)((char *)r->cq_ptr + p.cq_off.head);
+   r->cq_tail  = (unsigned int *)((char *)r->cq_ptr + p.cq_off.tail);
+   r->cq_mask  = (unsigned int *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+   r->cqes     = (struct io_uring_cqe *)
+                 ((char *)r->cq_ptr + p.cq_off.cqes);
+
+   return (void *)r;
+}
+
+/* Queue a read.  Returns FALSE if the ring is full. */
+static NTV2_BOOL ntv2_ring_read(
+   void *  rp,
+   FILE *  fp,
+   void *  buf,
+   size_t  len,
+   long    offset,
+   void *  udata)
+{
+   NTV2_RING *           r = (NTV2_RING *)rp;
+   struct io_uring_sqe * sqe;
+   unsigned int          tail;
+   unsigned int          index;
+
+   if ( r->queued + r->pending >= r->entries )
+      return FALSE;
+
+   tail  = *r->sq_tail;
+   index = tail & *r->sq_mask;
+   sqe   = &r->sqes[index];
+
+   memset(sqe, 0, sizeof(*sqe));
+   sqe->opcode    = IORING_OP_READ;
+   sqe->fd        = fileno(fp);
+   sqe->addr      = (unsigned long)buf;
+   sqe->len       = (unsigned int)len;
+   sqe->off       = (unsigned long long)offset;
+   sqe->user_data = (unsigned long long)(unsigned long)udata;
+
+   r->sq_array[index] = index;
+   NTV2_STORE_REL(r->sq_tail, tail + 1);
+
+   r->queued++;
+   return TRUE;
+}
+
+/* Submit all queued reads in one call.  Returns FALSE if this fails. */
+static NTV2_BOOL ntv2_ring_submit(void *rp)
+{
+   NTV2_RING * r = (NTV2_RING *)rp;
+
+   while ( r->queued > 0 )
+   {
+      int n = (int)syscall(__NR_io_uring_enter, r->fd, r->queued, 0, 0,
+                           NTV2_NULL, 0);
+      if ( n < 0 && errno == EINTR )
+         continue;
+      if ( n <= 0 )
+         return FALSE;
+
+      r->queued  -= (unsigned int)n;
+      r->pending += (unsigned int)n;
+   }
+
+   return TRUE;
+}
+
+/* Wait for a read to complete.  Returns FALSE if none are pending. */
+static NTV2_BOOL ntv2_ring_wait(
+   void *  rp,
+   void ** pudata,
+   long *  presult)
+{
+   NTV2_RING *           r = (NTV2_RING *)rp;
+   struct io_uring_cqe * cqe;
+   unsigned int          head;
+
+   if ( r->pending == 0 )
+      return FALSE;
+
+   for (;;)
+   {
+      head = *r->cq_head;
+      if ( head != NTV2_LOAD_ACQ(r->cq_tail) )
+         break;
+
+      if ( syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                   IORING_ENTER_GETEVENTS, NTV2_NULL, 0) < 0 &&
+           errno != EINTR )
+      {
+         return FALSE;
+      }
+   }
+
+   cqe      = &r->cqes[head & *r->cq_mask];
+   *pudata  = (void *)(unsigned long)cqe->user_data;
+   *presult = (long)cqe->res;
+
+   NTV2_STORE_REL(r->cq_head, head + 1);
+   r->pending--;
+
+   return TRUE;
+}
+
+#else
+
+static void * ntv2_ring_create(unsigned int entries)
+{
+   (void)(entries);
+   return NTV2_NULL;
+}
+
+static void ntv2_ring_delete(void *rp)
+{
+   (void)(rp);
+}
+
+static NTV2_BOOL ntv2_ring_read(
+   void *  rp,
+   FILE *  fp,
+   void *  buf,
+   size_t  len,
+   long    offset,
+   void *  udata)
+{
+   (void)(rp);
+   (void)(fp);
+   (void)(buf);
+   (void)(len);
+   (void)(offset);
+   (void)(udata);
+   return FALSE;
+}
+
+static NTV2_BOOL ntv2_ring_submit(void *rp)
+{
+   (void)(rp);
+   return FALSE;
+}
+
+static NTV2_BOOL ntv2_ring_wait(
+   void *  rp,
+   void ** pudata,
+   long *  presult)
+{
+   (void)(rp);
+   (void)(pudata);
+   (void)(presult);
+   return FALSE;
+}
+
+#endif